@@ -2,8 +2,11 @@
 #include <limits.h>
 
 #include "address_dictionary.h"
+#include "data_bundle.h"
+#include "stats.h"
 
 #define ADDRESS_DICTIONARY_SIGNATURE 0xBABABABA
+#define ADDRESS_DICTIONARY_PARTITIONED_SIGNATURE 0xBABABABB
 
 address_dictionary_t *address_dict = NULL;
 
@@ -11,10 +14,31 @@ address_dictionary_t *get_address_dictionary(void) {
     return address_dict;
 }
 
+static khash_t(str_expansions) *address_dictionary_slice_expansions(char *key);
+
+/*
+Copies the language namespace of a trie/expansion key ("lang|...") into
+language. Keys added without a language (the base namespace used for
+existence checks) get the empty string, which is its own slice.
+*/
+static void address_dictionary_key_language(const char *key, char *language) {
+    char *sep = strstr(key, NAMESPACE_SEPARATOR_CHAR);
+    size_t language_len = sep != NULL ? (size_t)(sep - key) : 0;
+    if (language_len >= MAX_LANGUAGE_LEN) {
+        language_len = 0;
+    }
+    memcpy(language, key, language_len);
+    language[language_len] = '\0';
+}
+
 address_expansion_array *address_dictionary_get_expansions(char *key) {
-    if (address_dict == NULL || address_dict->expansions == NULL) return NULL;
-    khiter_t k = kh_get(str_expansions, address_dict->expansions, key);
-    return k != kh_end(address_dict->expansions) ? kh_value(address_dict->expansions, k) : NULL;
+    if (address_dict == NULL) return NULL;
+
+    khash_t(str_expansions) *expansions = address_dict->slices == NULL ? address_dict->expansions : address_dictionary_slice_expansions(key);
+    if (expansions == NULL) return NULL;
+
+    khiter_t k = kh_get(str_expansions, expansions, key);
+    return k != kh_end(expansions) ? kh_value(expansions, k) : NULL;
 }
 
 int32_t address_dictionary_next_canonical_index(void) {
@@ -34,7 +58,7 @@ char *address_dictionary_get_canonical(uint32_t index) {
 }
 
 bool address_dictionary_add_expansion(char *name, char *language, address_expansion_t expansion) {
-    if (name == NULL) return false;
+    if (name == NULL || address_dict == NULL || address_dict->expansions == NULL) return false;
 
     int ret;
 
@@ -195,14 +219,29 @@ bool search_address_dictionaries_tokens_with_phrases(char *str, token_array *tok
     return trie_search_tokens_from_index(address_dict->trie, str, tokens, prefix.node_id, phrases);
 }
 
+bool address_dictionary_token_search_init(trie_token_search_t *search, char *lang, phrase_array **phrases) {
+    trie_prefix_result_t prefix = get_language_prefix(lang);
+
+    if (prefix.node_id == NULL_NODE_ID) {
+        return false;
+    }
+
+    trie_token_search_init(search, address_dict->trie, prefix.node_id, phrases);
+    return true;
+}
+
 
 phrase_array *search_address_dictionaries_tokens(char *str, token_array *tokens, char *lang) {
+    STATS_TIME_SCOPE(LIBPOSTAL_STAGE_DICTIONARY_SEARCH);
+
     phrase_array *phrases = NULL;
 
     if (!search_address_dictionaries_tokens_with_phrases(str, tokens, lang, &phrases)) {
         return NULL;
     }
 
+    STATS_COUNT(LIBPOSTAL_COUNTER_PHRASES, phrases->n);
+
     return phrases;
 }
 
@@ -235,7 +274,7 @@ phrase_t search_address_dictionaries_suffix(char *str, size_t len, char *lang) {
 bool address_dictionary_init(void) {
     if (address_dict != NULL) return false;
 
-    address_dict = malloc(sizeof(address_dictionary_t));
+    address_dict = calloc(1, sizeof(address_dictionary_t));
     if (address_dict == NULL) return false;
 
     address_dict->canonical = cstring_array_new();
@@ -262,6 +301,19 @@ exit_destroy_address_dict:
     return false;
 }
 
+static void address_dictionary_expansions_destroy(khash_t(str_expansions) *expansions) {
+    if (expansions == NULL) return;
+
+    const char *key;
+    address_expansion_array *expansion_array;
+    kh_foreach(expansions, key, expansion_array, {
+        free((char *)key);
+        address_expansion_array_destroy(expansion_array);
+    })
+
+    kh_destroy(str_expansions, expansions);
+}
+
 void address_dictionary_destroy(address_dictionary_t *self) {
     if (self == NULL) return;
 
@@ -269,17 +321,23 @@ void address_dictionary_destroy(address_dictionary_t *self) {
         cstring_array_destroy(self->canonical);
     }
 
-    if (self->expansions != NULL) {
-        const char *key;
-        address_expansion_array *expansions;
-        kh_foreach(self->expansions, key, expansions, {
-            free((char *)key);
-            address_expansion_array_destroy(expansions);
-        })
+    address_dictionary_expansions_destroy(self->expansions);
+
+    if (self->slices != NULL) {
+        for (size_t i = 0; i < self->slices->n; i++) {
+            address_dictionary_expansions_destroy(self->slices->a[i].expansions);
+        }
+        address_dictionary_slice_array_destroy(self->slices);
+        pthread_mutex_destroy(&self->slice_lock);
     }
 
-    kh_destroy(str_expansions, self->expansions);
+    if (self->slice_indices != NULL) {
+        kh_destroy(str_uint32, self->slice_indices);
+    }
 
+    if (self->path != NULL) {
+        free(self->path);
+    }
 
     if (self->trie != NULL) {
         trie_destroy(self->trie);
@@ -358,104 +416,183 @@ static bool address_expansion_write(FILE *f, address_expansion_t expansion) {
     return true;
 }
 
-bool address_dictionary_write(FILE *f) {
-    if (address_dict == NULL || f == NULL) return false;
+static inline uint64_t address_expansion_write_size(address_expansion_t expansion) {
+    return sizeof(uint32_t) * 3 + strlen(expansion.language) + 1 + sizeof(uint16_t) * expansion.num_dictionaries + sizeof(uint16_t) + sizeof(uint8_t);
+}
 
-    if (!file_write_uint32(f, ADDRESS_DICTIONARY_SIGNATURE)) {
+static bool address_dictionary_write_key(FILE *f, const char *key, address_expansion_array *expansions) {
+    uint32_t key_len = (uint32_t) strlen(key) + 1;
+    if (!file_write_uint32(f, key_len)) {
         return false;
     }
 
-    uint32_t canonical_str_len = (uint32_t) cstring_array_used(address_dict->canonical);
-    if (!file_write_uint32(f, canonical_str_len)) {
+    if (!file_write_chars(f, key, key_len)) {
         return false;
     }
 
-    if (!file_write_chars(f, address_dict->canonical->str->a, canonical_str_len)) {
+    uint32_t num_expansions = expansions->n;
+
+    if (!file_write_uint32(f, num_expansions)) {
         return false;
     }
 
-    uint32_t num_keys = (uint32_t) kh_size(address_dict->expansions);
+    for (size_t i = 0; i < num_expansions; i++) {
+        address_expansion_t expansion = expansions->a[i];
+        if (!address_expansion_write(f, expansion)) {
+            return false;
+        }
+    }
 
-    if (!file_write_uint32(f, num_keys)) {
-        return false;
+    return true;
+}
+
+static uint64_t address_dictionary_key_write_size(const char *key, address_expansion_array *expansions) {
+    uint64_t size = sizeof(uint32_t) + strlen(key) + 1 + sizeof(uint32_t);
+    for (size_t i = 0; i < expansions->n; i++) {
+        size += address_expansion_write_size(expansions->a[i]);
     }
+    return size;
+}
 
-    const char *key;
-    address_expansion_array *expansions;
+/*
+File layout, offsets are relative to the signature:
+
+    uint32 signature
+    uint32 canonical_str_len
+    char canonical[canonical_str_len]
+    uint32 num_slices
+    num_slices * {
+        uint32 language_len
+        char language[language_len]
+        uint32 num_keys
+        uint64 offset
+    }
+    uint64 trie_offset
+    slices: num_keys * {key, expansions}
+    trie
+*/
+bool address_dictionary_write(FILE *f) {
+    if (address_dict == NULL || address_dict->expansions == NULL || f == NULL) return false;
 
-    kh_foreach(address_dict->expansions, key, expansions, {
-        uint32_t key_len = (uint32_t) strlen(key) + 1;
-        if (!file_write_uint32(f, key_len)) {
-            return false;
-        }
+    bool ret = false;
 
-        if (!file_write_chars(f, key, key_len)) {
-            return false;
-        }
+    khash_t(str_expansions) *expansions = address_dict->expansions;
 
-        uint32_t num_expansions = expansions->n;
+    // Slice index of every occupied bucket, keys are namespaced as "lang|"
+    address_dictionary_slice_array *slices = address_dictionary_slice_array_new();
+    khash_t(str_uint32) *slice_indices = kh_init(str_uint32);
+    uint32_array *key_slices = uint32_array_new_zeros(kh_end(expansions));
+    uint64_array *slice_sizes = uint64_array_new();
 
-        if (!file_write_uint32(f, num_expansions)) {
-            return false;
-        }
+    if (slices == NULL || slice_indices == NULL || key_slices == NULL || slice_sizes == NULL) {
+        goto exit_address_dictionary_write;
+    }
 
+    for (khiter_t k = kh_begin(expansions); k != kh_end(expansions); ++k) {
+        if (!kh_exist(expansions, k)) continue;
 
-        for (size_t i = 0; i < num_expansions; i++) {
-            address_expansion_t expansion = expansions->a[i];
-            if (!address_expansion_write(f, expansion)) {
-                return false;
-            }
+        const char *key = kh_key(expansions, k);
+
+        address_dictionary_slice_t slice = (address_dictionary_slice_t){{0}, 0, 0, NULL};
+        address_dictionary_key_language(key, slice.language);
+
+        uint32_t slice_index;
+        khiter_t s = kh_get(str_uint32, slice_indices, slice.language);
+        if (s == kh_end(slice_indices)) {
+            slice_index = (uint32_t)slices->n;
+            address_dictionary_slice_array_push(slices, slice);
+            uint64_array_push(slice_sizes, 0);
+
+            int put_ret;
+            s = kh_put(str_uint32, slice_indices, strdup(slice.language), &put_ret);
+            if (put_ret < 0) goto exit_address_dictionary_write;
+            kh_value(slice_indices, s) = slice_index;
+        } else {
+            slice_index = kh_value(slice_indices, s);
         }
-    })
 
-    if (!trie_write(address_dict->trie, f)) {
-        return false;
+        key_slices->a[k] = slice_index;
+        slices->a[slice_index].num_keys++;
+        slice_sizes->a[slice_index] += address_dictionary_key_write_size(key, kh_value(expansions, k));
     }
 
-    return true;
-}
-
-bool address_dictionary_read(FILE *f) {
-    if (address_dict != NULL) return false;
+    uint32_t canonical_str_len = (uint32_t) cstring_array_used(address_dict->canonical);
 
-    uint32_t signature;
+    uint64_t offset = sizeof(uint32_t) * 3 + canonical_str_len + sizeof(uint64_t);
+    for (size_t i = 0; i < slices->n; i++) {
+        offset += sizeof(uint32_t) + strlen(slices->a[i].language) + 1 + sizeof(uint32_t) + sizeof(uint64_t);
+    }
 
-    if (!file_read_uint32(f, &signature) || signature != ADDRESS_DICTIONARY_SIGNATURE) {
-        return false;
+    for (size_t i = 0; i < slices->n; i++) {
+        slices->a[i].offset = offset;
+        offset += slice_sizes->a[i];
     }
 
-    address_dict = malloc(sizeof(address_dictionary_t));
-    if (address_dict == NULL) return false;
+    uint64_t trie_offset = offset;
 
-    uint32_t canonical_str_len;
+    if (!file_write_uint32(f, ADDRESS_DICTIONARY_PARTITIONED_SIGNATURE) ||
+        !file_write_uint32(f, canonical_str_len) ||
+        !file_write_chars(f, address_dict->canonical->str->a, canonical_str_len) ||
+        !file_write_uint32(f, (uint32_t)slices->n)) {
+        goto exit_address_dictionary_write;
+    }
 
-    if (!file_read_uint32(f, &canonical_str_len)) {
-        goto exit_address_dict_created;
+    for (size_t i = 0; i < slices->n; i++) {
+        address_dictionary_slice_t slice = slices->a[i];
+        uint32_t language_len = (uint32_t)strlen(slice.language) + 1;
+        if (!file_write_uint32(f, language_len) ||
+            !file_write_chars(f, slice.language, language_len) ||
+            !file_write_uint32(f, slice.num_keys) ||
+            !file_write_uint64(f, slice.offset)) {
+            goto exit_address_dictionary_write;
+        }
     }
 
-    char_array *array = char_array_new_size(canonical_str_len);
+    if (!file_write_uint64(f, trie_offset)) {
+        goto exit_address_dictionary_write;
+    }
 
-    if (array == NULL) {
-        goto exit_address_dict_created;
+    for (uint32_t i = 0; i < slices->n; i++) {
+        for (khiter_t k = kh_begin(expansions); k != kh_end(expansions); ++k) {
+            if (!kh_exist(expansions, k) || key_slices->a[k] != i) continue;
+
+            if (!address_dictionary_write_key(f, kh_key(expansions, k), kh_value(expansions, k))) {
+                goto exit_address_dictionary_write;
+            }
+        }
     }
 
-    if (!file_read_chars(f, array->a, canonical_str_len)) {
-        char_array_destroy(array);
-        goto exit_address_dict_created;
+    if (!trie_write(address_dict->trie, f)) {
+        goto exit_address_dictionary_write;
     }
 
-    array->n = canonical_str_len;
+    ret = true;
 
-    address_dict->canonical = cstring_array_from_char_array(array);
+exit_address_dictionary_write:
+    if (slice_indices != NULL) {
+        const char *language;
+        kh_foreach_key(slice_indices, language, {
+            free((char *)language);
+        })
+        kh_destroy(str_uint32, slice_indices);
+    }
 
-    uint32_t num_keys;
+    if (slices != NULL) {
+        address_dictionary_slice_array_destroy(slices);
+    }
 
-    if (!file_read_uint32(f, &num_keys)) {
-        return false;
+    if (key_slices != NULL) {
+        uint32_array_destroy(key_slices);
     }
 
-    address_dict->expansions = kh_init(str_expansions);
+    if (slice_sizes != NULL) {
+        uint64_array_destroy(slice_sizes);
+    }
 
+    return ret;
+}
+
+static bool address_dictionary_read_expansions(FILE *f, uint32_t num_keys, khash_t(str_expansions) *expansions_hash) {
     uint32_t key_len;
     uint32_t num_expansions;
     char *key;
@@ -463,28 +600,28 @@ bool address_dictionary_read(FILE *f) {
 
     for (uint32_t i = 0; i < num_keys; i++) {
         if (!file_read_uint32(f, &key_len)) {
-            goto exit_address_dict_created;
+            return false;
         }
 
         key = malloc(key_len);
         if (key == NULL) {
-            goto exit_address_dict_created;
+            return false;
         }
 
         if (!file_read_chars(f, key, key_len)) {
             free(key);
-            goto exit_address_dict_created;
+            return false;
         }
 
         if (!file_read_uint32(f, &num_expansions)) {
             free(key);
-            goto exit_address_dict_created;
+            return false;
         }
 
         expansions = address_expansion_array_new_size(num_expansions);
         if (expansions == NULL) {
             free(key);
-            goto exit_address_dict_created;
+            return false;
         }
 
         address_expansion_t expansion;
@@ -493,16 +630,243 @@ bool address_dictionary_read(FILE *f) {
             if (!address_expansion_read(f, &expansion)) {
                 free(key);
                 address_expansion_array_destroy(expansions);
-                goto exit_address_dict_created;
+                return false;
             }
             address_expansion_array_push(expansions, expansion);
         }
 
         int ret;
 
-        khiter_t k = kh_put(str_expansions, address_dict->expansions, key, &ret);
-        if (ret < 0) goto exit_address_dict_created;
-        kh_value(address_dict->expansions, k) = expansions;
+        khiter_t k = kh_put(str_expansions, expansions_hash, key, &ret);
+        if (ret < 0) {
+            free(key);
+            address_expansion_array_destroy(expansions);
+            return false;
+        }
+        kh_value(expansions_hash, k) = expansions;
+    }
+
+    return true;
+}
+
+static bool address_dictionary_read_slice(FILE *f, long base, address_dictionary_slice_t *slice, khash_t(str_expansions) *expansions) {
+    if (fseek(f, base + (long)slice->offset, SEEK_SET) != 0) {
+        return false;
+    }
+
+    return address_dictionary_read_expansions(f, slice->num_keys, expansions);
+}
+
+static khash_t(str_expansions) *address_dictionary_load_slice(address_dictionary_slice_t *slice) {
+    khash_t(str_expansions) *expansions = __atomic_load_n(&slice->expansions, __ATOMIC_ACQUIRE);
+    if (expansions != NULL) return expansions;
+
+    pthread_mutex_lock(&address_dict->slice_lock);
+
+    expansions = slice->expansions;
+    if (expansions == NULL) {
+        log_debug("Loading address dictionary for language %s\n", slice->language);
+        expansions = kh_init(str_expansions);
+
+        FILE *f = data_bundle_fopen(address_dict->path);
+        long base = f != NULL ? ftell(f) : -1;
+
+        if (expansions == NULL || base < 0 || !address_dictionary_read_slice(f, base, slice, expansions)) {
+            log_error("Error loading address dictionary for language %s\n", slice->language);
+            address_dictionary_expansions_destroy(expansions);
+            expansions = NULL;
+        } else {
+            __atomic_store_n(&slice->expansions, expansions, __ATOMIC_RELEASE);
+        }
+
+        if (f != NULL) {
+            fclose(f);
+        }
+    }
+
+    pthread_mutex_unlock(&address_dict->slice_lock);
+
+    return expansions;
+}
+
+static khash_t(str_expansions) *address_dictionary_slice_expansions(char *key) {
+    char language[MAX_LANGUAGE_LEN];
+    address_dictionary_key_language(key, language);
+
+    khiter_t k = kh_get(str_uint32, address_dict->slice_indices, language);
+    if (k == kh_end(address_dict->slice_indices)) return NULL;
+
+    return address_dictionary_load_slice(address_dict->slices->a + kh_value(address_dict->slice_indices, k));
+}
+
+size_t address_dictionary_num_loaded_languages(void) {
+    if (address_dict == NULL || address_dict->slices == NULL) return 0;
+
+    size_t num_loaded = 0;
+    for (size_t i = 0; i < address_dict->slices->n; i++) {
+        if (__atomic_load_n(&address_dict->slices->a[i].expansions, __ATOMIC_ACQUIRE) != NULL) {
+            num_loaded++;
+        }
+    }
+    return num_loaded;
+}
+
+static bool address_dictionary_should_load_language(char *language, char **languages, size_t num_languages) {
+    // The base namespace and ALL_LANGUAGES are needed whatever the input language
+    if (*language == '\0' || string_equals(language, ALL_LANGUAGES)) return true;
+
+    for (size_t i = 0; i < num_languages; i++) {
+        if (string_equals(language, languages[i])) return true;
+    }
+    return false;
+}
+
+static bool address_dictionary_read_canonical(FILE *f) {
+    uint32_t canonical_str_len;
+
+    if (!file_read_uint32(f, &canonical_str_len)) {
+        return false;
+    }
+
+    char_array *array = char_array_new_size(canonical_str_len);
+
+    if (array == NULL) {
+        return false;
+    }
+
+    if (!file_read_chars(f, array->a, canonical_str_len)) {
+        char_array_destroy(array);
+        return false;
+    }
+
+    array->n = canonical_str_len;
+
+    address_dict->canonical = cstring_array_from_char_array(array);
+
+    return address_dict->canonical != NULL;
+}
+
+static bool address_dictionary_read_partitioned(FILE *f, long base, char *path, char **languages, size_t num_languages) {
+    bool lazy = path != NULL;
+
+    uint32_t num_slices;
+    if (!file_read_uint32(f, &num_slices)) {
+        return false;
+    }
+
+    address_dictionary_slice_array *slices = address_dictionary_slice_array_new_size(num_slices);
+    if (slices == NULL) {
+        return false;
+    }
+
+    for (uint32_t i = 0; i < num_slices; i++) {
+        address_dictionary_slice_t slice = (address_dictionary_slice_t){{0}, 0, 0, NULL};
+        uint32_t language_len;
+
+        if (!file_read_uint32(f, &language_len) || language_len > MAX_LANGUAGE_LEN ||
+            !file_read_chars(f, slice.language, language_len) ||
+            !file_read_uint32(f, &slice.num_keys) ||
+            !file_read_uint64(f, &slice.offset)) {
+            address_dictionary_slice_array_destroy(slices);
+            return false;
+        }
+        slice.language[MAX_LANGUAGE_LEN - 1] = '\0';
+
+        address_dictionary_slice_array_push(slices, slice);
+    }
+
+    uint64_t trie_offset;
+    if (!file_read_uint64(f, &trie_offset)) {
+        address_dictionary_slice_array_destroy(slices);
+        return false;
+    }
+
+    if (!lazy) {
+        // Read everything into the one hash table, same as an unpartitioned dictionary
+        address_dict->expansions = kh_init(str_expansions);
+        bool ret = address_dict->expansions != NULL;
+
+        for (size_t i = 0; ret && i < slices->n; i++) {
+            ret = address_dictionary_read_slice(f, base, slices->a + i, address_dict->expansions);
+        }
+
+        address_dictionary_slice_array_destroy(slices);
+        if (!ret) return false;
+    } else {
+        address_dict->slices = slices;
+        pthread_mutex_init(&address_dict->slice_lock, NULL);
+
+        address_dict->path = strdup(path);
+        address_dict->slice_indices = kh_init(str_uint32);
+        if (address_dict->path == NULL || address_dict->slice_indices == NULL) {
+            return false;
+        }
+
+        for (uint32_t i = 0; i < slices->n; i++) {
+            address_dictionary_slice_t *slice = slices->a + i;
+
+            int ret;
+            khiter_t k = kh_put(str_uint32, address_dict->slice_indices, slice->language, &ret);
+            if (ret < 0) return false;
+            kh_value(address_dict->slice_indices, k) = i;
+
+            if (!address_dictionary_should_load_language(slice->language, languages, num_languages)) continue;
+
+            slice->expansions = kh_init(str_expansions);
+            if (slice->expansions == NULL ||
+                !address_dictionary_read_slice(f, base, slice, slice->expansions)) {
+                return false;
+            }
+        }
+    }
+
+    return fseek(f, base + (long)trie_offset, SEEK_SET) == 0;
+}
+
+/*
+path != NULL reads the dictionary per language (only possible for partitioned
+dictionaries), path is where the remaining slices are read from on first use.
+*/
+static bool address_dictionary_read_languages(FILE *f, char *path, char **languages, size_t num_languages) {
+    if (address_dict != NULL) return false;
+
+    long base = ftell(f);
+    if (base < 0) return false;
+
+    uint32_t signature;
+
+    if (!file_read_uint32(f, &signature) ||
+        (signature != ADDRESS_DICTIONARY_SIGNATURE && signature != ADDRESS_DICTIONARY_PARTITIONED_SIGNATURE)) {
+        return false;
+    }
+
+    address_dict = calloc(1, sizeof(address_dictionary_t));
+    if (address_dict == NULL) return false;
+
+    if (!address_dictionary_read_canonical(f)) {
+        goto exit_address_dict_created;
+    }
+
+    if (signature == ADDRESS_DICTIONARY_PARTITIONED_SIGNATURE) {
+        if (!address_dictionary_read_partitioned(f, base, path, languages, num_languages)) {
+            goto exit_address_dict_created;
+        }
+    } else {
+        if (path != NULL) {
+            log_warn("Address dictionary is not partitioned by language, loading all languages\n");
+        }
+
+        uint32_t num_keys;
+
+        if (!file_read_uint32(f, &num_keys)) {
+            goto exit_address_dict_created;
+        }
+
+        address_dict->expansions = kh_init(str_expansions);
+        if (address_dict->expansions == NULL ||
+            !address_dictionary_read_expansions(f, num_keys, address_dict->expansions)) {
+            goto exit_address_dict_created;
+        }
     }
 
     address_dict->trie = trie_read(f);
@@ -515,12 +879,16 @@ bool address_dictionary_read(FILE *f) {
 
 exit_address_dict_created:
     address_dictionary_destroy(address_dict);
+    address_dict = NULL;
     return false;
 }
 
+bool address_dictionary_read(FILE *f) {
+    return address_dictionary_read_languages(f, NULL, NULL, 0);
+}
 
 bool address_dictionary_load(char *path) {
-    FILE *f = fopen(path, "rb");
+    FILE *f = data_bundle_fopen(path);
     if (f == NULL) {
         return false;
     }
@@ -530,6 +898,17 @@ bool address_dictionary_load(char *path) {
     return ret_val;
 }
 
+bool address_dictionary_load_languages(char *path, char **languages, size_t num_languages) {
+    FILE *f = data_bundle_fopen(path);
+    if (f == NULL) {
+        return false;
+    }
+
+    bool ret_val = address_dictionary_read_languages(f, path, languages, num_languages);
+    fclose(f);
+    return ret_val;
+}
+
 bool address_dictionary_save(char *path) {
     if (address_dict == NULL) return false;
 
@@ -548,6 +927,14 @@ inline bool address_dictionary_module_setup(char *filename) {
     return true;
 }
 
+bool address_dictionary_module_setup_languages(char *filename, char **languages, size_t num_languages) {
+    if (address_dict == NULL) {
+        return address_dictionary_load_languages(filename == NULL ? DEFAULT_ADDRESS_EXPANSION_PATH : filename, languages, num_languages);
+    }
+
+    return true;
+}
+
 void address_dictionary_module_teardown(void) {
     if (address_dict != NULL) {
         address_dictionary_destroy(address_dict);
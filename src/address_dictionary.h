@@ -6,6 +6,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <pthread.h>
 
 #include <stdbool.h>
 #include <string.h>
@@ -48,10 +49,33 @@ VECTOR_INIT(address_expansion_array, address_expansion_t)
 
 KHASH_MAP_INIT_STR(str_expansions, address_expansion_array *)
 
+/*
+The expansions in the dictionary file are partitioned by language, the same
+way the trie keys are namespaced ("lang|"). A dictionary loaded with
+address_dictionary_load_languages only reads the slices for ALL_LANGUAGES,
+the base namespace (keys added without a language) and the requested
+languages, the others are read the first time one of their keys is looked
+up. Each slice has its own hash table which is published once fully built,
+so lookups don't need a lock.
+*/
+typedef struct address_dictionary_slice {
+    char language[MAX_LANGUAGE_LEN];
+    uint32_t num_keys;
+    uint64_t offset;
+    khash_t(str_expansions) *expansions;
+} address_dictionary_slice_t;
+
+VECTOR_INIT(address_dictionary_slice_array, address_dictionary_slice_t)
+
 typedef struct address_dictionary {
     cstring_array *canonical;
     khash_t(str_expansions) *expansions;
     trie_t *trie;
+    // Only set when loaded per language, in which case expansions is NULL
+    address_dictionary_slice_array *slices;
+    khash_t(str_uint32) *slice_indices;
+    char *path;
+    pthread_mutex_t slice_lock;
 } address_dictionary_t;
 
 address_dictionary_t *get_address_dictionary(void);
@@ -62,6 +86,8 @@ phrase_array *search_address_dictionaries(char *str, char *lang);
 bool search_address_dictionaries_with_phrases(char *str, char *lang, phrase_array **phrases);
 phrase_array *search_address_dictionaries_tokens(char *str, token_array *tokens, char *lang);
 bool search_address_dictionaries_tokens_with_phrases(char *str, token_array *tokens, char *lang, phrase_array **phrases);
+// Sets up a search of the dictionaries for lang, for use with trie_search_tokens_multi
+bool address_dictionary_token_search_init(trie_token_search_t *search, char *lang, phrase_array **phrases);
 
 phrase_t search_address_dictionaries_prefix(char *str, size_t len, char *lang);
 phrase_t search_address_dictionaries_suffix(char *str, size_t len, char *lang);
@@ -77,7 +103,13 @@ void address_dictionary_destroy(address_dictionary_t *self);
 bool address_dictionary_load(char *path);
 bool address_dictionary_save(char *path);
 
+// Loads the trie and the expansions for ALL_LANGUAGES, the base namespace + languages, others load on first use
+bool address_dictionary_load_languages(char *path, char **languages, size_t num_languages);
+// Number of language slices with expansions in memory, 0 if the dictionary isn't loaded per language
+size_t address_dictionary_num_loaded_languages(void);
+
 bool address_dictionary_module_setup(char *filename);
+bool address_dictionary_module_setup_languages(char *filename, char **languages, size_t num_languages);
 void address_dictionary_module_teardown(void);
 
 
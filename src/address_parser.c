@@ -3,13 +3,10 @@
 #include "features.h"
 #include "geodb.h"
 #include "scanner.h"
+#include "stats.h"
 
 #include "log/log.h"
 
-#define ADDRESS_PARSER_MODEL_FILENAME "address_parser.dat"
-#define ADDRESS_PARSER_VOCAB_FILENAME "address_parser_vocab.trie"
-#define ADDRESS_PARSER_PHRASE_FILENAME "address_parser_phrases.trie"
-
 #define UNKNOWN_WORD "UNKNOWN"
 #define UNKNOWN_NUMERIC "UNKNOWN_NUMERIC"
 
@@ -17,7 +14,7 @@ static address_parser_t *parser = NULL;
 
 
 address_parser_t *address_parser_new(void) {
-    address_parser_t *parser = malloc(sizeof(address_parser_t));
+    address_parser_t *parser = calloc(1, sizeof(address_parser_t));
     return parser;
 }
 
@@ -181,16 +178,42 @@ void address_parser_context_destroy(address_parser_context_t *self) {
         cstring_array_destroy(self->features);
     }
 
+    if (self->feature_hashes != NULL) {
+        uint64_array_destroy(self->feature_hashes);
+    }
+
+    if (self->tag_feature_words != NULL) {
+        cstring_array_destroy(self->tag_feature_words);
+    }
+
+    if (self->tag_feature_flags != NULL) {
+        uint32_array_destroy(self->tag_feature_flags);
+    }
+
+    if (self->static_scores != NULL) {
+        double_array_destroy(self->static_scores);
+    }
+
+    if (self->tokens != NULL) {
+        token_array_destroy(self->tokens);
+    }
+
     if (self->tokenized_str != NULL) {
+        // The context never owns the string, see address_parser_parse
+        self->tokenized_str->str = NULL;
         tokenized_string_destroy(self->tokenized_str);
     }
 
+    if (self->token_labels != NULL) {
+        cstring_array_destroy(self->token_labels);
+    }
+
     if (self->address_dictionary_phrases != NULL) {
         phrase_array_destroy(self->address_dictionary_phrases);
     }
 
     if (self->address_phrase_memberships != NULL) {
-        int64_array_destroy(self->address_phrase_memberships);
+        int32_array_destroy(self->address_phrase_memberships);
     }
 
     if (self->geodb_phrases != NULL) {
@@ -198,7 +221,7 @@ void address_parser_context_destroy(address_parser_context_t *self) {
     }
 
     if (self->geodb_phrase_memberships != NULL) {
-        int64_array_destroy(self->geodb_phrase_memberships);
+        int32_array_destroy(self->geodb_phrase_memberships);
     }
 
     if (self->component_phrases != NULL) {
@@ -206,14 +229,18 @@ void address_parser_context_destroy(address_parser_context_t *self) {
     }
 
     if (self->component_phrase_memberships != NULL) {
-        int64_array_destroy(self->component_phrase_memberships);
+        int32_array_destroy(self->component_phrase_memberships);
+    }
+
+    if (self->scores != NULL) {
+        double_array_destroy(self->scores);
     }
 
     free(self);
 }
 
 address_parser_context_t *address_parser_context_new(void) {
-    address_parser_context_t *context = malloc(sizeof(address_parser_context_t));
+    address_parser_context_t *context = calloc(1, sizeof(address_parser_context_t));
 
     if (context == NULL) return NULL;
 
@@ -250,17 +277,48 @@ address_parser_context_t *address_parser_context_new(void) {
         goto exit_address_parser_context_allocated;
     }
 
+    context->feature_hashes = uint64_array_new();
+    if (context->feature_hashes == NULL) {
+        goto exit_address_parser_context_allocated;
+    }
+    context->hash_features = false;
+
+    context->tag_feature_words = cstring_array_new();
+    if (context->tag_feature_words == NULL) {
+        goto exit_address_parser_context_allocated;
+    }
+
+    context->tag_feature_flags = uint32_array_new();
+    if (context->tag_feature_flags == NULL) {
+        goto exit_address_parser_context_allocated;
+    }
+
+    context->static_scores = double_array_new();
+    if (context->static_scores == NULL) {
+        goto exit_address_parser_context_allocated;
+    }
+
+    context->tokens = token_array_new();
+    if (context->tokens == NULL) {
+        goto exit_address_parser_context_allocated;
+    }
+
     context->tokenized_str = tokenized_string_new();
     if (context->tokenized_str == NULL) {
         goto exit_address_parser_context_allocated;
     }
 
+    context->token_labels = cstring_array_new();
+    if (context->token_labels == NULL) {
+        goto exit_address_parser_context_allocated;
+    }
+
     context->address_dictionary_phrases = phrase_array_new();
     if (context->address_dictionary_phrases == NULL) {
         goto exit_address_parser_context_allocated;
     }
 
-    context->address_phrase_memberships = int64_array_new();
+    context->address_phrase_memberships = int32_array_new();
     if (context->address_phrase_memberships == NULL) {
         goto exit_address_parser_context_allocated;
     }
@@ -270,7 +328,7 @@ address_parser_context_t *address_parser_context_new(void) {
         goto exit_address_parser_context_allocated;
     }
 
-    context->geodb_phrase_memberships = int64_array_new();
+    context->geodb_phrase_memberships = int32_array_new();
     if (context->geodb_phrase_memberships == NULL) {
         goto exit_address_parser_context_allocated;
     }
@@ -280,11 +338,16 @@ address_parser_context_t *address_parser_context_new(void) {
         goto exit_address_parser_context_allocated;
     }
 
-    context->component_phrase_memberships = int64_array_new();
+    context->component_phrase_memberships = int32_array_new();
     if (context->component_phrase_memberships == NULL) {
         goto exit_address_parser_context_allocated;
     }
 
+    context->scores = double_array_new();
+    if (context->scores == NULL) {
+        goto exit_address_parser_context_allocated;
+    }
+
     return context;
 
 exit_address_parser_context_allocated:
@@ -292,12 +355,25 @@ exit_address_parser_context_allocated:
     return NULL;
 }
 
+static void address_parser_phrase_memberships(phrase_array *phrases, int32_array *memberships, size_t num_tokens) {
+    int32_array_resize(memberships, num_tokens);
+    memberships->n = num_tokens;
+    int32_array_set(memberships->a, num_tokens, NULL_PHRASE_MEMBERSHIP);
+
+    for (int32_t j = 0; j < (int32_t)phrases->n; j++) {
+        phrase_t phrase = phrases->a[j];
+        for (uint32_t i = phrase.start; i < phrase.start + phrase.len && i < num_tokens; i++) {
+            log_debug("token i=%u, phrase membership=%d\n", i, j);
+            memberships->a[i] = j;
+        }
+    }
+}
+
 void address_parser_context_fill(address_parser_context_t *context, address_parser_t *parser, tokenized_string_t *tokenized_str, char *language, char *country) {
-    int64_t i, j;
+    STATS_TIME_SCOPE(LIBPOSTAL_STAGE_PARSER_CONTEXT_FILL);
 
     uint32_t token_index;
     char *word;
-    phrase_t phrase;
 
     context->language = language;
     context->country = country;
@@ -314,89 +390,24 @@ void address_parser_context_fill(address_parser_context_t *context, address_pars
     })
 
     phrase_array_clear(context->address_dictionary_phrases);
-    int64_array_clear(context->address_phrase_memberships);
-    
-    i = 0;
-    phrase_array *address_dictionary_phrases = context->address_dictionary_phrases;
-    int64_array *address_phrase_memberships = context->address_phrase_memberships;
-
-    if (search_address_dictionaries_tokens_with_phrases(str, tokens, context->language, &context->address_dictionary_phrases)) {
-        for (j = 0; j < address_dictionary_phrases->n; j++) {
-            phrase = address_dictionary_phrases->a[j];
-
-            for (; i < phrase.start; i++) {
-                int64_array_push(address_phrase_memberships, NULL_PHRASE_MEMBERSHIP);
-                log_debug("token i=%lld, null phrase membership\n", i);
-            }
-
-            for (i = phrase.start; i < phrase.start + phrase.len; i++) {
-                log_debug("token i=%lld, phrase membership=%lld\n", i, j);
-                int64_array_push(address_phrase_memberships, j);
-            }
-        }
-    }
-
-    for (; i < tokens->n; i++) {
-        log_debug("token i=%lld, null phrase membership\n", i);
-        int64_array_push(address_phrase_memberships, NULL_PHRASE_MEMBERSHIP);
-    }
-
     phrase_array_clear(context->geodb_phrases);
-    int64_array_clear(context->geodb_phrase_memberships);
-
-    phrase_array *geodb_phrases = context->geodb_phrases;
-    int64_array *geodb_phrase_memberships = context->geodb_phrase_memberships;
-    i = 0;
-
-    if (search_geodb_tokens_with_phrases(str, tokens, &context->geodb_phrases)) {
-        for (j = 0; j < geodb_phrases->n; j++) {
-            phrase = geodb_phrases->a[j];
-
-            for (; i < phrase.start; i++) {
-                log_debug("token i=%lld, null geo phrase membership\n", i);
-                int64_array_push(geodb_phrase_memberships, NULL_PHRASE_MEMBERSHIP);
-            }
-
-            for (i = phrase.start; i < phrase.start + phrase.len; i++) {
-                log_debug("token i=%lld, geo phrase membership=%lld\n", i, j);
-                int64_array_push(geodb_phrase_memberships, j);
-            }
-        }
-    }
-    for (; i < tokens->n; i++) {
-        log_debug("token i=%lld, null geo phrase membership\n", i);
-        int64_array_push(geodb_phrase_memberships, NULL_PHRASE_MEMBERSHIP);
-    }
-
     phrase_array_clear(context->component_phrases);
-    int64_array_clear(context->component_phrase_memberships);
-    i = 0;
-
-    phrase_array *component_phrases = context->component_phrases;
-    int64_array *component_phrase_memberships = context->component_phrase_memberships;
-
-    if (trie_search_tokens_with_phrases(parser->phrase_types, str, tokens, &component_phrases)) {
-        for (j = 0; j < component_phrases->n; j++) {
-            phrase = component_phrases->a[j];
 
-            for (; i < phrase.start; i++) {
-                log_debug("token i=%lld, null component phrase membership\n", i);
-                int64_array_push(component_phrase_memberships, NULL_PHRASE_MEMBERSHIP);
-            }
+    // Dictionary, place name and component phrases are found in one pass over the tokens
+    trie_token_search_t searches[3];
+    size_t num_searches = 0;
 
-            for (i = phrase.start; i < phrase.start + phrase.len; i++) {
-                log_debug("token i=%lld, component phrase membership=%lld\n", i, j);
-                int64_array_push(component_phrase_memberships, j);
-            }
-        }
-    }
-    for (; i < tokens->n; i++) {
-        log_debug("token i=%lld, null component phrase membership\n", i);
-        int64_array_push(component_phrase_memberships, NULL_PHRASE_MEMBERSHIP);
+    if (address_dictionary_token_search_init(&searches[num_searches], context->language, &context->address_dictionary_phrases)) {
+        num_searches++;
     }
+    geodb_token_search_init(&searches[num_searches++], &context->geodb_phrases);
+    trie_token_search_init(&searches[num_searches++], parser->phrase_types, ROOT_NODE_ID, &context->component_phrases);
 
+    trie_search_tokens_multi(searches, num_searches, str, tokens);
 
-
+    address_parser_phrase_memberships(context->address_dictionary_phrases, context->address_phrase_memberships, tokens->n);
+    address_parser_phrase_memberships(context->geodb_phrases, context->geodb_phrase_memberships, tokens->n);
+    address_parser_phrase_memberships(context->component_phrases, context->component_phrase_memberships, tokens->n);
 }
 
 
@@ -428,9 +439,9 @@ typedef struct adjacent_phrase {
 
 #define NULL_ADJACENT_PHRASE (adjacent_phrase_t){NULL_PHRASE, 0};
 
-static inline adjacent_phrase_t get_adjacent_phrase(int64_array *phrase_memberships, phrase_array *phrases, uint32_array *separator_positions, uint32_t i, int32_t direction) {
+static inline adjacent_phrase_t get_adjacent_phrase(int32_array *phrase_memberships, phrase_array *phrases, uint32_array *separator_positions, uint32_t i, int32_t direction) {
     uint32_t *separators = separator_positions->a;
-    int64_t *memberships = phrase_memberships->a;
+    int32_t *memberships = phrase_memberships->a;
 
     uint32_t num_strings = (uint32_t)phrase_memberships->n;
 
@@ -443,7 +454,7 @@ static inline adjacent_phrase_t get_adjacent_phrase(int64_array *phrase_membersh
                 adjacent.num_separators++;
             }
 
-            int64_t membership = memberships[ids];
+            int32_t membership = memberships[ids];
             if (membership != NULL_PHRASE_MEMBERSHIP) {
                 adjacent.phrase = phrases->a[membership];
                 break;
@@ -457,7 +468,7 @@ static inline adjacent_phrase_t get_adjacent_phrase(int64_array *phrase_membersh
                 adjacent.num_separators++;
             }
 
-            int64_t membership = memberships[ids];
+            int32_t membership = memberships[ids];
             if (membership != NULL_PHRASE_MEMBERSHIP) {
                 adjacent.phrase = phrases->a[membership];
                 break;
@@ -469,13 +480,28 @@ static inline adjacent_phrase_t get_adjacent_phrase(int64_array *phrase_membersh
 }
 */
 
-static inline void add_phrase_features(cstring_array *features, uint32_t phrase_types, uint32_t component, char *phrase_type, char *phrase_string, char *prev2, char *prev) {
+/*
+Adds a feature as a string or, at prediction time with a hashed model, as
+its hash, which avoids building the feature string at all
+*/
+static void address_parser_add_feature(address_parser_context_t *context, size_t count, ...) {
+    va_list args;
+    va_start(args, count);
+    if (context->hash_features) {
+        feature_hashes_vadd(context->feature_hashes, count, args);
+    } else {
+        feature_array_vadd(context->features, count, args);
+    }
+    va_end(args);
+}
+
+static inline void add_phrase_features(address_parser_context_t *context, uint32_t phrase_types, uint32_t component, char *phrase_type, char *phrase_string) {
     if (phrase_types == component) {
         log_debug("phrase=%s, phrase_types=%d\n", phrase_string, phrase_types);
-        feature_array_add(features, 2, "unambiguous phrase type", phrase_type);
-        feature_array_add(features, 3, "unambiguous phrase type+phrase", phrase_type, phrase_string);
+        address_parser_add_feature(context, 2, "unambiguous phrase type", phrase_type);
+        address_parser_add_feature(context, 3, "unambiguous phrase type+phrase", phrase_type, phrase_string);
     } else if (phrase_types & component) {
-        feature_array_add(features, 3, "phrase type+phrase", phrase_type, phrase_string);
+        address_parser_add_feature(context, 3, "phrase type+phrase", phrase_type, phrase_string);
     }
 }
 
@@ -504,29 +530,43 @@ uint32_t i: the current token index
 char *prev: the predicted tag at index i - 1
 char *prev2: the predicted tag at index i - 2
 
+Only a few features depend on prev and prev2. The rest (the static
+features) are computed by address_parser_token_features, which also fills
+in what the tag features need, so at prediction time the static features
+can be scored once per string (address_parser_static_features) and only
+the tag features per step of the greedy pass (address_parser_tag_features).
+address_parser_features computes both, as used in training.
+
 */
 
-bool address_parser_features(void *self, void *ctx, tokenized_string_t *tokenized, uint32_t i, char *prev, char *prev2) {
-    if (self == NULL || ctx == NULL) return false;
+#define ADDRESS_PARSER_TAG_FEATURES_PREV_TAG (1 << 0)
+#define ADDRESS_PARSER_TAG_FEATURES_PREV_WORD (1 << 1)
 
-    address_parser_t *parser = (address_parser_t *)self;
-    address_parser_context_t *context = (address_parser_context_t *)ctx;
+typedef struct address_parser_tag_inputs {
+    // The previous token is not part of the same phrase
+    bool has_prev_tag;
+    char *word;
+    // NULL unless has_prev_tag and there is a previous token
+    char *prev_word;
+} address_parser_tag_inputs_t;
 
+static bool address_parser_token_features(address_parser_t *parser, address_parser_context_t *context, tokenized_string_t *tokenized, uint32_t i, address_parser_tag_inputs_t *tag_inputs) {
     cstring_array *features = context->features;
     char *language = context->language;
     char *country = context->country;
 
     phrase_array *address_dictionary_phrases = context->address_dictionary_phrases;
-    int64_array *address_phrase_memberships = context->address_phrase_memberships;
+    int32_array *address_phrase_memberships = context->address_phrase_memberships;
     phrase_array *geodb_phrases = context->geodb_phrases;
-    int64_array *geodb_phrase_memberships = context->geodb_phrase_memberships;
+    int32_array *geodb_phrase_memberships = context->geodb_phrase_memberships;
     phrase_array *component_phrases = context->component_phrases;
-    int64_array *component_phrase_memberships = context->component_phrase_memberships;
+    int32_array *component_phrase_memberships = context->component_phrase_memberships;
     cstring_array *normalized = context->normalized;
 
     uint32_array *separators = context->separators;
 
     cstring_array_clear(features);
+    uint64_array_clear(context->feature_hashes);
 
     token_t token = tokenized->tokens->a[i];
 
@@ -551,7 +591,7 @@ bool address_parser_features(void *self, void *ctx, tokenized_string_t *tokenize
     char *geo_phrase_string = NULL;
     char *component_phrase_string = NULL;
 
-    int64_t address_phrase_index = address_phrase_memberships->a[i];
+    int32_t address_phrase_index = address_phrase_memberships->a[i];
 
     char_array *phrase_tokens = context->phrase;
     char_array *component_phrase_tokens = context->component_phrase;
@@ -578,8 +618,8 @@ bool address_parser_features(void *self, void *ctx, tokenized_string_t *tokenize
             add_word_feature = false;
             log_debug("phrase_string=%s\n", phrase_string);
 
-            add_phrase_features(features, address_phrase_types, ADDRESS_STREET, "street", phrase_string, prev2, prev);
-            add_phrase_features(features, address_phrase_types, ADDRESS_NAME, "name", phrase_string, prev2, prev);
+            add_phrase_features(context, address_phrase_types, ADDRESS_STREET, "street", phrase_string);
+            add_phrase_features(context, address_phrase_types, ADDRESS_NAME, "name", phrase_string);
         }
     }
 
@@ -593,7 +633,7 @@ bool address_parser_features(void *self, void *ctx, tokenized_string_t *tokenize
             char_array_add_len(phrase_tokens, word, prefix_phrase.len);
             char *prefix = char_array_get_string(phrase_tokens);
             log_debug("got prefix: %s\n", prefix);
-            feature_array_add(features, 2, "prefix", prefix);
+            address_parser_add_feature(context, 2, "prefix", prefix);
         }
     }
 
@@ -606,11 +646,11 @@ bool address_parser_features(void *self, void *ctx, tokenized_string_t *tokenize
             char_array_add_len(phrase_tokens, word + (token.len - suffix_phrase.len), suffix_phrase.len);
             char *suffix = char_array_get_string(phrase_tokens);
             log_debug("got suffix: %s\n", suffix);
-            feature_array_add(features, 2, "suffix", suffix);
+            address_parser_add_feature(context, 2, "suffix", suffix);
         }
     }
 
-    int64_t component_phrase_index = component_phrase_memberships->a[i];
+    int32_t component_phrase_index = component_phrase_memberships->a[i];
     phrase = NULL_PHRASE;
 
     address_parser_types_t types;
@@ -632,39 +672,39 @@ bool address_parser_features(void *self, void *ctx, tokenized_string_t *tokenize
         }
 
         if (component_phrase_string != NULL && component_phrase_types ^ ADDRESS_COMPONENT_POSTAL_CODE) {
-            feature_array_add(features, 2, "phrase", component_phrase_string);
+            address_parser_add_feature(context, 2, "phrase", component_phrase_string);
             add_word_feature = false;
         }
 
         if (component_phrase_types > 0) {
-            add_phrase_features(features, component_phrase_types, ADDRESS_COMPONENT_SUBURB, "suburb", component_phrase_string, prev2, prev);
-            add_phrase_features(features, component_phrase_types, ADDRESS_COMPONENT_CITY, "city", component_phrase_string, prev2, prev);
-            add_phrase_features(features, component_phrase_types, ADDRESS_COMPONENT_CITY_DISTRICT, "city_district", component_phrase_string, prev2, prev);
-            add_phrase_features(features, component_phrase_types, ADDRESS_COMPONENT_STATE_DISTRICT, "state_district", component_phrase_string, prev2, prev);
-            add_phrase_features(features, component_phrase_types, ADDRESS_COMPONENT_STATE, "state", component_phrase_string, prev2, prev);
-            add_phrase_features(features, component_phrase_types, ADDRESS_COMPONENT_POSTAL_CODE, "postal_code", component_phrase_string, prev2, prev);
-            add_phrase_features(features, component_phrase_types, ADDRESS_COMPONENT_COUNTRY, "country", component_phrase_string, prev2, prev);
+            add_phrase_features(context, component_phrase_types, ADDRESS_COMPONENT_SUBURB, "suburb", component_phrase_string);
+            add_phrase_features(context, component_phrase_types, ADDRESS_COMPONENT_CITY, "city", component_phrase_string);
+            add_phrase_features(context, component_phrase_types, ADDRESS_COMPONENT_CITY_DISTRICT, "city_district", component_phrase_string);
+            add_phrase_features(context, component_phrase_types, ADDRESS_COMPONENT_STATE_DISTRICT, "state_district", component_phrase_string);
+            add_phrase_features(context, component_phrase_types, ADDRESS_COMPONENT_STATE, "state", component_phrase_string);
+            add_phrase_features(context, component_phrase_types, ADDRESS_COMPONENT_POSTAL_CODE, "postal_code", component_phrase_string);
+            add_phrase_features(context, component_phrase_types, ADDRESS_COMPONENT_COUNTRY, "country", component_phrase_string);
         }
 
         if (most_common == ADDRESS_PARSER_CITY) {
-            feature_array_add(features, 2, "commonly city", component_phrase_string);
+            address_parser_add_feature(context, 2, "commonly city", component_phrase_string);
         } else if (most_common == ADDRESS_PARSER_STATE) {
-            feature_array_add(features, 2, "commonly state", component_phrase_string);
+            address_parser_add_feature(context, 2, "commonly state", component_phrase_string);
         } else if (most_common == ADDRESS_PARSER_COUNTRY) {
-            feature_array_add(features, 2, "commonly country", component_phrase_string);
+            address_parser_add_feature(context, 2, "commonly country", component_phrase_string);
         } else if (most_common == ADDRESS_PARSER_STATE_DISTRICT) {
-            feature_array_add(features, 2, "commonly state_district", component_phrase_string);
+            address_parser_add_feature(context, 2, "commonly state_district", component_phrase_string);
         } else if (most_common == ADDRESS_PARSER_SUBURB) {
-            feature_array_add(features, 2, "commonly suburb", component_phrase_string);
+            address_parser_add_feature(context, 2, "commonly suburb", component_phrase_string);
         } else if (most_common == ADDRESS_PARSER_CITY_DISTRICT) {
-            feature_array_add(features, 2, "commonly city_district", component_phrase_string);
+            address_parser_add_feature(context, 2, "commonly city_district", component_phrase_string);
         } else if (most_common == ADDRESS_PARSER_POSTAL_CODE) {
-            feature_array_add(features, 2, "commonly postal_code", component_phrase_string);
+            address_parser_add_feature(context, 2, "commonly postal_code", component_phrase_string);
         }
 
     }
 
-    int64_t geodb_phrase_index = geodb_phrase_memberships->a[i];
+    int32_t geodb_phrase_index = geodb_phrase_memberships->a[i];
 
     phrase = NULL_PHRASE;
     geodb_value_t geo;
@@ -683,21 +723,21 @@ bool address_parser_features(void *self, void *ctx, tokenized_string_t *tokenize
         }
 
         if (geo_phrase_string != NULL && geodb_phrase_types ^ ADDRESS_POSTAL_CODE) {
-            feature_array_add(features, 2, "phrase", geo_phrase_string);
+            address_parser_add_feature(context, 2, "phrase", geo_phrase_string);
             add_word_feature = false;
         }
 
         if (geodb_phrase_types ^ ADDRESS_ANY) {
-            add_phrase_features(features, geodb_phrase_types, ADDRESS_LOCALITY, "gn city", geo_phrase_string, prev2, prev);
-            add_phrase_features(features, geodb_phrase_types, ADDRESS_ADMIN1, "gn admin1", geo_phrase_string, prev2, prev);
-            add_phrase_features(features, geodb_phrase_types, ADDRESS_ADMIN2, "gn admin2", geo_phrase_string, prev2, prev);
-            add_phrase_features(features, geodb_phrase_types, ADDRESS_ADMIN3, "gn admin3", geo_phrase_string, prev2, prev);
-            add_phrase_features(features, geodb_phrase_types, ADDRESS_ADMIN4, "gn admin4", geo_phrase_string, prev2, prev);
-            add_phrase_features(features, geodb_phrase_types, ADDRESS_ADMIN_OTHER, "gn admin other", geo_phrase_string, prev2, prev);
-            add_phrase_features(features, geodb_phrase_types, ADDRESS_NEIGHBORHOOD, "gn neighborhood", geo_phrase_string, prev2, prev);
+            add_phrase_features(context, geodb_phrase_types, ADDRESS_LOCALITY, "gn city", geo_phrase_string);
+            add_phrase_features(context, geodb_phrase_types, ADDRESS_ADMIN1, "gn admin1", geo_phrase_string);
+            add_phrase_features(context, geodb_phrase_types, ADDRESS_ADMIN2, "gn admin2", geo_phrase_string);
+            add_phrase_features(context, geodb_phrase_types, ADDRESS_ADMIN3, "gn admin3", geo_phrase_string);
+            add_phrase_features(context, geodb_phrase_types, ADDRESS_ADMIN4, "gn admin4", geo_phrase_string);
+            add_phrase_features(context, geodb_phrase_types, ADDRESS_ADMIN_OTHER, "gn admin other", geo_phrase_string);
+            add_phrase_features(context, geodb_phrase_types, ADDRESS_NEIGHBORHOOD, "gn neighborhood", geo_phrase_string);
 
-            add_phrase_features(features, geodb_phrase_types, ADDRESS_COUNTRY, "gn country", geo_phrase_string, prev2, prev);
-            add_phrase_features(features, geodb_phrase_types, ADDRESS_POSTAL_CODE, "gn postal code", geo_phrase_string, prev2, prev);
+            add_phrase_features(context, geodb_phrase_types, ADDRESS_COUNTRY, "gn country", geo_phrase_string);
+            add_phrase_features(context, geodb_phrase_types, ADDRESS_POSTAL_CODE, "gn postal code", geo_phrase_string);
 
         }
 
@@ -707,11 +747,11 @@ bool address_parser_features(void *self, void *ctx, tokenized_string_t *tokenize
 
     if (add_word_feature) {
         // Bias unit, acts as an intercept
-        feature_array_add(features, 1, "bias");
+        address_parser_add_feature(context, 1, "bias");
 
         if (word_freq > 0) {
             // The individual word
-            feature_array_add(features, 2, "word", word);
+            address_parser_add_feature(context, 2, "word", word);
         } else {
             log_debug("word not in vocab: %s\n", word);
             word = (token.type != NUMERIC && token.type != IDEOGRAPHIC_NUMBER) ? UNKNOWN_WORD : UNKNOWN_NUMERIC;
@@ -724,17 +764,9 @@ bool address_parser_features(void *self, void *ctx, tokenized_string_t *tokenize
         word = phrase_string;
     }
 
-    if (prev != NULL && last_index == i - 1) {
-        // Previous tag and current word
-        feature_array_add(features, 3, "i-1 tag+word", prev, word);
-        feature_array_add(features, 2, "i-1 tag", prev);
-
-        if (prev2 != NULL) {
-            // Previous two tags and current word
-            feature_array_add(features, 4, "i-2 tag+i-1 tag+word", prev2, prev, word);
-            feature_array_add(features, 3, "i-2 tag+i-1 tag", prev2, prev);
-        }
-    }
+    tag_inputs->word = word;
+    tag_inputs->prev_word = NULL;
+    tag_inputs->has_prev_tag = last_index == i - 1;
 
     if (last_index >= 0) {
         char *prev_word = cstring_array_get_string(normalized, last_index);
@@ -746,14 +778,14 @@ bool address_parser_features(void *self, void *ctx, tokenized_string_t *tokenize
         }
 
         // Previous word
-        feature_array_add(features, 2, "i-1 word", prev_word);
+        address_parser_add_feature(context, 2, "i-1 word", prev_word);
 
-        if (last_index == i - 1) {
-            feature_array_add(features, 3, "i-1 tag+i-1 word", prev, prev_word);
+        if (tag_inputs->has_prev_tag) {
+            tag_inputs->prev_word = prev_word;
         }
 
         // Previous word and current word
-        feature_array_add(features, 3, "i-1 word+word", prev_word, word);
+        address_parser_add_feature(context, 3, "i-1 word+word", prev_word, word);
     }
 
     size_t num_tokens = tokenized->tokens->n;
@@ -768,12 +800,49 @@ bool address_parser_features(void *self, void *ctx, tokenized_string_t *tokenize
         }
 
         // Next word e.g. if the current word is unknown and the next word is "street"
-        feature_array_add(features, 2, "i+1 word", next_word);
+        address_parser_add_feature(context, 2, "i+1 word", next_word);
 
         // Current word and next word
-        feature_array_add(features, 3, "word+i+1 word", word, next_word);
+        address_parser_add_feature(context, 3, "word+i+1 word", word, next_word);
+    }
+
+    return true;
+}
+
+static void address_parser_add_tag_features(address_parser_context_t *context, address_parser_tag_inputs_t tag_inputs, char *prev, char *prev2) {
+    if (!tag_inputs.has_prev_tag || prev == NULL) return;
+
+    char *word = tag_inputs.word;
+
+    // Previous tag and current word
+    address_parser_add_feature(context, 3, "i-1 tag+word", prev, word);
+    address_parser_add_feature(context, 2, "i-1 tag", prev);
+
+    if (prev2 != NULL) {
+        // Previous two tags and current word
+        address_parser_add_feature(context, 4, "i-2 tag+i-1 tag+word", prev2, prev, word);
+        address_parser_add_feature(context, 3, "i-2 tag+i-1 tag", prev2, prev);
     }
 
+    if (tag_inputs.prev_word != NULL) {
+        address_parser_add_feature(context, 3, "i-1 tag+i-1 word", prev, tag_inputs.prev_word);
+    }
+}
+
+bool address_parser_features(void *self, void *ctx, tokenized_string_t *tokenized, uint32_t i, char *prev, char *prev2) {
+    if (self == NULL || ctx == NULL) return false;
+
+    address_parser_t *parser = (address_parser_t *)self;
+    address_parser_context_t *context = (address_parser_context_t *)ctx;
+
+    address_parser_tag_inputs_t tag_inputs;
+
+    if (!address_parser_token_features(parser, context, tokenized, i, &tag_inputs)) {
+        return false;
+    }
+
+    address_parser_add_tag_features(context, tag_inputs, prev, prev2);
+
     #ifndef PRINT_FEATURES
     if (0) {
     #endif
@@ -782,7 +851,7 @@ bool address_parser_features(void *self, void *ctx, tokenized_string_t *tokenize
     char *feature;
 
     printf("{");
-    cstring_array_foreach(features, idx, feature, {
+    cstring_array_foreach(context->features, idx, feature, {
         printf("  %s, ", feature);
     })
     printf("}\n");
@@ -792,7 +861,71 @@ bool address_parser_features(void *self, void *ctx, tokenized_string_t *tokenize
     #endif
 
     return true;
+}
 
+/*
+Static features must be computed for tokens 0..n-1 in order before any tag
+features, see averaged_perceptron_tagger_predict_split. The inputs the tag
+features need (current and previous word, whether the previous token was
+tagged separately) are saved per token in the context.
+*/
+bool address_parser_static_features(void *self, void *ctx, tokenized_string_t *tokenized, uint32_t i) {
+    if (self == NULL || ctx == NULL) return false;
+
+    address_parser_t *parser = (address_parser_t *)self;
+    address_parser_context_t *context = (address_parser_context_t *)ctx;
+
+    cstring_array *tag_feature_words = context->tag_feature_words;
+    uint32_array *tag_feature_flags = context->tag_feature_flags;
+
+    if (i == 0) {
+        cstring_array_clear(tag_feature_words);
+        uint32_array_clear(tag_feature_flags);
+    }
+
+    if (tag_feature_flags->n != i) {
+        log_error("Static features must be computed in token order, got %u after %zu tokens\n", i, tag_feature_flags->n);
+        return false;
+    }
+
+    address_parser_tag_inputs_t tag_inputs;
+
+    if (!address_parser_token_features(parser, context, tokenized, i, &tag_inputs)) {
+        return false;
+    }
+
+    uint32_t flags = 0;
+    if (tag_inputs.has_prev_tag) flags |= ADDRESS_PARSER_TAG_FEATURES_PREV_TAG;
+    if (tag_inputs.prev_word != NULL) flags |= ADDRESS_PARSER_TAG_FEATURES_PREV_WORD;
+
+    // Copied since phrase strings live in buffers reused for the next token
+    cstring_array_add_string(tag_feature_words, tag_inputs.word);
+    cstring_array_add_string(tag_feature_words, tag_inputs.prev_word != NULL ? tag_inputs.prev_word : "");
+    uint32_array_push(tag_feature_flags, flags);
+
+    return true;
+}
+
+bool address_parser_tag_features(void *self, void *ctx, tokenized_string_t *tokenized, uint32_t i, char *prev, char *prev2) {
+    if (self == NULL || ctx == NULL) return false;
+
+    address_parser_context_t *context = (address_parser_context_t *)ctx;
+
+    if (i >= context->tag_feature_flags->n) {
+        log_error("No static features for token %u\n", i);
+        return false;
+    }
+
+    uint32_t flags = context->tag_feature_flags->a[i];
+
+    address_parser_tag_inputs_t tag_inputs;
+    tag_inputs.has_prev_tag = flags & ADDRESS_PARSER_TAG_FEATURES_PREV_TAG;
+    tag_inputs.word = cstring_array_get_string(context->tag_feature_words, 2 * i);
+    tag_inputs.prev_word = flags & ADDRESS_PARSER_TAG_FEATURES_PREV_WORD ? cstring_array_get_string(context->tag_feature_words, 2 * i + 1) : NULL;
+
+    address_parser_add_tag_features(context, tag_inputs, prev, prev2);
+
+    return true;
 }
 
 address_parser_response_t *address_parser_response_new(void) {
@@ -800,21 +933,80 @@ address_parser_response_t *address_parser_response_new(void) {
     return response;
 }
 
-address_parser_response_t *address_parser_parse(char *address, char *language, char *country, address_parser_context_t *context) {
-    if (address == NULL || context == NULL) return NULL;
+static char *address_parser_single_phrase_label(uint32_t most_common) {
+    if (most_common == ADDRESS_PARSER_CITY) {
+        return ADDRESS_PARSER_LABEL_CITY;
+    } else if (most_common == ADDRESS_PARSER_STATE) {
+        return ADDRESS_PARSER_LABEL_STATE;
+    } else if (most_common == ADDRESS_PARSER_COUNTRY) {
+        return ADDRESS_PARSER_LABEL_COUNTRY;
+    } else if (most_common == ADDRESS_PARSER_STATE_DISTRICT) {
+        return ADDRESS_PARSER_LABEL_STATE_DISTRICT;
+    } else if (most_common == ADDRESS_PARSER_SUBURB) {
+        return ADDRESS_PARSER_LABEL_SUBURB;
+    } else if (most_common == ADDRESS_PARSER_CITY_DISTRICT) {
+        return ADDRESS_PARSER_LABEL_CITY_DISTRICT;
+    } else if (most_common == ADDRESS_PARSER_POSTAL_CODE) {
+        return ADDRESS_PARSER_LABEL_POSTAL_CODE;
+    }
+    return NULL;
+}
 
-    char *normalized = address_parser_normalize_string(address);
-    bool is_normalized = normalized != NULL;
-    if (!is_normalized) {
-        normalized = address;
+/*
+Maps a model class or label string to the public address_parser_label_t enum
+*/
+address_parser_label_t address_parser_label_from_string(char *label) {
+    if (label == NULL) return ADDRESS_LABEL_UNKNOWN;
+
+    if (string_equals(label, ADDRESS_PARSER_LABEL_HOUSE)) {
+        return ADDRESS_LABEL_HOUSE;
+    } else if (string_equals(label, ADDRESS_PARSER_LABEL_HOUSE_NUMBER)) {
+        return ADDRESS_LABEL_HOUSE_NUMBER;
+    } else if (string_equals(label, ADDRESS_PARSER_LABEL_ROAD)) {
+        return ADDRESS_LABEL_ROAD;
+    } else if (string_equals(label, ADDRESS_PARSER_LABEL_SUBURB)) {
+        return ADDRESS_LABEL_SUBURB;
+    } else if (string_equals(label, ADDRESS_PARSER_LABEL_CITY_DISTRICT)) {
+        return ADDRESS_LABEL_CITY_DISTRICT;
+    } else if (string_equals(label, ADDRESS_PARSER_LABEL_CITY)) {
+        return ADDRESS_LABEL_CITY;
+    } else if (string_equals(label, ADDRESS_PARSER_LABEL_STATE_DISTRICT)) {
+        return ADDRESS_LABEL_STATE_DISTRICT;
+    } else if (string_equals(label, ADDRESS_PARSER_LABEL_STATE)) {
+        return ADDRESS_LABEL_STATE;
+    } else if (string_equals(label, ADDRESS_PARSER_LABEL_POSTAL_CODE)) {
+        return ADDRESS_LABEL_POSTAL_CODE;
+    } else if (string_equals(label, ADDRESS_PARSER_LABEL_COUNTRY)) {
+        return ADDRESS_LABEL_COUNTRY;
     }
 
+    return ADDRESS_LABEL_UNKNOWN;
+}
+
+/*
+Tokenizes the normalized string into the context and runs the tagger.
+
+If the whole input string is a single known phrase at the SUBURB level or
+higher, sequence prediction is bypassed altogether, *single_phrase is set
+and *most_common holds the phrase's most common component. Otherwise the
+predicted labels for each token in context->tokenized_str are left in
+context->token_labels.
+*/
+static bool address_parser_predict(char *normalized, char *language, char *country, address_parser_context_t *context, bool *single_phrase, uint32_t *most_common) {
     address_parser_t *parser = get_address_parser();
     averaged_perceptron_t *model = parser->model;
 
-    token_array *tokens = tokenize(normalized);
+    *single_phrase = false;
+
+    token_array *tokens = context->tokens;
+    token_array_clear(tokens);
+    tokenize_add_tokens(tokens, (const char *)normalized, strlen(normalized), false);
+
+    tokenized_string_t *tokenized_str = context->tokenized_str;
+    tokenized_string_clear(tokenized_str);
+    tokenized_str->str = normalized;
 
-    tokenized_string_t *tokenized_str = tokenized_string_new_from_str_size(normalized, strlen(normalized), tokens->n);
+    uint32_array_clear(context->separators);
 
     for (int i = 0; i < tokens->n; i++) {
         token_t token = tokens->a[i];
@@ -831,101 +1023,235 @@ address_parser_response_t *address_parser_parse(char *address, char *language, c
 
     address_parser_context_fill(context, parser, tokenized_str, language, country);
 
-    address_parser_response_t *response = NULL;
-
-    // If the whole input string is a single known phrase at the SUBURB level or higher, bypass sequence prediction altogether
-
     if (context->component_phrases->n == 1) {
         phrase_t only_phrase = context->component_phrases->a[0];
         if (only_phrase.start == 0 && only_phrase.len == tokenized_str->tokens->n) {
             address_parser_types_t types;
-
             types.value = only_phrase.data;
-            uint32_t most_common = types.most_common;
-
-            char *label;
-
-            response = address_parser_response_new();
-
-            if (most_common == ADDRESS_PARSER_CITY) {
-                label = strdup(ADDRESS_PARSER_LABEL_CITY);
-            } else if (most_common == ADDRESS_PARSER_STATE) {
-                label = strdup(ADDRESS_PARSER_LABEL_STATE);
-            } else if (most_common == ADDRESS_PARSER_COUNTRY) {
-                label = strdup(ADDRESS_PARSER_LABEL_COUNTRY);
-            } else if (most_common == ADDRESS_PARSER_STATE_DISTRICT) {
-                label = strdup(ADDRESS_PARSER_LABEL_STATE_DISTRICT);
-            } else if (most_common == ADDRESS_PARSER_SUBURB) {
-                label = strdup(ADDRESS_PARSER_LABEL_SUBURB);
-            } else if (most_common == ADDRESS_PARSER_CITY_DISTRICT) {
-                label = strdup(ADDRESS_PARSER_LABEL_CITY_DISTRICT);
-            } else if (most_common == ADDRESS_PARSER_POSTAL_CODE) {
-                label = strdup(ADDRESS_PARSER_LABEL_POSTAL_CODE);
+
+            if (address_parser_single_phrase_label(types.most_common) != NULL) {
+                *single_phrase = true;
+                *most_common = types.most_common;
+                return true;
             }
+        }
+    }
 
-            char **single_label = malloc(sizeof(char *));
-            single_label[0] = label;
-            char **single_component = malloc(sizeof(char *));
-            single_component[0] = strdup(normalized);
+    cstring_array_clear(context->token_labels);
 
-            response->num_components = 1;
-            response->labels = single_label;
-            response->components = single_component;
+    cstring_array *features = context->features;
+    uint64_array *feature_hashes = NULL;
 
-            token_array_destroy(tokens);
-            tokenized_string_destroy(tokenized_str);
-            return response;
-        }
+    // Models saved with a feature index take hashes without building the hash table
+    if (model->feature_hashes != NULL || model->feature_index != NULL) {
+        features = NULL;
+        feature_hashes = context->feature_hashes;
+        context->hash_features = true;
     }
 
-    cstring_array *token_labels = cstring_array_new_size(tokens->n);
+    bool ret = averaged_perceptron_tagger_predict_split(model, parser, context, features, feature_hashes, context->scores, context->static_scores, context->token_labels, &address_parser_static_features, &address_parser_tag_features, tokenized_str);
+    context->hash_features = false;
+    return ret;
+}
 
-    char *prev_label = NULL;
+/*
+address_parser_parse
+--------------------
+
+The context's buffers (tokens, tokenized string, labels, features, phrase
+arrays, scores) are cleared and grown in place, so reusing one context
+across calls means a steady-state parse only allocates the normalized
+string and the response.
+*/
+address_parser_response_t *address_parser_parse(char *address, char *language, char *country, address_parser_context_t *context) {
+    if (address == NULL || context == NULL) return NULL;
+
+    char *normalized = address_parser_normalize_string(address);
+    bool is_normalized = normalized != NULL;
+    if (!is_normalized) {
+        normalized = address;
+    }
+
+    tokenized_string_t *tokenized_str = context->tokenized_str;
+    cstring_array *token_labels = context->token_labels;
+
+    address_parser_response_t *response = NULL;
+
+    bool single_phrase = false;
+    uint32_t most_common = 0;
+
+    if (!address_parser_predict(normalized, language, country, context, &single_phrase, &most_common)) {
+        goto exit_address_parser_parse;
+    }
 
-    if (averaged_perceptron_tagger_predict(model, parser, context, context->features, token_labels, &address_parser_features, tokenized_str)) {
+    if (single_phrase) {
         response = address_parser_response_new();
 
-        size_t num_strings = cstring_array_num_strings(tokenized_str->strings);
+        char **single_label = malloc(sizeof(char *));
+        single_label[0] = strdup(address_parser_single_phrase_label(most_common));
+        char **single_component = malloc(sizeof(char *));
+        single_component[0] = strdup(normalized);
 
-        cstring_array *labels = cstring_array_new_size(num_strings);
-        cstring_array *components = cstring_array_new_size(strlen(address) + num_strings);
+        response->num_components = 1;
+        response->labels = single_label;
+        response->components = single_component;
 
+        goto exit_address_parser_parse;
+    }
 
-        for (int i = 0; i < num_strings; i++) {
-            char *str = tokenized_string_get_token(tokenized_str, i);
-            char *label = cstring_array_get_string(token_labels, i);
+    char *prev_label = NULL;
 
-            if (prev_label == NULL || strcmp(label, prev_label) != 0) {
-                cstring_array_add_string(labels, label);
-                cstring_array_start_token(components);
+    response = address_parser_response_new();
 
-            }
+    size_t num_strings = cstring_array_num_strings(tokenized_str->strings);
 
-            if (prev_label != NULL && strcmp(label, prev_label) == 0) {
-                cstring_array_cat_string(components, " ");
-                cstring_array_cat_string(components, str);
-            } else {
-                cstring_array_append_string(components, str);
-                cstring_array_terminate(components);
-            }
+    cstring_array *labels = cstring_array_new_size(num_strings);
+    cstring_array *components = cstring_array_new_size(strlen(address) + num_strings);
+
+
+    for (int i = 0; i < num_strings; i++) {
+        char *str = tokenized_string_get_token(tokenized_str, i);
+        char *label = cstring_array_get_string(token_labels, i);
+
+        if (prev_label == NULL || strcmp(label, prev_label) != 0) {
+            cstring_array_add_string(labels, label);
+            cstring_array_start_token(components);
+
+        }
+
+        if (prev_label != NULL && strcmp(label, prev_label) == 0) {
+            cstring_array_cat_string(components, " ");
+            cstring_array_cat_string(components, str);
+        } else {
+            cstring_array_append_string(components, str);
+            cstring_array_terminate(components);
+        }
+
+        prev_label = label;
+    }
+    response->num_components = cstring_array_num_strings(components);
+    response->components = cstring_array_to_strings(components);
+    response->labels = cstring_array_to_strings(labels);
+
+exit_address_parser_parse:
+    tokenized_string_clear(tokenized_str);
+    if (is_normalized) {
+        free(normalized);
+    }
+
+    return response;
+}
+
+/*
+address_parser_parse_compact
+----------------------------
+
+Same as address_parser_parse, but rather than copying each component into
+its own string, returns (label, start, len) spans into the normalized
+input. The response struct, the spans and the normalized string are all
+in a single allocation.
+
+A span covers the normalized string from the start of the first token with
+a given label to the end of the last one, so any characters between those
+tokens (e.g. punctuation, extra whitespace) are included as-is.
+*/
+address_parser_compact_response_t *address_parser_parse_compact(char *address, char *language, char *country, address_parser_context_t *context) {
+    if (address == NULL || context == NULL) return NULL;
+
+    char *normalized = address_parser_normalize_string(address);
+    bool is_normalized = normalized != NULL;
+    if (!is_normalized) {
+        normalized = address;
+    }
+
+    tokenized_string_t *tokenized_str = context->tokenized_str;
+    cstring_array *token_labels = context->token_labels;
+
+    address_parser_compact_response_t *response = NULL;
+
+    bool single_phrase = false;
+    uint32_t most_common = 0;
+
+    if (!address_parser_predict(normalized, language, country, context, &single_phrase, &most_common)) {
+        goto exit_address_parser_parse_compact;
+    }
+
+    size_t normalized_len = strlen(normalized);
+    token_array *tokens = tokenized_str->tokens;
+    size_t num_tokens = tokens->n;
+
+    size_t num_components = 0;
+    char *prev_label = NULL;
 
+    if (single_phrase) {
+        num_components = 1;
+    } else {
+        for (size_t i = 0; i < num_tokens; i++) {
+            char *label = cstring_array_get_string(token_labels, i);
+            if (prev_label == NULL || strcmp(label, prev_label) != 0) {
+                num_components++;
+            }
             prev_label = label;
         }
-        response->num_components = cstring_array_num_strings(components);
-        response->components = cstring_array_to_strings(components);
-        response->labels = cstring_array_to_strings(labels);
+    }
 
+    size_t spans_size = sizeof(address_parser_span_t) * num_components;
+    char *data = malloc(sizeof(address_parser_compact_response_t) + spans_size + normalized_len + 1);
+    if (data == NULL) {
+        goto exit_address_parser_parse_compact;
     }
 
-    token_array_destroy(tokens);
-    tokenized_string_destroy(tokenized_str);
-    cstring_array_destroy(token_labels);
+    response = (address_parser_compact_response_t *)data;
+    response->num_components = num_components;
+    response->components = (address_parser_span_t *)(data + sizeof(address_parser_compact_response_t));
+    response->normalized = data + sizeof(address_parser_compact_response_t) + spans_size;
+    response->normalized_len = normalized_len;
+    memcpy(response->normalized, normalized, normalized_len + 1);
+
+    if (single_phrase) {
+        char *label = address_parser_single_phrase_label(most_common);
+        response->components[0] = (address_parser_span_t){address_parser_label_from_string(label), 0, (uint32_t)normalized_len};
+        goto exit_address_parser_parse_compact;
+    }
+
+    prev_label = NULL;
+    address_parser_span_t *span = NULL;
+
+    for (size_t i = 0; i < num_tokens; i++) {
+        token_t token = tokens->a[i];
+        char *label = cstring_array_get_string(token_labels, i);
+
+        if (prev_label == NULL || strcmp(label, prev_label) != 0) {
+            span = span == NULL ? response->components : span + 1;
+            span->label = address_parser_label_from_string(label);
+            span->start = (uint32_t)token.offset;
+        }
+        span->len = (uint32_t)(token.offset + token.len) - span->start;
+
+        prev_label = label;
+    }
+
+exit_address_parser_parse_compact:
+    tokenized_string_clear(tokenized_str);
+    if (is_normalized) {
+        free(normalized);
+    }
 
     return response;
 }
 
 
 
+bool address_parser_build_feature_hashes(void) {
+    if (parser == NULL || parser->model == NULL) return false;
+
+    if (!averaged_perceptron_build_feature_hashes(parser->model)) {
+        log_warn("Could not build feature hash index, using feature strings\n");
+        return false;
+    }
+    return true;
+}
+
 bool address_parser_module_setup(char *dir) {
     if (parser == NULL) {
         return address_parser_load(dir);
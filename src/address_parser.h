@@ -54,6 +54,10 @@ with the general error-driven averaged perceptron.
 #include "normalize.h"
 #include "string_utils.h"
 
+#define ADDRESS_PARSER_MODEL_FILENAME "address_parser.dat"
+#define ADDRESS_PARSER_VOCAB_FILENAME "address_parser_vocab.trie"
+#define ADDRESS_PARSER_PHRASE_FILENAME "address_parser_phrases.trie"
+
 #define DEFAULT_ADDRESS_PARSER_PATH LIBPOSTAL_ADDRESS_PARSER_DIR PATH_SEPARATOR "address_parser.dat"
 
 #define NULL_PHRASE_MEMBERSHIP -1
@@ -82,6 +86,7 @@ with the general error-driven averaged perceptron.
 #define ADDRESS_COMPONENT_POSTAL_CODE 1 << 12
 #define ADDRESS_COMPONENT_COUNTRY 1 << 13
 
+// Same order as address_parser_label_t in libpostal.h
 typedef enum {
     ADDRESS_PARSER_HOUSE,
     ADDRESS_PARSER_HOUSE_NUMBER,
@@ -104,7 +109,7 @@ typedef enum {
 #define ADDRESS_PARSER_LABEL_CITY "city"
 #define ADDRESS_PARSER_LABEL_STATE_DISTRICT  "state_district"
 #define ADDRESS_PARSER_LABEL_STATE  "state"
-#define ADDRESS_PARSER_LABEL_POSTAL_CODE  "postal_code"
+#define ADDRESS_PARSER_LABEL_POSTAL_CODE  "postcode"
 #define ADDRESS_PARSER_LABEL_COUNTRY  "country"
 
 typedef union address_parser_types {
@@ -120,6 +125,14 @@ typedef struct address_parser_context {
     char *language;
     char *country;
     cstring_array *features;
+    // Used instead of features when hash_features is set (see feature_hashes_add)
+    uint64_array *feature_hashes;
+    bool hash_features;
+    // Per-token inputs to the tag features (two words per token and flags), see address_parser_static_features
+    cstring_array *tag_feature_words;
+    uint32_array *tag_feature_flags;
+    // Per-token static feature scores, num_tokens x num_classes
+    double_array *static_scores;
     char_array *phrase;
     char_array *component_phrase;
     char_array *geodb_phrase;
@@ -127,14 +140,19 @@ typedef struct address_parser_context {
     cstring_array *normalized;
     phrase_array *address_dictionary_phrases;
     // Index in address_dictionary_phrases or -1
-    int64_array *address_phrase_memberships;
+    int32_array *address_phrase_memberships;
     phrase_array *geodb_phrases;
     // Index in gedob_phrases or -1
-    int64_array *geodb_phrase_memberships;
+    int32_array *geodb_phrase_memberships;
     phrase_array *component_phrases;
     // Index in component_phrases or -1
-    int64_array *component_phrase_memberships;
+    int32_array *component_phrase_memberships;
+    // Per-context class scores so the model can be shared across threads
+    double_array *scores;
+    // Buffers reused across calls to address_parser_parse
+    token_array *tokens;
     tokenized_string_t *tokenized_str;
+    cstring_array *token_labels;
 } address_parser_context_t;
 
 // Can add other gazetteers as well
@@ -150,7 +168,20 @@ address_parser_t *address_parser_new(void);
 address_parser_t *get_address_parser(void);
 bool address_parser_load(char *dir);
 
+/*
+Opt-in: indexes the loaded model's features by hash so prediction can skip
+building feature strings (see averaged_perceptron_build_feature_hashes).
+Not done by address_parser_load because the table costs memory and load
+time proportional to the number of features (see libpostal.h). Models
+saved with a feature index (see feature_index.h) predict from hashes
+without it.
+*/
+bool address_parser_build_feature_hashes(void);
+
+address_parser_response_t *address_parser_response_new(void);
 address_parser_response_t *address_parser_parse(char *address, char *language, char *country, address_parser_context_t *context);
+address_parser_compact_response_t *address_parser_parse_compact(char *address, char *language, char *country, address_parser_context_t *context);
+address_parser_label_t address_parser_label_from_string(char *label);
 void address_parser_destroy(address_parser_t *self);
 
 char *address_parser_normalize_string(char *str);
@@ -163,6 +194,9 @@ void address_parser_context_fill(address_parser_context_t *context, address_pars
 
 // Feature function
 bool address_parser_features(void *self, void *ctx, tokenized_string_t *str, uint32_t i, char *prev, char *prev2);
+// The same features split into those not depending on previous tags and those that do
+bool address_parser_static_features(void *self, void *ctx, tokenized_string_t *str, uint32_t i);
+bool address_parser_tag_features(void *self, void *ctx, tokenized_string_t *str, uint32_t i, char *prev, char *prev2);
 
 // I/O methods
 
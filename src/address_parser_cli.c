@@ -4,6 +4,7 @@
 #include "address_parser.h"
 #include "averaged_perceptron_tagger.h"
 #include "address_dictionary.h"
+#include "bulk_stream.h"
 #include "collections.h"
 #include "constants.h"
 #include "file_utils.h"
@@ -37,12 +38,99 @@ bool load_address_parser_dependencies(void) {
     return true;
 }
 
+#define ADDRESS_PARSER_USAGE "Usage: ./address_parser [dir]\n" \
+                             "       ./address_parser --bulk [--input file] [--threads n] [--language code] [--country code]\n"
+
+// Bulk mode: one NDJSON object per input line, {"address": ..., "components": {label: value, ...}}
+static char *bulk_parse_line(void *arg, size_t worker_id, char *address) {
+    address_parser_options_t *options = (address_parser_options_t *)arg;
+
+    address_parser_response_t *parsed = parse_address(address, *options);
+    if (parsed == NULL) return NULL;
+
+    char_array *json = char_array_new_size(strlen(address) * 4);
+
+    char *json_string = json_encode_string(address);
+    char_array_cat_printf(json, "{\"address\": %s, \"components\": {", json_string);
+    free(json_string);
+
+    for (size_t i = 0; i < parsed->num_components; i++) {
+        json_string = json_encode_string(parsed->components[i]);
+        char_array_cat_printf(json, "\"%s\": %s%s", parsed->labels[i], json_string, i < parsed->num_components - 1 ? ", " : "");
+        free(json_string);
+    }
+    char_array_cat(json, "}}");
+
+    address_parser_response_destroy(parsed);
+
+    return char_array_to_string(json);
+}
+
+static int address_parser_bulk(char *input_file, size_t num_threads, char *language, char *country) {
+    FILE *input = stdin;
+    if (input_file != NULL && (input = fopen(input_file, "r")) == NULL) {
+        log_error("Could not open input file: %s\n", input_file);
+        return EXIT_FAILURE;
+    }
+
+    if (!libpostal_setup() || !libpostal_setup_parser()) {
+        return EXIT_FAILURE;
+    }
+
+    address_parser_options_t options = get_libpostal_address_parser_default_options();
+    options.language = language;
+    options.country = country;
+
+    bulk_stream_stats_t stats;
+    bool ret = bulk_stream_run(input, stdout, num_threads, 0, bulk_parse_line, &options, &stats);
+    if (!ret) {
+        log_error("Error in bulk parsing\n");
+    }
+    bulk_stream_stats_print(stderr, stats);
+
+    if (input != stdin) {
+        fclose(input);
+    }
+
+    libpostal_teardown();
+    libpostal_teardown_parser();
+
+    return ret ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
 int main(int argc, char **argv) {
     char *address_parser_dir = LIBPOSTAL_ADDRESS_PARSER_DIR;
     char *history_file = "address_parser.history";
 
-    if (argc > 1) {
-        address_parser_dir = argv[1];
+    bool bulk = false;
+    char *input_file = NULL;
+    size_t num_threads = 0;
+    char *bulk_language = NULL;
+    char *bulk_country = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        char *arg = argv[i];
+        if (string_equals(arg, "-h") || string_equals(arg, "--help")) {
+            printf(ADDRESS_PARSER_USAGE);
+            exit(EXIT_SUCCESS);
+        } else if (string_equals(arg, "--bulk")) {
+            bulk = true;
+        } else if (string_equals(arg, "--input") && i < argc - 1) {
+            input_file = argv[++i];
+            bulk = true;
+        } else if (string_equals(arg, "--threads") && i < argc - 1) {
+            num_threads = (size_t)strtoul(argv[++i], NULL, 10);
+        } else if (string_equals(arg, "--language") && i < argc - 1) {
+            bulk_language = argv[++i];
+        } else if (string_equals(arg, "--country") && i < argc - 1) {
+            bulk_country = argv[++i];
+        } else {
+            address_parser_dir = arg;
+        }
+    }
+
+    if (bulk) {
+        exit(address_parser_bulk(input_file, num_threads, bulk_language, bulk_country));
     }
 
     printf("Loading models...\n");
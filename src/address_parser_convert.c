@@ -0,0 +1,113 @@
+/*
+address_parser_convert
+----------------------
+
+Converts an address parser model file (address_parser.dat) between weight
+layouts (see averaged_perceptron.h), e.g. from the sparse layout produced
+by address_parser_train to the dense layout:
+
+./address_parser_convert --layout dense address_parser.dat address_parser_dense.dat
+
+or to one of the quantized layouts (int8 or int16). The accuracy of a
+converted model can be checked against the original with:
+
+./address_parser_test --compare address_parser_int8.dat test_file parser_dir
+
+Prints the size of the weights before and after, and the instruction set
+the prediction kernels will use on this machine.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "averaged_perceptron.h"
+#include "log/log.h"
+#include "string_utils.h"
+
+#define ADDRESS_PARSER_CONVERT_USAGE "Usage: ./address_parser_convert [--layout sparse|dense|int8|int16] input_file output_file\n"
+
+static char *averaged_perceptron_layout_name(averaged_perceptron_layout_t layout) {
+    switch (layout) {
+        case AVERAGED_PERCEPTRON_LAYOUT_DENSE:
+            return "dense";
+        case AVERAGED_PERCEPTRON_LAYOUT_INT8:
+            return "int8";
+        case AVERAGED_PERCEPTRON_LAYOUT_INT16:
+            return "int16";
+        default:
+            return "sparse";
+    }
+}
+
+int main(int argc, char **argv) {
+    char *layout = "dense";
+    char *input_file = NULL;
+    char *output_file = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        char *arg = argv[i];
+        if (string_equals(arg, "-h") || string_equals(arg, "--help")) {
+            printf(ADDRESS_PARSER_CONVERT_USAGE);
+            exit(EXIT_SUCCESS);
+        } else if (string_equals(arg, "--layout") && i < argc - 1) {
+            layout = argv[++i];
+        } else if (input_file == NULL) {
+            input_file = arg;
+        } else if (output_file == NULL) {
+            output_file = arg;
+        } else {
+            log_error(ADDRESS_PARSER_CONVERT_USAGE);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (input_file == NULL || output_file == NULL) {
+        log_error(ADDRESS_PARSER_CONVERT_USAGE);
+        exit(EXIT_FAILURE);
+    }
+
+    averaged_perceptron_t *model = averaged_perceptron_load(input_file);
+    if (model == NULL) {
+        log_error("Could not load model from %s\n", input_file);
+        exit(EXIT_FAILURE);
+    }
+
+    printf("input: %s layout, %u features, %u classes, %zu bytes of weights\n",
+           averaged_perceptron_layout_name(model->layout), model->num_features, model->num_classes,
+           averaged_perceptron_weights_size(model));
+
+    bool converted;
+    if (string_equals(layout, "dense")) {
+        converted = averaged_perceptron_to_dense(model);
+    } else if (string_equals(layout, "int8")) {
+        converted = averaged_perceptron_quantize(model, 8);
+    } else if (string_equals(layout, "int16")) {
+        converted = averaged_perceptron_quantize(model, 16);
+    } else if (string_equals(layout, "sparse")) {
+        // Dense and quantized models can't be converted back, their weights have lost precision
+        converted = model->layout == AVERAGED_PERCEPTRON_LAYOUT_SPARSE;
+    } else {
+        log_error(ADDRESS_PARSER_CONVERT_USAGE);
+        exit(EXIT_FAILURE);
+    }
+
+    if (!converted) {
+        log_error("Could not convert model to the %s layout\n", layout);
+        averaged_perceptron_destroy(model);
+        exit(EXIT_FAILURE);
+    }
+
+    if (!averaged_perceptron_save(model, output_file)) {
+        log_error("Could not write model to %s\n", output_file);
+        averaged_perceptron_destroy(model);
+        exit(EXIT_FAILURE);
+    }
+
+    printf("output: %s layout, %zu bytes of weights, kernels: %s\n",
+           averaged_perceptron_layout_name(model->layout), averaged_perceptron_weights_size(model),
+           averaged_perceptron_kernels_isa());
+
+    averaged_perceptron_destroy(model);
+
+    return EXIT_SUCCESS;
+}
@@ -146,12 +146,39 @@ bool address_parser_data_set_next(address_parser_data_set_t *data_set) {
 
     data_set->tokenized_str = tokenized_str;
 
-    free(normalized);
+    // Owned by tokenized_str otherwise
+    if (tokenized_str == NULL) {
+        free(normalized);
+    }
     cstring_array_destroy(fields);
 
     return tokenized_str != NULL;
 }
 
+bool address_parser_data_set_skip(address_parser_data_set_t *data_set) {
+    if (data_set == NULL) return false;
+
+    char *line = file_getline(data_set->f);
+    if (line == NULL) {
+        return false;
+    }
+
+    free(line);
+    return true;
+}
+
+bool address_parser_data_set_eof(address_parser_data_set_t *data_set) {
+    if (data_set == NULL) return true;
+
+    int c = getc(data_set->f);
+    if (c == EOF) {
+        return true;
+    }
+
+    ungetc(c, data_set->f);
+    return false;
+}
+
 
 void address_parser_data_set_destroy(address_parser_data_set_t *self) {
     if (self == NULL) return;
@@ -35,6 +35,10 @@ typedef struct address_parser_data_set {
 address_parser_data_set_t *address_parser_data_set_init(char *filename);
 bool address_parser_data_set_tokenize_line(address_parser_data_set_t *data_ser, char *input);
 bool address_parser_data_set_next(address_parser_data_set_t *data_set);
+// Moves past the next example without tokenizing it, false at the end of the file
+bool address_parser_data_set_skip(address_parser_data_set_t *data_set);
+// True if there are no more examples to read
+bool address_parser_data_set_eof(address_parser_data_set_t *data_set);
 void address_parser_data_set_destroy(address_parser_data_set_t *self);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,103 @@
+/*
+address_parser_prune
+--------------------
+
+Removes features from a trained address parser model (address_parser.dat)
+that contribute little to its predictions. Training keeps every feature that
+was ever updated, many of which end up with tiny averaged weights:
+
+./address_parser_prune --min-weight 0.5 address_parser.dat address_parser_pruned.dat
+./address_parser_prune --max-features 1000000 address_parser.dat address_parser_pruned.dat
+
+--min-weight drops features whose largest absolute weight is below the
+threshold, --max-features keeps only that many features with the largest
+L1 norms. Both can be given, the threshold is applied first. The input must
+use the sparse layout, prune before converting with address_parser_convert.
+
+Prints the number of features and the size of the model before and after.
+The accuracy of the pruned model on held-out data can be compared to the
+original with:
+
+./address_parser_test --compare address_parser_pruned.dat test_file parser_dir
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "averaged_perceptron.h"
+#include "log/log.h"
+#include "string_utils.h"
+
+#define ADDRESS_PARSER_PRUNE_USAGE "Usage: ./address_parser_prune [--min-weight weight] [--max-features count] input_file output_file\n"
+
+static long file_size(char *filename) {
+    FILE *f = fopen(filename, "rb");
+    if (f == NULL) return -1;
+
+    long size = -1;
+    if (fseek(f, 0, SEEK_END) == 0) {
+        size = ftell(f);
+    }
+
+    fclose(f);
+    return size;
+}
+
+int main(int argc, char **argv) {
+    double min_weight = 0.0;
+    uint32_t max_features = 0;
+    char *input_file = NULL;
+    char *output_file = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        char *arg = argv[i];
+        if (string_equals(arg, "-h") || string_equals(arg, "--help")) {
+            printf(ADDRESS_PARSER_PRUNE_USAGE);
+            exit(EXIT_SUCCESS);
+        } else if (string_equals(arg, "--min-weight") && i < argc - 1) {
+            min_weight = strtod(argv[++i], NULL);
+        } else if (string_equals(arg, "--max-features") && i < argc - 1) {
+            max_features = (uint32_t)strtoul(argv[++i], NULL, 10);
+        } else if (input_file == NULL) {
+            input_file = arg;
+        } else if (output_file == NULL) {
+            output_file = arg;
+        } else {
+            log_error(ADDRESS_PARSER_PRUNE_USAGE);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (input_file == NULL || output_file == NULL || min_weight < 0.0) {
+        log_error(ADDRESS_PARSER_PRUNE_USAGE);
+        exit(EXIT_FAILURE);
+    }
+
+    averaged_perceptron_t *model = averaged_perceptron_load(input_file);
+    if (model == NULL) {
+        log_error("Could not load model from %s\n", input_file);
+        exit(EXIT_FAILURE);
+    }
+
+    printf("input: %u features, %zu bytes of weights, %ld bytes on disk\n",
+           model->num_features, averaged_perceptron_weights_size(model), file_size(input_file));
+
+    if (!averaged_perceptron_prune(model, min_weight, max_features)) {
+        log_error("Could not prune model, it must use the sparse layout\n");
+        averaged_perceptron_destroy(model);
+        exit(EXIT_FAILURE);
+    }
+
+    if (!averaged_perceptron_save(model, output_file)) {
+        log_error("Could not write model to %s\n", output_file);
+        averaged_perceptron_destroy(model);
+        exit(EXIT_FAILURE);
+    }
+
+    printf("output: %u features, %zu bytes of weights, %ld bytes on disk\n",
+           model->num_features, averaged_perceptron_weights_size(model), file_size(output_file));
+
+    averaged_perceptron_destroy(model);
+
+    return EXIT_SUCCESS;
+}
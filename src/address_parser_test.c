@@ -16,6 +16,8 @@ typedef struct address_parser_test_results {
     size_t num_address_errors;
     size_t num_address_predictions;
     uint32_t *confusion;
+    // Predicted class index of every token, optional
+    uint32_array *predictions;
 } address_parser_test_results_t;
 
 
@@ -32,7 +34,9 @@ uint32_t get_class_index(address_parser_t *parser, char *name) {
     return parser->model->num_classes;
 }
 
-#define EMPTY_ADDRESS_PARSER_TEST_RESULT (address_parser_test_results_t){0, 0, 0, 0, NULL}
+#define EMPTY_ADDRESS_PARSER_TEST_RESULT (address_parser_test_results_t){0, 0, 0, 0, NULL, NULL}
+
+#define ADDRESS_PARSER_TEST_USAGE "Usage: ./address_parser_test [--compare model_file] filename [parser_dir]\n"
 
 bool address_parser_test(address_parser_t *parser, char *filename, address_parser_test_results_t *result) {
     if (filename == NULL) {
@@ -76,12 +80,16 @@ bool address_parser_test(address_parser_t *parser, char *filename, address_parse
 
         size_t starting_errors = result->num_errors;
 
-        if (averaged_perceptron_tagger_predict(parser->model, parser, context, context->features, token_labels, &address_parser_features, data_set->tokenized_str)) {
+        if (averaged_perceptron_tagger_predict(parser->model, parser, context, context->features, context->scores, token_labels, &address_parser_features, data_set->tokenized_str)) {
             uint32_t i;
             char *predicted;
             cstring_array_foreach(token_labels, i, predicted, {
                 char *truth = cstring_array_get_string(data_set->labels, i);
 
+                if (result->predictions != NULL) {
+                    uint32_array_push(result->predictions, get_class_index(parser, predicted));
+                }
+
                 if (strcmp(predicted, truth) != 0) {
                     result->num_errors++;
 
@@ -121,18 +129,93 @@ bool address_parser_test(address_parser_t *parser, char *filename, address_parse
 }
 
 
-int main(int argc, char **argv) {
-    char *address_parser_dir = LIBPOSTAL_ADDRESS_PARSER_DIR;
+static void address_parser_test_print_errors(address_parser_test_results_t *results) {
+    printf("Errors: %zu / %zu (%f%%)\n", results->num_errors, results->num_predictions, (double)results->num_errors / results->num_predictions);
+    printf("Addresses: %zu / %zu (%f%%)\n\n", results->num_address_errors, results->num_address_predictions, (double)results->num_address_errors / results->num_address_predictions);
+}
 
-    if (argc < 2) {
-        log_error("Usage: ./address_parser_test filename [parser_dir]\n");
-        exit(EXIT_FAILURE);
+/*
+Runs the test again with the model in compare_file (e.g. a copy of the
+parser's model converted with address_parser_convert) swapped in, and
+reports its errors next to those of the parser's own model along with the
+number of tokens whose predicted label changed.
+*/
+static bool address_parser_test_compare(address_parser_t *parser, char *filename, char *compare_file, address_parser_test_results_t *results) {
+    averaged_perceptron_t *compare_model = averaged_perceptron_load(compare_file);
+    if (compare_model == NULL) {
+        log_error("Could not load model from %s\n", compare_file);
+        return false;
+    }
+
+    averaged_perceptron_t *model = parser->model;
+
+    // Class indices are compared across the two runs
+    if (compare_model->num_classes != model->num_classes) {
+        log_error("Model %s has %u classes, parser has %u\n", compare_file, compare_model->num_classes, model->num_classes);
+        averaged_perceptron_destroy(compare_model);
+        return false;
     }
 
-    char *filename = argv[1];
+    address_parser_test_results_t compare_results = EMPTY_ADDRESS_PARSER_TEST_RESULT;
+    compare_results.predictions = uint32_array_new_size(results->predictions->n);
+
+    parser->model = compare_model;
+    bool success = address_parser_test(parser, filename, &compare_results);
+    parser->model = model;
+
+    if (success) {
+        size_t num_changed = 0;
+        size_t num_predictions = compare_results.predictions->n < results->predictions->n ? compare_results.predictions->n : results->predictions->n;
+        for (size_t i = 0; i < num_predictions; i++) {
+            if (compare_results.predictions->a[i] != results->predictions->a[i]) {
+                num_changed++;
+            }
+        }
+
+        printf("Parser model: %zu bytes of weights\n", averaged_perceptron_weights_size(model));
+        address_parser_test_print_errors(results);
+
+        printf("%s: %zu bytes of weights\n", compare_file, averaged_perceptron_weights_size(compare_model));
+        address_parser_test_print_errors(&compare_results);
 
-    if (argc > 2) {
-        address_parser_dir = argv[2];
+        printf("Changed predictions: %zu / %zu (%f%%)\n", num_changed, num_predictions, (double)num_changed / num_predictions);
+        printf("Error difference: %+zd\n\n", (ssize_t)compare_results.num_errors - (ssize_t)results->num_errors);
+    } else {
+        log_error("Error testing model %s\n", compare_file);
+    }
+
+    free(compare_results.confusion);
+    uint32_array_destroy(compare_results.predictions);
+    averaged_perceptron_destroy(compare_model);
+
+    return success;
+}
+
+int main(int argc, char **argv) {
+    char *address_parser_dir = LIBPOSTAL_ADDRESS_PARSER_DIR;
+    char *filename = NULL;
+    char *compare_file = NULL;
+
+    bool have_parser_dir = false;
+
+    for (int i = 1; i < argc; i++) {
+        char *arg = argv[i];
+        if (string_equals(arg, "--compare") && i < argc - 1) {
+            compare_file = argv[++i];
+        } else if (filename == NULL) {
+            filename = arg;
+        } else if (!have_parser_dir) {
+            address_parser_dir = arg;
+            have_parser_dir = true;
+        } else {
+            log_error(ADDRESS_PARSER_TEST_USAGE);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (filename == NULL) {
+        log_error(ADDRESS_PARSER_TEST_USAGE);
+        exit(EXIT_FAILURE);
     }
 
     if (!address_dictionary_module_setup(NULL)) {
@@ -159,14 +242,23 @@ int main(int argc, char **argv) {
     address_parser_t *parser = get_address_parser();
 
     address_parser_test_results_t results = EMPTY_ADDRESS_PARSER_TEST_RESULT;
+    if (compare_file != NULL) {
+        results.predictions = uint32_array_new();
+    }
 
     if (!address_parser_test(parser, filename, &results)) {
         log_error("Error in training\n");
         exit(EXIT_FAILURE);
     }
 
-    printf("Errors: %zu / %zu (%f%%)\n", results.num_errors, results.num_predictions, (double)results.num_errors / results.num_predictions);
-    printf("Addresses: %zu / %zu (%f%%)\n\n", results.num_address_errors, results.num_address_predictions, (double)results.num_address_errors / results.num_address_predictions);
+    if (compare_file != NULL) {
+        if (!address_parser_test_compare(parser, filename, compare_file, &results)) {
+            exit(EXIT_FAILURE);
+        }
+        uint32_array_destroy(results.predictions);
+    } else {
+        address_parser_test_print_errors(&results);
+    }
 
 
     printf("Confusion matrix:\n\n");
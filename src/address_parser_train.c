@@ -1,5 +1,6 @@
 #include "address_parser.h"
 #include "address_parser_io.h"
+#include "address_parser_trainer.h"
 #include "address_dictionary.h"
 #include "averaged_perceptron_trainer.h"
 #include "collections.h"
@@ -7,12 +8,18 @@
 #include "file_utils.h"
 #include "geodb.h"
 #include "shuffle.h"
+#include "thread_pool.h"
 
 #include "log/log.h"
 
 // Training
 
 #define DEFAULT_ITERATIONS 5
+#define DEFAULT_THREADS 1
+// Mix weights at the end of each epoch
+#define DEFAULT_MIX_EXAMPLES 0
+
+#define ADDRESS_PARSER_TRAIN_USAGE "Usage: ./address_parser_train [--threads n] [--mix-examples n] filename output_dir\n"
 
 #define MIN_VOCAB_COUNT 5
 #define MIN_PHRASE_COUNT 1
@@ -332,71 +339,21 @@ exit_hashes_allocated:
 
 
 
-bool address_parser_train_epoch(address_parser_t *self, averaged_perceptron_trainer_t *trainer, char *filename) {
-    if (filename == NULL) {
-        log_error("Filename was NULL\n");
-        return false;
-    }
-
-    address_parser_data_set_t *data_set = address_parser_data_set_init(filename);
-    if (data_set == NULL) {
-        log_error("Error initializing data set\n");
-        return false;
-    }
-
-    address_parser_context_t *context = address_parser_context_new();
-
-    bool success = false;
-
-    size_t examples = 0;
-    size_t errors = trainer->num_errors;
-
-    bool logged = false;
-
-    while (address_parser_data_set_next(data_set)) {
-        char *language = char_array_get_string(data_set->language);
-        if (string_equals(language, UNKNOWN_LANGUAGE) || string_equals(language, AMBIGUOUS_LANGUAGE)) {
-            language = NULL;
-        }
-        char *country = char_array_get_string(data_set->country);
-
-        address_parser_context_fill(context, self, data_set->tokenized_str, language, country);
-
-        bool example_success = averaged_perceptron_trainer_train_example(trainer, self, context, context->features, &address_parser_features, data_set->tokenized_str, data_set->labels);
-
-        if (!example_success) {
-            log_error("Error training example\n");
-            goto exit_epoch_training_started;
-        }
-
-        tokenized_string_destroy(data_set->tokenized_str);
-        data_set->tokenized_str = NULL;
-
-        if (!example_success) {
-            log_error("Error training example without country/language\n");
-            goto exit_epoch_training_started;
-        }
+bool address_parser_train(address_parser_t *self, char *filename, uint32_t num_iterations, size_t num_threads, size_t mix_examples) {
+    averaged_perceptron_trainer_t *trainer = averaged_perceptron_trainer_new();
 
-        examples++;
-        if (examples % 1000 == 0 && examples > 0) {
-            log_info("Iter %d: Did %zu examples with %llu errors\n", trainer->iterations, examples, trainer->num_errors - errors);
-            errors = trainer->num_errors;
+    // A single thread trains on the examples in file order, exactly as before
+    thread_pool_t *pool = NULL;
+    if (num_threads > 1) {
+        pool = thread_pool_new(num_threads);
+        if (pool == NULL) {
+            log_error("Error creating thread pool\n");
+            averaged_perceptron_trainer_destroy(trainer);
+            return false;
         }
-
+        log_info("Training with %zu threads\n", thread_pool_num_workers(pool));
     }
 
-    success = true;
-
-exit_epoch_training_started:
-    address_parser_data_set_destroy(data_set);
-    address_parser_context_destroy(context);
-
-    return success;
-}
-
-bool address_parser_train(address_parser_t *self, char *filename, uint32_t num_iterations) {
-    averaged_perceptron_trainer_t *trainer = averaged_perceptron_trainer_new();
-
     for (uint32_t iter = 0; iter < num_iterations; iter++) {
         log_info("Doing epoch %d\n", iter);
 
@@ -407,42 +364,77 @@ bool address_parser_train(address_parser_t *self, char *filename, uint32_t num_i
 
         if (!shuffle_file(filename)) {
             log_error("Error in shuffle\n");
-            averaged_perceptron_trainer_destroy(trainer);
-            return false;
+            goto exit_training_started;
         }
 
         log_info("Shuffle complete\n");
         #endif
-        
-        if (!address_parser_train_epoch(self, trainer, filename)) {
+
+        bool epoch_success = pool != NULL ? address_parser_train_epoch_parallel(self, trainer, filename, pool, mix_examples)
+                                          : address_parser_train_epoch(self, trainer, filename);
+        if (!epoch_success) {
             log_error("Error in epoch\n");
-            averaged_perceptron_trainer_destroy(trainer);
-            return false;
+            goto exit_training_started;
         }
     }
 
+    if (pool != NULL) {
+        thread_pool_destroy(pool);
+    }
+
     log_debug("Done with training, averaging weights\n");
 
     self->model = averaged_perceptron_trainer_finalize(trainer);
-    
 
     return true;
+
+exit_training_started:
+    if (pool != NULL) {
+        thread_pool_destroy(pool);
+    }
+    averaged_perceptron_trainer_destroy(trainer);
+    return false;
 }
 
 
 int main(int argc, char **argv) {
-    if (argc < 3) {
-        printf("Usage: ./address_parser_train filename output_dir\n");
+    size_t num_threads = DEFAULT_THREADS;
+    size_t mix_examples = DEFAULT_MIX_EXAMPLES;
+    char *filename = NULL;
+    char *output_dir = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        char *arg = argv[i];
+        if (string_equals(arg, "-h") || string_equals(arg, "--help")) {
+            printf(ADDRESS_PARSER_TRAIN_USAGE);
+            exit(EXIT_SUCCESS);
+        } else if (string_equals(arg, "--threads") && i < argc - 1) {
+            num_threads = (size_t)strtoul(argv[++i], NULL, 10);
+        } else if (string_equals(arg, "--mix-examples") && i < argc - 1) {
+            mix_examples = (size_t)strtoul(argv[++i], NULL, 10);
+        } else if (filename == NULL) {
+            filename = arg;
+        } else if (output_dir == NULL) {
+            output_dir = arg;
+        } else {
+            printf(ADDRESS_PARSER_TRAIN_USAGE);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (filename == NULL || output_dir == NULL) {
+        printf(ADDRESS_PARSER_TRAIN_USAGE);
         exit(EXIT_FAILURE);
     }
 
+    if (num_threads == 0) {
+        num_threads = thread_pool_default_num_threads();
+    }
+
     #if !defined(HAVE_SHUF)
     log_warn("shuf must be installed to train address parser effectively. If this is a production machine, please install shuf. No shuffling will be performed.\n");
     #endif
 
-    char *filename = argv[1];
-    char *output_dir = argv[2];
-
     if (!address_dictionary_module_setup(NULL)) {
         log_error("Could not load address dictionaries\n");
         exit(EXIT_FAILURE);
@@ -466,7 +458,7 @@ int main(int argc, char **argv) {
 
     log_info("Finished initialization\n");
 
-    if (!address_parser_train(parser, filename, DEFAULT_ITERATIONS)) {
+    if (!address_parser_train(parser, filename, DEFAULT_ITERATIONS, num_threads, mix_examples)) {
         log_error("Error in training\n");
         exit(EXIT_FAILURE);
     }
@@ -0,0 +1,261 @@
+#include "address_parser_trainer.h"
+#include "address_parser_io.h"
+
+#include "log/log.h"
+
+bool address_parser_train_epoch(address_parser_t *self, averaged_perceptron_trainer_t *trainer, char *filename) {
+    if (filename == NULL) {
+        log_error("Filename was NULL\n");
+        return false;
+    }
+
+    address_parser_data_set_t *data_set = address_parser_data_set_init(filename);
+    if (data_set == NULL) {
+        log_error("Error initializing data set\n");
+        return false;
+    }
+
+    address_parser_context_t *context = address_parser_context_new();
+
+    bool success = false;
+
+    size_t examples = 0;
+    size_t errors = trainer->num_errors;
+
+    bool logged = false;
+
+    while (address_parser_data_set_next(data_set)) {
+        char *language = char_array_get_string(data_set->language);
+        if (string_equals(language, UNKNOWN_LANGUAGE) || string_equals(language, AMBIGUOUS_LANGUAGE)) {
+            language = NULL;
+        }
+        char *country = char_array_get_string(data_set->country);
+
+        address_parser_context_fill(context, self, data_set->tokenized_str, language, country);
+
+        bool example_success = averaged_perceptron_trainer_train_example(trainer, self, context, context->features, &address_parser_features, data_set->tokenized_str, data_set->labels);
+
+        if (!example_success) {
+            log_error("Error training example\n");
+            goto exit_epoch_training_started;
+        }
+
+        tokenized_string_destroy(data_set->tokenized_str);
+        data_set->tokenized_str = NULL;
+
+        if (!example_success) {
+            log_error("Error training example without country/language\n");
+            goto exit_epoch_training_started;
+        }
+
+        examples++;
+        if (examples % 1000 == 0 && examples > 0) {
+            log_info("Iter %d: Did %zu examples with %llu errors\n", trainer->iterations, examples, trainer->num_errors - errors);
+            errors = trainer->num_errors;
+        }
+
+    }
+
+    success = true;
+
+exit_epoch_training_started:
+    address_parser_data_set_destroy(data_set);
+    address_parser_context_destroy(context);
+
+    return success;
+}
+
+/*
+Each worker reads the whole file and skips the examples of other workers, so
+the shards, and the trained model, only depend on the number of workers.
+The worker trainers live for the whole epoch and are reset to the mixed
+weights after each round rather than copied from trainer.
+*/
+
+typedef struct address_parser_train_worker {
+    averaged_perceptron_trainer_t *trainer;
+    address_parser_data_set_t *data_set;
+    address_parser_context_t *context;
+    // Index of the next example in the file
+    size_t index;
+    size_t examples;
+    bool done;
+    bool success;
+} address_parser_train_worker_t;
+
+typedef struct address_parser_train_round {
+    address_parser_t *parser;
+    address_parser_train_worker_t *workers;
+    size_t num_workers;
+    // Examples before this index are trained on in this round
+    size_t end;
+} address_parser_train_round_t;
+
+static void address_parser_train_worker_run(void *arg, size_t worker_id, size_t task_index) {
+    address_parser_train_round_t *round = arg;
+    address_parser_t *parser = round->parser;
+    size_t num_workers = round->num_workers;
+    address_parser_train_worker_t *worker = round->workers + task_index;
+
+    address_parser_data_set_t *data_set = worker->data_set;
+    address_parser_context_t *context = worker->context;
+    averaged_perceptron_trainer_t *trainer = worker->trainer;
+
+    while (!worker->done && worker->index < round->end) {
+        if (worker->index % num_workers != task_index) {
+            worker->done = !address_parser_data_set_skip(data_set);
+            worker->index++;
+            continue;
+        }
+
+        if (!address_parser_data_set_next(data_set)) {
+            worker->done = true;
+            break;
+        }
+        worker->index++;
+
+        char *language = char_array_get_string(data_set->language);
+        if (string_equals(language, UNKNOWN_LANGUAGE) || string_equals(language, AMBIGUOUS_LANGUAGE)) {
+            language = NULL;
+        }
+        char *country = char_array_get_string(data_set->country);
+
+        address_parser_context_fill(context, parser, data_set->tokenized_str, language, country);
+
+        bool example_success = averaged_perceptron_trainer_train_example(trainer, parser, context, context->features, &address_parser_features, data_set->tokenized_str, data_set->labels);
+
+        tokenized_string_destroy(data_set->tokenized_str);
+        data_set->tokenized_str = NULL;
+
+        if (!example_success) {
+            log_error("Error training example\n");
+            worker->success = false;
+            worker->done = true;
+            break;
+        }
+
+        worker->examples++;
+    }
+
+    // A file ending on a round boundary doesn't need another round
+    if (!worker->done && address_parser_data_set_eof(data_set)) {
+        worker->done = true;
+    }
+}
+
+bool address_parser_train_epoch_parallel(address_parser_t *self, averaged_perceptron_trainer_t *trainer, char *filename, thread_pool_t *pool, size_t mix_examples) {
+    if (filename == NULL) {
+        log_error("Filename was NULL\n");
+        return false;
+    }
+
+    size_t num_workers = thread_pool_num_workers(pool);
+
+    address_parser_train_worker_t *workers = calloc(num_workers, sizeof(address_parser_train_worker_t));
+    averaged_perceptron_trainer_t **trainers = calloc(num_workers, sizeof(averaged_perceptron_trainer_t *));
+    if (workers == NULL || trainers == NULL) {
+        free(workers);
+        free(trainers);
+        return false;
+    }
+
+    bool success = false;
+
+    for (size_t i = 0; i < num_workers; i++) {
+        workers[i].success = true;
+
+        workers[i].data_set = address_parser_data_set_init(filename);
+        if (workers[i].data_set == NULL) {
+            log_error("Error initializing data set\n");
+            goto exit_epoch_workers_created;
+        }
+
+        workers[i].context = address_parser_context_new();
+        if (workers[i].context == NULL) {
+            log_error("Error allocating context\n");
+            goto exit_epoch_workers_created;
+        }
+
+        workers[i].trainer = averaged_perceptron_trainer_new_worker(trainer);
+        if (workers[i].trainer == NULL) {
+            log_error("Error creating worker trainer\n");
+            goto exit_epoch_workers_created;
+        }
+
+        workers[i].done = address_parser_data_set_eof(workers[i].data_set);
+    }
+
+    address_parser_train_round_t round = (address_parser_train_round_t){
+        .parser = self,
+        .workers = workers,
+        .num_workers = num_workers,
+        .end = 0
+    };
+
+    size_t examples = 0;
+    size_t errors = trainer->num_errors;
+
+    while (true) {
+        bool done = true;
+        for (size_t i = 0; i < num_workers; i++) {
+            done = done && workers[i].done;
+        }
+        if (done) break;
+
+        round.end = mix_examples > 0 ? round.end + mix_examples : SIZE_MAX;
+
+        if (!thread_pool_map(pool, num_workers, address_parser_train_worker_run, &round)) {
+            log_error("Error running training round\n");
+            goto exit_epoch_workers_created;
+        }
+
+        // Workers that had no examples left in this round still have the weights of trainer and are left out
+        size_t num_trainers = 0;
+        for (size_t i = 0; i < num_workers; i++) {
+            if (!workers[i].success) {
+                goto exit_epoch_workers_created;
+            }
+            if (workers[i].examples > 0) {
+                trainers[num_trainers++] = workers[i].trainer;
+            }
+        }
+
+        if (num_trainers > 0 && !averaged_perceptron_trainer_mix(trainer, trainers, num_trainers)) {
+            log_error("Error mixing weights\n");
+            goto exit_epoch_workers_created;
+        }
+
+        for (size_t i = 0; i < num_workers; i++) {
+            examples += workers[i].examples;
+            workers[i].examples = 0;
+            if (workers[i].done || num_trainers == 0) continue;
+
+            if (!averaged_perceptron_trainer_reset_worker(workers[i].trainer, trainer)) {
+                log_error("Error resetting worker trainer\n");
+                goto exit_epoch_workers_created;
+            }
+        }
+
+        log_info("Iter %d: Did %zu examples with %llu errors\n", trainer->iterations, examples, trainer->num_errors - errors);
+        errors = trainer->num_errors;
+    }
+
+    success = true;
+
+exit_epoch_workers_created:
+    for (size_t i = 0; i < num_workers; i++) {
+        if (workers[i].trainer != NULL) {
+            averaged_perceptron_trainer_destroy(workers[i].trainer);
+        }
+        if (workers[i].data_set != NULL) {
+            address_parser_data_set_destroy(workers[i].data_set);
+        }
+        if (workers[i].context != NULL) {
+            address_parser_context_destroy(workers[i].context);
+        }
+    }
+    free(workers);
+    free(trainers);
+
+    return success;
+}
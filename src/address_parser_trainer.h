@@ -0,0 +1,32 @@
+/*
+address_parser_trainer.h
+------------------------
+
+One epoch of address parser training over a file of tagged examples (see
+address_parser.h for the format), either in file order on the calling
+thread or on a thread pool with iterative parameter mixing (see
+averaged_perceptron_trainer.h).
+
+address_parser_train_epoch_parallel trains one worker per thread in the
+pool. Example i of the file goes to worker i % num_workers. Every
+mix_examples examples (or at the end of the epoch if mix_examples is 0)
+the workers' weights are mixed back into trainer, and the next round
+starts from the mixed weights. With a single worker it trains the same
+model as address_parser_train_epoch.
+*/
+
+#ifndef ADDRESS_PARSER_TRAINER_H
+#define ADDRESS_PARSER_TRAINER_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+
+#include "address_parser.h"
+#include "averaged_perceptron_trainer.h"
+#include "thread_pool.h"
+
+bool address_parser_train_epoch(address_parser_t *self, averaged_perceptron_trainer_t *trainer, char *filename);
+bool address_parser_train_epoch_parallel(address_parser_t *self, averaged_perceptron_trainer_t *trainer, char *filename, thread_pool_t *pool, size_t mix_examples);
+
+#endif
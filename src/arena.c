@@ -0,0 +1,170 @@
+#include "arena.h"
+
+#include <string.h>
+
+#include "log/log.h"
+#include "stats.h"
+
+#define ARENA_ALIGNMENT 16
+
+static inline size_t arena_align(size_t size) {
+    return (size + ARENA_ALIGNMENT - 1) & ~((size_t)ARENA_ALIGNMENT - 1);
+}
+
+static arena_block_t *arena_block_new(size_t size) {
+    // Header and data in one allocation, the header size keeps data aligned
+    arena_block_t *block = malloc(arena_align(sizeof(arena_block_t)) + size);
+    if (block == NULL) return NULL;
+
+    STATS_COUNT(LIBPOSTAL_COUNTER_ARENA_BLOCKS, 1);
+
+    block->next = NULL;
+    block->size = size;
+    block->used = 0;
+    block->data = (char *)block + arena_align(sizeof(arena_block_t));
+    return block;
+}
+
+arena_t *arena_new(size_t block_size) {
+    if (block_size == 0) {
+        block_size = ARENA_DEFAULT_BLOCK_SIZE;
+    }
+
+    arena_t *arena = malloc(sizeof(arena_t));
+    if (arena == NULL) return NULL;
+
+    arena->block_size = arena_align(block_size);
+    arena->blocks = arena_block_new(arena->block_size);
+    if (arena->blocks == NULL) {
+        free(arena);
+        return NULL;
+    }
+    arena->current = arena->blocks;
+    arena->large_blocks = NULL;
+    arena->last = NULL;
+    arena->last_block = NULL;
+
+    return arena;
+}
+
+void *arena_alloc(arena_t *self, size_t size) {
+    STATS_COUNT(LIBPOSTAL_COUNTER_ARENA_ALLOCATIONS, 1);
+
+    size_t aligned = arena_align(size > 0 ? size : 1);
+
+    arena_block_t *block;
+
+    if (aligned > self->block_size) {
+        block = arena_block_new(aligned);
+        if (block == NULL) {
+            log_error("Could not allocate arena block of size %zu\n", aligned);
+            return NULL;
+        }
+        block->next = self->large_blocks;
+        self->large_blocks = block;
+    } else {
+        block = self->current;
+        // Blocks kept from previous resets are reused before allocating new ones
+        while (block->used + aligned > block->size) {
+            if (block->next == NULL) {
+                block->next = arena_block_new(self->block_size);
+                if (block->next == NULL) {
+                    log_error("Could not allocate arena block of size %zu\n", self->block_size);
+                    return NULL;
+                }
+            }
+            block = block->next;
+        }
+        self->current = block;
+    }
+
+    void *ptr = block->data + block->used;
+    block->used += aligned;
+    self->last = ptr;
+    self->last_block = block;
+
+    return ptr;
+}
+
+void *arena_calloc(arena_t *self, size_t n, size_t size) {
+    void *ptr = arena_alloc(self, n * size);
+    if (ptr == NULL) return NULL;
+    memset(ptr, 0, n * size);
+    return ptr;
+}
+
+void *arena_realloc(arena_t *self, void *ptr, size_t old_size, size_t new_size) {
+    if (ptr == NULL) return arena_alloc(self, new_size);
+    if (new_size <= old_size) return ptr;
+
+    // Growing the most recent allocation, extend in place if it fits
+    if (ptr == self->last) {
+        arena_block_t *block = self->last_block;
+        size_t offset = (char *)ptr - block->data;
+        size_t aligned = arena_align(new_size);
+        if (offset + aligned <= block->size) {
+            block->used = offset + aligned;
+            return ptr;
+        }
+    }
+
+    void *new_ptr = arena_alloc(self, new_size);
+    if (new_ptr == NULL) return NULL;
+    memcpy(new_ptr, ptr, old_size);
+    return new_ptr;
+}
+
+char *arena_strndup(arena_t *self, const char *str, size_t len) {
+    char *copy = arena_alloc(self, len + 1);
+    if (copy == NULL) return NULL;
+    memcpy(copy, str, len);
+    copy[len] = '\0';
+    return copy;
+}
+
+char *arena_strdup(arena_t *self, const char *str) {
+    return arena_strndup(self, str, strlen(str));
+}
+
+static void arena_free_blocks(arena_block_t *block) {
+    while (block != NULL) {
+        arena_block_t *next = block->next;
+        free(block);
+        block = next;
+    }
+}
+
+size_t arena_capacity(arena_t *self) {
+    size_t capacity = 0;
+    for (arena_block_t *block = self->blocks; block != NULL; block = block->next) {
+        capacity += block->size;
+    }
+    for (arena_block_t *block = self->large_blocks; block != NULL; block = block->next) {
+        capacity += block->size;
+    }
+    return capacity;
+}
+
+void arena_reset(arena_t *self) {
+    if (self == NULL) return;
+
+    for (arena_block_t *block = self->blocks; block != NULL; block = block->next) {
+        block->used = 0;
+    }
+
+    arena_free_blocks(self->large_blocks);
+    self->large_blocks = NULL;
+
+    self->current = self->blocks;
+    self->last = NULL;
+    self->last_block = NULL;
+}
+
+void arena_destroy(arena_t *self) {
+    if (self == NULL) return;
+
+    arena_free_blocks(self->blocks);
+    arena_free_blocks(self->large_blocks);
+
+    free(self);
+}
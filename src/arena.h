@@ -0,0 +1,68 @@
+/*
+arena.h
+-------
+
+Bump allocator for short-lived scratch memory, e.g. everything allocated
+during a single call to expand_address.
+
+Allocations are carved out of large blocks and never freed individually.
+arena_reset releases everything at once and keeps the blocks around for
+the next use, so a long-running process doing many small calls settles
+into a fixed set of blocks instead of churning through malloc/free.
+
+Vectors (see vector.h) can be backed by an arena using name##_new_size_arena.
+They grow with arena_realloc, which extends the most recent allocation in
+place when possible, and name##_destroy is a no-op for them. The same goes
+for cstring_array, string_tree and string_tree_iterator through their
+*_arena constructors in string_utils.h: arena-backed objects are released
+by arena_reset, their *_destroy functions are no-ops, and they must not
+escape the arena (so no char_array_to_string or cstring_array_to_strings
+on them).
+*/
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#define ARENA_DEFAULT_BLOCK_SIZE (64 * 1024)
+
+typedef struct arena_block {
+    struct arena_block *next;
+    size_t size;
+    size_t used;
+    char *data;
+} arena_block_t;
+
+typedef struct arena {
+    arena_block_t *blocks;
+    arena_block_t *current;
+    // Allocations larger than block_size get a block of their own
+    arena_block_t *large_blocks;
+    size_t block_size;
+    // Most recent allocation and its block, can be grown in place
+    void *last;
+    arena_block_t *last_block;
+} arena_t;
+
+// block_size == 0 means ARENA_DEFAULT_BLOCK_SIZE
+arena_t *arena_new(size_t block_size);
+
+void *arena_alloc(arena_t *self, size_t size);
+void *arena_calloc(arena_t *self, size_t n, size_t size);
+void *arena_realloc(arena_t *self, void *ptr, size_t old_size, size_t new_size);
+
+char *arena_strdup(arena_t *self, const char *str);
+char *arena_strndup(arena_t *self, const char *str, size_t len);
+
+// Total bytes of block memory held by the arena
+size_t arena_capacity(arena_t *self);
+
+// Releases all allocations. Regular blocks are kept for reuse, large ones are freed.
+void arena_reset(arena_t *self);
+
+void arena_destroy(arena_t *self);
+
+#endif
@@ -1,39 +1,277 @@
+#include <math.h>
+
 #include "averaged_perceptron.h"
+#include "data_bundle.h"
+#include "features.h"
+#include "log/log.h"
 
-#define PERCEPTRON_SIGNATURE 0xCBCBCBCB
+// Dense and int16 weights are read and converted in blocks of this many values
+#define PERCEPTRON_DENSE_READ_BLOCK_SIZE 65536
 
 static inline bool averaged_perceptron_get_feature_id(averaged_perceptron_t *self, char *feature, uint32_t *feature_id) {
+    if (self->feature_index != NULL) {
+        return feature_index_get(self->feature_index, feature, feature_id);
+    }
     return trie_get_data(self->features, feature, feature_id);
 }
 
-inline double_array *averaged_perceptron_predict_scores(averaged_perceptron_t *self, cstring_array *features) {
-    if (self->scores == NULL || self->scores->n == 0) self->scores = double_array_new_zeros((size_t)self->num_classes);
+static inline bool averaged_perceptron_get_feature_hash_id(averaged_perceptron_t *self, uint64_t hash, uint32_t *feature_id) {
+    if (self->feature_index != NULL) {
+        return feature_index_get_hash(self->feature_index, hash, feature_id);
+    }
 
-    double_array_set(self->scores->a, self->scores->n, 0.0);
+    khiter_t k = kh_get(int64_uint32, self->feature_hashes, hash);
+    if (k == kh_end(self->feature_hashes)) {
+        return false;
+    }
 
-    double *scores = self->scores->a;
+    *feature_id = kh_value(self->feature_hashes, k);
+    return true;
+}
 
-    uint32_t i = 0;
-    char *feature;
-    uint32_t feature_id;
+static bool averaged_perceptron_has_weights(averaged_perceptron_t *self) {
+    switch (self->layout) {
+        case AVERAGED_PERCEPTRON_LAYOUT_SPARSE:
+            return self->weights != NULL && self->weights->indptr->n >= (size_t)self->num_features + 1;
+        case AVERAGED_PERCEPTRON_LAYOUT_DENSE:
+            return self->dense_weights != NULL;
+        case AVERAGED_PERCEPTRON_LAYOUT_INT8:
+            return self->int8_weights != NULL && self->class_scales != NULL;
+        case AVERAGED_PERCEPTRON_LAYOUT_INT16:
+            return self->int16_weights != NULL && self->class_scales != NULL;
+    }
+    return false;
+}
+
+// Writes the weights of one feature for every class to row (num_classes values), in any layout
+static bool averaged_perceptron_get_row(averaged_perceptron_t *self, uint32_t feature_id, double *row) {
+    uint32_t num_classes = self->num_classes;
+    size_t offset = (size_t)feature_id * self->row_width;
+
+    switch (self->layout) {
+        case AVERAGED_PERCEPTRON_LAYOUT_SPARSE: {
+            uint32_t *indptr = self->weights->indptr->a;
+            uint32_t *indices = self->weights->indices->a;
+            double *data = self->weights->data->a;
+
+            double_array_set(row, num_classes, 0.0);
+            for (uint32_t col = indptr[feature_id]; col < indptr[feature_id + 1]; col++) {
+                uint32_t class_id = indices[col];
+                if (class_id >= num_classes) return false;
+                row[class_id] = data[col];
+            }
+            return true;
+        }
+        case AVERAGED_PERCEPTRON_LAYOUT_DENSE: {
+            float *values = self->dense_weights->a + offset;
+            for (uint32_t class_id = 0; class_id < num_classes; class_id++) {
+                row[class_id] = (double)values[class_id];
+            }
+            return true;
+        }
+        case AVERAGED_PERCEPTRON_LAYOUT_INT8: {
+            int8_t *values = self->int8_weights->a + offset;
+            float *class_scales = self->class_scales->a;
+            for (uint32_t class_id = 0; class_id < num_classes; class_id++) {
+                row[class_id] = (double)values[class_id] * (double)class_scales[class_id];
+            }
+            return true;
+        }
+        case AVERAGED_PERCEPTRON_LAYOUT_INT16: {
+            int16_t *values = self->int16_weights->a + offset;
+            float *class_scales = self->class_scales->a;
+            for (uint32_t class_id = 0; class_id < num_classes; class_id++) {
+                row[class_id] = (double)values[class_id] * (double)class_scales[class_id];
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+// Frees the weights of the current layout
+static void averaged_perceptron_destroy_weights(averaged_perceptron_t *self) {
+    if (self->weights != NULL) {
+        sparse_matrix_destroy(self->weights);
+        self->weights = NULL;
+    }
+
+    if (self->dense_weights != NULL) {
+        float_array_destroy(self->dense_weights);
+        self->dense_weights = NULL;
+    }
+
+    if (self->int8_weights != NULL) {
+        int8_array_destroy(self->int8_weights);
+        self->int8_weights = NULL;
+    }
+
+    if (self->int16_weights != NULL) {
+        int16_array_destroy(self->int16_weights);
+        self->int16_weights = NULL;
+    }
+
+    if (self->class_scales != NULL) {
+        float_array_destroy(self->class_scales);
+        self->class_scales = NULL;
+    }
+}
+
+static inline void averaged_perceptron_reset_scores(averaged_perceptron_t *self, double_array *scores) {
+    size_t num_classes = (size_t)self->num_classes;
+    if (scores->m < num_classes) {
+        double_array_resize(scores, num_classes);
+    }
+    scores->n = num_classes;
+    double_array_set(scores->a, scores->n, 0.0);
+}
+
+// Feature ids are resolved in batches so the dense kernels see many rows per call
+#define AVERAGED_PERCEPTRON_ROW_BATCH_SIZE 64
+
+/*
+Dense rows are summed into float sums, quantized rows into int32 sums. At
+most 2^31 / INT16_MAX = 65536 int16 rows can be added before the int32 sums
+could overflow, far more than the features of one prediction.
+*/
+static inline void averaged_perceptron_add_rows(averaged_perceptron_t *self, uint32_t *feature_ids, size_t num_ids, double *scores, float *sums, int32_t *int_sums) {
+    if (num_ids == 0) return;
+
+    switch (self->layout) {
+        case AVERAGED_PERCEPTRON_LAYOUT_DENSE:
+            self->rows_sum(self->dense_weights->a, self->row_width, feature_ids, num_ids, sums);
+            return;
+        case AVERAGED_PERCEPTRON_LAYOUT_INT8:
+            self->int8_rows_sum(self->int8_weights->a, self->row_width, feature_ids, num_ids, int_sums);
+            return;
+        case AVERAGED_PERCEPTRON_LAYOUT_INT16:
+            self->int16_rows_sum(self->int16_weights->a, self->row_width, feature_ids, num_ids, int_sums);
+            return;
+        default:
+            break;
+    }
 
     uint32_t *indptr = self->weights->indptr->a;
     uint32_t *indices = self->weights->indices->a;
     double *data = self->weights->data->a;
 
+    for (size_t i = 0; i < num_ids; i++) {
+        uint32_t feature_id = feature_ids[i];
+        for (int col = indptr[feature_id]; col < indptr[feature_id + 1]; col++) {
+            uint32_t class_id = indices[col];
+            scores[class_id] += data[col];
+        }
+    }
+}
+
+static inline void averaged_perceptron_add_sums(averaged_perceptron_t *self, float *sums, int32_t *int_sums, double *scores) {
+    if (self->layout == AVERAGED_PERCEPTRON_LAYOUT_DENSE) {
+        for (uint32_t i = 0; i < self->num_classes; i++) {
+            scores[i] += (double)sums[i];
+        }
+    } else if (self->layout == AVERAGED_PERCEPTRON_LAYOUT_INT8 || self->layout == AVERAGED_PERCEPTRON_LAYOUT_INT16) {
+        float *class_scales = self->class_scales->a;
+        for (uint32_t i = 0; i < self->num_classes; i++) {
+            scores[i] += (double)int_sums[i] * (double)class_scales[i];
+        }
+    }
+}
+
+/*
+Adds the weights of the given features to scores (num_classes values)
+without resetting them first, e.g. to score some features once and reuse
+the result as the starting point for several predictions.
+*/
+void averaged_perceptron_add_scores(averaged_perceptron_t *self, cstring_array *features, double *scores) {
+    uint32_t i = 0;
+    char *feature;
+    uint32_t feature_id;
+
+    uint32_t feature_ids[AVERAGED_PERCEPTRON_ROW_BATCH_SIZE];
+    size_t num_ids = 0;
+
+    // Only used by the dense and quantized layouts
+    float sums[self->row_width + 1];
+    memset(sums, 0, sizeof(sums));
+    int32_t int_sums[self->row_width + 1];
+    memset(int_sums, 0, sizeof(int_sums));
+
     cstring_array_foreach(features, i, feature, {
         if (!averaged_perceptron_get_feature_id(self, feature, &feature_id)) {
             continue;
         }
 
-        for (int col = indptr[feature_id]; col < indptr[feature_id + 1]; col++) {
-            uint32_t class_id = indices[col];
-            scores[class_id] += data[col];
+        feature_ids[num_ids++] = feature_id;
+        if (num_ids == AVERAGED_PERCEPTRON_ROW_BATCH_SIZE) {
+            averaged_perceptron_add_rows(self, feature_ids, num_ids, scores, sums, int_sums);
+            num_ids = 0;
         }
-
     })
 
-    return self->scores;   
+    averaged_perceptron_add_rows(self, feature_ids, num_ids, scores, sums, int_sums);
+    averaged_perceptron_add_sums(self, sums, int_sums, scores);
+}
+
+// Same for features given by their hashes, requires averaged_perceptron_build_feature_hashes
+void averaged_perceptron_add_scores_hashes(averaged_perceptron_t *self, uint64_array *feature_hashes, double *scores) {
+    uint32_t feature_id;
+
+    uint32_t feature_ids[AVERAGED_PERCEPTRON_ROW_BATCH_SIZE];
+    size_t num_ids = 0;
+
+    float sums[self->row_width + 1];
+    memset(sums, 0, sizeof(sums));
+    int32_t int_sums[self->row_width + 1];
+    memset(int_sums, 0, sizeof(int_sums));
+
+    for (size_t i = 0; i < feature_hashes->n; i++) {
+        if (!averaged_perceptron_get_feature_hash_id(self, feature_hashes->a[i], &feature_id)) {
+            continue;
+        }
+
+        feature_ids[num_ids++] = feature_id;
+        if (num_ids == AVERAGED_PERCEPTRON_ROW_BATCH_SIZE) {
+            averaged_perceptron_add_rows(self, feature_ids, num_ids, scores, sums, int_sums);
+            num_ids = 0;
+        }
+    }
+
+    averaged_perceptron_add_rows(self, feature_ids, num_ids, scores, sums, int_sums);
+    averaged_perceptron_add_sums(self, sums, int_sums, scores);
+}
+
+/*
+Reentrant version of averaged_perceptron_predict_scores. The model is only
+read, scores are accumulated into a caller-owned buffer which is resized to
+num_classes as needed, so multiple threads can share one model as long as
+each uses its own buffer.
+*/
+double_array *averaged_perceptron_predict_scores_r(averaged_perceptron_t *self, cstring_array *features, double_array *scores) {
+    if (scores == NULL) return NULL;
+
+    averaged_perceptron_reset_scores(self, scores);
+    averaged_perceptron_add_scores(self, features, scores->a);
+
+    return scores;
+}
+
+/*
+Same as averaged_perceptron_predict_scores_r for features given by their
+hashes (see feature_hashes_add). Requires averaged_perceptron_build_feature_hashes.
+*/
+double_array *averaged_perceptron_predict_scores_hashes_r(averaged_perceptron_t *self, uint64_array *feature_hashes, double_array *scores) {
+    if (scores == NULL || (self->feature_hashes == NULL && self->feature_index == NULL)) return NULL;
+
+    averaged_perceptron_reset_scores(self, scores);
+    averaged_perceptron_add_scores_hashes(self, feature_hashes, scores->a);
+
+    return scores;
+}
+
+inline double_array *averaged_perceptron_predict_scores(averaged_perceptron_t *self, cstring_array *features) {
+    if (self->scores == NULL) self->scores = double_array_new_zeros((size_t)self->num_classes);
+
+    return averaged_perceptron_predict_scores_r(self, features, self->scores);
 }
 
 inline double_array *averaged_perceptron_predict_scores_counts(averaged_perceptron_t *self, khash_t(str_uint32) *feature_counts) {
@@ -48,6 +286,23 @@ inline double_array *averaged_perceptron_predict_scores_counts(averaged_perceptr
     uint32_t count;
     uint32_t feature_id;
 
+    if (self->layout != AVERAGED_PERCEPTRON_LAYOUT_SPARSE) {
+        double row[self->num_classes];
+
+        kh_foreach(feature_counts, feature, count, {
+            if (!averaged_perceptron_get_feature_id(self, (char *)feature, &feature_id) ||
+                !averaged_perceptron_get_row(self, feature_id, row)) {
+                continue;
+            }
+
+            for (uint32_t class_id = 0; class_id < self->num_classes; class_id++) {
+                scores[class_id] += row[class_id] * (double)count;
+            }
+        })
+
+        return self->scores;
+    }
+
     uint32_t *indptr = self->weights->indptr->a;
     uint32_t *indices = self->weights->indices->a;
     double *data = self->weights->data->a;
@@ -67,6 +322,24 @@ inline double_array *averaged_perceptron_predict_scores_counts(averaged_perceptr
 }
 
 
+inline uint32_t averaged_perceptron_predict_r(averaged_perceptron_t *self, cstring_array *features, double_array *scores) {
+    scores = averaged_perceptron_predict_scores_r(self, features, scores);
+    if (scores == NULL) return 0;
+
+    int64_t max_score = double_array_argmax(scores->a, scores->n);
+
+    return (uint32_t)max_score;
+}
+
+inline uint32_t averaged_perceptron_predict_hashes_r(averaged_perceptron_t *self, uint64_array *feature_hashes, double_array *scores) {
+    scores = averaged_perceptron_predict_scores_hashes_r(self, feature_hashes, scores);
+    if (scores == NULL) return 0;
+
+    int64_t max_score = double_array_argmax(scores->a, scores->n);
+
+    return (uint32_t)max_score;
+}
+
 inline uint32_t averaged_perceptron_predict(averaged_perceptron_t *self, cstring_array *features) {
     double_array *scores = averaged_perceptron_predict_scores(self, features);
 
@@ -84,26 +357,544 @@ inline uint32_t averaged_perceptron_predict_counts(averaged_perceptron_t *self,
     return (uint32_t)max_score;
 }
 
+static void averaged_perceptron_add_feature_hash(char *feature, uint32_t feature_id, void *arg) {
+    khash_t(int64_uint32) *hashes = (khash_t(int64_uint32) *)arg;
+
+    int ret;
+    khiter_t k = kh_put(int64_uint32, hashes, feature_hash_string(feature), &ret);
+    if (ret > 0) {
+        kh_value(hashes, k) = feature_id;
+    }
+}
+
+bool averaged_perceptron_build_feature_hashes(averaged_perceptron_t *self) {
+    if (self == NULL) return false;
+    // The feature index already looks up features by hash
+    if (self->feature_hashes != NULL || self->feature_index != NULL) return true;
+    if (self->features == NULL) return false;
+
+    khash_t(int64_uint32) *hashes = kh_init(int64_uint32);
+    if (hashes == NULL) return false;
+
+    if (kh_resize(int64_uint32, hashes, trie_num_keys(self->features)) < 0) {
+        kh_destroy(int64_uint32, hashes);
+        return false;
+    }
+
+    trie_foreach_key(self->features, averaged_perceptron_add_feature_hash, hashes);
+
+    self->feature_hashes = hashes;
+    return true;
+}
+
+static inline uint32_t averaged_perceptron_dense_row_width(uint32_t num_classes) {
+    uint32_t multiple = AVERAGED_PERCEPTRON_KERNEL_ROW_MULTIPLE;
+    return (num_classes + multiple - 1) / multiple * multiple;
+}
+
+static float_array *averaged_perceptron_dense_weights_new(uint32_t num_features, uint32_t row_width) {
+    size_t size = (size_t)num_features * row_width;
+    float_array *weights = float_array_new_aligned(size > 0 ? size : 1, AVERAGED_PERCEPTRON_KERNEL_ALIGNMENT);
+    if (weights == NULL) return NULL;
+    weights->n = size;
+    float_array_zero(weights->a, size);
+    return weights;
+}
+
+static int8_array *averaged_perceptron_int8_weights_new(uint32_t num_features, uint32_t row_width) {
+    size_t size = (size_t)num_features * row_width;
+    int8_array *weights = int8_array_new_aligned(size > 0 ? size : 1, AVERAGED_PERCEPTRON_KERNEL_ALIGNMENT);
+    if (weights == NULL) return NULL;
+    weights->n = size;
+    memset(weights->a, 0, size * sizeof(int8_t));
+    return weights;
+}
+
+static int16_array *averaged_perceptron_int16_weights_new(uint32_t num_features, uint32_t row_width) {
+    size_t size = (size_t)num_features * row_width;
+    int16_array *weights = int16_array_new_aligned(size > 0 ? size : 1, AVERAGED_PERCEPTRON_KERNEL_ALIGNMENT);
+    if (weights == NULL) return NULL;
+    weights->n = size;
+    memset(weights->a, 0, size * sizeof(int16_t));
+    return weights;
+}
+
+bool averaged_perceptron_to_dense(averaged_perceptron_t *self) {
+    if (self == NULL) return false;
+    if (self->layout == AVERAGED_PERCEPTRON_LAYOUT_DENSE) return true;
+    if (!averaged_perceptron_has_weights(self)) return false;
+
+    uint32_t row_width = averaged_perceptron_dense_row_width(self->num_classes);
+
+    float_array *dense_weights = averaged_perceptron_dense_weights_new(self->num_features, row_width);
+    if (dense_weights == NULL) return false;
+
+    double row[self->num_classes];
+
+    for (uint32_t feature_id = 0; feature_id < self->num_features; feature_id++) {
+        if (!averaged_perceptron_get_row(self, feature_id, row)) {
+            float_array_destroy(dense_weights);
+            return false;
+        }
+
+        float *values = dense_weights->a + (size_t)feature_id * row_width;
+        for (uint32_t class_id = 0; class_id < self->num_classes; class_id++) {
+            values[class_id] = (float)row[class_id];
+        }
+    }
+
+    averaged_perceptron_destroy_weights(self);
+
+    self->dense_weights = dense_weights;
+    self->row_width = row_width;
+    self->rows_sum = float_rows_sum_function_select();
+    self->layout = AVERAGED_PERCEPTRON_LAYOUT_DENSE;
+
+    return true;
+}
+
+/*
+Symmetric linear quantization with one scale per class: the scale of class c
+is max_f |w[f][c]| / max_value so every weight of the class fits in the
+integer range, and q[f][c] = round(w[f][c] / scale). Scales per class rather
+than per feature keep the scale out of the inner loop, the integer rows are
+summed as is and each class score is multiplied by its scale once.
+*/
+bool averaged_perceptron_quantize(averaged_perceptron_t *self, uint32_t bits) {
+    if (self == NULL || (bits != 8 && bits != 16)) return false;
+
+    averaged_perceptron_layout_t layout = bits == 8 ? AVERAGED_PERCEPTRON_LAYOUT_INT8 : AVERAGED_PERCEPTRON_LAYOUT_INT16;
+    if (self->layout == layout) return true;
+    if (!averaged_perceptron_has_weights(self)) return false;
+
+    uint32_t num_features = self->num_features;
+    uint32_t num_classes = self->num_classes;
+    uint32_t row_width = averaged_perceptron_dense_row_width(num_classes);
+    double max_value = bits == 8 ? (double)INT8_MAX : (double)INT16_MAX;
+
+    double row[num_classes];
+    double max_weights[num_classes];
+    double_array_set(max_weights, num_classes, 0.0);
+
+    for (uint32_t feature_id = 0; feature_id < num_features; feature_id++) {
+        if (!averaged_perceptron_get_row(self, feature_id, row)) {
+            return false;
+        }
+
+        for (uint32_t class_id = 0; class_id < num_classes; class_id++) {
+            double weight = fabs(row[class_id]);
+            if (weight > max_weights[class_id]) {
+                max_weights[class_id] = weight;
+            }
+        }
+    }
+
+    float_array *class_scales = float_array_new_size(num_classes);
+    if (class_scales == NULL) return false;
+    class_scales->n = num_classes;
+
+    for (uint32_t class_id = 0; class_id < num_classes; class_id++) {
+        class_scales->a[class_id] = max_weights[class_id] > 0.0 ? (float)(max_weights[class_id] / max_value) : 1.0f;
+    }
+
+    int8_array *int8_weights = NULL;
+    int16_array *int16_weights = NULL;
+
+    if (bits == 8) {
+        int8_weights = averaged_perceptron_int8_weights_new(num_features, row_width);
+    } else {
+        int16_weights = averaged_perceptron_int16_weights_new(num_features, row_width);
+    }
+
+    if (int8_weights == NULL && int16_weights == NULL) {
+        float_array_destroy(class_scales);
+        return false;
+    }
+
+    for (uint32_t feature_id = 0; feature_id < num_features; feature_id++) {
+        if (!averaged_perceptron_get_row(self, feature_id, row)) {
+            float_array_destroy(class_scales);
+            int8_array_destroy(int8_weights);
+            int16_array_destroy(int16_weights);
+            return false;
+        }
+
+        size_t offset = (size_t)feature_id * row_width;
+        for (uint32_t class_id = 0; class_id < num_classes; class_id++) {
+            double value = round(row[class_id] / (double)class_scales->a[class_id]);
+            // The float scale may round down slightly, keep the extremes in range
+            if (value > max_value) {
+                value = max_value;
+            } else if (value < -max_value) {
+                value = -max_value;
+            }
+
+            if (int8_weights != NULL) {
+                int8_weights->a[offset + class_id] = (int8_t)value;
+            } else {
+                int16_weights->a[offset + class_id] = (int16_t)value;
+            }
+        }
+    }
+
+    averaged_perceptron_destroy_weights(self);
+
+    self->int8_weights = int8_weights;
+    self->int16_weights = int16_weights;
+    self->class_scales = class_scales;
+    self->row_width = row_width;
+    if (bits == 8) {
+        self->int8_rows_sum = int8_rows_sum_function_select();
+    } else {
+        self->int16_rows_sum = int16_rows_sum_function_select();
+    }
+    self->layout = layout;
+
+    return true;
+}
+
+#define PRUNED_FEATURE_ID UINT32_MAX
+
+typedef struct averaged_perceptron_prune_keys {
+    trie_t *features;
+    uint32_t *feature_map;
+    uint32_t num_features;
+    bool success;
+} averaged_perceptron_prune_keys_t;
+
+static void averaged_perceptron_prune_add_key(char *feature, uint32_t feature_id, void *arg) {
+    averaged_perceptron_prune_keys_t *keys = (averaged_perceptron_prune_keys_t *)arg;
+    if (!keys->success || feature_id >= keys->num_features) return;
+
+    uint32_t new_id = keys->feature_map[feature_id];
+    if (new_id == PRUNED_FEATURE_ID) return;
+
+    if (!trie_add(keys->features, feature, new_id)) {
+        keys->success = false;
+    }
+}
+
+/*
+Drops features from a sparse model: features with no nonzero weights or
+whose largest absolute weight is below min_weight, then if more than
+max_features remain, all but the max_features with the largest L1 norms
+(max_features = 0 keeps them all). The remaining features keep their
+relative order and are renumbered, the trie and CSR matrix are rebuilt.
+*/
+bool averaged_perceptron_prune(averaged_perceptron_t *self, double min_weight, uint32_t max_features) {
+    if (self == NULL || self->features == NULL ||
+        self->layout != AVERAGED_PERCEPTRON_LAYOUT_SPARSE ||
+        !averaged_perceptron_has_weights(self)) {
+        return false;
+    }
+
+    uint32_t num_features = self->num_features;
+    sparse_matrix_t *weights = self->weights;
+    uint32_t *indptr = weights->indptr->a;
+    uint32_t *indices = weights->indices->a;
+    double *data = weights->data->a;
+
+    bool success = false;
+    trie_t *features = NULL;
+    sparse_matrix_t *pruned_weights = NULL;
+    size_t *sorted_features = NULL;
+
+    size_t size = num_features > 0 ? num_features : 1;
+    double *l1_norms = malloc(sizeof(double) * size);
+    uint32_t *feature_map = malloc(sizeof(uint32_t) * size);
+    if (l1_norms == NULL || feature_map == NULL) {
+        goto exit_prune;
+    }
+
+    uint32_t num_kept = 0;
+
+    for (uint32_t feature_id = 0; feature_id < num_features; feature_id++) {
+        double max_weight = 0.0;
+        double l1_norm = 0.0;
+        for (uint32_t col = indptr[feature_id]; col < indptr[feature_id + 1]; col++) {
+            double weight = fabs(data[col]);
+            if (weight > max_weight) {
+                max_weight = weight;
+            }
+            l1_norm += weight;
+        }
+
+        if (max_weight > 0.0 && max_weight >= min_weight) {
+            feature_map[feature_id] = 0;
+            l1_norms[feature_id] = l1_norm;
+            num_kept++;
+        } else {
+            feature_map[feature_id] = PRUNED_FEATURE_ID;
+            // Sorts before every kept feature
+            l1_norms[feature_id] = -1.0;
+        }
+    }
+
+    if (max_features > 0 && num_kept > max_features) {
+        sorted_features = double_array_argsort(l1_norms, num_features);
+        if (sorted_features == NULL) {
+            goto exit_prune;
+        }
+
+        for (uint32_t i = 0; i < num_features - max_features; i++) {
+            feature_map[sorted_features[i]] = PRUNED_FEATURE_ID;
+        }
+    }
+
+    pruned_weights = sparse_matrix_new_shape(0, weights->n);
+    if (pruned_weights == NULL) {
+        goto exit_prune;
+    }
+
+    uint32_t new_id = 0;
+
+    for (uint32_t feature_id = 0; feature_id < num_features; feature_id++) {
+        if (feature_map[feature_id] == PRUNED_FEATURE_ID) continue;
+
+        feature_map[feature_id] = new_id++;
+        for (uint32_t col = indptr[feature_id]; col < indptr[feature_id + 1]; col++) {
+            sparse_matrix_append(pruned_weights, indices[col], data[col]);
+        }
+        sparse_matrix_finalize_row(pruned_weights);
+    }
+
+    features = trie_new();
+    if (features == NULL) {
+        goto exit_prune;
+    }
+
+    averaged_perceptron_prune_keys_t keys = (averaged_perceptron_prune_keys_t){
+        .features = features,
+        .feature_map = feature_map,
+        .num_features = num_features,
+        .success = true
+    };
+
+    trie_foreach_key(self->features, averaged_perceptron_prune_add_key, &keys);
+
+    if (!keys.success || trie_num_keys(features) != new_id) {
+        goto exit_prune;
+    }
+
+    trie_destroy(self->features);
+    self->features = features;
+    features = NULL;
+
+    sparse_matrix_destroy(self->weights);
+    self->weights = pruned_weights;
+    pruned_weights = NULL;
+
+    self->num_features = new_id;
+
+    // Feature ids have changed, a stale index is dropped and rebuilt on save
+    if (self->feature_index != NULL) {
+        feature_index_destroy(self->feature_index);
+        self->feature_index = NULL;
+    }
+
+    if (self->feature_hashes != NULL) {
+        kh_destroy(int64_uint32, self->feature_hashes);
+        self->feature_hashes = NULL;
+        averaged_perceptron_build_feature_hashes(self);
+    }
+
+    success = true;
+
+exit_prune:
+    if (features != NULL) {
+        trie_destroy(features);
+    }
+
+    if (pruned_weights != NULL) {
+        sparse_matrix_destroy(pruned_weights);
+    }
+
+    free(sorted_features);
+    free(l1_norms);
+    free(feature_map);
+
+    return success;
+}
+
+size_t averaged_perceptron_weights_size(averaged_perceptron_t *self) {
+    if (self == NULL) return 0;
+
+    if (!averaged_perceptron_has_weights(self)) return 0;
+
+    if (self->layout == AVERAGED_PERCEPTRON_LAYOUT_DENSE) {
+        return self->dense_weights->n * sizeof(float);
+    } else if (self->layout == AVERAGED_PERCEPTRON_LAYOUT_INT8) {
+        return self->int8_weights->n * sizeof(int8_t) + self->class_scales->n * sizeof(float);
+    } else if (self->layout == AVERAGED_PERCEPTRON_LAYOUT_INT16) {
+        return self->int16_weights->n * sizeof(int16_t) + self->class_scales->n * sizeof(float);
+    } else {
+        return self->weights->indptr->n * sizeof(uint32_t) +
+               self->weights->indices->n * sizeof(uint32_t) +
+               self->weights->data->n * sizeof(double);
+    }
+
+    return 0;
+}
+
+static bool averaged_perceptron_read_dense_weights(averaged_perceptron_t *self, FILE *f) {
+    if (!file_read_uint32(f, &self->row_width) ||
+        self->row_width < self->num_classes ||
+        self->row_width % AVERAGED_PERCEPTRON_KERNEL_ROW_MULTIPLE != 0) {
+        return false;
+    }
+
+    self->dense_weights = averaged_perceptron_dense_weights_new(self->num_features, self->row_width);
+    if (self->dense_weights == NULL) {
+        return false;
+    }
+
+    float *values = self->dense_weights->a;
+    size_t size = self->dense_weights->n;
+
+    for (size_t offset = 0; offset < size; offset += PERCEPTRON_DENSE_READ_BLOCK_SIZE) {
+        size_t block_size = size - offset < PERCEPTRON_DENSE_READ_BLOCK_SIZE ? size - offset : PERCEPTRON_DENSE_READ_BLOCK_SIZE;
+        if (!file_read_float_array(f, values + offset, block_size)) {
+            return false;
+        }
+    }
+
+    self->rows_sum = float_rows_sum_function_select();
+    self->layout = AVERAGED_PERCEPTRON_LAYOUT_DENSE;
+
+    return true;
+}
+
+static bool averaged_perceptron_write_dense_weights(averaged_perceptron_t *self, FILE *f) {
+    if (!file_write_uint32(f, self->row_width)) {
+        return false;
+    }
+
+    float *values = self->dense_weights->a;
+    for (size_t i = 0; i < self->dense_weights->n; i++) {
+        if (!file_write_float(f, values[i])) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/*
+Quantized weights are stored as: bits, row_width, num_classes float scales,
+then num_features * row_width weights, raw bytes for int8 and big-endian
+for int16.
+*/
+static bool averaged_perceptron_read_quantized_weights(averaged_perceptron_t *self, FILE *f) {
+    uint32_t bits;
+    if (!file_read_uint32(f, &bits) ||
+        (bits != 8 && bits != 16) ||
+        !file_read_uint32(f, &self->row_width) ||
+        self->row_width < self->num_classes ||
+        self->row_width % AVERAGED_PERCEPTRON_KERNEL_ROW_MULTIPLE != 0) {
+        return false;
+    }
+
+    self->class_scales = float_array_new_size(self->num_classes);
+    if (self->class_scales == NULL ||
+        !file_read_float_array(f, self->class_scales->a, self->num_classes)) {
+        return false;
+    }
+    self->class_scales->n = self->num_classes;
+
+    if (bits == 8) {
+        self->int8_weights = averaged_perceptron_int8_weights_new(self->num_features, self->row_width);
+        if (self->int8_weights == NULL ||
+            !file_read_chars(f, (char *)self->int8_weights->a, self->int8_weights->n)) {
+            return false;
+        }
+
+        self->int8_rows_sum = int8_rows_sum_function_select();
+        self->layout = AVERAGED_PERCEPTRON_LAYOUT_INT8;
+        return true;
+    }
+
+    self->int16_weights = averaged_perceptron_int16_weights_new(self->num_features, self->row_width);
+    if (self->int16_weights == NULL) {
+        return false;
+    }
+
+    uint16_t *values = (uint16_t *)self->int16_weights->a;
+    size_t size = self->int16_weights->n;
+
+    for (size_t offset = 0; offset < size; offset += PERCEPTRON_DENSE_READ_BLOCK_SIZE) {
+        size_t block_size = size - offset < PERCEPTRON_DENSE_READ_BLOCK_SIZE ? size - offset : PERCEPTRON_DENSE_READ_BLOCK_SIZE;
+        if (!file_read_uint16_array(f, values + offset, block_size)) {
+            return false;
+        }
+    }
+
+    self->int16_rows_sum = int16_rows_sum_function_select();
+    self->layout = AVERAGED_PERCEPTRON_LAYOUT_INT16;
+    return true;
+}
+
+static bool averaged_perceptron_write_quantized_weights(averaged_perceptron_t *self, FILE *f) {
+    bool int8 = self->layout == AVERAGED_PERCEPTRON_LAYOUT_INT8;
+
+    if (!file_write_uint32(f, int8 ? 8 : 16) ||
+        !file_write_uint32(f, self->row_width)) {
+        return false;
+    }
+
+    for (size_t i = 0; i < self->class_scales->n; i++) {
+        if (!file_write_float(f, self->class_scales->a[i])) {
+            return false;
+        }
+    }
+
+    if (int8) {
+        return file_write_chars(f, (const char *)self->int8_weights->a, self->int8_weights->n);
+    }
+
+    int16_t *values = self->int16_weights->a;
+    for (size_t i = 0; i < self->int16_weights->n; i++) {
+        if (!file_write_uint16(f, (uint16_t)values[i])) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
 averaged_perceptron_t *averaged_perceptron_read(FILE *f) {
     if (f == NULL) return NULL;
 
     uint32_t signature;
 
-    if (!file_read_uint32(f, &signature) || signature != PERCEPTRON_SIGNATURE) {
+    if (!file_read_uint32(f, &signature) ||
+        (signature != PERCEPTRON_SIGNATURE &&
+         signature != PERCEPTRON_DENSE_SIGNATURE &&
+         signature != PERCEPTRON_QUANTIZED_SIGNATURE)) {
         return NULL;
     }
 
-    averaged_perceptron_t *perceptron = malloc(sizeof(averaged_perceptron_t));
+    averaged_perceptron_t *perceptron = calloc(1, sizeof(averaged_perceptron_t));
+    if (perceptron == NULL) return NULL;
 
     if (!file_read_uint32(f, &perceptron->num_features) ||
         !file_read_uint32(f, &perceptron->num_classes) ||
         perceptron->num_classes == 0) {
-        return NULL;
+        goto exit_perceptron_created;
     }
 
-    perceptron->weights = sparse_matrix_read(f);
-    if (perceptron->weights == NULL) {
-        goto exit_perceptron_created;
+    if (signature == PERCEPTRON_DENSE_SIGNATURE) {
+        if (!averaged_perceptron_read_dense_weights(perceptron, f)) {
+            goto exit_perceptron_created;
+        }
+    } else if (signature == PERCEPTRON_QUANTIZED_SIGNATURE) {
+        if (!averaged_perceptron_read_quantized_weights(perceptron, f)) {
+            goto exit_perceptron_created;
+        }
+    } else {
+        perceptron->weights = sparse_matrix_read(f);
+        if (perceptron->weights == NULL) {
+            goto exit_perceptron_created;
+        }
     }
 
     perceptron->scores = double_array_new_zeros((size_t)perceptron->num_classes);
@@ -138,6 +929,9 @@ averaged_perceptron_t *averaged_perceptron_read(FILE *f) {
         goto exit_perceptron_created;
     }
 
+    // Optional, older models end with the trie
+    perceptron->feature_index = feature_index_read(f);
+
     return perceptron;
 
 exit_perceptron_created:
@@ -147,7 +941,7 @@ exit_perceptron_created:
 
 averaged_perceptron_t *averaged_perceptron_load(char *filename) {
     if (filename == NULL) return NULL;
-    FILE *f = fopen(filename, "rb");
+    FILE *f = data_bundle_fopen(filename);
     if (f == NULL) return NULL;
     averaged_perceptron_t *perceptron = averaged_perceptron_read(f);
     fclose(f);
@@ -155,18 +949,36 @@ averaged_perceptron_t *averaged_perceptron_load(char *filename) {
 }
 
 bool averaged_perceptron_write(averaged_perceptron_t *self, FILE *f) {
-    if (self == NULL || f == NULL || self->weights == NULL || self->classes == NULL ||
-        self->features == NULL) {
+    if (self == NULL || f == NULL || self->classes == NULL || self->features == NULL) {
         return false;
     }
 
-    if (!file_write_uint32(f, PERCEPTRON_SIGNATURE) ||
+    if (!averaged_perceptron_has_weights(self)) {
+        return false;
+    }
+
+    uint32_t signature = PERCEPTRON_SIGNATURE;
+    if (self->layout == AVERAGED_PERCEPTRON_LAYOUT_DENSE) {
+        signature = PERCEPTRON_DENSE_SIGNATURE;
+    } else if (self->layout == AVERAGED_PERCEPTRON_LAYOUT_INT8 || self->layout == AVERAGED_PERCEPTRON_LAYOUT_INT16) {
+        signature = PERCEPTRON_QUANTIZED_SIGNATURE;
+    }
+
+    if (!file_write_uint32(f, signature) ||
         !file_write_uint32(f, self->num_features) ||
         !file_write_uint32(f, self->num_classes)) {
         return false;
     }
 
-    if (!sparse_matrix_write(self->weights, f)) {
+    if (signature == PERCEPTRON_DENSE_SIGNATURE) {
+        if (!averaged_perceptron_write_dense_weights(self, f)) {
+            return false;
+        }
+    } else if (signature == PERCEPTRON_QUANTIZED_SIGNATURE) {
+        if (!averaged_perceptron_write_quantized_weights(self, f)) {
+            return false;
+        }
+    } else if (!sparse_matrix_write(self->weights, f)) {
         return false;
     }
 
@@ -183,7 +995,23 @@ bool averaged_perceptron_write(averaged_perceptron_t *self, FILE *f) {
         return false;
     }
 
-    return true;
+    // Models are saved with a feature index so lookups at prediction time can skip the trie
+    feature_index_t *feature_index = self->feature_index;
+    if (feature_index == NULL) {
+        feature_index = feature_index_new_from_trie(self->features);
+        if (feature_index == NULL) {
+            log_warn("Could not build feature index, model will use the trie\n");
+            return true;
+        }
+    }
+
+    bool success = feature_index_write(feature_index, f);
+
+    if (feature_index != self->feature_index) {
+        feature_index_destroy(feature_index);
+    }
+
+    return success;
 }
 
 bool averaged_perceptron_save(averaged_perceptron_t *self, char *filename) {
@@ -203,13 +1031,19 @@ void averaged_perceptron_destroy(averaged_perceptron_t *self) {
         trie_destroy(self->features);
     }
 
+    if (self->feature_hashes != NULL) {
+        kh_destroy(int64_uint32, self->feature_hashes);
+    }
+
+    if (self->feature_index != NULL) {
+        feature_index_destroy(self->feature_index);
+    }
+
     if (self->classes != NULL) {
         cstring_array_destroy(self->classes);
     }
 
-    if (self->weights != NULL) {
-        sparse_matrix_destroy(self->weights);
-    }
+    averaged_perceptron_destroy_weights(self);
 
     if (self->scores != NULL) {
         double_array_destroy(self->scores);
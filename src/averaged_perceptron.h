@@ -15,6 +15,47 @@ very little memory.
 
 The weights are stored as a sparse matrix in compressed sparse row format
 (see sparse_matrix.h)
+
+The model itself is read-only at prediction time. The *_r variants of the
+predict functions accumulate scores into a caller-owned buffer so that one
+model can be shared by many threads. The non-reentrant versions use the
+model's own scores buffer.
+
+averaged_perceptron_build_feature_hashes additionally indexes the feature
+ids by the 64-bit hash of each feature name (see features.h), costing
+roughly 26 bytes per feature (12 per bucket at a load factor under 0.77)
+and about a second per million features to build. The *_hashes_r predict
+functions then take feature hashes instead of strings, so callers can skip
+building feature strings and walking the trie for each one. Features whose
+hashes collide (vanishingly unlikely at 64 bits) keep the first id seen.
+
+Models are saved with a minimal perfect hash index of their features (see
+feature_index.h) after the trie. When a model file has one, feature lookups
+by string or by hash go through the index instead of the trie or the hash
+table, and averaged_perceptron_build_feature_hashes has nothing to do.
+
+Weights can be stored in one of four layouts:
+
+- sparse (the default, what training produces): a CSR matrix of doubles,
+  prediction scatters each nonzero into its class score.
+- dense: one float32 row of num_classes weights per feature, padded with
+  zeros to row_width (a multiple of the SIMD width). Prediction sums whole
+  rows with vector adds (see averaged_perceptron_kernels.h), with no
+  indices or branches. It takes 4 * row_width bytes per feature vs. 12
+  bytes per nonzero + 4 per feature for the sparse layout, so it's smaller
+  when the average feature has more than about a third of the classes
+  nonzero.
+
+- int8/int16: like dense but each weight is a signed integer, w[f][c] is
+  approximated by q[f][c] * class_scales[c] with one scale per class chosen
+  so the class's largest weight maps to the largest integer. Rows are
+  summed in int32 and each class score is scaled once per prediction, so
+  scoring never converts individual weights back to floats. Takes 1 or 2
+  bytes per weight, a quarter or half of the dense layout.
+
+averaged_perceptron_to_dense and averaged_perceptron_quantize convert a
+loaded model in place, and averaged_perceptron_write/read store and
+recognize all layouts.
 */
 #ifndef AVERAGED_PERCEPTRON_H
 #define AVERAGED_PERCEPTRON_H
@@ -24,15 +65,45 @@ The weights are stored as a sparse matrix in compressed sparse row format
 #include <stdbool.h>
 
 #include "collections.h"
+#include "averaged_perceptron_kernels.h"
+#include "feature_index.h"
 #include "sparse_matrix.h"
 #include "trie.h"
 
+// File signature of each layout, int8 and int16 share the quantized one
+#define PERCEPTRON_SIGNATURE 0xCBCBCBCB
+#define PERCEPTRON_DENSE_SIGNATURE 0xCBCBCBCC
+#define PERCEPTRON_QUANTIZED_SIGNATURE 0xCBCBCBCD
+
+typedef enum {
+    AVERAGED_PERCEPTRON_LAYOUT_SPARSE,
+    AVERAGED_PERCEPTRON_LAYOUT_DENSE,
+    AVERAGED_PERCEPTRON_LAYOUT_INT8,
+    AVERAGED_PERCEPTRON_LAYOUT_INT16
+} averaged_perceptron_layout_t;
+
 typedef struct averaged_perceptron {
     uint32_t num_features;
     uint32_t num_classes;
+    averaged_perceptron_layout_t layout;
     trie_t *features;
+    // Feature hash => feature id, optional
+    khash_t(int64_uint32) *feature_hashes;
+    // Feature name => feature id, optional, replaces the trie and feature_hashes for lookups
+    feature_index_t *feature_index;
     cstring_array *classes;
+    // Sparse layout
     sparse_matrix_t *weights;
+    // Dense layout, num_features x row_width
+    uint32_t row_width;
+    float_array *dense_weights;
+    float_rows_sum_function rows_sum;
+    // Quantized layouts, num_features x row_width, weight = value * class_scales[class_id]
+    int8_array *int8_weights;
+    int16_array *int16_weights;
+    float_array *class_scales;
+    int8_rows_sum_function int8_rows_sum;
+    int16_rows_sum_function int16_rows_sum;
     double_array *scores;
 } averaged_perceptron_t;
 
@@ -40,11 +111,28 @@ averaged_perceptron_t *averaged_perceptron_read(FILE *f);
 averaged_perceptron_t *averaged_perceptron_load(char *filename);
 
 uint32_t averaged_perceptron_predict(averaged_perceptron_t *self, cstring_array *features);
+uint32_t averaged_perceptron_predict_r(averaged_perceptron_t *self, cstring_array *features, double_array *scores);
+uint32_t averaged_perceptron_predict_hashes_r(averaged_perceptron_t *self, uint64_array *feature_hashes, double_array *scores);
 uint32_t averaged_perceptron_predict_counts(averaged_perceptron_t *self, khash_t(str_uint32) *feature_counts);
 
+void averaged_perceptron_add_scores(averaged_perceptron_t *self, cstring_array *features, double *scores);
+void averaged_perceptron_add_scores_hashes(averaged_perceptron_t *self, uint64_array *feature_hashes, double *scores);
+
 double_array *averaged_perceptron_predict_scores(averaged_perceptron_t *self, cstring_array *features);
+double_array *averaged_perceptron_predict_scores_r(averaged_perceptron_t *self, cstring_array *features, double_array *scores);
+double_array *averaged_perceptron_predict_scores_hashes_r(averaged_perceptron_t *self, uint64_array *feature_hashes, double_array *scores);
 double_array *averaged_perceptron_predict_scores_counts(averaged_perceptron_t *self, khash_t(str_uint32) *feature_counts);
 
+bool averaged_perceptron_build_feature_hashes(averaged_perceptron_t *self);
+
+bool averaged_perceptron_to_dense(averaged_perceptron_t *self);
+// Converts to the int8 or int16 layout, bits must be 8 or 16
+bool averaged_perceptron_quantize(averaged_perceptron_t *self, uint32_t bits);
+bool averaged_perceptron_prune(averaged_perceptron_t *self, double min_weight, uint32_t max_features);
+
+// Bytes used by the weights in the current layout
+size_t averaged_perceptron_weights_size(averaged_perceptron_t *self);
+
 bool averaged_perceptron_write(averaged_perceptron_t *self, FILE *f);
 bool averaged_perceptron_save(averaged_perceptron_t *self, char *filename);
 
@@ -0,0 +1,252 @@
+#include <string.h>
+
+#include "averaged_perceptron_kernels.h"
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define AVERAGED_PERCEPTRON_KERNELS_X86
+#include <immintrin.h>
+#endif
+
+static void float_rows_sum_scalar(const float *weights, size_t row_width, const uint32_t *rows, size_t num_rows, float *sums) {
+    for (size_t i = 0; i < num_rows; i++) {
+        const float *row = weights + (size_t)rows[i] * row_width;
+        for (size_t j = 0; j < row_width; j++) {
+            sums[j] += row[j];
+        }
+    }
+}
+
+static void int8_rows_sum_scalar(const int8_t *weights, size_t row_width, const uint32_t *rows, size_t num_rows, int32_t *sums) {
+    for (size_t i = 0; i < num_rows; i++) {
+        const int8_t *row = weights + (size_t)rows[i] * row_width;
+        for (size_t j = 0; j < row_width; j++) {
+            sums[j] += row[j];
+        }
+    }
+}
+
+static void int16_rows_sum_scalar(const int16_t *weights, size_t row_width, const uint32_t *rows, size_t num_rows, int32_t *sums) {
+    for (size_t i = 0; i < num_rows; i++) {
+        const int16_t *row = weights + (size_t)rows[i] * row_width;
+        for (size_t j = 0; j < row_width; j++) {
+            sums[j] += row[j];
+        }
+    }
+}
+
+#ifdef AVERAGED_PERCEPTRON_KERNELS_X86
+
+__attribute__((target("sse2")))
+static void float_rows_sum_sse2(const float *weights, size_t row_width, const uint32_t *rows, size_t num_rows, float *sums) {
+    for (size_t j = 0; j < row_width; j += 4) {
+        __m128 sum = _mm_loadu_ps(sums + j);
+        for (size_t i = 0; i < num_rows; i++) {
+            const float *row = weights + (size_t)rows[i] * row_width;
+            sum = _mm_add_ps(sum, _mm_loadu_ps(row + j));
+        }
+        _mm_storeu_ps(sums + j, sum);
+    }
+}
+
+__attribute__((target("avx2")))
+static void float_rows_sum_avx2(const float *weights, size_t row_width, const uint32_t *rows, size_t num_rows, float *sums) {
+    size_t j = 0;
+    for (; j + 8 <= row_width; j += 8) {
+        __m256 sum = _mm256_loadu_ps(sums + j);
+        for (size_t i = 0; i < num_rows; i++) {
+            const float *row = weights + (size_t)rows[i] * row_width;
+            sum = _mm256_add_ps(sum, _mm256_loadu_ps(row + j));
+        }
+        _mm256_storeu_ps(sums + j, sum);
+    }
+
+    // row_width is a multiple of 4, at most one half-width column block remains
+    if (j < row_width) {
+        __m128 sum = _mm_loadu_ps(sums + j);
+        for (size_t i = 0; i < num_rows; i++) {
+            const float *row = weights + (size_t)rows[i] * row_width;
+            sum = _mm_add_ps(sum, _mm_loadu_ps(row + j));
+        }
+        _mm_storeu_ps(sums + j, sum);
+    }
+}
+
+// Loads 4 int8 values sign-extended to int32 lanes
+__attribute__((target("sse2")))
+static inline __m128i int8_load4_sse2(const int8_t *src) {
+    int32_t packed;
+    memcpy(&packed, src, sizeof(packed));
+    __m128i v = _mm_cvtsi32_si128(packed);
+    // Replicate each byte into the top of its 32-bit lane, then shift back down with sign
+    v = _mm_unpacklo_epi8(v, v);
+    v = _mm_unpacklo_epi16(v, v);
+    return _mm_srai_epi32(v, 24);
+}
+
+__attribute__((target("sse2")))
+static void int8_rows_sum_sse2(const int8_t *weights, size_t row_width, const uint32_t *rows, size_t num_rows, int32_t *sums) {
+    for (size_t j = 0; j < row_width; j += 4) {
+        __m128i sum = _mm_loadu_si128((const __m128i *)(sums + j));
+        for (size_t i = 0; i < num_rows; i++) {
+            const int8_t *row = weights + (size_t)rows[i] * row_width;
+            sum = _mm_add_epi32(sum, int8_load4_sse2(row + j));
+        }
+        _mm_storeu_si128((__m128i *)(sums + j), sum);
+    }
+}
+
+// Loads 4 int16 values sign-extended to int32 lanes
+__attribute__((target("sse2")))
+static inline __m128i int16_load4_sse2(const int16_t *src) {
+    __m128i v = _mm_loadl_epi64((const __m128i *)src);
+    return _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+}
+
+__attribute__((target("sse2")))
+static void int16_rows_sum_sse2(const int16_t *weights, size_t row_width, const uint32_t *rows, size_t num_rows, int32_t *sums) {
+    for (size_t j = 0; j < row_width; j += 4) {
+        __m128i sum = _mm_loadu_si128((const __m128i *)(sums + j));
+        for (size_t i = 0; i < num_rows; i++) {
+            const int16_t *row = weights + (size_t)rows[i] * row_width;
+            sum = _mm_add_epi32(sum, int16_load4_sse2(row + j));
+        }
+        _mm_storeu_si128((__m128i *)(sums + j), sum);
+    }
+}
+
+__attribute__((target("avx2")))
+static void int8_rows_sum_avx2(const int8_t *weights, size_t row_width, const uint32_t *rows, size_t num_rows, int32_t *sums) {
+    size_t j = 0;
+    for (; j + 8 <= row_width; j += 8) {
+        __m256i sum = _mm256_loadu_si256((const __m256i *)(sums + j));
+        for (size_t i = 0; i < num_rows; i++) {
+            const int8_t *row = weights + (size_t)rows[i] * row_width;
+            sum = _mm256_add_epi32(sum, _mm256_cvtepi8_epi32(_mm_loadl_epi64((const __m128i *)(row + j))));
+        }
+        _mm256_storeu_si256((__m256i *)(sums + j), sum);
+    }
+
+    if (j < row_width) {
+        __m128i sum = _mm_loadu_si128((const __m128i *)(sums + j));
+        for (size_t i = 0; i < num_rows; i++) {
+            const int8_t *row = weights + (size_t)rows[i] * row_width;
+            int32_t packed;
+            memcpy(&packed, row + j, sizeof(packed));
+            sum = _mm_add_epi32(sum, _mm_cvtepi8_epi32(_mm_cvtsi32_si128(packed)));
+        }
+        _mm_storeu_si128((__m128i *)(sums + j), sum);
+    }
+}
+
+__attribute__((target("avx2")))
+static void int16_rows_sum_avx2(const int16_t *weights, size_t row_width, const uint32_t *rows, size_t num_rows, int32_t *sums) {
+    size_t j = 0;
+    for (; j + 8 <= row_width; j += 8) {
+        __m256i sum = _mm256_loadu_si256((const __m256i *)(sums + j));
+        for (size_t i = 0; i < num_rows; i++) {
+            const int16_t *row = weights + (size_t)rows[i] * row_width;
+            sum = _mm256_add_epi32(sum, _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)(row + j))));
+        }
+        _mm256_storeu_si256((__m256i *)(sums + j), sum);
+    }
+
+    if (j < row_width) {
+        __m128i sum = _mm_loadu_si128((const __m128i *)(sums + j));
+        for (size_t i = 0; i < num_rows; i++) {
+            const int16_t *row = weights + (size_t)rows[i] * row_width;
+            sum = _mm_add_epi32(sum, _mm_cvtepi16_epi32(_mm_loadl_epi64((const __m128i *)(row + j))));
+        }
+        _mm_storeu_si128((__m128i *)(sums + j), sum);
+    }
+}
+
+static inline bool averaged_perceptron_kernels_have_avx2(void) {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+}
+
+static inline bool averaged_perceptron_kernels_have_sse2(void) {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("sse2");
+}
+
+#endif
+
+static averaged_perceptron_kernels_isa_t averaged_perceptron_kernels_best_isa(void) {
+    #ifdef AVERAGED_PERCEPTRON_KERNELS_X86
+    if (averaged_perceptron_kernels_have_avx2()) {
+        return AVERAGED_PERCEPTRON_KERNELS_AVX2;
+    } else if (averaged_perceptron_kernels_have_sse2()) {
+        return AVERAGED_PERCEPTRON_KERNELS_SSE2;
+    }
+    #endif
+    return AVERAGED_PERCEPTRON_KERNELS_SCALAR;
+}
+
+float_rows_sum_function float_rows_sum_function_get(averaged_perceptron_kernels_isa_t isa) {
+    switch (isa) {
+        case AVERAGED_PERCEPTRON_KERNELS_SCALAR:
+            return float_rows_sum_scalar;
+        #ifdef AVERAGED_PERCEPTRON_KERNELS_X86
+        case AVERAGED_PERCEPTRON_KERNELS_SSE2:
+            return averaged_perceptron_kernels_have_sse2() ? float_rows_sum_sse2 : NULL;
+        case AVERAGED_PERCEPTRON_KERNELS_AVX2:
+            return averaged_perceptron_kernels_have_avx2() ? float_rows_sum_avx2 : NULL;
+        #endif
+        default:
+            return NULL;
+    }
+}
+
+float_rows_sum_function float_rows_sum_function_select(void) {
+    return float_rows_sum_function_get(averaged_perceptron_kernels_best_isa());
+}
+
+int8_rows_sum_function int8_rows_sum_function_get(averaged_perceptron_kernels_isa_t isa) {
+    switch (isa) {
+        case AVERAGED_PERCEPTRON_KERNELS_SCALAR:
+            return int8_rows_sum_scalar;
+        #ifdef AVERAGED_PERCEPTRON_KERNELS_X86
+        case AVERAGED_PERCEPTRON_KERNELS_SSE2:
+            return averaged_perceptron_kernels_have_sse2() ? int8_rows_sum_sse2 : NULL;
+        case AVERAGED_PERCEPTRON_KERNELS_AVX2:
+            return averaged_perceptron_kernels_have_avx2() ? int8_rows_sum_avx2 : NULL;
+        #endif
+        default:
+            return NULL;
+    }
+}
+
+int8_rows_sum_function int8_rows_sum_function_select(void) {
+    return int8_rows_sum_function_get(averaged_perceptron_kernels_best_isa());
+}
+
+int16_rows_sum_function int16_rows_sum_function_get(averaged_perceptron_kernels_isa_t isa) {
+    switch (isa) {
+        case AVERAGED_PERCEPTRON_KERNELS_SCALAR:
+            return int16_rows_sum_scalar;
+        #ifdef AVERAGED_PERCEPTRON_KERNELS_X86
+        case AVERAGED_PERCEPTRON_KERNELS_SSE2:
+            return averaged_perceptron_kernels_have_sse2() ? int16_rows_sum_sse2 : NULL;
+        case AVERAGED_PERCEPTRON_KERNELS_AVX2:
+            return averaged_perceptron_kernels_have_avx2() ? int16_rows_sum_avx2 : NULL;
+        #endif
+        default:
+            return NULL;
+    }
+}
+
+int16_rows_sum_function int16_rows_sum_function_select(void) {
+    return int16_rows_sum_function_get(averaged_perceptron_kernels_best_isa());
+}
+
+const char *averaged_perceptron_kernels_isa(void) {
+    switch (averaged_perceptron_kernels_best_isa()) {
+        case AVERAGED_PERCEPTRON_KERNELS_AVX2:
+            return "avx2";
+        case AVERAGED_PERCEPTRON_KERNELS_SSE2:
+            return "sse2";
+        default:
+            return "scalar";
+    }
+}
@@ -0,0 +1,55 @@
+/*
+averaged_perceptron_kernels.h
+-----------------------------
+
+Kernels used by the dense and quantized averaged perceptron layouts to
+sum rows of a row-major weight matrix (one row per feature, one column per
+class) into a vector of class scores. Quantized (int8/int16) rows are
+summed into int32 accumulators, scales are applied by the caller once per
+prediction.
+
+Each kernel has a portable scalar version and, when built with GCC or
+Clang for x86, SSE2 and AVX2 versions. The best version supported by the
+CPU is picked at runtime, so the same binary runs everywhere.
+
+row_width must be a multiple of AVERAGED_PERCEPTRON_KERNEL_ROW_MULTIPLE,
+rows are padded with zeros up to it so the kernels never need a scalar
+tail loop.
+*/
+
+#ifndef AVERAGED_PERCEPTRON_KERNELS_H
+#define AVERAGED_PERCEPTRON_KERNELS_H
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// SSE register width in floats
+#define AVERAGED_PERCEPTRON_KERNEL_ROW_MULTIPLE 4
+#define AVERAGED_PERCEPTRON_KERNEL_ALIGNMENT 32
+
+// sums[0..row_width) += weights[row * row_width..(row + 1) * row_width) for each row in rows
+typedef void (*float_rows_sum_function)(const float *weights, size_t row_width, const uint32_t *rows, size_t num_rows, float *sums);
+
+typedef void (*int8_rows_sum_function)(const int8_t *weights, size_t row_width, const uint32_t *rows, size_t num_rows, int32_t *sums);
+typedef void (*int16_rows_sum_function)(const int16_t *weights, size_t row_width, const uint32_t *rows, size_t num_rows, int32_t *sums);
+
+typedef enum {
+    AVERAGED_PERCEPTRON_KERNELS_SCALAR,
+    AVERAGED_PERCEPTRON_KERNELS_SSE2,
+    AVERAGED_PERCEPTRON_KERNELS_AVX2
+} averaged_perceptron_kernels_isa_t;
+
+float_rows_sum_function float_rows_sum_function_select(void);
+int8_rows_sum_function int8_rows_sum_function_select(void);
+int16_rows_sum_function int16_rows_sum_function_select(void);
+
+// The kernels for a given instruction set, NULL if the build or the CPU doesn't support it
+float_rows_sum_function float_rows_sum_function_get(averaged_perceptron_kernels_isa_t isa);
+int8_rows_sum_function int8_rows_sum_function_get(averaged_perceptron_kernels_isa_t isa);
+int16_rows_sum_function int16_rows_sum_function_get(averaged_perceptron_kernels_isa_t isa);
+
+// Name of the instruction set used by the selected kernels: "avx2", "sse2" or "scalar"
+const char *averaged_perceptron_kernels_isa(void);
+
+#endif
@@ -1,8 +1,11 @@
+
 #include "averaged_perceptron_tagger.h"
 #include "log/log.h"
+#include "stats.h"
 
 
-bool averaged_perceptron_tagger_predict(averaged_perceptron_t *model, void *tagger, void *context, cstring_array *features, cstring_array *labels, ap_tagger_feature_function feature_function, tokenized_string_t *tokenized) {
+bool averaged_perceptron_tagger_predict(averaged_perceptron_t *model, void *tagger, void *context, cstring_array *features, double_array *scores, cstring_array *labels, ap_tagger_feature_function feature_function, tokenized_string_t *tokenized) {
+    STATS_TIME_SCOPE(LIBPOSTAL_STAGE_PARSER_PREDICT);
 
     // Keep two tags of history in training
     char *prev = START;
@@ -33,7 +36,9 @@ bool averaged_perceptron_tagger_predict(averaged_perceptron_t *model, void *tagg
             return false;
         }
 
-        uint32_t guess = averaged_perceptron_predict(model, features);
+        STATS_COUNT(LIBPOSTAL_COUNTER_FEATURES, cstring_array_num_strings(features));
+
+        uint32_t guess = averaged_perceptron_predict_r(model, features, scores);
         char *predicted = cstring_array_get_string(model->classes, guess);
 
         cstring_array_add_string(labels, predicted);
@@ -46,3 +51,92 @@ bool averaged_perceptron_tagger_predict(averaged_perceptron_t *model, void *tagg
     return true;
 
 }
+
+static inline void averaged_perceptron_tagger_clear_features(cstring_array *features, uint64_array *feature_hashes) {
+    if (features != NULL) {
+        cstring_array_clear(features);
+    } else {
+        uint64_array_clear(feature_hashes);
+    }
+}
+
+static inline void averaged_perceptron_tagger_add_scores(averaged_perceptron_t *model, cstring_array *features, uint64_array *feature_hashes, double *scores) {
+    if (features != NULL) {
+        STATS_COUNT(LIBPOSTAL_COUNTER_FEATURES, cstring_array_num_strings(features));
+        averaged_perceptron_add_scores(model, features, scores);
+    } else {
+        STATS_COUNT(LIBPOSTAL_COUNTER_FEATURES, feature_hashes->n);
+        averaged_perceptron_add_scores_hashes(model, feature_hashes, scores);
+    }
+}
+
+bool averaged_perceptron_tagger_predict_split(averaged_perceptron_t *model, void *tagger, void *context, cstring_array *features, uint64_array *feature_hashes, double_array *scores, double_array *static_scores, cstring_array *labels, ap_tagger_static_feature_function static_feature_function, ap_tagger_feature_function tag_feature_function, tokenized_string_t *tokenized) {
+    if ((features == NULL) == (feature_hashes == NULL) || scores == NULL || static_scores == NULL) return false;
+    if (feature_hashes != NULL && model->feature_hashes == NULL && model->feature_index == NULL) return false;
+
+    STATS_TIME_SCOPE(LIBPOSTAL_STAGE_PARSER_PREDICT);
+
+    size_t num_tokens = tokenized->tokens->n;
+    size_t num_classes = (size_t)model->num_classes;
+
+    double_array_resize(static_scores, num_tokens * num_classes);
+    double_array_resize(scores, num_classes);
+    if (static_scores->m < num_tokens * num_classes || scores->m < num_classes) {
+        return false;
+    }
+    static_scores->n = num_tokens * num_classes;
+    scores->n = num_classes;
+    double_array_zero(static_scores->a, static_scores->n);
+
+    // Score everything not depending on previous tags once per token
+    for (uint32_t i = 0; i < num_tokens; i++) {
+        averaged_perceptron_tagger_clear_features(features, feature_hashes);
+
+        if (!static_feature_function(tagger, context, tokenized, i)) {
+            log_error("Could not add static features\n");
+            return false;
+        }
+
+        averaged_perceptron_tagger_add_scores(model, features, feature_hashes, static_scores->a + i * num_classes);
+    }
+
+    char *prev = START;
+    char *prev2 = START2;
+
+    uint32_t prev_id = 0;
+    uint32_t prev2_id = 0;
+
+    for (uint32_t i = 0; i < num_tokens; i++) {
+        averaged_perceptron_tagger_clear_features(features, feature_hashes);
+
+        if (i > 0) {
+            prev = cstring_array_get_string(model->classes, prev_id);
+        }
+
+        if (i > 1) {
+            prev2 = cstring_array_get_string(model->classes, prev2_id);
+        } else if (i == 1) {
+            prev2 = START;
+        }
+
+        log_debug("prev=%s, prev2=%s\n", prev, prev2);
+
+        if (!tag_feature_function(tagger, context, tokenized, i, prev, prev2)) {
+            log_error("Could not add tag features\n");
+            return false;
+        }
+
+        memcpy(scores->a, static_scores->a + i * num_classes, num_classes * sizeof(double));
+        averaged_perceptron_tagger_add_scores(model, features, feature_hashes, scores->a);
+
+        uint32_t guess = (uint32_t)double_array_argmax(scores->a, num_classes);
+        char *predicted = cstring_array_get_string(model->classes, guess);
+
+        cstring_array_add_string(labels, predicted);
+
+        prev2_id = prev_id;
+        prev_id = guess;
+    }
+
+    return true;
+}
@@ -26,6 +26,28 @@ the current value.
 // Arguments:                              tagger, context, tokenized str, index, i-1 tag, i-2 tag
 typedef bool (*ap_tagger_feature_function)(void *, void *, tokenized_string_t *, uint32_t, char *, char *);
 
-bool averaged_perceptron_tagger_predict(averaged_perceptron_t *model, void *tagger, void *context, cstring_array *features, cstring_array *labels, ap_tagger_feature_function feature_function, tokenized_string_t *tokenized);
+/*
+scores is a per-caller buffer for class scores (see averaged_perceptron_predict_r)
+so prediction doesn't write to the shared model and can be called from multiple
+threads as long as each thread uses its own context, features and scores.
+*/
+bool averaged_perceptron_tagger_predict(averaged_perceptron_t *model, void *tagger, void *context, cstring_array *features, double_array *scores, cstring_array *labels, ap_tagger_feature_function feature_function, tokenized_string_t *tokenized);
+
+// Arguments:                                     tagger, context, tokenized str, index
+typedef bool (*ap_tagger_static_feature_function)(void *, void *, tokenized_string_t *, uint32_t);
+
+/*
+Same as averaged_perceptron_tagger_predict with the features split in two:
+static_feature_function adds the features not depending on previous tags.
+It is called for every token in order before the greedy pass, and its
+scores are kept in static_scores (num_tokens x num_classes). tag_feature_function
+then adds only the tag history features at each step.
+
+Exactly one of features and feature_hashes is non-NULL. With feature_hashes,
+the feature functions add hashes (see feature_hashes_add) and the model must
+either have been loaded with a feature index (see feature_index.h) or have its
+feature hash table built (averaged_perceptron_build_feature_hashes).
+*/
+bool averaged_perceptron_tagger_predict_split(averaged_perceptron_t *model, void *tagger, void *context, cstring_array *features, uint64_array *feature_hashes, double_array *scores, double_array *static_scores, cstring_array *labels, ap_tagger_static_feature_function static_feature_function, ap_tagger_feature_function tag_feature_function, tokenized_string_t *tokenized);
 
 #endif
\ No newline at end of file
@@ -86,6 +86,14 @@ bool averaged_perceptron_trainer_get_feature_id(averaged_perceptron_trainer_t *s
         return false;
     }
 
+    if (self->shared_features != NULL) {
+        k = kh_get(str_uint32, self->shared_features, feature);
+        if (k != kh_end(self->shared_features)) {
+            *feature_id = kh_value(self->shared_features, k);
+            return true;
+        }
+    }
+
     khash_t(str_uint32) *features = self->features;
 
 
@@ -94,7 +102,7 @@ bool averaged_perceptron_trainer_get_feature_id(averaged_perceptron_trainer_t *s
         *feature_id = kh_value(features, k);
         return true;
     } else if (add_if_missing) {
-        uint32_t new_id = (uint32_t)kh_size(features);
+        uint32_t new_id = self->num_shared_features + (uint32_t)kh_size(features);
         int ret;
         char *key = strdup(feature);
         if (key == NULL) {
@@ -145,7 +153,7 @@ averaged_perceptron_t *averaged_perceptron_trainer_finalize(averaged_perceptron_
         sparse_matrix_finalize_row(averaged_weights);
     }
 
-    averaged_perceptron_t *perceptron = malloc(sizeof(averaged_perceptron_t));
+    averaged_perceptron_t *perceptron = calloc(1, sizeof(averaged_perceptron_t));
 
     perceptron->weights = averaged_weights;
 
@@ -322,6 +330,223 @@ bool averaged_perceptron_trainer_update_counts(averaged_perceptron_trainer_t *se
     return true;
 }
 
+bool averaged_perceptron_trainer_reset_worker(averaged_perceptron_trainer_t *worker, averaged_perceptron_trainer_t *self) {
+    if (worker == NULL || self == NULL) return false;
+
+    const char *key;
+    uint32_t id;
+
+    // Features the worker added were mixed into self, which the worker shares
+    kh_foreach(worker->features, key, id, {
+        free((char *)key);
+    })
+    kh_clear(str_uint32, worker->features);
+    worker->shared_features = self->features;
+    worker->num_shared_features = self->num_features;
+    worker->num_features = self->num_features;
+
+    // Other workers may have added classes in a different order, there are few so they're copied
+    kh_foreach(worker->classes, key, id, {
+        free((char *)key);
+    })
+    kh_clear(str_uint32, worker->classes);
+    cstring_array_clear(worker->class_strings);
+    worker->num_classes = 0;
+
+    for (uint32_t class_id = 0; class_id < self->num_classes; class_id++) {
+        char *class_name = cstring_array_get_string(self->class_strings, class_id);
+        if (!averaged_perceptron_trainer_get_class_id(worker, class_name, &id, true)) {
+            return false;
+        }
+    }
+
+    uint32_t feature_id;
+    uint32_t class_id;
+    khash_t(class_weights) *weights;
+    class_weight_t weight;
+    khiter_t k;
+    int ret;
+
+    // Tables are emptied and refilled in place. Feature ids self doesn't have weights for
+    // were the worker's own ids for new features, which have their ids in self now
+    for (k = kh_begin(worker->weights); k != kh_end(worker->weights); ++k) {
+        if (!kh_exist(worker->weights, k)) continue;
+        weights = kh_value(worker->weights, k);
+        if (kh_get(feature_class_weights, self->weights, kh_key(worker->weights, k)) == kh_end(self->weights)) {
+            kh_destroy(class_weights, weights);
+            kh_del(feature_class_weights, worker->weights, k);
+        } else {
+            kh_clear(class_weights, weights);
+        }
+    }
+
+    kh_foreach(self->weights, feature_id, weights, {
+        khash_t(class_weights) *worker_weights = averaged_perceptron_trainer_get_class_weights(worker, feature_id, true);
+        if (worker_weights == NULL) {
+            return false;
+        }
+
+        kh_foreach(weights, class_id, weight, {
+            k = kh_put(class_weights, worker_weights, class_id, &ret);
+            if (ret < 0) {
+                return false;
+            }
+            // Only the current weights are copied, totals are kept by self
+            class_weight_t worker_weight = NULL_WEIGHT;
+            worker_weight.value = weight.value;
+            kh_value(worker_weights, k) = worker_weight;
+        })
+    })
+
+    worker->num_updates = 0;
+    worker->num_errors = 0;
+    worker->iterations = self->iterations;
+
+    return true;
+}
+
+averaged_perceptron_trainer_t *averaged_perceptron_trainer_new_worker(averaged_perceptron_trainer_t *self) {
+    averaged_perceptron_trainer_t *worker = averaged_perceptron_trainer_new();
+    if (worker == NULL) return NULL;
+
+    if (!averaged_perceptron_trainer_reset_worker(worker, self)) {
+        averaged_perceptron_trainer_destroy(worker);
+        return NULL;
+    }
+
+    return worker;
+}
+
+bool averaged_perceptron_trainer_mix(averaged_perceptron_trainer_t *self, averaged_perceptron_trainer_t **trainers, size_t num_trainers) {
+    if (num_trainers == 0) return false;
+
+    uint32_t feature_id;
+    uint32_t class_id;
+    khash_t(class_weights) *weights;
+    class_weight_t weight;
+    khiter_t k;
+    int ret;
+
+    uint64_t updates = self->num_updates;
+    for (size_t i = 0; i < num_trainers; i++) {
+        updates += trainers[i]->num_updates;
+    }
+
+    // Every weight in self was copied to each trainer, so its value is replaced by their average.
+    // Totals are brought up to date first so the updates self made before the copies are kept
+    kh_foreach(self->weights, feature_id, weights, {
+        for (k = kh_begin(weights); k != kh_end(weights); ++k) {
+            if (!kh_exist(weights, k)) continue;
+            class_weight_t *self_weight = &kh_value(weights, k);
+            self_weight->total += (self->num_updates - self_weight->last_updated) * self_weight->value;
+            self_weight->last_updated = self->num_updates;
+            self_weight->value = 0.0;
+        }
+    })
+
+    bool success = false;
+
+    uint32_t *feature_ids = NULL;
+    uint32_t *class_ids = NULL;
+    char **feature_strings = NULL;
+
+    double mix_weight = 1.0 / (double)num_trainers;
+
+    for (size_t i = 0; i < num_trainers; i++) {
+        averaged_perceptron_trainer_t *trainer = trainers[i];
+
+        // Trainers may have added classes and features, map their ids to ids in self
+        class_ids = malloc(sizeof(uint32_t) * (trainer->num_classes + 1));
+        feature_ids = malloc(sizeof(uint32_t) * (trainer->num_features + 1));
+        feature_strings = calloc(trainer->num_features + 1, sizeof(char *));
+        if (class_ids == NULL || feature_ids == NULL || feature_strings == NULL) {
+            goto exit_mix;
+        }
+
+        for (class_id = 0; class_id < trainer->num_classes; class_id++) {
+            char *class_name = cstring_array_get_string(trainer->class_strings, class_id);
+            if (!averaged_perceptron_trainer_get_class_id(self, class_name, &class_ids[class_id], true)) {
+                goto exit_mix;
+            }
+        }
+
+        // Features a worker shares with self have the same ids
+        uint32_t num_shared_features = 0;
+        if (trainer->shared_features != NULL) {
+            if (trainer->shared_features != self->features) {
+                log_error("Worker shares the features of another trainer\n");
+                goto exit_mix;
+            }
+            num_shared_features = trainer->num_shared_features;
+        }
+
+        for (feature_id = 0; feature_id < num_shared_features; feature_id++) {
+            feature_ids[feature_id] = feature_id;
+        }
+
+        const char *feature;
+        kh_foreach(trainer->features, feature, feature_id, {
+            feature_strings[feature_id] = (char *)feature;
+        })
+
+        // New features are added in the order the trainer saw them
+        for (feature_id = num_shared_features; feature_id < trainer->num_features; feature_id++) {
+            if (!averaged_perceptron_trainer_get_feature_id(self, feature_strings[feature_id], &feature_ids[feature_id], true)) {
+                goto exit_mix;
+            }
+        }
+
+        uint64_t trainer_updates = trainer->num_updates;
+
+        kh_foreach(trainer->weights, feature_id, weights, {
+            khash_t(class_weights) *self_weights = averaged_perceptron_trainer_get_class_weights(self, feature_ids[feature_id], true);
+            if (self_weights == NULL) {
+                goto exit_mix;
+            }
+
+            kh_foreach(weights, class_id, weight, {
+                weight.total += (trainer_updates - weight.last_updated) * weight.value;
+
+                k = kh_get(class_weights, self_weights, class_ids[class_id]);
+                class_weight_t self_weight;
+                if (k == kh_end(self_weights)) {
+                    self_weight = NULL_WEIGHT;
+                    k = kh_put(class_weights, self_weights, class_ids[class_id], &ret);
+                    if (ret < 0) {
+                        goto exit_mix;
+                    }
+                } else {
+                    self_weight = kh_value(self_weights, k);
+                }
+
+                self_weight.value += mix_weight * weight.value;
+                self_weight.total += weight.total;
+                self_weight.last_updated = updates;
+                kh_value(self_weights, k) = self_weight;
+            })
+        })
+
+        self->num_errors += trainer->num_errors;
+
+        free(class_ids);
+        class_ids = NULL;
+        free(feature_ids);
+        feature_ids = NULL;
+        free(feature_strings);
+        feature_strings = NULL;
+    }
+
+    self->num_updates = updates;
+
+    success = true;
+
+exit_mix:
+    free(class_ids);
+    free(feature_ids);
+    free(feature_strings);
+    return success;
+}
+
 bool averaged_perceptron_trainer_train_example(averaged_perceptron_trainer_t *self, void *tagger, void *context, cstring_array *features, ap_tagger_feature_function feature_function, tokenized_string_t *tokenized, cstring_array *labels) {
     // Keep two tags of history in training
     char *prev = START;
@@ -394,6 +619,8 @@ averaged_perceptron_trainer_t *averaged_perceptron_trainer_new(void) {
     if (self == NULL) return NULL;
 
     self->num_features = 0;
+    self->shared_features = NULL;
+    self->num_shared_features = 0;
     self->num_classes = 0;
     self->num_updates = 0;
     self->num_errors = 0;
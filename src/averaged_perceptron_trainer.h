@@ -60,6 +60,11 @@ typedef struct averaged_perceptron_trainer {
     uint64_t num_errors;
     uint32_t iterations;
     khash_t(str_uint32) *features;
+    // Workers only: the features of the trainer they're mixed into, read-only
+    // while the worker trains. features then holds only the ones added since,
+    // with ids starting at num_shared_features
+    khash_t(str_uint32) *shared_features;
+    uint32_t num_shared_features;
     khash_t(str_uint32) *classes;
     cstring_array *class_strings;
     // {feature_id => {class_id => class_weight_t}}
@@ -82,6 +87,31 @@ bool averaged_perceptron_trainer_train_example(averaged_perceptron_trainer_t *se
 
 averaged_perceptron_t *averaged_perceptron_trainer_finalize(averaged_perceptron_trainer_t *self);
 
+/*
+Iterative parameter mixing [McDonald et al., 2010] for training on several
+threads. Each thread trains a copy of the model on its own shard of the
+data, then the copies are mixed back into self by averaging their weights,
+and the next round starts from the mixed weights.
+
+averaged_perceptron_trainer_new_worker creates a trainer for one thread
+that starts from the current weights of self. Instead of copying the feature
+strings, it looks features up in self's dictionary, which must not change
+while workers train, and keeps only the features it adds itself.
+averaged_perceptron_trainer_mix sets the weights of self to the average of
+the trainers' weights and adds any classes and features they've seen. Their
+running totals are added to those of self, so the averaged model from
+finalize is the average over every update made by any of the trainers.
+averaged_perceptron_trainer_reset_worker then sets a worker back to the
+mixed weights of self in place, with zero totals and updates, so the next
+round reuses its tables.
+
+Paper: [McDonald et al., 2010] Distributed Training Strategies for the Structured Perceptron
+Link: http://www.aclweb.org/anthology/N10-1069
+*/
+averaged_perceptron_trainer_t *averaged_perceptron_trainer_new_worker(averaged_perceptron_trainer_t *self);
+bool averaged_perceptron_trainer_reset_worker(averaged_perceptron_trainer_t *worker, averaged_perceptron_trainer_t *self);
+bool averaged_perceptron_trainer_mix(averaged_perceptron_trainer_t *self, averaged_perceptron_trainer_t **trainers, size_t num_trainers);
+
 
 
 void averaged_perceptron_trainer_destroy(averaged_perceptron_trainer_t *self);
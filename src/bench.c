@@ -1,75 +1,397 @@
+/*
+bench
+-----
+
+Corpus benchmark. Loads addresses (one per line) from a file and runs each
+operation (expand, parse, classify) separately over the whole corpus, at
+1, 2, 4, ... up to --threads threads (always including --threads itself)
+to show scaling. Every call is timed individually with a monotonic clock.
+
+Writes one JSON document to stdout with throughput and latency percentiles
+per operation and thread count, so results can be compared across releases
+and corpora. Builds configured with --enable-stats also include the
+per-stage breakdown from libpostal_get_stats for each run.
+
+Before timing, each operation is run once over the corpus in a single
+thread to load models and warm caches.
+*/
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
- 
-#ifdef TIME_WITH_SYS_TIME
-#include <sys/time.h>
-#include <time.h>
-#else
-#ifdef HAVE_SYS_TIME_H
-#include <sys/time.h>
-#else
 #include <time.h>
-#endif
-#endif
 
 #include "libpostal.h"
-#include "libpostal_config.h"
+#include "collections.h"
+#include "file_utils.h"
+#include "json_encode.h"
+#include "language_classifier.h"
 #include "log/log.h"
-#include "scanner.h"
+#include "string_utils.h"
+#include "thread_pool.h"
+
+#define BENCH_USAGE "Usage: ./bench --input file [--ops expand,parse,classify] [--threads n] [--iterations n] [--language code]...\n"
+
+#define BENCH_MAX_LANGUAGES 16
+
+typedef enum {
+    BENCH_OP_EXPAND,
+    BENCH_OP_PARSE,
+    BENCH_OP_CLASSIFY,
+    NUM_BENCH_OPS
+} bench_op_t;
+
+static const char *bench_op_names[NUM_BENCH_OPS] = {"expand", "parse", "classify"};
+
+typedef struct bench_job {
+    bench_op_t op;
+    cstring_array *addresses;
+    normalize_options_t expand_options;
+    address_parser_options_t parser_options;
+    // Indexed by worker_id
+    double_array **latencies;
+    libpostal_parser_session_t **sessions;
+    size_t *num_errors;
+} bench_job_t;
+
+static inline double bench_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static bool bench_call(bench_job_t *job, size_t worker_id, char *address) {
+    switch (job->op) {
+        case BENCH_OP_EXPAND: {
+            size_t num_expansions;
+            char **expansions = expand_address(address, job->expand_options, &num_expansions);
+            if (expansions == NULL) return false;
+            expansion_array_destroy(expansions, num_expansions);
+            return true;
+        }
+        case BENCH_OP_PARSE: {
+            if (job->sessions[worker_id] == NULL) {
+                job->sessions[worker_id] = libpostal_parser_session_new();
+                if (job->sessions[worker_id] == NULL) return false;
+            }
+            address_parser_response_t *parsed = parse_address_r(job->sessions[worker_id], address, job->parser_options);
+            if (parsed == NULL) return false;
+            address_parser_response_destroy(parsed);
+            return true;
+        }
+        case BENCH_OP_CLASSIFY: {
+            language_classifier_response_t *classified = classify_languages(address);
+            if (classified == NULL) return false;
+            language_classifier_response_destroy(classified);
+            return true;
+        }
+        default:
+            return false;
+    }
+}
+
+static void bench_task(void *arg, size_t worker_id, size_t i) {
+    bench_job_t *job = (bench_job_t *)arg;
+
+    size_t num_addresses = cstring_array_num_strings(job->addresses);
+    char *address = cstring_array_get_string(job->addresses, (uint32_t)(i % num_addresses));
+
+    double start = bench_now();
+    bool ok = bench_call(job, worker_id, address);
+    double elapsed = bench_now() - start;
+
+    if (job->latencies != NULL) {
+        double_array_push(job->latencies[worker_id], elapsed);
+    }
+
+    if (!ok) {
+        job->num_errors[worker_id]++;
+    }
+}
+
+static int bench_compare_double(const void *a, const void *b) {
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+static inline double bench_percentile(double *sorted, size_t n, double p) {
+    size_t i = (size_t)(p * (double)(n - 1) + 0.5);
+    return sorted[i];
+}
+
+static void bench_print_stats(void) {
+    libpostal_stats_t stats = libpostal_get_stats();
+    if (!stats.enabled) return;
+
+    printf(", \"stages\": {");
+    for (size_t i = 0; i < LIBPOSTAL_NUM_STAGES; i++) {
+        printf("%s\"%s\": {\"calls\": %llu, \"nanoseconds\": %llu}", i > 0 ? ", " : "",
+               libpostal_stage_name((libpostal_stage_t)i),
+               (unsigned long long)stats.stages[i].calls,
+               (unsigned long long)stats.stages[i].nanoseconds);
+    }
+    printf("}, \"counters\": {");
+    for (size_t i = 0; i < LIBPOSTAL_NUM_COUNTERS; i++) {
+        printf("%s\"%s\": %llu", i > 0 ? ", " : "",
+               libpostal_counter_name((libpostal_counter_t)i),
+               (unsigned long long)stats.counters[i]);
+    }
+    printf("}");
+}
+
+// Runs one operation at one thread count and prints its JSON result object
+static bool bench_run(bench_job_t *job, size_t num_threads, size_t num_calls, bool first) {
+    thread_pool_t *pool = thread_pool_new(num_threads);
+    if (pool == NULL) {
+        log_error("Could not create thread pool\n");
+        return false;
+    }
+
+    size_t num_workers = thread_pool_num_workers(pool);
+
+    bool ret = false;
+
+    double_array *latencies = NULL;
+    job->latencies = calloc(num_workers, sizeof(double_array *));
+    job->sessions = calloc(num_workers, sizeof(libpostal_parser_session_t *));
+    job->num_errors = calloc(num_workers, sizeof(size_t));
+    if (job->latencies == NULL || job->sessions == NULL || job->num_errors == NULL) {
+        goto exit_bench_pool_created;
+    }
+
+    for (size_t i = 0; i < num_workers; i++) {
+        job->latencies[i] = double_array_new_size(num_calls / num_workers + 1);
+        if (job->latencies[i] == NULL) {
+            goto exit_bench_pool_created;
+        }
+    }
+
+    libpostal_reset_stats();
+
+    double start = bench_now();
+    if (!thread_pool_map(pool, num_calls, bench_task, job)) {
+        goto exit_bench_pool_created;
+    }
+    double elapsed = bench_now() - start;
+
+    latencies = double_array_new_size(num_calls);
+    size_t num_errors = 0;
+    for (size_t i = 0; i < num_workers; i++) {
+        double_array_extend(latencies, job->latencies[i]);
+        num_errors += job->num_errors[i];
+    }
+
+    size_t n = latencies->n;
+    qsort(latencies->a, n, sizeof(double), bench_compare_double);
+
+    printf("%s\n    {\"op\": \"%s\", \"threads\": %zu, \"calls\": %zu, \"errors\": %zu, \"seconds\": %.6f, \"throughput\": %.2f",
+           first ? "" : ",", bench_op_names[job->op], num_threads, n, num_errors, elapsed, elapsed > 0.0 ? (double)n / elapsed : 0.0);
+
+    if (n > 0) {
+        printf(", \"latency_us\": {\"mean\": %.3f, \"p50\": %.3f, \"p90\": %.3f, \"p99\": %.3f, \"p999\": %.3f, \"max\": %.3f}",
+               double_array_sum(latencies->a, n) / (double)n * 1e6,
+               bench_percentile(latencies->a, n, 0.5) * 1e6,
+               bench_percentile(latencies->a, n, 0.9) * 1e6,
+               bench_percentile(latencies->a, n, 0.99) * 1e6,
+               bench_percentile(latencies->a, n, 0.999) * 1e6,
+               latencies->a[n - 1] * 1e6);
+    }
+
+    bench_print_stats();
+    printf("}");
+
+    ret = true;
+
+exit_bench_pool_created:
+    if (latencies != NULL) {
+        double_array_destroy(latencies);
+    }
+
+    for (size_t i = 0; i < num_workers; i++) {
+        if (job->latencies != NULL && job->latencies[i] != NULL) {
+            double_array_destroy(job->latencies[i]);
+        }
+        if (job->sessions != NULL && job->sessions[i] != NULL) {
+            libpostal_parser_session_destroy(job->sessions[i]);
+        }
+    }
+    free(job->latencies);
+    free(job->sessions);
+    free(job->num_errors);
+    job->latencies = NULL;
+    job->sessions = NULL;
+    job->num_errors = NULL;
+
+    thread_pool_destroy(pool);
+    return ret;
+}
+
+// Single-threaded pass over the corpus, not timed
+static bool bench_warmup(bench_job_t *job) {
+    size_t num_addresses = cstring_array_num_strings(job->addresses);
+    libpostal_parser_session_t *session = NULL;
+    size_t num_errors = 0;
+
+    job->latencies = NULL;
+    job->sessions = &session;
+    job->num_errors = &num_errors;
+
+    for (size_t i = 0; i < num_addresses; i++) {
+        bench_task(job, 0, i);
+    }
+
+    if (session != NULL) {
+        libpostal_parser_session_destroy(session);
+    }
+
+    job->sessions = NULL;
+    job->num_errors = NULL;
+
+    return num_errors < num_addresses;
+}
 
 int main(int argc, char **argv) {
-    if (argc < 3) {
-        log_error("Usage: test_libpostal string languages...\n");
+    char *input_file = NULL;
+    char *ops = "expand,parse,classify";
+    size_t max_threads = 1;
+    size_t iterations = 1;
+
+    char *languages[BENCH_MAX_LANGUAGES];
+    size_t num_languages = 0;
+
+    for (int i = 1; i < argc; i++) {
+        char *arg = argv[i];
+        if (string_equals(arg, "-h") || string_equals(arg, "--help")) {
+            printf(BENCH_USAGE);
+            exit(EXIT_SUCCESS);
+        } else if (string_equals(arg, "--input") && i < argc - 1) {
+            input_file = argv[++i];
+        } else if (string_equals(arg, "--ops") && i < argc - 1) {
+            ops = argv[++i];
+        } else if (string_equals(arg, "--threads") && i < argc - 1) {
+            max_threads = (size_t)strtoul(argv[++i], NULL, 10);
+        } else if (string_equals(arg, "--iterations") && i < argc - 1) {
+            iterations = (size_t)strtoul(argv[++i], NULL, 10);
+        } else if (string_equals(arg, "--language") && i < argc - 1 && num_languages < BENCH_MAX_LANGUAGES) {
+            char *language = argv[++i];
+            if (strlen(language) >= MAX_LANGUAGE_LEN) {
+                log_error("Invalid language code: %s\n", language);
+                exit(EXIT_FAILURE);
+            }
+            languages[num_languages++] = language;
+        } else {
+            log_error(BENCH_USAGE);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (input_file == NULL || max_threads == 0 || iterations == 0) {
+        log_error(BENCH_USAGE);
+        exit(EXIT_FAILURE);
+    }
+
+    bool run_ops[NUM_BENCH_OPS] = {false};
+    cstring_array *op_names = cstring_array_split(ops, ",", 1, NULL);
+    if (op_names == NULL) {
+        log_error(BENCH_USAGE);
         exit(EXIT_FAILURE);
     }
 
-    char *str = argv[1];
-    char *languages[argc - 2];
-    for (int i = 0; i < argc - 2; i++) {
-        char *arg = argv[i + 2];
-        if (strlen(arg) >= MAX_LANGUAGE_LEN) {
-            printf("arg %d was longer than a language code (%d chars). Make sure to quote the input string\n", i + 2, MAX_LANGUAGE_LEN - 1);
+    for (uint32_t i = 0; i < cstring_array_num_strings(op_names); i++) {
+        char *name = cstring_array_get_string(op_names, i);
+        bool found = false;
+        for (size_t j = 0; j < NUM_BENCH_OPS; j++) {
+            if (string_equals(name, (char *)bench_op_names[j])) {
+                run_ops[j] = true;
+                found = true;
+            }
+        }
+        if (!found) {
+            log_error("Unknown op: %s\n", name);
+            exit(EXIT_FAILURE);
         }
-        languages[i] = arg;
     }
+    cstring_array_destroy(op_names);
 
-    if (!libpostal_setup()) {
+    FILE *f = fopen(input_file, "r");
+    if (f == NULL) {
+        log_error("Could not open input file: %s\n", input_file);
         exit(EXIT_FAILURE);
     }
 
-    normalize_options_t options = get_libpostal_default_options();
+    cstring_array *addresses = cstring_array_new();
+    char *line;
+    while ((line = file_getline(f)) != NULL) {
+        if (line[0] != '\0') {
+            cstring_array_add_string(addresses, line);
+        }
+        free(line);
+    }
+    fclose(f);
 
-    options.num_languages = 1;
-    options.languages = languages;
+    size_t num_addresses = cstring_array_num_strings(addresses);
+    if (num_addresses == 0) {
+        log_error("No addresses in %s\n", input_file);
+        exit(EXIT_FAILURE);
+    }
+
+    bool need_classifier = run_ops[BENCH_OP_CLASSIFY] || (run_ops[BENCH_OP_EXPAND] && num_languages == 0);
+
+    if (!libpostal_setup() ||
+        (need_classifier && !libpostal_setup_language_classifier()) ||
+        (run_ops[BENCH_OP_PARSE] && !libpostal_setup_parser())) {
+        exit(EXIT_FAILURE);
+    }
 
-    size_t num_expansions;
+    bench_job_t job;
+    memset(&job, 0, sizeof(job));
+    job.addresses = addresses;
+    job.expand_options = get_libpostal_default_options();
+    job.expand_options.languages = languages;
+    job.expand_options.num_languages = (int)num_languages;
+    job.parser_options = get_libpostal_address_parser_default_options();
 
-    char **strings;
-    char *normalized;
+    char *encoded_input = json_encode_string(input_file);
+    printf("{\"corpus\": %s, \"addresses\": %zu, \"iterations\": %zu, \"results\": [", encoded_input, num_addresses, iterations);
+    free(encoded_input);
 
-    int num_loops = 100000;
+    size_t num_calls = num_addresses * iterations;
+    bool first = true;
+    int ret = EXIT_SUCCESS;
 
-    token_array *tokens = tokenize(str);
-    uint64_t num_tokens = tokens->n;
-    token_array_destroy(tokens);
+    for (size_t op = 0; op < NUM_BENCH_OPS; op++) {
+        if (!run_ops[op]) continue;
+        job.op = (bench_op_t)op;
 
-    clock_t t1 = clock();
-    for (int i = 0; i < num_loops; i++) {
-        strings = expand_address(str, options, &num_expansions);
-        for (uint64_t i = 0; i < num_expansions; i++) {
-            normalized = strings[i];
-            free(normalized);
+        if (!bench_warmup(&job)) {
+            log_error("All %s calls failed during warmup\n", bench_op_names[op]);
+            ret = EXIT_FAILURE;
+            continue;
+        }
+
+        for (size_t num_threads = 1; ; num_threads *= 2) {
+            if (num_threads > max_threads) {
+                num_threads = max_threads;
+            }
+
+            if (!bench_run(&job, num_threads, num_calls, first)) {
+                ret = EXIT_FAILURE;
+                break;
+            }
+            first = false;
+            fflush(stdout);
+
+            if (num_threads == max_threads) break;
         }
-        free(strings);
     }
-    clock_t t2 = clock();
 
-    double benchmark_time = (double)(t2 - t1) / CLOCKS_PER_SEC;
-    printf("Benchmark time: %f\n", benchmark_time);
-    double addresses_per_second = num_loops / benchmark_time;
-    printf("addresses/s = %f\n", addresses_per_second);
-    double tokens_per_second = (num_loops * num_tokens) / benchmark_time;
-    printf("tokens/s = %f\n", tokens_per_second);
+    printf("\n]}\n");
+
+    cstring_array_destroy(addresses);
+    libpostal_teardown_parser();
+    libpostal_teardown_language_classifier();
     libpostal_teardown();
+
+    return ret;
 }
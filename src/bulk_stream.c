@@ -0,0 +1,110 @@
+#include "bulk_stream.h"
+
+#include <string.h>
+#include <sys/time.h>
+
+#include "file_utils.h"
+#include "log/log.h"
+#include "thread_pool.h"
+
+typedef struct bulk_stream_batch {
+    char **lines;
+    char **outputs;
+    bulk_stream_process_function func;
+    void *arg;
+} bulk_stream_batch_t;
+
+static void bulk_stream_process_line(void *arg, size_t worker_id, size_t task_index) {
+    bulk_stream_batch_t *batch = (bulk_stream_batch_t *)arg;
+    batch->outputs[task_index] = batch->func(batch->arg, worker_id, batch->lines[task_index]);
+}
+
+static inline double bulk_stream_now(void) {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (double)tv.tv_sec + (double)tv.tv_usec / 1e6;
+}
+
+bool bulk_stream_run(FILE *input, FILE *output, size_t num_threads, size_t batch_size, bulk_stream_process_function func, void *arg, bulk_stream_stats_t *stats) {
+    if (input == NULL || output == NULL || func == NULL) return false;
+
+    if (batch_size == 0) {
+        batch_size = BULK_STREAM_DEFAULT_BATCH_SIZE;
+    }
+
+    bool ret = false;
+    bulk_stream_stats_t batch_stats = (bulk_stream_stats_t){0, 0, 0.0};
+
+    double start = bulk_stream_now();
+
+    thread_pool_t *pool = thread_pool_new(num_threads);
+    char **lines = calloc(batch_size, sizeof(char *));
+    char **outputs = calloc(batch_size, sizeof(char *));
+
+    if (pool == NULL || lines == NULL || outputs == NULL) {
+        log_error("Could not allocate bulk stream\n");
+        goto exit_bulk_stream;
+    }
+
+    bulk_stream_batch_t batch = (bulk_stream_batch_t){lines, outputs, func, arg};
+
+    bool done = false;
+
+    while (!done) {
+        size_t num_lines = 0;
+        char *line;
+
+        while (num_lines < batch_size) {
+            if ((line = file_getline(input)) == NULL) {
+                done = true;
+                break;
+            }
+            lines[num_lines++] = line;
+        }
+
+        if (num_lines == 0) break;
+
+        thread_pool_map(pool, num_lines, bulk_stream_process_line, &batch);
+
+        for (size_t i = 0; i < num_lines; i++) {
+            if (outputs[i] != NULL) {
+                fputs(outputs[i], output);
+                free(outputs[i]);
+                outputs[i] = NULL;
+            } else {
+                fputs("null", output);
+                batch_stats.num_errors++;
+            }
+            fputc('\n', output);
+
+            free(lines[i]);
+            lines[i] = NULL;
+        }
+
+        batch_stats.num_lines += num_lines;
+    }
+
+    ret = fflush(output) == 0;
+
+exit_bulk_stream:
+    batch_stats.seconds = bulk_stream_now() - start;
+
+    if (stats != NULL) {
+        *stats = batch_stats;
+    }
+
+    if (pool != NULL) {
+        thread_pool_destroy(pool);
+    }
+
+    free(lines);
+    free(outputs);
+
+    return ret;
+}
+
+void bulk_stream_stats_print(FILE *f, bulk_stream_stats_t stats) {
+    fprintf(f, "Processed %zu lines (%zu errors) in %.3f seconds, %.1f lines/second\n",
+            stats.num_lines, stats.num_errors, stats.seconds,
+            stats.seconds > 0.0 ? (double)stats.num_lines / stats.seconds : 0.0);
+}
@@ -0,0 +1,43 @@
+/*
+bulk_stream.h
+-------------
+
+Streams newline-delimited input through a thread pool and writes one output
+line per input line, in input order.
+
+Lines are read in batches of up to batch_size, processed in parallel, then
+written out before the next batch is read, so at most batch_size lines are
+in flight (bounded reordering) and memory use doesn't depend on the size of
+the input.
+
+The process function is called from worker threads with a stable worker_id
+(see thread_pool.h) and returns a malloc'd output line without the trailing
+newline, or NULL on error, in which case "null" is written to keep the
+output aligned with the input.
+*/
+
+#ifndef BULK_STREAM_H
+#define BULK_STREAM_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#define BULK_STREAM_DEFAULT_BATCH_SIZE 4096
+
+typedef char *(*bulk_stream_process_function)(void *arg, size_t worker_id, char *line);
+
+typedef struct bulk_stream_stats {
+    size_t num_lines;
+    size_t num_errors;
+    double seconds;
+} bulk_stream_stats_t;
+
+// num_threads == 0 means one per CPU, batch_size == 0 means BULK_STREAM_DEFAULT_BATCH_SIZE
+bool bulk_stream_run(FILE *input, FILE *output, size_t num_threads, size_t batch_size, bulk_stream_process_function func, void *arg, bulk_stream_stats_t *stats);
+
+// Writes a one line throughput summary, e.g. to stderr
+void bulk_stream_stats_print(FILE *f, bulk_stream_stats_t stats);
+
+#endif
@@ -18,6 +18,7 @@
 // Maps
 
 KHASH_MAP_INIT_INT(int_uint32, uint32_t)
+KHASH_MAP_INIT_INT64(int64_uint32, uint32_t)
 
 #define kh_char_hash_func(key) (uint32_t)(key)
 #define kh_char_hash_equal(a, b) ((a) == (b))
@@ -44,6 +45,8 @@ VECTOR_INIT_NUMERIC(uint64_array, uint64_t, uint64_t, nop)
 VECTOR_INIT_NUMERIC_FLOAT(float_array, float, fabsf)
 VECTOR_INIT_NUMERIC_FLOAT(double_array, double, fabs)
 
+VECTOR_INIT(int8_array, int8_t)
+VECTOR_INIT(int16_array, int16_t)
 VECTOR_INIT(char_array, char)
 VECTOR_INIT(uchar_array, unsigned char)
 VECTOR_INIT(string_array, char *)
@@ -0,0 +1,171 @@
+/*
+convert_data
+------------
+
+Rewrites the data files in a libpostal data directory in the current file
+formats. Tries in files written before the memory-mappable layout (see
+trie.h) are still readable but get deserialized node by node on every
+load; after conversion they're mapped instead:
+
+./convert_data /usr/local/share/libpostal
+
+Each file is loaded with its module's reader, written next to the original
+and renamed over it, so a process that has the old file open (or mapped)
+keeps its copy. Files that don't exist in the data directory are skipped.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+
+#include "address_dictionary.h"
+#include "address_parser.h"
+#include "averaged_perceptron.h"
+#include "geodb.h"
+#include "language_classifier.h"
+#include "libpostal_config.h"
+#include "log/log.h"
+#include "numex.h"
+#include "string_utils.h"
+#include "transliterate.h"
+#include "trie.h"
+
+#define CONVERT_DATA_USAGE "Usage: ./convert_data [data_dir]\n"
+
+#define CONVERT_DATA_TEMP_SUFFIX ".converting"
+
+typedef enum {
+    CONVERT_TRANSLITERATION,
+    CONVERT_NUMEX,
+    CONVERT_ADDRESS_DICTIONARY,
+    CONVERT_LANGUAGE_CLASSIFIER,
+    CONVERT_AVERAGED_PERCEPTRON,
+    CONVERT_TRIE
+} convert_data_file_type_t;
+
+typedef struct convert_data_file {
+    char *name;
+    convert_data_file_type_t type;
+} convert_data_file_t;
+
+// Every data file containing a trie, relative to the data directory
+static convert_data_file_t convert_data_files[] = {
+    {"transliteration" PATH_SEPARATOR "transliteration.dat", CONVERT_TRANSLITERATION},
+    {"numex" PATH_SEPARATOR "numex.dat", CONVERT_NUMEX},
+    {"address_expansions" PATH_SEPARATOR "address_dictionary.dat", CONVERT_ADDRESS_DICTIONARY},
+    {"language_classifier" PATH_SEPARATOR LANGUAGE_CLASSIFIER_FILENAME, CONVERT_LANGUAGE_CLASSIFIER},
+    {"language_classifier" PATH_SEPARATOR LANGUAGE_CLASSIFIER_COUNTRY_FILENAME, CONVERT_LANGUAGE_CLASSIFIER},
+    {"address_parser" PATH_SEPARATOR ADDRESS_PARSER_MODEL_FILENAME, CONVERT_AVERAGED_PERCEPTRON},
+    {"address_parser" PATH_SEPARATOR ADDRESS_PARSER_VOCAB_FILENAME, CONVERT_TRIE},
+    {"address_parser" PATH_SEPARATOR ADDRESS_PARSER_PHRASE_FILENAME, CONVERT_TRIE},
+    {"geodb" PATH_SEPARATOR GEODB_NAMES_TRIE_FILENAME, CONVERT_TRIE},
+    {"geodb" PATH_SEPARATOR GEODB_FEATURES_TRIE_FILENAME, CONVERT_TRIE}
+};
+
+static bool convert_data_file(convert_data_file_type_t type, char *input_path, char *output_path) {
+    bool ret = false;
+
+    switch (type) {
+        case CONVERT_TRANSLITERATION:
+            ret = transliteration_table_load(input_path) && transliteration_table_save(output_path);
+            transliteration_module_teardown();
+            break;
+        case CONVERT_NUMEX:
+            ret = numex_table_load(input_path) && numex_table_save(output_path);
+            numex_module_teardown();
+            break;
+        case CONVERT_ADDRESS_DICTIONARY:
+            // Loads every language, a partial dictionary would be written out partially
+            ret = address_dictionary_load(input_path) && address_dictionary_save(output_path);
+            address_dictionary_module_teardown();
+            break;
+        case CONVERT_LANGUAGE_CLASSIFIER: {
+            language_classifier_t *classifier = language_classifier_load(input_path);
+            ret = classifier != NULL && language_classifier_save(classifier, output_path);
+            language_classifier_destroy(classifier);
+            break;
+        }
+        case CONVERT_AVERAGED_PERCEPTRON: {
+            averaged_perceptron_t *model = averaged_perceptron_load(input_path);
+            ret = model != NULL && averaged_perceptron_save(model, output_path);
+            averaged_perceptron_destroy(model);
+            break;
+        }
+        case CONVERT_TRIE: {
+            trie_t *trie = trie_load(input_path);
+            ret = trie != NULL && trie_save(trie, output_path);
+            trie_destroy(trie);
+            break;
+        }
+    }
+
+    return ret;
+}
+
+int main(int argc, char **argv) {
+    char *data_dir = LIBPOSTAL_DATA_DIR;
+
+    if (argc > 2) {
+        log_error(CONVERT_DATA_USAGE);
+        exit(EXIT_FAILURE);
+    } else if (argc == 2) {
+        if (string_equals(argv[1], "-h") || string_equals(argv[1], "--help")) {
+            printf(CONVERT_DATA_USAGE);
+            exit(EXIT_SUCCESS);
+        }
+        data_dir = argv[1];
+    }
+
+    char_array *path = char_array_new();
+    char_array *temp_path = char_array_new();
+    if (path == NULL || temp_path == NULL) {
+        exit(EXIT_FAILURE);
+    }
+
+    size_t num_files = sizeof(convert_data_files) / sizeof(convert_data_file_t);
+    size_t num_converted = 0;
+    bool success = true;
+
+    for (size_t i = 0; i < num_files; i++) {
+        convert_data_file_t file = convert_data_files[i];
+
+        char_array_clear(path);
+        char_array_add_joined(path, PATH_SEPARATOR, true, 2, data_dir, file.name);
+        char *input_path = char_array_get_string(path);
+
+        struct stat st;
+        if (stat(input_path, &st) != 0) {
+            log_info("Skipping %s, not found\n", input_path);
+            continue;
+        }
+
+        char_array_clear(temp_path);
+        char_array_cat(temp_path, input_path);
+        char_array_cat(temp_path, CONVERT_DATA_TEMP_SUFFIX);
+        char *output_path = char_array_get_string(temp_path);
+
+        if (!convert_data_file(file.type, input_path, output_path)) {
+            log_error("Could not convert %s\n", input_path);
+            remove(output_path);
+            success = false;
+            continue;
+        }
+
+        if (rename(output_path, input_path) != 0) {
+            log_error("Could not replace %s\n", input_path);
+            remove(output_path);
+            success = false;
+            continue;
+        }
+
+        printf("converted %s\n", input_path);
+        num_converted++;
+    }
+
+    printf("%zu files converted\n", num_converted);
+
+    char_array_destroy(path);
+    char_array_destroy(temp_path);
+
+    exit(success ? EXIT_SUCCESS : EXIT_FAILURE);
+}
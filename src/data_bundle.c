@@ -0,0 +1,388 @@
+// First, so a 64-bit off_t from AC_SYS_LARGEFILE applies to the system headers
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "data_bundle.h"
+
+#include <pthread.h>
+#include <string.h>
+#include <sys/types.h>
+
+#include "file_utils.h"
+#include "log/log.h"
+#include "string_utils.h"
+
+#define DATA_BUNDLE_COPY_BUFFER_SIZE (1024 * 1024)
+
+static data_bundle_t *default_bundle = NULL;
+
+/*
+CRC-32 (IEEE 802.3 polynomial, reflected)
+*/
+
+static uint32_t crc32_table[256];
+static pthread_once_t crc32_table_once = PTHREAD_ONCE_INIT;
+
+static void crc32_init_table(void) {
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t c = i;
+        for (int k = 0; k < 8; k++) {
+            c = c & 1 ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+        }
+        crc32_table[i] = c;
+    }
+}
+
+static uint32_t crc32_update(uint32_t crc, const unsigned char *buf, size_t len) {
+    pthread_once(&crc32_table_once, crc32_init_table);
+
+    crc = ~crc;
+    for (size_t i = 0; i < len; i++) {
+        crc = crc32_table[(crc ^ buf[i]) & 0xff] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+/*
+Sections can start past 2GB, and long is 32 bits on Windows
+*/
+
+static int data_bundle_fseek(FILE *f, uint64_t offset, int whence) {
+#ifdef _WIN32
+    return _fseeki64(f, (__int64)offset, whence);
+#else
+    return fseeko(f, (off_t)offset, whence);
+#endif
+}
+
+static int64_t data_bundle_ftell(FILE *f) {
+#ifdef _WIN32
+    return (int64_t)_ftelli64(f);
+#else
+    return (int64_t)ftello(f);
+#endif
+}
+
+static void data_bundle_sections_destroy(data_bundle_section_array *sections) {
+    if (sections == NULL) return;
+
+    for (size_t i = 0; i < sections->n; i++) {
+        free(sections->a[i].name);
+    }
+    data_bundle_section_array_destroy(sections);
+}
+
+void data_bundle_destroy(data_bundle_t *self) {
+    if (self == NULL) return;
+
+    if (self->path != NULL) {
+        free(self->path);
+    }
+
+    data_bundle_sections_destroy(self->sections);
+
+    free(self);
+}
+
+data_bundle_t *data_bundle_open(char *path, bool verify_checksums) {
+    if (path == NULL) return NULL;
+
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        log_error("Could not open data bundle: %s\n", path);
+        return NULL;
+    }
+
+    data_bundle_t *bundle = calloc(1, sizeof(data_bundle_t));
+    if (bundle == NULL) {
+        goto exit_bundle_file_opened;
+    }
+
+    bundle->path = strdup(path);
+    bundle->verify_checksums = verify_checksums;
+    bundle->sections = data_bundle_section_array_new();
+    if (bundle->path == NULL || bundle->sections == NULL) {
+        goto exit_bundle_created;
+    }
+
+    uint32_t signature;
+    if (!file_read_uint32(f, &signature) || signature != DATA_BUNDLE_SIGNATURE) {
+        log_error("Invalid data bundle signature: %s\n", path);
+        goto exit_bundle_created;
+    }
+
+    if (!file_read_uint32(f, &bundle->version) || bundle->version != DATA_BUNDLE_VERSION) {
+        log_error("Unsupported data bundle version: %u\n", bundle->version);
+        goto exit_bundle_created;
+    }
+
+    uint32_t num_sections;
+    if (!file_read_uint32(f, &num_sections)) {
+        goto exit_bundle_created;
+    }
+
+    for (uint32_t i = 0; i < num_sections; i++) {
+        uint32_t name_len;
+        if (!file_read_uint32(f, &name_len)) {
+            goto exit_bundle_created;
+        }
+
+        char *name = malloc(name_len + 1);
+        if (name == NULL) {
+            goto exit_bundle_created;
+        }
+
+        data_bundle_section_t section = (data_bundle_section_t){name, 0, 0, 0, false};
+
+        if (!file_read_chars(f, name, name_len) ||
+            !file_read_uint64(f, &section.offset) ||
+            !file_read_uint64(f, &section.size) ||
+            !file_read_uint32(f, &section.checksum)) {
+            free(name);
+            goto exit_bundle_created;
+        }
+        name[name_len] = '\0';
+
+        data_bundle_section_array_push(bundle->sections, section);
+    }
+
+    fclose(f);
+    return bundle;
+
+exit_bundle_created:
+    data_bundle_destroy(bundle);
+exit_bundle_file_opened:
+    fclose(f);
+    return NULL;
+}
+
+data_bundle_section_t *data_bundle_get_section(data_bundle_t *self, char *name) {
+    if (self == NULL || name == NULL) return NULL;
+
+    for (size_t i = 0; i < self->sections->n; i++) {
+        if (string_equals(self->sections->a[i].name, name)) {
+            return self->sections->a + i;
+        }
+    }
+    return NULL;
+}
+
+static bool data_bundle_checksum_file(FILE *f, uint64_t size, uint32_t *checksum) {
+    unsigned char *buf = malloc(DATA_BUNDLE_COPY_BUFFER_SIZE);
+    if (buf == NULL) return false;
+
+    uint32_t crc = 0;
+    uint64_t remaining = size;
+    bool ret = true;
+
+    while (remaining > 0) {
+        size_t chunk = remaining < DATA_BUNDLE_COPY_BUFFER_SIZE ? (size_t)remaining : DATA_BUNDLE_COPY_BUFFER_SIZE;
+        if (fread(buf, 1, chunk, f) != chunk) {
+            ret = false;
+            break;
+        }
+        crc = crc32_update(crc, buf, chunk);
+        remaining -= chunk;
+    }
+
+    free(buf);
+    *checksum = crc;
+    return ret;
+}
+
+bool data_bundle_verify_section(data_bundle_t *self, data_bundle_section_t *section) {
+    if (self == NULL || section == NULL) return false;
+    // Sections may be opened from several threads, verifying twice is harmless
+    if (__atomic_load_n(&section->verified, __ATOMIC_ACQUIRE)) return true;
+
+    FILE *f = fopen(self->path, "rb");
+    if (f == NULL) return false;
+
+    uint32_t checksum;
+    bool ret = data_bundle_fseek(f, section->offset, SEEK_SET) == 0 &&
+               data_bundle_checksum_file(f, section->size, &checksum) &&
+               checksum == section->checksum;
+    fclose(f);
+
+    if (!ret) {
+        log_error("Checksum mismatch for data bundle section %s\n", section->name);
+    }
+
+    __atomic_store_n(&section->verified, ret, __ATOMIC_RELEASE);
+    return ret;
+}
+
+FILE *data_bundle_open_section(data_bundle_t *self, char *name) {
+    data_bundle_section_t *section = data_bundle_get_section(self, name);
+    if (section == NULL) return NULL;
+
+    if (self->verify_checksums && !data_bundle_verify_section(self, section)) {
+        return NULL;
+    }
+
+    FILE *f = fopen(self->path, "rb");
+    if (f == NULL) return NULL;
+
+    if (data_bundle_fseek(f, section->offset, SEEK_SET) != 0) {
+        fclose(f);
+        return NULL;
+    }
+
+    return f;
+}
+
+static bool data_bundle_write_padding(FILE *f, uint64_t from, uint64_t to) {
+    for (; from < to; from++) {
+        if (fputc(0, f) == EOF) return false;
+    }
+    return true;
+}
+
+static inline uint64_t data_bundle_align(uint64_t offset) {
+    return (offset + DATA_BUNDLE_ALIGNMENT - 1) & ~((uint64_t)DATA_BUNDLE_ALIGNMENT - 1);
+}
+
+bool data_bundle_write(char *path, char *data_dir, char **names, size_t num_names) {
+    if (path == NULL || data_dir == NULL || names == NULL) return false;
+
+    bool ret = false;
+
+    FILE **inputs = calloc(num_names, sizeof(FILE *));
+    uint64_t *sizes = calloc(num_names, sizeof(uint64_t));
+    uint32_t *checksums = calloc(num_names, sizeof(uint32_t));
+    char_array *file_path = char_array_new();
+    unsigned char *buf = malloc(DATA_BUNDLE_COPY_BUFFER_SIZE);
+    FILE *f = NULL;
+
+    if (inputs == NULL || sizes == NULL || checksums == NULL || file_path == NULL || buf == NULL) {
+        goto exit_bundle_write;
+    }
+
+    // Directory size depends only on the names, so offsets can be computed up front
+    uint64_t header_size = 3 * sizeof(uint32_t);
+
+    for (size_t i = 0; i < num_names; i++) {
+        char_array_clear(file_path);
+        char_array_cat_joined(file_path, PATH_SEPARATOR, true, 2, data_dir, names[i]);
+        char *input_path = char_array_get_string(file_path);
+
+        inputs[i] = fopen(input_path, "rb");
+        if (inputs[i] == NULL) {
+            log_error("Could not open %s\n", input_path);
+            goto exit_bundle_write;
+        }
+
+        if (data_bundle_fseek(inputs[i], 0, SEEK_END) != 0) {
+            goto exit_bundle_write;
+        }
+        int64_t size = data_bundle_ftell(inputs[i]);
+        if (size < 0) {
+            goto exit_bundle_write;
+        }
+        sizes[i] = (uint64_t)size;
+        rewind(inputs[i]);
+
+        if (!data_bundle_checksum_file(inputs[i], sizes[i], &checksums[i])) {
+            goto exit_bundle_write;
+        }
+        rewind(inputs[i]);
+
+        header_size += sizeof(uint32_t) + strlen(names[i]) + 2 * sizeof(uint64_t) + sizeof(uint32_t);
+    }
+
+    f = fopen(path, "wb");
+    if (f == NULL) {
+        goto exit_bundle_write;
+    }
+
+    if (!file_write_uint32(f, DATA_BUNDLE_SIGNATURE) ||
+        !file_write_uint32(f, DATA_BUNDLE_VERSION) ||
+        !file_write_uint32(f, (uint32_t)num_names)) {
+        goto exit_bundle_write;
+    }
+
+    uint64_t offset = data_bundle_align(header_size);
+
+    for (size_t i = 0; i < num_names; i++) {
+        uint32_t name_len = (uint32_t)strlen(names[i]);
+        if (!file_write_uint32(f, name_len) ||
+            !file_write_chars(f, names[i], name_len) ||
+            !file_write_uint64(f, offset) ||
+            !file_write_uint64(f, sizes[i]) ||
+            !file_write_uint32(f, checksums[i])) {
+            goto exit_bundle_write;
+        }
+        offset = data_bundle_align(offset + sizes[i]);
+    }
+
+    uint64_t pos = header_size;
+
+    for (size_t i = 0; i < num_names; i++) {
+        uint64_t section_start = data_bundle_align(pos);
+        if (!data_bundle_write_padding(f, pos, section_start)) {
+            goto exit_bundle_write;
+        }
+
+        uint64_t remaining = sizes[i];
+        while (remaining > 0) {
+            size_t chunk = remaining < DATA_BUNDLE_COPY_BUFFER_SIZE ? (size_t)remaining : DATA_BUNDLE_COPY_BUFFER_SIZE;
+            if (fread(buf, 1, chunk, inputs[i]) != chunk || fwrite(buf, 1, chunk, f) != chunk) {
+                goto exit_bundle_write;
+            }
+            remaining -= chunk;
+        }
+
+        pos = section_start + sizes[i];
+    }
+
+    ret = true;
+
+exit_bundle_write:
+    if (f != NULL) {
+        fclose(f);
+    }
+
+    if (inputs != NULL) {
+        for (size_t i = 0; i < num_names; i++) {
+            if (inputs[i] != NULL) {
+                fclose(inputs[i]);
+            }
+        }
+        free(inputs);
+    }
+
+    free(sizes);
+    free(checksums);
+    free(buf);
+    char_array_destroy(file_path);
+
+    return ret;
+}
+
+void data_bundle_set_default(data_bundle_t *bundle) {
+    default_bundle = bundle;
+}
+
+data_bundle_t *data_bundle_get_default(void) {
+    return default_bundle;
+}
+
+FILE *data_bundle_fopen(char *path) {
+    if (path == NULL) return NULL;
+
+    if (default_bundle != NULL) {
+        size_t prefix_len = strlen(LIBPOSTAL_DATA_DIR);
+        size_t separator_len = PATH_SEPARATOR_LEN;
+
+        if (strncmp(path, LIBPOSTAL_DATA_DIR, prefix_len) == 0 &&
+            strncmp(path + prefix_len, PATH_SEPARATOR, separator_len) == 0) {
+            char *name = path + prefix_len + separator_len;
+            if (data_bundle_get_section(default_bundle, name) != NULL) {
+                return data_bundle_open_section(default_bundle, name);
+            }
+        }
+    }
+
+    return fopen(path, "rb");
+}
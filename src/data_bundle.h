@@ -0,0 +1,103 @@
+/*
+data_bundle.h
+-------------
+
+Packs libpostal's data files into a single file with a versioned header
+and a section directory. Each section is the verbatim contents of one data
+file, named by its path relative to LIBPOSTAL_DATA_DIR (e.g.
+"transliteration/transliteration.dat"), and starts on a page boundary so
+any memory-mappable structures inside it (see the trie layout in trie.h)
+stay aligned.
+
+File layout (integers big-endian, like the rest of libpostal's formats):
+
+    uint32 signature
+    uint32 version
+    uint32 num_sections
+    num_sections * {
+        uint32 name_len
+        char name[name_len]
+        uint64 offset
+        uint64 size
+        uint32 checksum        // CRC-32 of the section's bytes
+    }
+    sections, each aligned to DATA_BUNDLE_ALIGNMENT
+
+Nothing is read from a section until it's opened. Module loaders open
+their files through data_bundle_fopen, which returns a FILE * positioned at
+the matching section of the default bundle if one has been set, or falls
+back to opening the file on disk.
+
+The geodb's sparkey hash and log files (geodb.spi/geodb.spl) are opened by
+path inside sparkey, so they stay as separate files next to the bundle's
+data directory.
+*/
+
+#ifndef DATA_BUNDLE_H
+#define DATA_BUNDLE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "collections.h"
+
+#define DATA_BUNDLE_SIGNATURE 0x4C504442
+#define DATA_BUNDLE_VERSION 1
+#define DATA_BUNDLE_ALIGNMENT 4096
+
+#define DEFAULT_DATA_BUNDLE_FILENAME "libpostal.bundle"
+
+typedef struct data_bundle_section {
+    char *name;
+    uint64_t offset;
+    uint64_t size;
+    uint32_t checksum;
+    // Read and written with __atomic builtins, sections can be opened from any thread
+    bool verified;
+} data_bundle_section_t;
+
+VECTOR_INIT(data_bundle_section_array, data_bundle_section_t)
+
+typedef struct data_bundle {
+    char *path;
+    uint32_t version;
+    bool verify_checksums;
+    data_bundle_section_array *sections;
+} data_bundle_t;
+
+// Reads the header and section directory only
+data_bundle_t *data_bundle_open(char *path, bool verify_checksums);
+
+data_bundle_section_t *data_bundle_get_section(data_bundle_t *self, char *name);
+
+/*
+Opens a new FILE * on the bundle positioned at the start of the section.
+If the bundle was opened with verify_checksums, the section's checksum is
+checked the first time it's opened.
+*/
+FILE *data_bundle_open_section(data_bundle_t *self, char *name);
+
+bool data_bundle_verify_section(data_bundle_t *self, data_bundle_section_t *section);
+
+void data_bundle_destroy(data_bundle_t *self);
+
+// Writes a bundle with the given files, names are relative to data_dir
+bool data_bundle_write(char *path, char *data_dir, char **names, size_t num_names);
+
+/*
+Default bundle used by data_bundle_fopen. Setting it doesn't transfer
+ownership, callers clear it (NULL) before destroying the bundle.
+*/
+void data_bundle_set_default(data_bundle_t *bundle);
+data_bundle_t *data_bundle_get_default(void);
+
+/*
+Opens a data file for reading. If a default bundle is set and path is
+under LIBPOSTAL_DATA_DIR with a matching section, the returned FILE * is
+on the bundle, positioned at that section. Otherwise same as fopen(path, "rb").
+*/
+FILE *data_bundle_fopen(char *path);
+
+#endif
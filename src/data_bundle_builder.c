@@ -0,0 +1,62 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "address_parser.h"
+#include "data_bundle.h"
+#include "geodb.h"
+#include "language_classifier.h"
+#include "libpostal_config.h"
+#include "log/log.h"
+
+// Data files relative to LIBPOSTAL_DATA_DIR, in the order they're packed
+static char *bundle_sections[] = {
+    "transliteration" PATH_SEPARATOR "transliteration.dat",
+    "numex" PATH_SEPARATOR "numex.dat",
+    "address_expansions" PATH_SEPARATOR "address_dictionary.dat",
+    "language_classifier" PATH_SEPARATOR LANGUAGE_CLASSIFIER_FILENAME,
+    "address_parser" PATH_SEPARATOR ADDRESS_PARSER_MODEL_FILENAME,
+    "address_parser" PATH_SEPARATOR ADDRESS_PARSER_VOCAB_FILENAME,
+    "address_parser" PATH_SEPARATOR ADDRESS_PARSER_PHRASE_FILENAME,
+    "geodb" PATH_SEPARATOR GEODB_NAMES_TRIE_FILENAME,
+    "geodb" PATH_SEPARATOR GEODB_FEATURES_TRIE_FILENAME,
+    "geodb" PATH_SEPARATOR GEODB_POSTAL_CODES_FILENAME
+};
+
+int main(int argc, char **argv) {
+    char *data_dir = LIBPOSTAL_DATA_DIR;
+    char *output_file = LIBPOSTAL_DATA_DIR PATH_SEPARATOR DEFAULT_DATA_BUNDLE_FILENAME;
+
+    if (argc > 1) {
+        output_file = argv[1];
+    }
+
+    if (argc > 2) {
+        data_dir = argv[2];
+    }
+
+    size_t num_sections = sizeof(bundle_sections) / sizeof(char *);
+
+    if (!data_bundle_write(output_file, data_dir, bundle_sections, num_sections)) {
+        log_error("Error writing data bundle to %s\n", output_file);
+        exit(EXIT_FAILURE);
+    }
+
+    data_bundle_t *bundle = data_bundle_open(output_file, true);
+    if (bundle == NULL) {
+        log_error("Error reading data bundle back\n");
+        exit(EXIT_FAILURE);
+    }
+
+    for (size_t i = 0; i < bundle->sections->n; i++) {
+        data_bundle_section_t *section = bundle->sections->a + i;
+        if (!data_bundle_verify_section(bundle, section)) {
+            data_bundle_destroy(bundle);
+            exit(EXIT_FAILURE);
+        }
+        printf("%s: %llu bytes\n", section->name, (unsigned long long)section->size);
+    }
+
+    data_bundle_destroy(bundle);
+
+    exit(EXIT_SUCCESS);
+}
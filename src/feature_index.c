@@ -0,0 +1,372 @@
+#include "feature_index.h"
+#include "features.h"
+#include "file_utils.h"
+
+#include "log/log.h"
+
+// Seeds with this bit set hold the slot itself, used for buckets with a single key
+#define FEATURE_INDEX_DIRECT_SLOT (1U << 31)
+// Buckets with more than one key try seeds up to this value
+#define FEATURE_INDEX_MAX_SEED (1U << 24)
+
+#define FEATURE_INDEX_SEED_MULTIPLIER 0x9E3779B97F4A7C15ULL
+
+// Finalizer of MurmurHash3's 64-bit variant, spreads FNV's weak low bits
+static inline uint64_t feature_index_mix(uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xFF51AFD7ED558CCDULL;
+    x ^= x >> 33;
+    x *= 0xC4CEB9FE1A85EC53ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+// Maps the top 32 bits of x onto [0, n) with a multiply instead of a division
+static inline uint32_t feature_index_reduce(uint64_t x, uint32_t n) {
+    return (uint32_t)(((x >> 32) * (uint64_t)n) >> 32);
+}
+
+static inline uint32_t feature_index_bucket(feature_index_t *self, uint64_t x) {
+    return feature_index_reduce(x, self->num_buckets);
+}
+
+static inline uint32_t feature_index_slot(feature_index_t *self, uint64_t x, uint32_t seed) {
+    if (seed & FEATURE_INDEX_DIRECT_SLOT) {
+        return seed & ~FEATURE_INDEX_DIRECT_SLOT;
+    }
+    return feature_index_reduce(feature_index_mix(x + ((uint64_t)seed + 1) * FEATURE_INDEX_SEED_MULTIPLIER), self->num_keys);
+}
+
+bool feature_index_get_hash(feature_index_t *self, uint64_t hash, uint32_t *value) {
+    if (self->num_keys == 0) return false;
+
+    uint64_t x = feature_index_mix(hash);
+    uint32_t seed = self->seeds->a[feature_index_bucket(self, x)];
+    feature_index_slot_t slot = self->slots->a[feature_index_slot(self, x, seed)];
+
+    if (slot.fingerprint != (uint32_t)x) {
+        return false;
+    }
+
+    *value = slot.value;
+    return true;
+}
+
+bool feature_index_get(feature_index_t *self, char *key, uint32_t *value) {
+    return feature_index_get_hash(self, feature_hash_string(key), value);
+}
+
+static feature_index_t *feature_index_new_size(uint32_t num_keys, uint32_t num_buckets) {
+    feature_index_t *self = calloc(1, sizeof(feature_index_t));
+    if (self == NULL) return NULL;
+
+    self->num_keys = num_keys;
+    self->num_buckets = num_buckets;
+
+    self->seeds = uint32_array_new_size(num_buckets);
+    if (self->seeds == NULL) {
+        goto exit_index_created;
+    }
+    self->seeds->n = num_buckets;
+    // Empty buckets keep seed 0, lookups of unknown keys in them fail on the fingerprint
+    memset(self->seeds->a, 0, sizeof(uint32_t) * num_buckets);
+
+    self->slots = feature_index_slot_array_new_size(num_keys > 0 ? num_keys : 1);
+    if (self->slots == NULL) {
+        goto exit_index_created;
+    }
+    self->slots->n = num_keys;
+
+    return self;
+
+exit_index_created:
+    feature_index_destroy(self);
+    return NULL;
+}
+
+/*
+Buckets are placed largest first, while most slots are still free. For each
+one, seeds are tried in order until all of its keys land on free slots.
+Buckets with a single key are placed last and just take the next free slot.
+*/
+feature_index_t *feature_index_new(uint64_t *hashes, uint32_t *values, size_t n) {
+    if (n >= FEATURE_INDEX_DIRECT_SLOT) {
+        log_error("Too many keys for feature index: %zu\n", n);
+        return NULL;
+    }
+
+    uint32_t num_keys = (uint32_t)n;
+    uint32_t num_buckets = num_keys / FEATURE_INDEX_BUCKET_SIZE + 1;
+
+    feature_index_t *self = feature_index_new_size(num_keys, num_buckets);
+    if (self == NULL) return NULL;
+
+    bool success = false;
+
+    size_t keys_size = num_keys > 0 ? num_keys : 1;
+    uint64_t *mixed = malloc(sizeof(uint64_t) * keys_size);
+    uint32_t *bucket_keys = malloc(sizeof(uint32_t) * keys_size);
+    uint32_t *bucket_offsets = calloc(num_buckets + 1, sizeof(uint32_t));
+    uint32_t *bucket_fill = malloc(sizeof(uint32_t) * num_buckets);
+    uint32_t *bucket_order = malloc(sizeof(uint32_t) * num_buckets);
+    uint8_t *taken = calloc(keys_size, sizeof(uint8_t));
+    uint32_t *size_offsets = NULL;
+    uint32_t *bucket_slots = NULL;
+
+    if (mixed == NULL || bucket_keys == NULL || bucket_offsets == NULL ||
+        bucket_fill == NULL || bucket_order == NULL || taken == NULL) {
+        goto exit_index_build;
+    }
+
+    // Group the keys by bucket
+    for (uint32_t i = 0; i < num_keys; i++) {
+        mixed[i] = feature_index_mix(hashes[i]);
+        bucket_offsets[feature_index_bucket(self, mixed[i]) + 1]++;
+    }
+
+    uint32_t max_bucket_size = 0;
+    for (uint32_t b = 0; b < num_buckets; b++) {
+        uint32_t bucket_size = bucket_offsets[b + 1];
+        if (bucket_size > max_bucket_size) {
+            max_bucket_size = bucket_size;
+        }
+        bucket_offsets[b + 1] += bucket_offsets[b];
+        bucket_fill[b] = bucket_offsets[b];
+    }
+
+    for (uint32_t i = 0; i < num_keys; i++) {
+        bucket_keys[bucket_fill[feature_index_bucket(self, mixed[i])]++] = i;
+    }
+
+    // Counting sort of the buckets by size, largest first
+    size_offsets = calloc(max_bucket_size + 2, sizeof(uint32_t));
+    bucket_slots = malloc(sizeof(uint32_t) * (max_bucket_size + 1));
+    if (size_offsets == NULL || bucket_slots == NULL) {
+        goto exit_index_build;
+    }
+
+    for (uint32_t b = 0; b < num_buckets; b++) {
+        uint32_t bucket_size = bucket_offsets[b + 1] - bucket_offsets[b];
+        size_offsets[max_bucket_size - bucket_size + 1]++;
+    }
+
+    for (uint32_t i = 1; i <= max_bucket_size + 1; i++) {
+        size_offsets[i] += size_offsets[i - 1];
+    }
+
+    for (uint32_t b = 0; b < num_buckets; b++) {
+        uint32_t bucket_size = bucket_offsets[b + 1] - bucket_offsets[b];
+        bucket_order[size_offsets[max_bucket_size - bucket_size]++] = b;
+    }
+
+    uint32_t next_free = 0;
+
+    for (uint32_t i = 0; i < num_buckets; i++) {
+        uint32_t b = bucket_order[i];
+        uint32_t *keys = bucket_keys + bucket_offsets[b];
+        uint32_t bucket_size = bucket_offsets[b + 1] - bucket_offsets[b];
+
+        if (bucket_size == 0) {
+            // Every bucket after this one is empty too
+            break;
+        } else if (bucket_size == 1) {
+            while (taken[next_free]) {
+                next_free++;
+            }
+            bucket_slots[0] = next_free;
+            self->seeds->a[b] = FEATURE_INDEX_DIRECT_SLOT | next_free;
+        } else {
+            // Keys with the same hash could never be separated
+            for (uint32_t j = 0; j < bucket_size; j++) {
+                for (uint32_t k = j + 1; k < bucket_size; k++) {
+                    if (mixed[keys[j]] == mixed[keys[k]]) {
+                        log_error("Feature index: two keys have the same hash\n");
+                        goto exit_index_build;
+                    }
+                }
+            }
+
+            uint32_t seed;
+            for (seed = 0; seed < FEATURE_INDEX_MAX_SEED; seed++) {
+                bool placed = true;
+                for (uint32_t j = 0; j < bucket_size && placed; j++) {
+                    uint32_t slot = feature_index_slot(self, mixed[keys[j]], seed);
+                    if (taken[slot]) {
+                        placed = false;
+                    }
+                    for (uint32_t k = 0; k < j && placed; k++) {
+                        if (bucket_slots[k] == slot) {
+                            placed = false;
+                        }
+                    }
+                    bucket_slots[j] = slot;
+                }
+
+                if (placed) break;
+            }
+
+            if (seed == FEATURE_INDEX_MAX_SEED) {
+                log_error("Feature index: no seed found for bucket of size %u\n", bucket_size);
+                goto exit_index_build;
+            }
+
+            self->seeds->a[b] = seed;
+        }
+
+        for (uint32_t j = 0; j < bucket_size; j++) {
+            uint32_t slot = bucket_slots[j];
+            taken[slot] = 1;
+            self->slots->a[slot] = (feature_index_slot_t){(uint32_t)mixed[keys[j]], values[keys[j]]};
+        }
+    }
+
+    success = true;
+
+exit_index_build:
+    free(mixed);
+    free(bucket_keys);
+    free(bucket_offsets);
+    free(bucket_fill);
+    free(bucket_order);
+    free(taken);
+    free(size_offsets);
+    free(bucket_slots);
+
+    if (!success) {
+        feature_index_destroy(self);
+        return NULL;
+    }
+
+    return self;
+}
+
+typedef struct feature_index_keys {
+    uint64_array *hashes;
+    uint32_array *values;
+} feature_index_keys_t;
+
+static void feature_index_add_key(char *key, uint32_t value, void *arg) {
+    feature_index_keys_t *keys = (feature_index_keys_t *)arg;
+    uint64_array_push(keys->hashes, feature_hash_string(key));
+    uint32_array_push(keys->values, value);
+}
+
+feature_index_t *feature_index_new_from_trie(trie_t *trie) {
+    if (trie == NULL) return NULL;
+
+    uint32_t num_keys = trie_num_keys(trie);
+
+    feature_index_keys_t keys = (feature_index_keys_t){
+        .hashes = uint64_array_new_size(num_keys > 0 ? num_keys : 1),
+        .values = uint32_array_new_size(num_keys > 0 ? num_keys : 1)
+    };
+
+    feature_index_t *self = NULL;
+
+    if (keys.hashes != NULL && keys.values != NULL) {
+        trie_foreach_key(trie, feature_index_add_key, &keys);
+        self = feature_index_new(keys.hashes->a, keys.values->a, keys.hashes->n);
+    }
+
+    if (keys.hashes != NULL) {
+        uint64_array_destroy(keys.hashes);
+    }
+
+    if (keys.values != NULL) {
+        uint32_array_destroy(keys.values);
+    }
+
+    return self;
+}
+
+bool feature_index_write(feature_index_t *self, FILE *f) {
+    if (self == NULL || f == NULL) return false;
+
+    if (!file_write_uint32(f, FEATURE_INDEX_SIGNATURE) ||
+        !file_write_uint32(f, self->num_keys) ||
+        !file_write_uint32(f, self->num_buckets)) {
+        return false;
+    }
+
+    for (uint32_t i = 0; i < self->num_buckets; i++) {
+        if (!file_write_uint32(f, self->seeds->a[i])) {
+            return false;
+        }
+    }
+
+    for (uint32_t i = 0; i < self->num_keys; i++) {
+        feature_index_slot_t slot = self->slots->a[i];
+        if (!file_write_uint32(f, slot.fingerprint) ||
+            !file_write_uint32(f, slot.value)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+feature_index_t *feature_index_read(FILE *f) {
+    if (f == NULL) return NULL;
+
+    long save_pos = ftell(f);
+
+    uint32_t signature;
+    uint32_t num_keys;
+    uint32_t num_buckets;
+
+    feature_index_t *self = NULL;
+
+    if (!file_read_uint32(f, &signature) || signature != FEATURE_INDEX_SIGNATURE) {
+        goto exit_file_read;
+    }
+
+    if (!file_read_uint32(f, &num_keys) ||
+        !file_read_uint32(f, &num_buckets) ||
+        num_buckets == 0 ||
+        num_keys >= FEATURE_INDEX_DIRECT_SLOT) {
+        goto exit_file_read;
+    }
+
+    self = feature_index_new_size(num_keys, num_buckets);
+    if (self == NULL) {
+        goto exit_file_read;
+    }
+
+    if (!file_read_uint32_array(f, self->seeds->a, num_buckets)) {
+        goto exit_index_created;
+    }
+
+    for (uint32_t i = 0; i < num_buckets; i++) {
+        uint32_t seed = self->seeds->a[i];
+        if ((seed & FEATURE_INDEX_DIRECT_SLOT) && (seed & ~FEATURE_INDEX_DIRECT_SLOT) >= num_keys) {
+            goto exit_index_created;
+        }
+    }
+
+    // Slots are pairs of uint32s
+    if (num_keys > 0 && !file_read_uint32_array(f, (uint32_t *)self->slots->a, (size_t)num_keys * 2)) {
+        goto exit_index_created;
+    }
+
+    return self;
+
+exit_index_created:
+    feature_index_destroy(self);
+exit_file_read:
+    fseek(f, save_pos, SEEK_SET);
+    return NULL;
+}
+
+void feature_index_destroy(feature_index_t *self) {
+    if (self == NULL) return;
+
+    if (self->seeds != NULL) {
+        uint32_array_destroy(self->seeds);
+    }
+
+    if (self->slots != NULL) {
+        feature_index_slot_array_destroy(self->slots);
+    }
+
+    free(self);
+}
@@ -0,0 +1,75 @@
+/*
+feature_index.h
+---------------
+
+Read-only index from feature strings to ids, built from a model's feature
+trie and stored next to it in the model file. Used for exact-match lookups
+at prediction time in place of trie_get_data.
+
+It's a minimal perfect hash in the hash-and-displace style: keys are hashed
+once with feature_hash_string (see features.h) and spread over buckets of
+about FEATURE_INDEX_BUCKET_SIZE keys. Each bucket stores a seed chosen at
+build time so that its keys land on distinct slots, with exactly as many
+slots as keys. A slot holds a 32-bit fingerprint of the key's hash and the
+key's id, so a lookup is one hash, one read of the bucket's seed and one
+read of the slot. Keys that aren't in the index are rejected by the
+fingerprint, with a false positive rate of about 2^-32.
+
+At about 9 bytes per key it's much smaller than the trie, which for
+memory-mapped models means the trie's pages are never touched.
+
+File layout (big-endian):
+
+    uint32 signature
+    uint32 num_keys
+    uint32 num_buckets
+    uint32 seeds[num_buckets]
+    num_keys * {uint32 fingerprint, uint32 value}
+
+feature_index_read restores the file position and returns NULL when the
+next thing in the file isn't an index, so it can be appended to existing
+formats as an optional section.
+*/
+
+#ifndef FEATURE_INDEX_H
+#define FEATURE_INDEX_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "collections.h"
+#include "trie.h"
+
+#define FEATURE_INDEX_SIGNATURE 0xCDCDCDCD
+
+#define FEATURE_INDEX_BUCKET_SIZE 4
+
+typedef struct feature_index_slot {
+    uint32_t fingerprint;
+    uint32_t value;
+} feature_index_slot_t;
+
+VECTOR_INIT(feature_index_slot_array, feature_index_slot_t)
+
+typedef struct feature_index {
+    uint32_t num_keys;
+    uint32_t num_buckets;
+    uint32_array *seeds;
+    feature_index_slot_array *slots;
+} feature_index_t;
+
+// Build from parallel arrays of key hashes and values, NULL if two keys have the same hash
+feature_index_t *feature_index_new(uint64_t *hashes, uint32_t *values, size_t n);
+feature_index_t *feature_index_new_from_trie(trie_t *trie);
+
+bool feature_index_get_hash(feature_index_t *self, uint64_t hash, uint32_t *value);
+bool feature_index_get(feature_index_t *self, char *key, uint32_t *value);
+
+bool feature_index_write(feature_index_t *self, FILE *f);
+feature_index_t *feature_index_read(FILE *f);
+
+void feature_index_destroy(feature_index_t *self);
+
+#endif
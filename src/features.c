@@ -1,18 +1,58 @@
 #include "features.h"
 
 
-void feature_array_add(cstring_array *features, size_t count, ...) {
+void feature_array_vadd(cstring_array *features, size_t count, va_list args) {
     if (count <= 0) {
-        return;        
+        return;
     }
 
-    va_list args;
-    va_start(args, count);
-
     cstring_array_start_token(features);
 
     bool strip_separator = true;
     char_array_append_vjoined(features->str, FEATURE_SEPARATOR_CHAR, strip_separator, count, args);
+}
+
+void feature_array_add(cstring_array *features, size_t count, ...) {
+    va_list args;
+    va_start(args, count);
+    feature_array_vadd(features, count, args);
+    va_end(args);
+}
+
+inline uint64_t feature_hash_string(char *str) {
+    return feature_hash_update(FEATURE_HASH_OFFSET_BASIS, str, strlen(str));
+}
+
+// Mirrors char_array_append_vjoined with strip_separator=true
+void feature_hashes_vadd(uint64_array *features, size_t count, va_list args) {
+    if (count <= 0) {
+        return;
+    }
+
+    uint64_t hash = FEATURE_HASH_OFFSET_BASIS;
+
+    for (size_t i = 0; i < count - 1; i++) {
+        char *arg = va_arg(args, char *);
+        size_t len = strlen(arg);
+
+        if (len > 0 && arg[len - 1] == FEATURE_SEPARATOR_CHAR[0]) {
+            len--;
+        }
+
+        hash = feature_hash_update(hash, arg, len);
+        hash = feature_hash_update(hash, FEATURE_SEPARATOR_CHAR, 1);
+    }
+
+    char *arg = va_arg(args, char *);
+    hash = feature_hash_update(hash, arg, strlen(arg));
+
+    uint64_array_push(features, hash);
+}
+
+void feature_hashes_add(uint64_array *features, size_t count, ...) {
+    va_list args;
+    va_start(args, count);
+    feature_hashes_vadd(features, count, args);
     va_end(args);
 }
 
@@ -11,6 +11,7 @@
 // Add feature to array
 
 void feature_array_add(cstring_array *features, size_t count, ...);
+void feature_array_vadd(cstring_array *features, size_t count, va_list args);
 
 // Add feature using printf format
 void feature_array_add_printf(cstring_array *features, char *format, ...);
@@ -22,6 +23,35 @@ bool feature_counts_add_no_copy(khash_t(str_double) *features, char *feature, do
 bool feature_counts_update(khash_t(str_double) *features, char *feature, double count); 
 bool feature_counts_update_no_copy(khash_t(str_double) *features, char *feature, double count); 
 
+/*
+Feature hashing
+
+feature_hashes_add pushes the 64-bit FNV-1a hash of the string that
+feature_array_add would build from the same parts (joined by
+FEATURE_SEPARATOR_CHAR, trailing separators stripped from all but the
+last part) without building the string, so it always equals
+feature_hash_string of that string. Models index their feature names by
+this hash (see averaged_perceptron_build_feature_hashes) so features can
+be looked up without ever being materialized as strings.
+*/
+
+#define FEATURE_HASH_OFFSET_BASIS 14695981039346656037ULL
+#define FEATURE_HASH_PRIME 1099511628211ULL
+
+static inline uint64_t feature_hash_update(uint64_t hash, const char *str, size_t len) {
+    const unsigned char *ptr = (const unsigned char *)str;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= (uint64_t)ptr[i];
+        hash *= FEATURE_HASH_PRIME;
+    }
+    return hash;
+}
+
+uint64_t feature_hash_string(char *str);
+
+void feature_hashes_add(uint64_array *features, size_t count, ...);
+void feature_hashes_vadd(uint64_array *features, size_t count, va_list args);
+
 VECTOR_INIT(feature_count_array, khash_t(str_double) *)
 
 #endif
\ No newline at end of file
@@ -177,6 +177,47 @@ bool file_write_uint32(FILE *file, uint32_t value) {
     return (fwrite(buf, 4, 1, file) == 1);
 }
 
+typedef union {
+    uint32_t u;
+    float f;
+} uint32_float_t;
+
+bool file_read_float(FILE *file, float *value) {
+    uint32_float_t uf;
+    if (!file_read_uint32(file, &uf.u)) {
+        return false;
+    }
+    *value = uf.f;
+    return true;
+}
+
+bool file_read_float_array(FILE *file, float *value, size_t n) {
+    unsigned char *buf = malloc(n * sizeof(uint32_t));
+
+    if (buf == NULL) return false;
+
+    bool ret = false;
+
+    if (fread(buf, sizeof(uint32_t), n, file) == n) {
+        uint32_float_t uf;
+
+        for (size_t i = 0, byte_offset = 0; i < n; i++, byte_offset += sizeof(uint32_t)) {
+            unsigned char *ptr = buf + byte_offset;
+            uf.u = file_deserialize_uint32(ptr);
+            value[i] = uf.f;
+        }
+        ret = true;
+    }
+    free(buf);
+    return ret;
+}
+
+bool file_write_float(FILE *file, float value) {
+    uint32_float_t uf;
+    uf.f = value;
+    return file_write_uint32(file, uf.u);
+}
+
 
 inline uint16_t file_deserialize_uint16(unsigned char *buf) {
     return (buf[0] << 8) | buf[1];
@@ -194,6 +235,25 @@ bool file_read_uint16(FILE *file, uint16_t *value) {
 
 }
 
+bool file_read_uint16_array(FILE *file, uint16_t *value, size_t n) {
+    unsigned char *buf = malloc(n * sizeof(uint16_t));
+
+    if (buf == NULL) return false;
+
+    bool ret = false;
+
+    if (fread(buf, sizeof(uint16_t), n, file) == n) {
+
+        for (size_t i = 0, byte_offset = 0; i < n; i++, byte_offset += sizeof(uint16_t)) {
+            unsigned char *ptr = buf + byte_offset;
+            value[i] = file_deserialize_uint16(ptr);
+        }
+        ret = true;
+    }
+    free(buf);
+    return ret;
+}
+
 bool file_write_uint16(FILE *file, uint16_t value) {
     unsigned char buf[2];
 
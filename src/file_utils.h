@@ -72,10 +72,17 @@ bool file_write_uint32(FILE *file, uint32_t value);
 
 bool file_read_uint32_array(FILE *file, uint32_t *value, size_t n);
 
+bool file_read_float(FILE *file, float *value);
+bool file_write_float(FILE *file, float value);
+
+bool file_read_float_array(FILE *file, float *value, size_t n);
+
 uint16_t file_deserialize_uint16(unsigned char *buf);
 bool file_read_uint16(FILE *file, uint16_t *value);
 bool file_write_uint16(FILE *file, uint16_t value);
 
+bool file_read_uint16_array(FILE *file, uint16_t *value, size_t n);
+
 bool file_read_uint8(FILE *file, uint8_t *value);
 bool file_write_uint8(FILE *file, uint8_t value);
 
@@ -1,4 +1,5 @@
 #include "geodb.h"
+#include "data_bundle.h"
 
 static geodb_t *geodb = NULL;
 
@@ -47,7 +48,7 @@ void geodb_destroy(geodb_t *self) {
 geodb_t *geodb_init(char *dir) {
     if (dir == NULL) return NULL;
 
-    geodb_t *gdb = malloc(sizeof(geodb_t));
+    geodb_t *gdb = calloc(1, sizeof(geodb_t));
 
     if (gdb == NULL) return NULL;
 
@@ -77,7 +78,10 @@ geodb_t *geodb_init(char *dir) {
     char_array_cat_joined(path, PATH_SEPARATOR, true, 2, dir, GEODB_POSTAL_CODES_FILENAME);
     char *postal_codes_path = char_array_get_string(path);
 
-    FILE *f = fopen(postal_codes_path, "rb");
+    FILE *f = data_bundle_fopen(postal_codes_path);
+    if (f == NULL) {
+        goto exit_geodb_created;
+    }
 
     uint64_t num_postal_strings = 0;
     if (!file_read_uint64(f, &num_postal_strings)) {
@@ -185,6 +189,10 @@ bool search_geodb_tokens_with_phrases(char *str, token_array *tokens, phrase_arr
     return trie_search_tokens_with_phrases(geodb->names, str, tokens, phrases);
 }
 
+void geodb_token_search_init(trie_token_search_t *search, phrase_array **phrases) {
+    trie_token_search_init(search, geodb->names, ROOT_NODE_ID, phrases);
+}
+
 
 phrase_array *search_geodb_tokens(char *str, token_array *tokens) {
     phrase_array *phrases = NULL;
@@ -217,6 +225,7 @@ geonames_generic_t *geodb_get_len(char *key, size_t len) {
                 }
                 return generic;
             }
+            free(generic);
         }
     } 
     return NULL;
@@ -233,7 +242,7 @@ bool geodb_module_setup(char *dir) {
         return geodb_load(dir == NULL ? LIBPOSTAL_GEODB_DIR : dir);
     }
 
-    return false;
+    return true;
 }
 
 
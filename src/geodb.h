@@ -58,6 +58,11 @@ typedef struct gn_geocoding_result {
 geodb_t *get_geodb(void);
 bool geodb_load(char *dir);
 
+/*
+Returns true if the geodb is already loaded, like the other modules' setup
+functions, so it can be called again by libpostal_ensure_modules after the
+parser was set up explicitly. It used to return false in that case.
+*/
 bool geodb_module_setup(char *dir);
 void geodb_module_teardown(void);
 
@@ -68,6 +73,8 @@ void geodb_destroy(geodb_t *self);
 bool search_geodb_with_phrases(char *str, phrase_array **phrases);
 phrase_array *search_geodb(char *str);
 bool search_geodb_tokens_with_phrases(char *str, token_array *tokens, phrase_array **phrases);
+// Sets up a search of the place names, for use with trie_search_tokens_multi
+void geodb_token_search_init(trie_token_search_t *search, phrase_array **phrases);
 phrase_array *search_geodb_tokens(char *str, token_array *tokens);
 
 geonames_generic_t *geodb_get_len(char *key, size_t len);
@@ -1,10 +1,12 @@
 #include "language_classifier.h"
+#include "data_bundle.h"
 
 #include <float.h>
 
 #include "language_features.h"
 #include "minibatch.h"
 #include "normalize.h"
+#include "stats.h"
 #include "token_types.h"
 #include "unicode_scripts.h"
 
@@ -21,6 +23,10 @@ void language_classifier_destroy(language_classifier_t *self) {
         trie_destroy(self->features);
     }
 
+    if (self->feature_index != NULL) {
+        feature_index_destroy(self->feature_index);
+    }
+
     if (self->labels != NULL) {
         cstring_array_destroy(self->labels);
     }
@@ -33,7 +39,7 @@ void language_classifier_destroy(language_classifier_t *self) {
 }
 
 language_classifier_t *language_classifier_new(void) {
-    language_classifier_t *language_classifier = malloc(sizeof(language_classifier_t));
+    language_classifier_t *language_classifier = calloc(1, sizeof(language_classifier_t));
     return language_classifier;
 }
 
@@ -55,6 +61,8 @@ void language_classifier_response_destroy(language_classifier_response_t *self)
 }
 
 language_classifier_response_t *classify_languages(char *address) {
+    STATS_TIME_SCOPE(LIBPOSTAL_STAGE_LANGUAGE_CLASSIFIER);
+
     language_classifier_t *classifier = get_language_classifier();
     
     if (classifier == NULL) {
@@ -78,7 +86,12 @@ language_classifier_response_t *classify_languages(char *address) {
         return NULL;
     }
 
-    sparse_matrix_t *x = feature_vector(classifier->features, feature_counts);
+    sparse_matrix_t *x;
+    if (classifier->feature_index != NULL) {
+        x = feature_vector_index(classifier->feature_index, feature_counts);
+    } else {
+        x = feature_vector(classifier->features, feature_counts);
+    }
 
     size_t n = classifier->num_labels;
     matrix_t *p_y = matrix_new_zeros(1, n);
@@ -196,6 +209,9 @@ language_classifier_t *language_classifier_read(FILE *f) {
 
     classifier->weights = weights;
 
+    // Optional, older models end with the weights
+    classifier->feature_index = feature_index_read(f);
+
     return classifier;
 
 exit_classifier_created:
@@ -209,7 +225,7 @@ exit_file_read:
 language_classifier_t *language_classifier_load(char *path) {
     FILE *f;
 
-    f = fopen(path, "rb");
+    f = data_bundle_fopen(path);
     if (!f) return NULL;
 
     language_classifier_t *classifier = language_classifier_read(f);
@@ -230,7 +246,23 @@ bool language_classifier_write(language_classifier_t *self, FILE *f) {
         return false;
     }
 
-    return true;
+    // Saved with a feature index so lookups at prediction time can skip the trie
+    feature_index_t *feature_index = self->feature_index;
+    if (feature_index == NULL) {
+        feature_index = feature_index_new_from_trie(self->features);
+        if (feature_index == NULL) {
+            log_warn("Could not build feature index, classifier will use the trie\n");
+            return true;
+        }
+    }
+
+    bool success = feature_index_write(feature_index, f);
+
+    if (feature_index != self->feature_index) {
+        feature_index_destroy(feature_index);
+    }
+
+    return success;
 }
 
 bool language_classifier_save(language_classifier_t *self, char *path) {
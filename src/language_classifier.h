@@ -7,6 +7,7 @@
 #include <stdbool.h>
 
 #include "collections.h"
+#include "feature_index.h"
 #include "language_features.h"
 #include "logistic_regression.h"
 #include "tokens.h"
@@ -20,6 +21,8 @@ typedef struct language_classifier {
     size_t num_labels;
     size_t num_features;
     trie_t *features;
+    // Optional, used instead of the trie for lookups when present
+    feature_index_t *feature_index;
     cstring_array *labels;
     matrix_t *weights;
 } language_classifier_t;
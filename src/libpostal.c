@@ -1,4 +1,6 @@
 #include <stdlib.h>
+#include <pthread.h>
+#include <time.h>
 
 #include "libpostal.h"
 
@@ -8,14 +10,19 @@
 
 #include "address_dictionary.h"
 #include "address_parser.h"
+#include "arena.h"
 #include "collections.h"
 #include "constants.h"
+#include "data_bundle.h"
 #include "geodb.h"
 #include "language_classifier.h"
 #include "numex.h"
 #include "normalize.h"
+#include "result_cache.h"
 #include "scanner.h"
+#include "stats.h"
 #include "string_utils.h"
+#include "thread_pool.h"
 #include "token_types.h"
 #include "transliterate.h"
 
@@ -32,6 +39,8 @@ KSORT_INIT(phrase_language_array, phrase_language_t, ks_lt_phrase_language)
 
 #define DEFAULT_KEY_LEN 32
 
+#define EXPAND_ARENA_BLOCK_SIZE (64 * 1024)
+
 
 static normalize_options_t LIBPOSTAL_DEFAULT_OPTIONS = {
         .languages = NULL,
@@ -61,6 +70,78 @@ normalize_options_t get_libpostal_default_options(void) {
     return LIBPOSTAL_DEFAULT_OPTIONS;
 }
 
+/*
+Lazy module loading
+
+After libpostal_setup_bundle, modules aren't loaded up front. Each entry
+point calls libpostal_ensure_modules with the modules it needs, which
+loads any that are missing from the bundle (under a lock, so concurrent
+first calls load a module once). Without a bundle, modules are set up
+explicitly by the libpostal_setup* functions and this is a no-op.
+*/
+
+#define LIBPOSTAL_MODULE_TRANSLITERATION (1 << 0)
+#define LIBPOSTAL_MODULE_NUMEX (1 << 1)
+#define LIBPOSTAL_MODULE_ADDRESS_DICTIONARY (1 << 2)
+#define LIBPOSTAL_MODULE_LANGUAGE_CLASSIFIER (1 << 3)
+#define LIBPOSTAL_MODULE_GEODB (1 << 4)
+#define LIBPOSTAL_MODULE_ADDRESS_PARSER (1 << 5)
+
+#define LIBPOSTAL_EXPAND_MODULES (LIBPOSTAL_MODULE_TRANSLITERATION | LIBPOSTAL_MODULE_NUMEX | LIBPOSTAL_MODULE_ADDRESS_DICTIONARY)
+#define LIBPOSTAL_PARSER_MODULES (LIBPOSTAL_MODULE_TRANSLITERATION | LIBPOSTAL_MODULE_ADDRESS_DICTIONARY | LIBPOSTAL_MODULE_GEODB | LIBPOSTAL_MODULE_ADDRESS_PARSER)
+
+static data_bundle_t *libpostal_bundle = NULL;
+static pthread_mutex_t libpostal_modules_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint32_t libpostal_modules_loaded = 0;
+
+static bool libpostal_module_setup(uint32_t module) {
+    switch (module) {
+        case LIBPOSTAL_MODULE_TRANSLITERATION:
+            return transliteration_module_setup(NULL);
+        case LIBPOSTAL_MODULE_NUMEX:
+            return numex_module_setup(NULL);
+        case LIBPOSTAL_MODULE_ADDRESS_DICTIONARY:
+            return address_dictionary_module_setup(NULL);
+        case LIBPOSTAL_MODULE_LANGUAGE_CLASSIFIER:
+            return language_classifier_module_setup(NULL) && get_language_classifier() != NULL;
+        case LIBPOSTAL_MODULE_GEODB:
+            return geodb_module_setup(NULL);
+        case LIBPOSTAL_MODULE_ADDRESS_PARSER:
+            return address_parser_module_setup(NULL);
+        default:
+            return false;
+    }
+}
+
+static bool libpostal_ensure_modules(uint32_t modules) {
+    if (libpostal_bundle == NULL) return true;
+
+    if ((__atomic_load_n(&libpostal_modules_loaded, __ATOMIC_ACQUIRE) & modules) == modules) {
+        return true;
+    }
+
+    bool ret = true;
+
+    pthread_mutex_lock(&libpostal_modules_lock);
+    for (uint32_t module = 1; module <= modules; module <<= 1) {
+        if (!(modules & module) || (libpostal_modules_loaded & module)) continue;
+
+        if (!libpostal_module_setup(module)) {
+            log_error("Error loading module %u from data bundle\n", module);
+            ret = false;
+            break;
+        }
+        __atomic_or_fetch(&libpostal_modules_loaded, module, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&libpostal_modules_lock);
+
+    return ret;
+}
+
+static void libpostal_clear_modules(uint32_t modules) {
+    __atomic_and_fetch(&libpostal_modules_loaded, ~modules, __ATOMIC_RELEASE);
+}
+
 static inline uint64_t get_normalize_token_options(normalize_options_t options) {
     uint64_t normalize_token_options = 0;
 
@@ -136,17 +217,17 @@ static void add_normalized_strings_token(cstring_array *strings, char *str, toke
     }
 }
 
-static string_tree_t *add_string_alternatives(char *str, normalize_options_t options) {
+static string_tree_t *add_string_alternatives(arena_t *arena, char *str, normalize_options_t options) {
     char_array *key = NULL;
 
     log_debug("input=%s\n", str);
-    token_array *tokens = tokenize_keep_whitespace(str);
+    size_t len = strlen(str);
 
+    token_array *tokens = token_array_new_size_arena(arena, DEFAULT_VECTOR_SIZE);
     if (tokens == NULL) {
         return NULL;
     }
-
-    size_t len = strlen(str);
+    tokenize_add_tokens(tokens, str, len, true);
 
     log_debug("tokenized, num tokens=%zu\n", tokens->n);
 
@@ -169,7 +250,7 @@ static string_tree_t *add_string_alternatives(char *str, normalize_options_t opt
 
         log_debug("lang_phrases->n = %zu\n", lang_phrases->n);
 
-        phrases = phrases != NULL ? phrases : phrase_language_array_new_size(lang_phrases->n);
+        phrases = phrases != NULL ? phrases : phrase_language_array_new_size_arena(arena, lang_phrases->n);
 
         for (int j = 0; j < lang_phrases->n; j++) {
             phrase_t p = lang_phrases->a[j];
@@ -183,7 +264,7 @@ static string_tree_t *add_string_alternatives(char *str, normalize_options_t opt
 
     lang_phrases = search_address_dictionaries_tokens(str, tokens, ALL_LANGUAGES);
     if (lang_phrases != NULL) {
-        phrases = phrases != NULL ? phrases : phrase_language_array_new_size(lang_phrases->n);
+        phrases = phrases != NULL ? phrases : phrase_language_array_new_size_arena(arena, lang_phrases->n);
 
         for (int j = 0; j < lang_phrases->n; j++) {
             phrase_t p = lang_phrases->a[j];
@@ -193,7 +274,7 @@ static string_tree_t *add_string_alternatives(char *str, normalize_options_t opt
 
     }
 
-    string_tree_t *tree = string_tree_new_size(len);
+    string_tree_t *tree = string_tree_new_size_arena(arena, len);
 
     bool last_added_was_whitespace = false;
 
@@ -211,7 +292,7 @@ static string_tree_t *add_string_alternatives(char *str, normalize_options_t opt
         phrase_t phrase = NULL_PHRASE;
         phrase_t prev_phrase = NULL_PHRASE;
 
-        key = key != NULL ? key : char_array_new_size(DEFAULT_KEY_LEN);
+        key = key != NULL ? key : char_array_new_size_arena(arena, DEFAULT_KEY_LEN);
 
         for (int i = 0; i < phrases->n; i++) {
             phrase_lang = phrases->a[i];
@@ -399,8 +480,6 @@ static string_tree_t *add_string_alternatives(char *str, normalize_options_t opt
 
         }
 
-        char_array_destroy(key);
-
         end = (int)tokens->n;
 
         if (phrase.start + phrase.len > 0 && phrase.start + phrase.len <= end - 1) {
@@ -481,12 +560,6 @@ static string_tree_t *add_string_alternatives(char *str, normalize_options_t opt
         }
     }
 
-    if (phrases != NULL) {
-        phrase_language_array_destroy(phrases);
-    }
-
-    token_array_destroy(tokens);
-
     return tree;
 }
 
@@ -545,7 +618,7 @@ static inline void cat_affix_expansion(char_array *key, char *str, address_expan
     }
 }
 
-static bool add_affix_expansions(string_tree_t *tree, char *str, char *lang, token_t token, phrase_t prefix, phrase_t suffix, normalize_options_t options) {
+static bool add_affix_expansions(arena_t *arena, string_tree_t *tree, char *str, char *lang, token_t token, phrase_t prefix, phrase_t suffix, normalize_options_t options) {
     cstring_array *strings = tree->strings;
 
     bool have_suffix = suffix.len > 0 && suffix.len < token.len;
@@ -561,7 +634,7 @@ static bool add_affix_expansions(string_tree_t *tree, char *str, char *lang, tok
     address_expansion_t prefix_expansion;
     address_expansion_t suffix_expansion;
 
-    char_array *key = char_array_new_size(token.len);
+    char_array *key = char_array_new_size_arena(arena, token.len);
     char *expansion;
 
     size_t num_strings = 0;
@@ -585,7 +658,6 @@ static bool add_affix_expansions(string_tree_t *tree, char *str, char *lang, tok
     }
 
     if (!have_suffix && !have_prefix) {
-        char_array_destroy(key);
         return false;
     }
     
@@ -613,7 +685,7 @@ static bool add_affix_expansions(string_tree_t *tree, char *str, char *lang, tok
                 if (prefix.len + suffix.len < token.len) {
                     root_len = token.len - suffix.len - prefix.len;
                     root_token = (token_t){token.offset + prefix.len, root_len, token.type};
-                    root_strings = cstring_array_new_size(root_len);
+                    root_strings = cstring_array_new_size_arena(arena, root_len);
                     add_normalized_strings_token(root_strings, str, root_token, options);
                     num_strings = cstring_array_num_strings(root_strings);
 
@@ -647,7 +719,6 @@ static bool add_affix_expansions(string_tree_t *tree, char *str, char *lang, tok
                         }
                     }
 
-                    cstring_array_destroy(root_strings);
                     root_strings = NULL;
 
                 } else {
@@ -667,7 +738,7 @@ static bool add_affix_expansions(string_tree_t *tree, char *str, char *lang, tok
     } else if (have_suffix) {
         root_len = suffix.start;
         root_token = (token_t){token.offset, root_len, token.type};
-        root_strings = cstring_array_new_size(root_len);
+        root_strings = cstring_array_new_size_arena(arena, root_len);
         add_normalized_strings_token(root_strings, str, root_token, options);
         num_strings = cstring_array_num_strings(root_strings);
 
@@ -701,12 +772,12 @@ static bool add_affix_expansions(string_tree_t *tree, char *str, char *lang, tok
         if (prefix.len <= token.len) {
             root_len = token.len - prefix.len;
             root_token = (token_t){token.offset + prefix.len, root_len, token.type};
-            root_strings = cstring_array_new_size(root_len);
+            root_strings = cstring_array_new_size_arena(arena, root_len);
             add_normalized_strings_token(root_strings, str, root_token, options);
             num_strings = cstring_array_num_strings(root_strings);
 
         } else {
-            root_strings = cstring_array_new_size(token.len);
+            root_strings = cstring_array_new_size_arena(arena, token.len);
             add_normalized_strings_token(root_strings, str, token, options);
             num_strings = cstring_array_num_strings(root_strings);
 
@@ -715,8 +786,6 @@ static bool add_affix_expansions(string_tree_t *tree, char *str, char *lang, tok
                 cstring_array_add_string(tree->strings, root_word);
             }
 
-            char_array_destroy(key);
-            cstring_array_destroy(root_strings);
             return false;
 
         }
@@ -746,17 +815,11 @@ static bool add_affix_expansions(string_tree_t *tree, char *str, char *lang, tok
         }
     }
 
-    char_array_destroy(key);
-
-    if (root_strings != NULL) {
-        cstring_array_destroy(root_strings);
-    }
-
     return true;
 
 }
 
-static inline bool expand_affixes(string_tree_t *tree, char *str, char *lang, token_t token, normalize_options_t options) {
+static inline bool expand_affixes(arena_t *arena, string_tree_t *tree, char *str, char *lang, token_t token, normalize_options_t options) {
     phrase_t suffix = search_address_dictionaries_suffix(str + token.offset, token.len, lang);
 
     phrase_t prefix = search_address_dictionaries_prefix(str + token.offset, token.len, lang);
@@ -764,10 +827,10 @@ static inline bool expand_affixes(string_tree_t *tree, char *str, char *lang, to
     if ((suffix.len == 0 && prefix.len == 0)) return false;
 
 
-    return add_affix_expansions(tree, str, lang, token, prefix, suffix, options);
+    return add_affix_expansions(arena, tree, str, lang, token, prefix, suffix, options);
 }
 
-static inline void add_normalized_strings_tokenized(string_tree_t *tree, char *str, token_array *tokens, normalize_options_t options) {
+static inline void add_normalized_strings_tokenized(arena_t *arena, string_tree_t *tree, char *str, token_array *tokens, normalize_options_t options) {
     cstring_array *strings = tree->strings;
 
     for (int i = 0; i < tokens->n; i++) {
@@ -782,7 +845,7 @@ static inline void add_normalized_strings_tokenized(string_tree_t *tree, char *s
 
         for (int j = 0; j < options.num_languages; j++) {
             char *lang = options.languages[j];
-            if (expand_affixes(tree, str, lang, token, options)) {
+            if (expand_affixes(arena, tree, str, lang, token, options)) {
                 have_phrase = true;
                 break;
             }
@@ -798,113 +861,215 @@ static inline void add_normalized_strings_tokenized(string_tree_t *tree, char *s
 }
 
 
-static void expand_alternative(cstring_array *strings, khash_t(str_set) *unique_strings, char *str, normalize_options_t options) {
-    size_t len = strlen(str);
-    token_array *tokens = tokenize_keep_whitespace(str);
-    string_tree_t *token_tree = string_tree_new_size(len);
+/*
+expand_alternative is split into stages so the same steps can be driven
+either by the loops below (expand_address) or one step at a time by an
+expansion iterator:
 
-    add_normalized_strings_tokenized(token_tree, str, tokens, options);
+1. expand_alternative_tokenized: tokenize a normalized string and add the
+   per-token alternatives, returns an iterator over tokenized strings
+2. expand_tokenized_string: join the current tokenized string, replace
+   numeric expressions and add phrase alternatives, returns an iterator over
+   full expansions (or NULL)
+3. expand_unique_string: join the current expansion, NULL if already seen
+*/
 
-    string_tree_iterator_t *tokenized_iter = string_tree_iterator_new(token_tree);
+static string_tree_iterator_t *expand_alternative_tokenized(arena_t *arena, char *str, normalize_options_t options) {
+    size_t len = strlen(str);
+    token_array *tokens = token_array_new_size_arena(arena, DEFAULT_VECTOR_SIZE);
+    tokenize_add_tokens(tokens, str, len, true);
+    string_tree_t *token_tree = string_tree_new_size_arena(arena, len);
 
-    string_tree_iterator_t *iter;
+    add_normalized_strings_tokenized(arena, token_tree, str, tokens, options);
 
-    char_array *temp_string = char_array_new_size(len);
+    return string_tree_iterator_new_arena(arena, token_tree);
+}
 
+static char *expand_join_tokenized(string_tree_iterator_t *tokenized_iter, char_array *temp_string) {
     char *token;
 
-    char *lang;
+    char_array_clear(temp_string);
 
-    kh_resize(str_set, unique_strings, kh_size(unique_strings) + tokenized_iter->remaining);
+    string_tree_iterator_foreach_token(tokenized_iter, token, {
+        if (token == NULL) {
+            continue;
+        }
+        char_array_append(temp_string, token);
+    })
+    char_array_terminate(temp_string);
 
-    for (; string_tree_iterator_done(tokenized_iter); string_tree_iterator_next(tokenized_iter)) {
-        char_array_clear(temp_string);
+    return char_array_get_string(temp_string);
+}
 
-        string_tree_iterator_foreach_token(tokenized_iter, token, {
-            if (token == NULL) {
-                continue;
-            }
-            char_array_append(temp_string, token);
-        })
-        char_array_terminate(temp_string);
-
-        char *tokenized_str = char_array_get_string(temp_string);
-
-        char *new_str = tokenized_str;
-        char *last_numex_str = NULL;
-        if (options.expand_numex) {
-            char *numex_replaced = NULL;
-            for (int i = 0; i < options.num_languages; i++)  {
-                lang = options.languages[i];
-
-                numex_replaced = replace_numeric_expressions(new_str, lang);
-                if (numex_replaced != NULL) {
-                    new_str = numex_replaced;
-                
-                    if (last_numex_str != NULL) {
-                        free(last_numex_str);
-                    }            
-                    last_numex_str = numex_replaced;
-                }
+// Replaces numeric expressions and adds phrase alternatives for a tokenized string
+static string_tree_t *expand_string_alternatives(arena_t *arena, char *tokenized_str, normalize_options_t options) {
+    char *lang;
+    char *new_str = tokenized_str;
+    char *last_numex_str = NULL;
+    if (options.expand_numex) {
+        char *numex_replaced = NULL;
+        for (int i = 0; i < options.num_languages; i++)  {
+            lang = options.languages[i];
+
+            numex_replaced = replace_numeric_expressions(new_str, lang);
+            if (numex_replaced != NULL) {
+                new_str = numex_replaced;
+            
+                if (last_numex_str != NULL) {
+                    free(last_numex_str);
+                }            
+                last_numex_str = numex_replaced;
             }
-
         }
-        
-        string_tree_t *alternatives;
 
-        int ret;
-        log_debug("new_str=%s\n", new_str);
+    }
+    
+    string_tree_t *alternatives;
+
+    log_debug("new_str=%s\n", new_str);
 
-        log_debug("Adding alternatives for single normalization\n");
-        alternatives = add_string_alternatives(new_str, options);
+    log_debug("Adding alternatives for single normalization\n");
+    alternatives = add_string_alternatives(arena, new_str, options);
 
-        if (last_numex_str != NULL) {
-            free(last_numex_str);
-        }
+    if (last_numex_str != NULL) {
+        free(last_numex_str);
+    }
 
-        if (alternatives == NULL) {
-            log_debug("alternatives = NULL\n");
-            continue;
-        }
+    return alternatives;
+}
+
+static string_tree_iterator_t *expand_tokenized_string(arena_t *arena, string_tree_iterator_t *tokenized_iter, char_array *temp_string, normalize_options_t options) {
+    char *tokenized_str = expand_join_tokenized(tokenized_iter, temp_string);
+
+    string_tree_t *alternatives = expand_string_alternatives(arena, tokenized_str, options);
+    if (alternatives == NULL) {
+        log_debug("alternatives = NULL\n");
+        return NULL;
+    }
+
+    string_tree_iterator_t *iter = string_tree_iterator_new_arena(arena, alternatives);
+    log_debug("iter->num_tokens=%d\n", iter->num_tokens);
+
+    return iter;
+}
+
+static char *expand_unique_string(arena_t *arena, string_tree_iterator_t *iter, char_array *temp_string, khash_t(str_set) *unique_strings) {
+    char *token;
+    int ret;
+
+    char_array_clear(temp_string);
+    string_tree_iterator_foreach_token(iter, token, {
+        log_debug("token=%s\n", token);
+        char_array_append(temp_string, token);
+    })
+    char_array_terminate(temp_string);
 
+    token = char_array_get_string(temp_string);
+    log_debug("full string=%s\n", token);
+    khiter_t k = kh_get(str_set, unique_strings, token);
 
-        iter = string_tree_iterator_new(alternatives);
-        log_debug("iter->num_tokens=%d\n", iter->num_tokens);
+    if (k != kh_end(unique_strings)) {
+        return NULL;
+    }
+
+    kh_put(str_set, unique_strings, arena_strdup(arena, token), &ret);
+    return token;
+}
+
+static void expand_alternative(arena_t *arena, cstring_array *strings, khash_t(str_set) *unique_strings, char *str, normalize_options_t options) {
+    string_tree_iterator_t *tokenized_iter = expand_alternative_tokenized(arena, str, options);
+
+    char_array *temp_string = char_array_new_size_arena(arena, strlen(str));
+
+    kh_resize(str_set, unique_strings, kh_size(unique_strings) + tokenized_iter->remaining);
+
+    for (; string_tree_iterator_done(tokenized_iter); string_tree_iterator_next(tokenized_iter)) {
+        string_tree_iterator_t *iter = expand_tokenized_string(arena, tokenized_iter, temp_string, options);
+        if (iter == NULL) continue;
 
         for (; string_tree_iterator_done(iter); string_tree_iterator_next(iter)) {
-            char_array_clear(temp_string);
-            string_tree_iterator_foreach_token(iter, token, {
-                log_debug("token=%s\n", token);
-                char_array_append(temp_string, token);
-            })
-            char_array_terminate(temp_string);
-
-            token = char_array_get_string(temp_string);
-            log_debug("full string=%s\n", token);
-            khiter_t k = kh_get(str_set, unique_strings, token);
-
-            if (k == kh_end(unique_strings)) {
+            char *expansion = expand_unique_string(arena, iter, temp_string, unique_strings);
+            if (expansion != NULL) {
                 log_debug("doing postprocessing\n");
-                add_postprocessed_string(strings, token, options);
-                k = kh_put(str_set, unique_strings, strdup(token), &ret);
+                add_postprocessed_string(strings, expansion, options);
             }
+        }
+    }
+}
 
+// Joins the segments of the current normalization with spaces
+static char *expand_join_normalized(string_tree_iterator_t *iter, char_array *temp_string) {
+    char *segment;
+    char_array_clear(temp_string);
+    bool is_first = true;
 
+    string_tree_iterator_foreach_token(iter, segment, {
+        if (!is_first) {
+            char_array_append(temp_string, " ");
         }
+        char_array_append(temp_string, segment);
+        is_first = false;
+    })
+    char_array_terminate(temp_string);
+    return char_array_get_string(temp_string);
+}
 
-        string_tree_iterator_destroy(iter);
-        string_tree_destroy(alternatives);
-    }
+/*
+All of the scratch memory for one expansion (token arrays, string trees and
+their iterators, temp strings, the keys of the dedupe set) comes from a
+per-thread arena which is reset at the end of the call. Only the returned
+strings and the few results handed back by other modules (numex,
+transliteration, normalization) are allocated with malloc.
+*/
+static pthread_key_t expand_arena_key;
+static pthread_once_t expand_arena_key_once = PTHREAD_ONCE_INIT;
+
+static void expand_arena_key_destructor(void *arena) {
+    arena_destroy((arena_t *)arena);
+}
 
-    string_tree_iterator_destroy(tokenized_iter);
-    string_tree_destroy(token_tree);
+static void expand_arena_key_init(void) {
+    pthread_key_create(&expand_arena_key, expand_arena_key_destructor);
+}
 
-    token_array_destroy(tokens);
+static arena_t *get_thread_expand_arena(void) {
+    pthread_once(&expand_arena_key_once, expand_arena_key_init);
 
-    char_array_destroy(temp_string);
+    arena_t *arena = pthread_getspecific(expand_arena_key);
+    if (arena == NULL) {
+        arena = arena_new(EXPAND_ARENA_BLOCK_SIZE);
+        if (arena == NULL) return NULL;
+        pthread_setspecific(expand_arena_key, arena);
+    }
+    return arena;
 }
 
-char **expand_address(char *input, normalize_options_t options, size_t *n) {
+static void destroy_thread_expand_arena(void) {
+    pthread_once(&expand_arena_key_once, expand_arena_key_init);
+
+    arena_t *arena = pthread_getspecific(expand_arena_key);
+    if (arena != NULL) {
+        arena_destroy(arena);
+        pthread_setspecific(expand_arena_key, NULL);
+    }
+}
+
+static cstring_array *expand_address_strings(char *input, normalize_options_t options) {
+    uint32_t modules = LIBPOSTAL_EXPAND_MODULES;
+    if (options.num_languages == 0) {
+        modules |= LIBPOSTAL_MODULE_LANGUAGE_CLASSIFIER;
+    }
+
+    if (!libpostal_ensure_modules(modules)) {
+        return NULL;
+    }
+
+    arena_t *arena = get_thread_expand_arena();
+    if (arena == NULL) {
+        log_error("Could not allocate expansion arena\n");
+        return NULL;
+    }
+
     options.address_components |= ADDRESS_ANY;
 
     uint64_t normalize_string_options = get_normalize_string_options(options);
@@ -924,7 +1089,7 @@ char **expand_address(char *input, normalize_options_t options, size_t *n) {
     string_tree_t *tree = normalize_string_languages(input, normalize_string_options, options.num_languages, options.languages);
 
     cstring_array *strings = cstring_array_new_size(len * 2);
-    char_array *temp_string = char_array_new_size(len);
+    char_array *temp_string = char_array_new_size_arena(arena, len);
 
     khash_t(str_set) *unique_strings = kh_init(str_set);
 
@@ -934,165 +1099,1721 @@ char **expand_address(char *input, normalize_options_t options, size_t *n) {
 
     if (string_tree_num_strings(tree) == 1) {
         char *normalized = string_tree_get_alternative(tree, 0, 0);
-        expand_alternative(strings, unique_strings, normalized, options);
+        expand_alternative(arena, strings, unique_strings, normalized, options);
 
     } else {
         log_debug("Adding alternatives for multiple normalizations\n");
         string_tree_iterator_t *iter = string_tree_iterator_new(tree);
 
         for (; string_tree_iterator_done(iter); string_tree_iterator_next(iter)) {
-            char *segment;
-            char_array_clear(temp_string);
-            bool is_first = true;
-
-            string_tree_iterator_foreach_token(iter, segment, {
-                if (!is_first) {
-                    char_array_append(temp_string, " ");
-                }
-                char_array_append(temp_string, segment);
-                is_first = false;
-            })
-            char_array_terminate(temp_string);
-            token = char_array_get_string(temp_string);
+            token = expand_join_normalized(iter, temp_string);
             log_debug("current permutation = %s\n", token);
-            expand_alternative(strings, unique_strings, token, options);
+            expand_alternative(arena, strings, unique_strings, token, options);
         }
 
         string_tree_iterator_destroy(iter);
     }
 
-    char *key_str = NULL;
-    for (int i = kh_begin(unique_strings); i != kh_end(unique_strings); ++i) {
-        if (!kh_exist(unique_strings, i)) continue;
-        key_str = (char *)kh_key(unique_strings, i);
-        free(key_str);
-    }
-
+    // Keys are in the arena
     kh_destroy(str_set, unique_strings);
 
     if (lang_response != NULL) {
         language_classifier_response_destroy(lang_response);
     }
 
-    char_array_destroy(temp_string);
     string_tree_destroy(tree);
 
-    *n = cstring_array_num_strings(strings);
+    arena_reset(arena);
 
-    return cstring_array_to_strings(strings);
+    STATS_COUNT(LIBPOSTAL_COUNTER_EXPANSIONS, cstring_array_num_strings(strings));
 
+    return strings;
 }
 
-void expansion_array_destroy(char **expansions, size_t n) {
-    for (size_t i = 0; i < n; i++) {
-        free(expansions[i]);
-    }
-    free(expansions);
+/*
+Expansion iterator
+
+Runs the same stages as expand_address_strings, but as a state machine that
+stops as soon as it has the next unique expansion. Work is only done for the
+expansions actually consumed, and the caller can cap the number of
+expansions and set a deadline. Expansions come out in the same order as
+from expand_address.
+
+The iterator owns its arena (rather than using the per-thread one) since it
+lives across calls and can be interleaved with other expansions.
+*/
+
+struct libpostal_expansion_iterator {
+    arena_t *arena;
+    normalize_options_t options;
+    language_classifier_response_t *lang_response;
+    // Normalizations of the input, iterated when there's more than one
+    string_tree_t *tree;
+    string_tree_iterator_t *tree_iter;
+    bool started;
+    string_tree_iterator_t *tokenized_iter;
+    string_tree_iterator_t *alternatives_iter;
+    khash_t(str_set) *unique_strings;
+    char_array *temp_string;
+    // Postprocessed strings for the current unique expansion
+    cstring_array *pending;
+    uint32_t pending_index;
+    size_t max_expansions;
+    size_t num_expansions;
+    uint64_t deadline;
+    bool done;
+    bool truncated;
+};
+
+static inline uint64_t expansion_iterator_now_usec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ULL + (uint64_t)ts.tv_nsec / 1000ULL;
 }
 
-void address_parser_response_destroy(address_parser_response_t *self) {
+void expand_address_iterator_destroy(libpostal_expansion_iterator_t *self) {
     if (self == NULL) return;
 
-    for (int i = 0; i < self->num_components; i++) {
-        if (self->components != NULL) {
-            free(self->components[i]);
-        }
+    if (self->unique_strings != NULL) {
+        // Keys are in the arena
+        kh_destroy(str_set, self->unique_strings);
+    }
 
-        if (self->labels != NULL) {
-            free(self->labels[i]);
-        }
+    if (self->pending != NULL) {
+        cstring_array_destroy(self->pending);
     }
 
-    if (self->components != NULL) {
-        free(self->components);
+    if (self->tree_iter != NULL) {
+        string_tree_iterator_destroy(self->tree_iter);
     }
 
-    if (self->labels != NULL) {
-        free(self->labels);
+    if (self->tree != NULL) {
+        string_tree_destroy(self->tree);
+    }
+
+    if (self->lang_response != NULL) {
+        language_classifier_response_destroy(self->lang_response);
+    }
+
+    if (self->arena != NULL) {
+        arena_destroy(self->arena);
     }
 
     free(self);
 }
 
-static address_parser_options_t LIBPOSTAL_ADDRESS_PARSER_DEFAULT_OPTIONS =  {
-    .language = NULL,
-    .country = NULL
-};
+libpostal_expansion_iterator_t *expand_address_iterator_new(char *input, normalize_options_t options, size_t max_expansions, uint64_t timeout_usec) {
+    if (input == NULL) return NULL;
 
-inline address_parser_options_t get_libpostal_address_parser_default_options(void) {
-    return LIBPOSTAL_ADDRESS_PARSER_DEFAULT_OPTIONS;
-}
+    uint64_t start = expansion_iterator_now_usec();
 
-address_parser_response_t *parse_address(char *address, address_parser_options_t options) {
-    address_parser_context_t *context = address_parser_context_new();
-    address_parser_response_t *parsed = address_parser_parse(address, options.language, options.country, context);
+    uint32_t modules = LIBPOSTAL_EXPAND_MODULES;
+    if (options.num_languages == 0) {
+        modules |= LIBPOSTAL_MODULE_LANGUAGE_CLASSIFIER;
+    }
 
-    if (parsed == NULL) {
-        log_error("Parser returned NULL\n");
-        address_parser_context_destroy(context);
-        address_parser_response_destroy(parsed);
+    if (!libpostal_ensure_modules(modules)) {
         return NULL;
     }
 
-    address_parser_context_destroy(context);
+    libpostal_expansion_iterator_t *self = calloc(1, sizeof(libpostal_expansion_iterator_t));
+    if (self == NULL) return NULL;
 
-    return parsed;
+    self->arena = arena_new(EXPAND_ARENA_BLOCK_SIZE);
+    self->unique_strings = kh_init(str_set);
+    self->pending = cstring_array_new();
+    if (self->arena == NULL || self->unique_strings == NULL || self->pending == NULL) {
+        goto exit_iterator_created;
+    }
+
+    self->temp_string = char_array_new_size_arena(self->arena, strlen(input));
+
+    options.address_components |= ADDRESS_ANY;
+
+    if (options.num_languages == 0) {
+         self->lang_response = classify_languages(input);
+         if (self->lang_response != NULL) {
+            options.num_languages = self->lang_response->num_languages;
+            options.languages = self->lang_response->languages;
+         }
+    }
+
+    self->options = options;
+
+    self->tree = normalize_string_languages(input, get_normalize_string_options(options), options.num_languages, options.languages);
+    if (self->tree == NULL) {
+        goto exit_iterator_created;
+    }
+
+    if (string_tree_num_strings(self->tree) != 1) {
+        self->tree_iter = string_tree_iterator_new(self->tree);
+        if (self->tree_iter == NULL) {
+            goto exit_iterator_created;
+        }
+    }
+
+    self->max_expansions = max_expansions;
+    self->deadline = timeout_usec > 0 ? start + timeout_usec : 0;
+
+    return self;
+
+exit_iterator_created:
+    expand_address_iterator_destroy(self);
+    return NULL;
 }
 
-bool libpostal_setup(void) {
-    if (!transliteration_module_setup(NULL)) {
-        log_error("Error loading transliteration module\n");
-        return false;
+// Next normalization of the input, NULL when there are no more
+static char *expand_address_iterator_next_normalized(libpostal_expansion_iterator_t *self) {
+    if (self->tree_iter == NULL) {
+        if (self->started) return NULL;
+        self->started = true;
+        return string_tree_get_alternative(self->tree, 0, 0);
     }
 
-    if (!numex_module_setup(NULL)) {
-        log_error("Error loading numex module\n");
-        return false;
+    if (self->started) {
+        string_tree_iterator_next(self->tree_iter);
     }
+    self->started = true;
 
-    if (!address_dictionary_module_setup(NULL)) {
-        log_error("Error loading dictionary module\n");
-        return false;
+    if (!string_tree_iterator_done(self->tree_iter)) {
+        return NULL;
     }
 
-    return true;
+    return expand_join_normalized(self->tree_iter, self->temp_string);
 }
 
-bool libpostal_setup_language_classifier(void) {
-    if (!language_classifier_module_setup(NULL)) {
-        log_error("Error loading language classifier\n");
-        return false;
+char *expand_address_iterator_next(libpostal_expansion_iterator_t *self) {
+    if (self == NULL) return NULL;
+
+    while (!self->done) {
+        if (self->deadline > 0 && expansion_iterator_now_usec() >= self->deadline) {
+            self->truncated = true;
+            self->done = true;
+            break;
+        }
+
+        if (self->pending_index < cstring_array_num_strings(self->pending)) {
+            // Only truncated once there's an expansion past the cap, not when the cap is hit exactly
+            if (self->max_expansions > 0 && self->num_expansions >= self->max_expansions) {
+                self->truncated = true;
+                self->done = true;
+                break;
+            }
+            self->num_expansions++;
+            return cstring_array_get_string(self->pending, self->pending_index++);
+        }
+
+        if (self->alternatives_iter != NULL) {
+            if (string_tree_iterator_done(self->alternatives_iter)) {
+                char *expansion = expand_unique_string(self->arena, self->alternatives_iter, self->temp_string, self->unique_strings);
+                if (expansion != NULL) {
+                    cstring_array_clear(self->pending);
+                    self->pending_index = 0;
+                    add_postprocessed_string(self->pending, expansion, self->options);
+                }
+                string_tree_iterator_next(self->alternatives_iter);
+                continue;
+            }
+            self->alternatives_iter = NULL;
+        }
+
+        if (self->tokenized_iter != NULL) {
+            if (string_tree_iterator_done(self->tokenized_iter)) {
+                self->alternatives_iter = expand_tokenized_string(self->arena, self->tokenized_iter, self->temp_string, self->options);
+                string_tree_iterator_next(self->tokenized_iter);
+                continue;
+            }
+            self->tokenized_iter = NULL;
+        }
+
+        char *normalized = expand_address_iterator_next_normalized(self);
+        if (normalized == NULL) {
+            self->done = true;
+            break;
+        }
+
+        self->tokenized_iter = expand_alternative_tokenized(self->arena, normalized, self->options);
     }
-    return true;
+
+    return NULL;
 }
 
-bool libpostal_setup_parser(void) {
-    if (!geodb_module_setup(NULL)) {
-        log_error("Error loading geodb module\n");
-        return false;
+bool expand_address_iterator_truncated(libpostal_expansion_iterator_t *self) {
+    return self != NULL && self->truncated;
+}
+
+/*
+Expansion lattice
+
+Instead of enumerating every expansion, stop before the final cartesian
+product and return the per-position alternatives. Each normalization of the
+input is one sequence (deduplicated). It's tokenized with the per-token
+variants (e.g. with and without hyphens): runs of tokens with a single
+variant have numeric expressions replaced and phrases from the address
+dictionaries looked up together, giving positions with their alternatives.
+A token with several variants is one position, whose alternatives are the
+expansions of each of its variants.
+
+Output size is linear in the number of positions and alternatives rather
+than exponential in the number of ambiguous tokens, and no per-expansion
+dedupe is needed.
+*/
+
+typedef struct expansion_lattice_builder {
+    arena_t *arena;
+    normalize_options_t options;
+    char_array *temp_string;
+    char_array *run_string;
+    khash_t(str_set) *sequences;
+    // Alternatives already added to the current position
+    khash_t(str_set) *position_alternatives;
+    uint32_array *sequence_sizes;
+    uint32_array *position_sizes;
+    cstring_array *alternatives;
+} expansion_lattice_builder_t;
+
+// Adds the positions of the alternatives tree of str, returns the number added
+static uint32_t expansion_lattice_add_run(expansion_lattice_builder_t *builder, char *str) {
+    string_tree_t *tree = expand_string_alternatives(builder->arena, str, builder->options);
+    if (tree == NULL) return 0;
+
+    uint32_t num_positions = 0;
+    uint32_t num_tokens = string_tree_num_tokens(tree);
+
+    for (uint32_t i = 0; i < num_tokens; i++) {
+        uint32_t num_alternatives = string_tree_num_alternatives(tree, i);
+        if (num_alternatives == 0) continue;
+
+        for (uint32_t j = 0; j < num_alternatives; j++) {
+            cstring_array_add_string(builder->alternatives, string_tree_get_alternative(tree, i, j));
+        }
+        uint32_array_push(builder->position_sizes, num_alternatives);
+        num_positions++;
     }
 
-    if (!address_parser_module_setup(NULL)) {
-        log_error("Error loading address parser module\n");
-        return false;
+    return num_positions;
+}
+
+// Adds one position holding the expansions of every variant of token i
+static uint32_t expansion_lattice_add_variants(expansion_lattice_builder_t *builder, string_tree_t *token_tree, uint32_t i) {
+    uint32_t num_alternatives = 0;
+
+    kh_clear(str_set, builder->position_alternatives);
+
+    for (uint32_t j = 0; j < string_tree_num_alternatives(token_tree, i); j++) {
+        string_tree_t *tree = expand_string_alternatives(builder->arena, string_tree_get_alternative(token_tree, i, j), builder->options);
+        if (tree == NULL) continue;
+
+        string_tree_iterator_t *iter = string_tree_iterator_new_arena(builder->arena, tree);
+        for (; string_tree_iterator_done(iter); string_tree_iterator_next(iter)) {
+            char *expansion = expand_unique_string(builder->arena, iter, builder->temp_string, builder->position_alternatives);
+            if (expansion == NULL) continue;
+
+            cstring_array_add_string(builder->alternatives, expansion);
+            num_alternatives++;
+        }
     }
 
-    return true;
+    if (num_alternatives == 0) return 0;
+
+    uint32_array_push(builder->position_sizes, num_alternatives);
+    return 1;
 }
 
-void libpostal_teardown(void) {
-    transliteration_module_teardown();
+static void expansion_lattice_add_normalized(expansion_lattice_builder_t *builder, char *str) {
+    int ret;
 
-    numex_module_teardown();
+    khiter_t k = kh_get(str_set, builder->sequences, str);
+    if (k != kh_end(builder->sequences)) {
+        return;
+    }
+    // str may point into temp_string, which is reused below
+    str = arena_strdup(builder->arena, str);
+    kh_put(str_set, builder->sequences, str, &ret);
 
-    address_dictionary_module_teardown();
+    size_t len = strlen(str);
+    token_array *tokens = token_array_new_size_arena(builder->arena, DEFAULT_VECTOR_SIZE);
+    tokenize_add_tokens(tokens, str, len, true);
+    string_tree_t *token_tree = string_tree_new_size_arena(builder->arena, len);
+    add_normalized_strings_tokenized(builder->arena, token_tree, str, tokens, builder->options);
+
+    uint32_t num_positions = 0;
+    uint32_t num_tokens = string_tree_num_tokens(token_tree);
+    char_array_clear(builder->run_string);
+
+    for (uint32_t i = 0; i < num_tokens; i++) {
+        uint32_t num_variants = string_tree_num_alternatives(token_tree, i);
+
+        if (num_variants == 1) {
+            char_array_append(builder->run_string, string_tree_get_alternative(token_tree, i, 0));
+            continue;
+        } else if (num_variants == 0) {
+            continue;
+        }
+
+        if (builder->run_string->n > 0) {
+            char_array_terminate(builder->run_string);
+            num_positions += expansion_lattice_add_run(builder, char_array_get_string(builder->run_string));
+            char_array_clear(builder->run_string);
+        }
+
+        num_positions += expansion_lattice_add_variants(builder, token_tree, i);
+    }
+
+    if (builder->run_string->n > 0) {
+        char_array_terminate(builder->run_string);
+        num_positions += expansion_lattice_add_run(builder, char_array_get_string(builder->run_string));
+    }
+
+    uint32_array_push(builder->sequence_sizes, num_positions);
 }
 
-void libpostal_teardown_language_classifier(void) {
-    language_classifier_module_teardown();
+// Copies the builder's arrays into a single allocation
+static libpostal_expansion_lattice_t *expansion_lattice_new(uint32_t *sequence_sizes, size_t num_sequences, uint32_t *position_sizes, size_t num_positions, char *strings, size_t strings_len) {
+    size_t num_alternatives = 0;
+    for (size_t i = 0; i < num_positions; i++) {
+        num_alternatives += position_sizes[i];
+    }
+
+    size_t sequence_offsets_size = sizeof(size_t) * (num_sequences + 1);
+    size_t position_offsets_size = sizeof(size_t) * (num_positions + 1);
+    size_t pointers_size = sizeof(char *) * num_alternatives;
+
+    libpostal_expansion_lattice_t *lattice = malloc(sizeof(libpostal_expansion_lattice_t));
+    if (lattice == NULL) return NULL;
+
+    char *data = malloc(sequence_offsets_size + position_offsets_size + pointers_size + strings_len);
+    if (data == NULL) {
+        free(lattice);
+        return NULL;
+    }
+
+    lattice->num_sequences = num_sequences;
+    lattice->num_positions = num_positions;
+    lattice->num_alternatives = num_alternatives;
+    lattice->sequence_offsets = (size_t *)data;
+    lattice->position_offsets = (size_t *)(data + sequence_offsets_size);
+    lattice->alternatives = (char **)(data + sequence_offsets_size + position_offsets_size);
+    lattice->strings = data + sequence_offsets_size + position_offsets_size + pointers_size;
+    lattice->strings_len = strings_len;
+
+    size_t offset = 0;
+    for (size_t i = 0; i < num_sequences; i++) {
+        lattice->sequence_offsets[i] = offset;
+        offset += sequence_sizes[i];
+    }
+    lattice->sequence_offsets[num_sequences] = offset;
+
+    offset = 0;
+    for (size_t i = 0; i < num_positions; i++) {
+        lattice->position_offsets[i] = offset;
+        offset += position_sizes[i];
+    }
+    lattice->position_offsets[num_positions] = offset;
+
+    if (strings_len > 0) {
+        memcpy(lattice->strings, strings, strings_len);
+    }
+
+    char *ptr = lattice->strings;
+    for (size_t i = 0; i < num_alternatives; i++) {
+        lattice->alternatives[i] = ptr;
+        ptr += strlen(ptr) + 1;
+    }
+
+    return lattice;
 }
 
-void libpostal_teardown_parser(void) {
-    geodb_module_teardown();
-    address_parser_module_teardown();
+libpostal_expansion_lattice_t *expand_address_lattice(char *input, normalize_options_t options) {
+    if (input == NULL) return NULL;
+
+    uint32_t modules = LIBPOSTAL_EXPAND_MODULES;
+    if (options.num_languages == 0) {
+        modules |= LIBPOSTAL_MODULE_LANGUAGE_CLASSIFIER;
+    }
+
+    if (!libpostal_ensure_modules(modules)) {
+        return NULL;
+    }
+
+    arena_t *arena = get_thread_expand_arena();
+    if (arena == NULL) {
+        log_error("Could not allocate expansion arena\n");
+        return NULL;
+    }
+
+    options.address_components |= ADDRESS_ANY;
+
+    size_t len = strlen(input);
+
+    language_classifier_response_t *lang_response = NULL;
+
+    if (options.num_languages == 0) {
+         lang_response = classify_languages(input);
+         if (lang_response != NULL) {
+            options.num_languages = lang_response->num_languages;
+            options.languages = lang_response->languages;
+         }
+    }
+
+    libpostal_expansion_lattice_t *lattice = NULL;
+
+    expansion_lattice_builder_t builder = (expansion_lattice_builder_t){
+        .arena = arena,
+        .options = options,
+        .temp_string = char_array_new_size_arena(arena, len),
+        .run_string = char_array_new_size_arena(arena, len),
+        .sequences = kh_init(str_set),
+        .position_alternatives = kh_init(str_set),
+        .sequence_sizes = uint32_array_new(),
+        .position_sizes = uint32_array_new(),
+        .alternatives = cstring_array_new_size(len * 2)
+    };
+
+    if (builder.sequences == NULL || builder.position_alternatives == NULL || builder.sequence_sizes == NULL || builder.position_sizes == NULL || builder.alternatives == NULL) {
+        goto exit_lattice_builder_created;
+    }
+
+    string_tree_t *tree = normalize_string_languages(input, get_normalize_string_options(options), options.num_languages, options.languages);
+    if (tree == NULL) {
+        goto exit_lattice_builder_created;
+    }
+
+    if (string_tree_num_strings(tree) == 1) {
+        expansion_lattice_add_normalized(&builder, string_tree_get_alternative(tree, 0, 0));
+    } else {
+        string_tree_iterator_t *iter = string_tree_iterator_new(tree);
+
+        for (; string_tree_iterator_done(iter); string_tree_iterator_next(iter)) {
+            expansion_lattice_add_normalized(&builder, expand_join_normalized(iter, builder.temp_string));
+        }
+
+        string_tree_iterator_destroy(iter);
+    }
+
+    string_tree_destroy(tree);
+
+    lattice = expansion_lattice_new(builder.sequence_sizes->a, builder.sequence_sizes->n,
+                                    builder.position_sizes->a, builder.position_sizes->n,
+                                    builder.alternatives->str->a, cstring_array_used(builder.alternatives));
+
+exit_lattice_builder_created:
+    if (builder.sequences != NULL) {
+        // Keys are in the arena
+        kh_destroy(str_set, builder.sequences);
+    }
+    if (builder.position_alternatives != NULL) {
+        kh_destroy(str_set, builder.position_alternatives);
+    }
+    if (builder.sequence_sizes != NULL) {
+        uint32_array_destroy(builder.sequence_sizes);
+    }
+    if (builder.position_sizes != NULL) {
+        uint32_array_destroy(builder.position_sizes);
+    }
+    if (builder.alternatives != NULL) {
+        cstring_array_destroy(builder.alternatives);
+    }
+
+    if (lang_response != NULL) {
+        language_classifier_response_destroy(lang_response);
+    }
+
+    arena_reset(arena);
+
+    return lattice;
+}
+
+void expansion_lattice_destroy(libpostal_expansion_lattice_t *self) {
+    if (self == NULL) return;
+
+    // sequence_offsets is the start of the single allocation holding the lattice
+    if (self->sequence_offsets != NULL) {
+        free(self->sequence_offsets);
+    }
+
+    free(self);
+}
+
+/*
+Serialized lattice, all integers are big-endian uint32:
+
+    uint32 signature
+    uint32 num_sequences
+    uint32 num_positions
+    uint32 strings_len
+    uint32 positions per sequence [num_sequences]
+    uint32 alternatives per position [num_positions]
+    char strings[strings_len]       // NUL-terminated alternatives, in order
+*/
+
+#define EXPANSION_LATTICE_SIGNATURE 0x4C415454
+#define EXPANSION_LATTICE_HEADER_SIZE (4 * sizeof(uint32_t))
+
+static inline void expansion_lattice_write_uint32(unsigned char *buf, uint32_t value) {
+    buf[0] = (unsigned char)(value >> 24);
+    buf[1] = (unsigned char)(value >> 16);
+    buf[2] = (unsigned char)(value >> 8);
+    buf[3] = (unsigned char)value;
+}
+
+static inline uint32_t expansion_lattice_read_uint32(const unsigned char *buf) {
+    return ((uint32_t)buf[0] << 24) | ((uint32_t)buf[1] << 16) | ((uint32_t)buf[2] << 8) | (uint32_t)buf[3];
+}
+
+char *expansion_lattice_serialize(libpostal_expansion_lattice_t *self, size_t *len) {
+    if (self == NULL || len == NULL) return NULL;
+
+    if (self->num_sequences > UINT32_MAX || self->num_positions > UINT32_MAX || self->strings_len > UINT32_MAX) {
+        return NULL;
+    }
+
+    size_t size = EXPANSION_LATTICE_HEADER_SIZE + sizeof(uint32_t) * (self->num_sequences + self->num_positions) + self->strings_len;
+    unsigned char *buf = malloc(size);
+    if (buf == NULL) return NULL;
+
+    unsigned char *ptr = buf;
+    expansion_lattice_write_uint32(ptr, EXPANSION_LATTICE_SIGNATURE);
+    expansion_lattice_write_uint32(ptr + 4, (uint32_t)self->num_sequences);
+    expansion_lattice_write_uint32(ptr + 8, (uint32_t)self->num_positions);
+    expansion_lattice_write_uint32(ptr + 12, (uint32_t)self->strings_len);
+    ptr += EXPANSION_LATTICE_HEADER_SIZE;
+
+    for (size_t i = 0; i < self->num_sequences; i++) {
+        expansion_lattice_write_uint32(ptr, (uint32_t)(self->sequence_offsets[i + 1] - self->sequence_offsets[i]));
+        ptr += sizeof(uint32_t);
+    }
+
+    for (size_t i = 0; i < self->num_positions; i++) {
+        expansion_lattice_write_uint32(ptr, (uint32_t)(self->position_offsets[i + 1] - self->position_offsets[i]));
+        ptr += sizeof(uint32_t);
+    }
+
+    if (self->strings_len > 0) {
+        memcpy(ptr, self->strings, self->strings_len);
+    }
+
+    *len = size;
+    return (char *)buf;
+}
+
+libpostal_expansion_lattice_t *expansion_lattice_deserialize(char *data, size_t len) {
+    if (data == NULL || len < EXPANSION_LATTICE_HEADER_SIZE) return NULL;
+
+    const unsigned char *buf = (const unsigned char *)data;
+
+    if (expansion_lattice_read_uint32(buf) != EXPANSION_LATTICE_SIGNATURE) {
+        log_error("Invalid expansion lattice signature\n");
+        return NULL;
+    }
+
+    size_t num_sequences = expansion_lattice_read_uint32(buf + 4);
+    size_t num_positions = expansion_lattice_read_uint32(buf + 8);
+    size_t strings_len = expansion_lattice_read_uint32(buf + 12);
+
+    size_t sizes_len = sizeof(uint32_t) * (num_sequences + num_positions);
+    if (len != EXPANSION_LATTICE_HEADER_SIZE + sizes_len + strings_len) {
+        log_error("Invalid expansion lattice length\n");
+        return NULL;
+    }
+
+    libpostal_expansion_lattice_t *lattice = NULL;
+
+    uint32_t *sizes = malloc(sizeof(uint32_t) * (num_sequences + num_positions + 1));
+    if (sizes == NULL) return NULL;
+
+    const unsigned char *ptr = buf + EXPANSION_LATTICE_HEADER_SIZE;
+    for (size_t i = 0; i < num_sequences + num_positions; i++) {
+        sizes[i] = expansion_lattice_read_uint32(ptr);
+        ptr += sizeof(uint32_t);
+    }
+
+    size_t total_positions = 0;
+    for (size_t i = 0; i < num_sequences; i++) {
+        total_positions += sizes[i];
+    }
+
+    size_t num_alternatives = 0;
+    for (size_t i = 0; i < num_positions; i++) {
+        num_alternatives += sizes[num_sequences + i];
+    }
+
+    // Every alternative must be NUL-terminated inside strings
+    size_t num_strings = 0;
+    for (size_t i = 0; i < strings_len; i++) {
+        if (ptr[i] == '\0') num_strings++;
+    }
+
+    if (total_positions != num_positions || num_strings != num_alternatives ||
+        (strings_len > 0 && ptr[strings_len - 1] != '\0')) {
+        log_error("Inconsistent expansion lattice\n");
+        goto exit_lattice_sizes_allocated;
+    }
+
+    lattice = expansion_lattice_new(sizes, num_sequences, sizes + num_sequences, num_positions, (char *)ptr, strings_len);
+
+exit_lattice_sizes_allocated:
+    free(sizes);
+    return lattice;
+}
+
+/*
+Canonical normalization
+
+A single deterministic string per address, e.g. as a key for dedupe joins.
+Same stages as expand_address but only ever following the first
+alternative: the first normalization of the input, the default
+normalization of each token, numeric expressions, then each phrase from the
+address dictionaries is replaced by the canonical form of its first
+expansion applicable to options.address_components, skipping personal
+titles at the end of the address or before punctuation. Everything is
+written straight into a char_array in one pass per stage, no string trees
+are enumerated and nothing needs deduping.
+*/
+
+typedef struct canonical_writer {
+    char_array *str;
+    bool pending_space;
+} canonical_writer_t;
+
+static inline void canonical_writer_append_len(canonical_writer_t *writer, char *str, size_t len) {
+    if (len == 0) return;
+
+    if (writer->pending_space && char_array_len(writer->str) > 0) {
+        char_array_append(writer->str, " ");
+    }
+    writer->pending_space = false;
+    char_array_append_len(writer->str, str, len);
+}
+
+static inline void canonical_writer_add_token(canonical_writer_t *writer, char *str, token_t token) {
+    if (token.type == WHITESPACE || is_punctuation(token.type)) {
+        writer->pending_space = true;
+    } else {
+        canonical_writer_append_len(writer, str + token.offset, token.len);
+    }
+}
+
+static bool address_expansion_is_personal_title(address_expansion_t expansion) {
+    for (size_t i = 0; i < expansion.num_dictionaries; i++) {
+        if (expansion.dictionary_ids[i] != DICTIONARY_PERSONAL_TITLE) return false;
+    }
+    return expansion.num_dictionaries > 0;
+}
+
+static void canonical_writer_add_phrase(canonical_writer_t *writer, char_array *key, char *str, token_array *tokens, phrase_language_t phrase_lang, normalize_options_t options) {
+    phrase_t phrase = phrase_lang.phrase;
+
+    expansion_value_t value;
+    value.value = phrase.data;
+
+    address_expansion_array *expansions = NULL;
+
+    if ((value.components & options.address_components) > 0) {
+        char_array_clear(key);
+        char_array_cat(key, phrase_lang.language);
+        char_array_cat(key, NAMESPACE_SEPARATOR_CHAR);
+
+        for (size_t i = phrase.start; i < phrase.start + phrase.len; i++) {
+            token_t token = tokens->a[i];
+            if (token.type != WHITESPACE) {
+                char_array_cat_len(key, str + token.offset, token.len);
+            } else {
+                char_array_cat(key, " ");
+            }
+        }
+
+        expansions = address_dictionary_get_expansions(char_array_get_string(key));
+    }
+
+    // A personal title ("st" => "saint") comes before a name, so at the end of
+    // the address or before punctuation prefer an expansion that isn't one
+    // ("st" => "street")
+    bool is_last = true;
+    for (size_t i = phrase.start + phrase.len; i < tokens->n; i++) {
+        if (tokens->a[i].type == WHITESPACE) continue;
+        is_last = is_punctuation(tokens->a[i].type);
+        break;
+    }
+
+    address_expansion_t *expansion = NULL;
+    if (expansions != NULL && expansions->n > 0) {
+        expansion = expansions->a;
+        bool found = false;
+        for (size_t i = 0; i < expansions->n; i++) {
+            if (!(expansions->a[i].address_components & options.address_components)) continue;
+            if (!found) {
+                expansion = expansions->a + i;
+                found = true;
+            }
+            if (!is_last || !address_expansion_is_personal_title(expansions->a[i])) {
+                expansion = expansions->a + i;
+                break;
+            }
+        }
+    }
+
+    if (expansion != NULL && expansion->canonical_index != NULL_CANONICAL_INDEX) {
+        char *canonical = address_dictionary_get_canonical(expansion->canonical_index);
+        char *canonical_normalized = normalize_string_utf8(canonical, get_normalize_string_options(options));
+        canonical = canonical_normalized != NULL ? canonical_normalized : canonical;
+
+        canonical_writer_append_len(writer, canonical, strlen(canonical));
+
+        if (canonical_normalized != NULL) {
+            free(canonical_normalized);
+        }
+    } else {
+        // The phrase is already canonical
+        for (size_t i = phrase.start; i < phrase.start + phrase.len; i++) {
+            canonical_writer_add_token(writer, str, tokens->a[i]);
+        }
+    }
+}
+
+static void canonical_replace_phrases(arena_t *arena, char_array *out, char *str, normalize_options_t options) {
+    size_t len = strlen(str);
+
+    token_array *tokens = token_array_new_size_arena(arena, DEFAULT_VECTOR_SIZE);
+    tokenize_add_tokens(tokens, str, len, true);
+
+    phrase_language_array *phrases = phrase_language_array_new_size_arena(arena, DEFAULT_VECTOR_SIZE);
+
+    for (int i = 0; i <= options.num_languages; i++) {
+        char *lang = i < options.num_languages ? options.languages[i] : ALL_LANGUAGES;
+
+        phrase_array *lang_phrases = search_address_dictionaries_tokens(str, tokens, lang);
+        if (lang_phrases == NULL) continue;
+
+        for (size_t j = 0; j < lang_phrases->n; j++) {
+            phrase_language_array_push(phrases, (phrase_language_t){lang, lang_phrases->a[j]});
+        }
+
+        phrase_array_destroy(lang_phrases);
+    }
+
+    // Longest phrase first at each start position
+    ks_introsort(phrase_language_array, phrases->n, phrases->a);
+
+    canonical_writer_t writer = (canonical_writer_t){out, false};
+    char_array *key = char_array_new_size_arena(arena, DEFAULT_KEY_LEN);
+
+    size_t next_token = 0;
+
+    for (size_t i = 0; i < phrases->n; i++) {
+        phrase_language_t phrase_lang = phrases->a[i];
+        phrase_t phrase = phrase_lang.phrase;
+        // Overlaps a phrase already written
+        if (phrase.start < next_token) continue;
+
+        for (; next_token < phrase.start; next_token++) {
+            canonical_writer_add_token(&writer, str, tokens->a[next_token]);
+        }
+
+        canonical_writer_add_phrase(&writer, key, str, tokens, phrase_lang, options);
+        next_token = phrase.start + phrase.len;
+    }
+
+    for (; next_token < tokens->n; next_token++) {
+        canonical_writer_add_token(&writer, str, tokens->a[next_token]);
+    }
+
+    char_array_terminate(out);
+}
+
+char *normalize_address_canonical(char *input, normalize_options_t options) {
+    if (input == NULL) return NULL;
+
+    uint32_t modules = LIBPOSTAL_EXPAND_MODULES;
+    if (options.num_languages == 0) {
+        modules |= LIBPOSTAL_MODULE_LANGUAGE_CLASSIFIER;
+    }
+
+    if (!libpostal_ensure_modules(modules)) {
+        return NULL;
+    }
+
+    arena_t *arena = get_thread_expand_arena();
+    if (arena == NULL) {
+        log_error("Could not allocate expansion arena\n");
+        return NULL;
+    }
+
+    options.address_components |= ADDRESS_ANY;
+
+    size_t len = strlen(input);
+
+    language_classifier_response_t *lang_response = NULL;
+
+    if (options.num_languages == 0) {
+         lang_response = classify_languages(input);
+         if (lang_response != NULL) {
+            options.num_languages = lang_response->num_languages;
+            options.languages = lang_response->languages;
+         }
+    }
+
+    char *canonical = NULL;
+
+    // 1. First normalization of the input
+    string_tree_t *tree = normalize_string_languages(input, get_normalize_string_options(options), options.num_languages, options.languages);
+    if (tree == NULL) {
+        goto exit_canonical_languages_classified;
+    }
+
+    char_array *normalized = char_array_new_size_arena(arena, len);
+    uint32_t num_segments = string_tree_num_tokens(tree);
+    for (uint32_t i = 0; i < num_segments; i++) {
+        char *segment = string_tree_get_alternative(tree, i, 0);
+        if (segment == NULL) continue;
+        if (i > 0) {
+            char_array_append(normalized, " ");
+        }
+        char_array_append(normalized, segment);
+    }
+    char_array_terminate(normalized);
+
+    string_tree_destroy(tree);
+
+    // 2. Default normalization of each token
+    char *str = char_array_get_string(normalized);
+    size_t normalized_len = char_array_len(normalized);
+
+    token_array *tokens = token_array_new_size_arena(arena, DEFAULT_VECTOR_SIZE);
+    tokenize_add_tokens(tokens, str, normalized_len, true);
+
+    uint64_t normalize_token_options = get_normalize_token_options(options);
+
+    char_array *tokenized = char_array_new_size_arena(arena, normalized_len);
+    for (size_t i = 0; i < tokens->n; i++) {
+        token_t token = tokens->a[i];
+        if (is_special_token(token.type)) {
+            char_array_append_len(tokenized, str + token.offset, token.len);
+        } else if (token.type == WHITESPACE) {
+            char_array_append(tokenized, " ");
+        } else {
+            add_normalized_token(tokenized, str, token, normalize_token_options);
+            // add_normalized_token NUL-terminates, the next token goes after it
+            char_array_strip_nul_byte(tokenized);
+        }
+    }
+    char_array_terminate(tokenized);
+
+    // 3. Numeric expressions
+    str = char_array_get_string(tokenized);
+    char *numex_str = NULL;
+    if (options.expand_numex) {
+        for (int i = 0; i < options.num_languages; i++) {
+            char *numex_replaced = replace_numeric_expressions(numex_str != NULL ? numex_str : str, options.languages[i]);
+            if (numex_replaced != NULL) {
+                if (numex_str != NULL) {
+                    free(numex_str);
+                }
+                numex_str = numex_replaced;
+            }
+        }
+    }
+
+    // 4. Phrase replacement
+    char_array *out = char_array_new_size(len);
+    canonical_replace_phrases(arena, out, numex_str != NULL ? numex_str : str, options);
+
+    if (numex_str != NULL) {
+        free(numex_str);
+    }
+
+    canonical = char_array_to_string(out);
+
+exit_canonical_languages_classified:
+    if (lang_response != NULL) {
+        language_classifier_response_destroy(lang_response);
+    }
+
+    arena_reset(arena);
+
+    return canonical;
+}
+
+/*
+Result cache
+
+Keys are an op tag followed by every option that affects the result and the
+input bytes. Values are the result strings, each NUL-terminated, in the same
+layout as cstring_array's string data (expansions in order for expand,
+label/component pairs for parse), so hits skip the whole pipeline and only
+copy strings out.
+*/
+
+static result_cache_t *libpostal_result_cache = NULL;
+
+#define RESULT_CACHE_KEY_EXPAND 'E'
+#define RESULT_CACHE_KEY_PARSE 'P'
+
+bool libpostal_cache_enable(size_t max_memory, size_t num_shards) {
+    result_cache_t *cache = result_cache_new(num_shards, max_memory);
+    if (cache == NULL) {
+        log_error("Could not allocate result cache\n");
+        return false;
+    }
+
+    libpostal_cache_disable();
+    libpostal_result_cache = cache;
+    return true;
+}
+
+void libpostal_cache_disable(void) {
+    if (libpostal_result_cache != NULL) {
+        result_cache_destroy(libpostal_result_cache);
+        libpostal_result_cache = NULL;
+    }
+}
+
+void libpostal_cache_flush(void) {
+    result_cache_clear(libpostal_result_cache);
+}
+
+libpostal_cache_stats_t libpostal_cache_get_stats(void) {
+    result_cache_stats_t stats = result_cache_get_stats(libpostal_result_cache);
+    return (libpostal_cache_stats_t){stats.hits, stats.misses, stats.evictions, stats.num_entries, stats.memory_used, stats.memory_limit};
+}
+
+static inline void result_cache_key_add_optional(char_array *key, char *str) {
+    // Distinguishes NULL from ""
+    char_array_push(key, str != NULL);
+    char_array_add(key, str != NULL ? str : "");
+}
+
+static void expand_address_cache_key(char_array *key, char *input, normalize_options_t options) {
+    char_array_clear(key);
+    char_array_push(key, RESULT_CACHE_KEY_EXPAND);
+
+    uint32_t num_languages = options.num_languages > 0 && options.languages != NULL ? (uint32_t)options.num_languages : 0;
+    char_array_append_len(key, (char *)&num_languages, sizeof(num_languages));
+    for (uint32_t i = 0; i < num_languages; i++) {
+        char_array_add(key, options.languages[i]);
+    }
+
+    char_array_append_len(key, (char *)&options.address_components, sizeof(options.address_components));
+
+    bool flags[] = {
+        options.latin_ascii,
+        options.transliterate,
+        options.strip_accents,
+        options.decompose,
+        options.lowercase,
+        options.trim_string,
+        options.drop_parentheticals,
+        options.replace_numeric_hyphens,
+        options.delete_numeric_hyphens,
+        options.split_alpha_from_numeric,
+        options.replace_word_hyphens,
+        options.delete_word_hyphens,
+        options.delete_final_periods,
+        options.delete_acronym_periods,
+        options.drop_english_possessives,
+        options.delete_apostrophes,
+        options.expand_numex,
+        options.roman_numerals
+    };
+    char_array_append_len(key, (char *)flags, sizeof(flags));
+
+    char_array_append(key, input);
+}
+
+static void parse_address_cache_key(char_array *key, char *input, address_parser_options_t options) {
+    char_array_clear(key);
+    char_array_push(key, RESULT_CACHE_KEY_PARSE);
+    result_cache_key_add_optional(key, options.language);
+    result_cache_key_add_optional(key, options.country);
+    char_array_append(key, input);
+}
+
+// Splits a cached value back into malloc'd strings, NULL if any allocation fails
+static char **result_cache_value_strings(char_array *value, size_t *n) {
+    size_t num_strings = 0;
+    for (size_t i = 0; i < value->n; i++) {
+        if (value->a[i] == '\0') num_strings++;
+    }
+
+    char **strings = malloc(sizeof(char *) * (num_strings > 0 ? num_strings : 1));
+    if (strings == NULL) return NULL;
+
+    char *str = value->a;
+    for (size_t i = 0; i < num_strings; i++) {
+        size_t len = strlen(str);
+        strings[i] = strndup(str, len);
+        if (strings[i] == NULL) {
+            for (size_t j = 0; j < i; j++) {
+                free(strings[j]);
+            }
+            free(strings);
+            return NULL;
+        }
+        str += len + 1;
+    }
+
+    *n = num_strings;
+    return strings;
+}
+
+// Same as result_cache_value_strings for callers that want a cstring_array
+static cstring_array *result_cache_value_cstring_array(char_array *value) {
+    cstring_array *strings = cstring_array_new();
+    if (strings == NULL) return NULL;
+
+    char *end = value->a + value->n;
+    for (char *str = value->a; str < end; str += strlen(str) + 1) {
+        cstring_array_add_string(strings, str);
+    }
+
+    return strings;
+}
+
+// expand_address_strings, going through the result cache when it's enabled
+static cstring_array *expand_address_strings_cached(char *input, normalize_options_t options) {
+    result_cache_t *cache = libpostal_result_cache;
+    if (cache == NULL) {
+        return expand_address_strings(input, options);
+    }
+
+    char_array *key = char_array_new_size(strlen(input) + 64);
+    char_array *value = char_array_new();
+    cstring_array *strings = NULL;
+
+    if (key == NULL || value == NULL) {
+        goto exit_expand_cached_arrays_allocated;
+    }
+
+    expand_address_cache_key(key, input, options);
+
+    if (result_cache_get(cache, key->a, key->n, value)) {
+        strings = result_cache_value_cstring_array(value);
+    } else {
+        strings = expand_address_strings(input, options);
+        if (strings != NULL) {
+            result_cache_put(cache, key->a, key->n, strings->str->a, cstring_array_used(strings));
+        }
+    }
+
+exit_expand_cached_arrays_allocated:
+    if (key != NULL) {
+        char_array_destroy(key);
+    }
+    if (value != NULL) {
+        char_array_destroy(value);
+    }
+    return strings;
+}
+
+char **expand_address(char *input, normalize_options_t options, size_t *n) {
+    cstring_array *strings = expand_address_strings_cached(input, options);
+    if (strings == NULL) {
+        *n = 0;
+        return NULL;
+    }
+
+    *n = cstring_array_num_strings(strings);
+
+    return cstring_array_to_strings(strings);
+}
+
+void expansion_array_destroy(char **expansions, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        free(expansions[i]);
+    }
+    free(expansions);
+}
+
+void address_parser_response_destroy(address_parser_response_t *self) {
+    if (self == NULL) return;
+
+    for (int i = 0; i < self->num_components; i++) {
+        if (self->components != NULL) {
+            free(self->components[i]);
+        }
+
+        if (self->labels != NULL) {
+            free(self->labels[i]);
+        }
+    }
+
+    if (self->components != NULL) {
+        free(self->components);
+    }
+
+    if (self->labels != NULL) {
+        free(self->labels);
+    }
+
+    free(self);
+}
+
+static const char *ADDRESS_PARSER_LABEL_NAMES[] = {
+    ADDRESS_PARSER_LABEL_HOUSE,
+    ADDRESS_PARSER_LABEL_HOUSE_NUMBER,
+    ADDRESS_PARSER_LABEL_ROAD,
+    ADDRESS_PARSER_LABEL_SUBURB,
+    ADDRESS_PARSER_LABEL_CITY_DISTRICT,
+    ADDRESS_PARSER_LABEL_CITY,
+    ADDRESS_PARSER_LABEL_STATE_DISTRICT,
+    ADDRESS_PARSER_LABEL_STATE,
+    ADDRESS_PARSER_LABEL_POSTAL_CODE,
+    ADDRESS_PARSER_LABEL_COUNTRY
+};
+
+const char *address_parser_label_name(address_parser_label_t label) {
+    if (label >= NUM_ADDRESS_LABELS) return NULL;
+    return ADDRESS_PARSER_LABEL_NAMES[label];
+}
+
+void address_parser_compact_response_destroy(address_parser_compact_response_t *self) {
+    if (self == NULL) return;
+    // Spans and normalized string are allocated along with the struct
+    free(self);
+}
+
+static address_parser_options_t LIBPOSTAL_ADDRESS_PARSER_DEFAULT_OPTIONS =  {
+    .language = NULL,
+    .country = NULL
+};
+
+inline address_parser_options_t get_libpostal_address_parser_default_options(void) {
+    return LIBPOSTAL_ADDRESS_PARSER_DEFAULT_OPTIONS;
+}
+
+/*
+parse_address reuses a parser context per thread rather than allocating
+one per call. The context only holds scratch buffers, no references to the
+loaded models, so it's safe to keep across setup/teardown and is freed
+when the thread exits (or in libpostal_teardown_parser for the calling thread).
+*/
+static pthread_key_t parser_context_key;
+static pthread_once_t parser_context_key_once = PTHREAD_ONCE_INIT;
+
+static void parser_context_key_destructor(void *context) {
+    address_parser_context_destroy((address_parser_context_t *)context);
+}
+
+static void parser_context_key_init(void) {
+    pthread_key_create(&parser_context_key, parser_context_key_destructor);
+}
+
+static address_parser_context_t *get_thread_parser_context(void) {
+    pthread_once(&parser_context_key_once, parser_context_key_init);
+
+    address_parser_context_t *context = pthread_getspecific(parser_context_key);
+    if (context == NULL) {
+        context = address_parser_context_new();
+        if (context == NULL) return NULL;
+        pthread_setspecific(parser_context_key, context);
+    }
+    return context;
+}
+
+static void destroy_thread_parser_context(void) {
+    pthread_once(&parser_context_key_once, parser_context_key_init);
+
+    address_parser_context_t *context = pthread_getspecific(parser_context_key);
+    if (context != NULL) {
+        address_parser_context_destroy(context);
+        pthread_setspecific(parser_context_key, NULL);
+    }
+}
+
+address_parser_compact_response_t *parse_address_compact(char *address, address_parser_options_t options) {
+    if (!libpostal_ensure_modules(LIBPOSTAL_PARSER_MODULES)) {
+        return NULL;
+    }
+
+    address_parser_context_t *context = get_thread_parser_context();
+    if (context == NULL) {
+        log_error("Could not allocate parser context\n");
+        return NULL;
+    }
+
+    return address_parser_parse_compact(address, options.language, options.country, context);
+}
+
+static address_parser_response_t *parse_address_cached(char *address, address_parser_options_t options, address_parser_context_t *context) {
+    result_cache_t *cache = libpostal_result_cache;
+    if (cache == NULL) {
+        return address_parser_parse(address, options.language, options.country, context);
+    }
+
+    char_array *key = char_array_new_size(strlen(address) + 16);
+    char_array *value = char_array_new();
+    parse_address_cache_key(key, address, options);
+
+    address_parser_response_t *parsed = NULL;
+
+    if (result_cache_get(cache, key->a, key->n, value)) {
+        size_t num_strings;
+        char **strings = result_cache_value_strings(value, &num_strings);
+        parsed = strings != NULL ? address_parser_response_new() : NULL;
+        if (parsed != NULL) {
+            parsed->num_components = num_strings / 2;
+            parsed->labels = malloc(sizeof(char *) * (parsed->num_components + 1));
+            parsed->components = malloc(sizeof(char *) * (parsed->num_components + 1));
+            for (size_t i = 0; i < parsed->num_components; i++) {
+                parsed->labels[i] = strings[i * 2];
+                parsed->components[i] = strings[i * 2 + 1];
+            }
+        }
+        free(strings);
+    } else {
+        parsed = address_parser_parse(address, options.language, options.country, context);
+        if (parsed != NULL) {
+            char_array_clear(value);
+            for (size_t i = 0; i < parsed->num_components; i++) {
+                char_array_add(value, parsed->labels[i]);
+                char_array_add(value, parsed->components[i]);
+            }
+            result_cache_put(cache, key->a, key->n, value->a, value->n);
+        }
+    }
+
+    char_array_destroy(key);
+    char_array_destroy(value);
+
+    return parsed;
+}
+
+address_parser_response_t *parse_address(char *address, address_parser_options_t options) {
+    if (!libpostal_ensure_modules(LIBPOSTAL_PARSER_MODULES)) {
+        return NULL;
+    }
+
+    address_parser_context_t *context = get_thread_parser_context();
+    if (context == NULL) {
+        log_error("Could not allocate parser context\n");
+        return NULL;
+    }
+
+    address_parser_response_t *parsed = parse_address_cached(address, options, context);
+
+    if (parsed == NULL) {
+        log_error("Parser returned NULL\n");
+        return NULL;
+    }
+
+    return parsed;
+}
+
+struct libpostal_parser_session {
+    address_parser_context_t *context;
+};
+
+void libpostal_parser_session_destroy(libpostal_parser_session_t *self) {
+    if (self == NULL) return;
+
+    if (self->context != NULL) {
+        address_parser_context_destroy(self->context);
+    }
+
+    free(self);
+}
+
+libpostal_parser_session_t *libpostal_parser_session_new(void) {
+    if (!libpostal_ensure_modules(LIBPOSTAL_PARSER_MODULES)) {
+        return NULL;
+    }
+
+    if (get_address_parser() == NULL || get_geodb() == NULL) {
+        log_error("Parser not loaded, call libpostal_setup_parser before creating a session\n");
+        return NULL;
+    }
+
+    libpostal_parser_session_t *session = malloc(sizeof(libpostal_parser_session_t));
+    if (session == NULL) return NULL;
+
+    session->context = address_parser_context_new();
+    if (session->context == NULL) {
+        free(session);
+        return NULL;
+    }
+
+    return session;
+}
+
+address_parser_response_t *parse_address_r(libpostal_parser_session_t *session, char *address, address_parser_options_t options) {
+    if (session == NULL) return NULL;
+
+    address_parser_response_t *parsed = parse_address_cached(address, options, session->context);
+
+    if (parsed == NULL) {
+        log_error("Parser returned NULL\n");
+        return NULL;
+    }
+
+    return parsed;
+}
+
+address_parser_compact_response_t *parse_address_compact_r(libpostal_parser_session_t *session, char *address, address_parser_options_t options) {
+    if (session == NULL) return NULL;
+
+    return address_parser_parse_compact(address, options.language, options.country, session->context);
+}
+
+/*
+Batch API
+
+expand_address_batch and parse_address_batch split their inputs across a
+thread pool, each worker using its own parser context. Both go through the
+result cache like the single-input calls. Per-input results are collected
+into slots indexed by input position, then copied into a single allocation
+(offsets, string pointers and string data) so results come back in input
+order and are freed with one call.
+*/
+
+typedef struct expand_address_batch_job {
+    char **inputs;
+    normalize_options_t options;
+    cstring_array **results;
+} expand_address_batch_job_t;
+
+static void expand_address_batch_task(void *arg, size_t worker_id, size_t i) {
+    expand_address_batch_job_t *job = (expand_address_batch_job_t *)arg;
+    job->results[i] = expand_address_strings_cached(job->inputs[i], job->options);
+}
+
+expand_address_batch_response_t *expand_address_batch(char **inputs, size_t num_inputs, normalize_options_t options, size_t num_threads) {
+    if (inputs == NULL) return NULL;
+
+    expand_address_batch_response_t *response = NULL;
+
+    cstring_array **results = calloc(num_inputs, sizeof(cstring_array *));
+    if (results == NULL) return NULL;
+
+    thread_pool_t *pool = thread_pool_new(num_threads);
+    if (pool == NULL) {
+        free(results);
+        return NULL;
+    }
+
+    expand_address_batch_job_t job = (expand_address_batch_job_t){inputs, options, results};
+
+    if (!thread_pool_map(pool, num_inputs, expand_address_batch_task, &job)) {
+        goto exit_expand_batch_results_allocated;
+    }
+
+    size_t num_expansions = 0;
+    size_t strings_len = 0;
+
+    for (size_t i = 0; i < num_inputs; i++) {
+        if (results[i] == NULL) continue;
+        num_expansions += cstring_array_num_strings(results[i]);
+        strings_len += cstring_array_used(results[i]);
+    }
+
+    size_t offsets_size = sizeof(size_t) * (num_inputs + 1);
+    size_t pointers_size = sizeof(char *) * num_expansions;
+
+    char *data = malloc(offsets_size + pointers_size + strings_len);
+    response = malloc(sizeof(expand_address_batch_response_t));
+    if (data == NULL || response == NULL) {
+        free(data);
+        free(response);
+        response = NULL;
+        goto exit_expand_batch_results_allocated;
+    }
+
+    response->num_inputs = num_inputs;
+    response->num_expansions = num_expansions;
+    response->offsets = (size_t *)data;
+    response->expansions = (char **)(data + offsets_size);
+    response->strings = data + offsets_size + pointers_size;
+
+    size_t expansion_index = 0;
+    char *ptr = response->strings;
+
+    for (size_t i = 0; i < num_inputs; i++) {
+        response->offsets[i] = expansion_index;
+        cstring_array *strings = results[i];
+        if (strings == NULL) continue;
+
+        size_t used = cstring_array_used(strings);
+        memcpy(ptr, strings->str->a, used);
+
+        for (uint32_t j = 0; j < cstring_array_num_strings(strings); j++) {
+            response->expansions[expansion_index++] = ptr + cstring_array_get_offset(strings, j);
+        }
+
+        ptr += used;
+    }
+    response->offsets[num_inputs] = expansion_index;
+
+exit_expand_batch_results_allocated:
+    for (size_t i = 0; i < num_inputs; i++) {
+        if (results[i] != NULL) {
+            cstring_array_destroy(results[i]);
+        }
+    }
+    free(results);
+    thread_pool_destroy(pool);
+    return response;
+}
+
+void expand_address_batch_response_destroy(expand_address_batch_response_t *self) {
+    if (self == NULL) return;
+
+    // offsets is the start of the single allocation holding the results
+    if (self->offsets != NULL) {
+        free(self->offsets);
+    }
+
+    free(self);
+}
+
+typedef struct parse_address_batch_job {
+    char **inputs;
+    address_parser_options_t options;
+    address_parser_context_t **contexts;
+    address_parser_response_t **results;
+} parse_address_batch_job_t;
+
+static void parse_address_batch_task(void *arg, size_t worker_id, size_t i) {
+    parse_address_batch_job_t *job = (parse_address_batch_job_t *)arg;
+    job->results[i] = parse_address_cached(job->inputs[i], job->options, job->contexts[worker_id]);
+}
+
+address_parser_batch_response_t *parse_address_batch(char **inputs, size_t num_inputs, address_parser_options_t options, size_t num_threads) {
+    if (inputs == NULL) return NULL;
+
+    if (!libpostal_ensure_modules(LIBPOSTAL_PARSER_MODULES)) {
+        return NULL;
+    }
+
+    address_parser_batch_response_t *response = NULL;
+
+    thread_pool_t *pool = thread_pool_new(num_threads);
+    if (pool == NULL) return NULL;
+
+    size_t num_workers = thread_pool_num_workers(pool);
+
+    address_parser_response_t **results = calloc(num_inputs, sizeof(address_parser_response_t *));
+    address_parser_context_t **contexts = calloc(num_workers, sizeof(address_parser_context_t *));
+    if (results == NULL || contexts == NULL) {
+        goto exit_parse_batch_results_allocated;
+    }
+
+    for (size_t i = 0; i < num_workers; i++) {
+        contexts[i] = address_parser_context_new();
+        if (contexts[i] == NULL) {
+            goto exit_parse_batch_results_allocated;
+        }
+    }
+
+    parse_address_batch_job_t job = (parse_address_batch_job_t){inputs, options, contexts, results};
+
+    if (!thread_pool_map(pool, num_inputs, parse_address_batch_task, &job)) {
+        goto exit_parse_batch_results_allocated;
+    }
+
+    size_t num_components = 0;
+    size_t strings_len = 0;
+
+    for (size_t i = 0; i < num_inputs; i++) {
+        address_parser_response_t *parsed = results[i];
+        if (parsed == NULL) continue;
+        num_components += parsed->num_components;
+        for (size_t j = 0; j < parsed->num_components; j++) {
+            strings_len += strlen(parsed->components[j]) + strlen(parsed->labels[j]) + 2;
+        }
+    }
+
+    size_t offsets_size = sizeof(size_t) * (num_inputs + 1);
+    size_t pointers_size = sizeof(char *) * num_components;
+
+    char *data = malloc(offsets_size + 2 * pointers_size + strings_len);
+    response = malloc(sizeof(address_parser_batch_response_t));
+    if (data == NULL || response == NULL) {
+        free(data);
+        free(response);
+        response = NULL;
+        goto exit_parse_batch_results_allocated;
+    }
+
+    response->num_inputs = num_inputs;
+    response->num_components = num_components;
+    response->offsets = (size_t *)data;
+    response->components = (char **)(data + offsets_size);
+    response->labels = (char **)(data + offsets_size + pointers_size);
+    response->strings = data + offsets_size + 2 * pointers_size;
+
+    size_t component_index = 0;
+    char *ptr = response->strings;
+
+    for (size_t i = 0; i < num_inputs; i++) {
+        response->offsets[i] = component_index;
+        address_parser_response_t *parsed = results[i];
+        if (parsed == NULL) continue;
+
+        for (size_t j = 0; j < parsed->num_components; j++) {
+            size_t len = strlen(parsed->components[j]) + 1;
+            memcpy(ptr, parsed->components[j], len);
+            response->components[component_index] = ptr;
+            ptr += len;
+
+            len = strlen(parsed->labels[j]) + 1;
+            memcpy(ptr, parsed->labels[j], len);
+            response->labels[component_index] = ptr;
+            ptr += len;
+
+            component_index++;
+        }
+    }
+    response->offsets[num_inputs] = component_index;
+
+exit_parse_batch_results_allocated:
+    if (results != NULL) {
+        for (size_t i = 0; i < num_inputs; i++) {
+            address_parser_response_destroy(results[i]);
+        }
+        free(results);
+    }
+
+    if (contexts != NULL) {
+        for (size_t i = 0; i < num_workers; i++) {
+            address_parser_context_destroy(contexts[i]);
+        }
+        free(contexts);
+    }
+
+    thread_pool_destroy(pool);
+    return response;
+}
+
+void address_parser_batch_response_destroy(address_parser_batch_response_t *self) {
+    if (self == NULL) return;
+
+    // offsets is the start of the single allocation holding the results
+    if (self->offsets != NULL) {
+        free(self->offsets);
+    }
+
+    free(self);
+}
+
+bool libpostal_setup(void) {
+    if (!transliteration_module_setup(NULL)) {
+        log_error("Error loading transliteration module\n");
+        return false;
+    }
+
+    if (!numex_module_setup(NULL)) {
+        log_error("Error loading numex module\n");
+        return false;
+    }
+
+    if (!address_dictionary_module_setup(NULL)) {
+        log_error("Error loading dictionary module\n");
+        return false;
+    }
+
+    return true;
+}
+
+bool libpostal_setup_languages(char **languages, size_t num_languages) {
+    if (!transliteration_module_setup(NULL)) {
+        log_error("Error loading transliteration module\n");
+        return false;
+    }
+
+    if (!numex_module_setup(NULL)) {
+        log_error("Error loading numex module\n");
+        return false;
+    }
+
+    if (!address_dictionary_module_setup_languages(NULL, languages, num_languages)) {
+        log_error("Error loading dictionary module\n");
+        return false;
+    }
+
+    return true;
+}
+
+bool libpostal_setup_language_classifier(void) {
+    if (!language_classifier_module_setup(NULL)) {
+        log_error("Error loading language classifier\n");
+        return false;
+    }
+    return true;
+}
+
+bool libpostal_setup_parser(void) {
+    if (!geodb_module_setup(NULL)) {
+        log_error("Error loading geodb module\n");
+        return false;
+    }
+
+    if (!address_parser_module_setup(NULL)) {
+        log_error("Error loading address parser module\n");
+        return false;
+    }
+
+    return true;
+}
+
+bool libpostal_setup_parser_feature_hashes(void) {
+    return libpostal_setup_parser() && address_parser_build_feature_hashes();
+}
+
+bool libpostal_setup_bundle(char *path, bool verify_checksums) {
+    if (libpostal_bundle != NULL) return true;
+
+    if (path == NULL) {
+        path = LIBPOSTAL_DATA_DIR PATH_SEPARATOR DEFAULT_DATA_BUNDLE_FILENAME;
+    }
+
+    data_bundle_t *bundle = data_bundle_open(path, verify_checksums);
+    if (bundle == NULL) {
+        log_error("Error opening data bundle\n");
+        return false;
+    }
+
+    data_bundle_set_default(bundle);
+    libpostal_bundle = bundle;
+
+    return true;
+}
+
+void libpostal_teardown(void) {
+    destroy_thread_expand_arena();
+
+    libpostal_cache_disable();
+
+    transliteration_module_teardown();
+
+    numex_module_teardown();
+
+    address_dictionary_module_teardown();
+
+    libpostal_clear_modules(LIBPOSTAL_MODULE_TRANSLITERATION | LIBPOSTAL_MODULE_NUMEX | LIBPOSTAL_MODULE_ADDRESS_DICTIONARY);
+}
+
+void libpostal_teardown_language_classifier(void) {
+    language_classifier_module_teardown();
+
+    libpostal_clear_modules(LIBPOSTAL_MODULE_LANGUAGE_CLASSIFIER);
+}
+
+void libpostal_teardown_parser(void) {
+    destroy_thread_parser_context();
+    libpostal_cache_flush();
+    geodb_module_teardown();
+    address_parser_module_teardown();
+
+    libpostal_clear_modules(LIBPOSTAL_MODULE_GEODB | LIBPOSTAL_MODULE_ADDRESS_PARSER);
+}
+
+void libpostal_teardown_bundle(void) {
+    libpostal_teardown_parser();
+    libpostal_teardown_language_classifier();
+    libpostal_teardown();
+
+    if (libpostal_bundle != NULL) {
+        data_bundle_set_default(NULL);
+        data_bundle_destroy(libpostal_bundle);
+        libpostal_bundle = NULL;
+    }
 }
@@ -68,6 +68,159 @@ char **expand_address(char *input, normalize_options_t options, size_t *n);
 
 void expansion_array_destroy(char **expansions, size_t n);
 
+/*
+Canonical normalization
+
+Returns a single deterministic normalized string for input (free with free),
+for use as a key when all that's needed is to match equivalent addresses
+rather than every expansion. Follows only the first normalization of each
+token and replaces each phrase from the address dictionaries with its
+canonical form, in one linear pass. Affixes inside words (e.g. German
+compound street names) are left as is.
+*/
+
+char *normalize_address_canonical(char *input, normalize_options_t options);
+
+/*
+Expansion iterator
+
+Yields the expansions of input one at a time, in the same order as
+expand_address, doing only the work needed for the expansions consumed.
+Iteration stops after max_expansions expansions (0 = no limit) or once
+timeout_usec microseconds have passed since the iterator was created
+(0 = no deadline). expand_address_iterator_truncated returns true if it
+stopped with expansions left over: after the max_expansions-th expansion,
+the next call looks for one more before reporting truncation, so an input
+with exactly max_expansions expansions is not truncated.
+
+Strings returned by expand_address_iterator_next are owned by the iterator
+and valid until the next call. options.languages must outlive the iterator.
+An iterator may only be used by one thread at a time.
+*/
+
+typedef struct libpostal_expansion_iterator libpostal_expansion_iterator_t;
+
+libpostal_expansion_iterator_t *expand_address_iterator_new(char *input, normalize_options_t options, size_t max_expansions, uint64_t timeout_usec);
+// Returns NULL when there are no more expansions or a limit was hit
+char *expand_address_iterator_next(libpostal_expansion_iterator_t *self);
+bool expand_address_iterator_truncated(libpostal_expansion_iterator_t *self);
+void expand_address_iterator_destroy(libpostal_expansion_iterator_t *self);
+
+/*
+Expansion lattice
+
+A compact alternative to expand_address: rather than every expansion, the
+lattice holds the alternatives for each position, so its size is linear in
+the input. Each normalization of the input gives one sequence
+(deduplicated). Sequence i covers positions sequence_offsets[i] through
+sequence_offsets[i + 1] - 1, and position j has alternatives
+alternatives[position_offsets[j]] through
+alternatives[position_offsets[j + 1] - 1], where phrases from the address
+dictionaries (e.g. "st" => "saint", "street") are a single position, as is
+a token with several variants (e.g. "saint-denis" => "saint denis",
+"saintdenis", with the expansions of each).
+
+An expansion is the concatenation of one alternative per position of a
+sequence, alternatives include their own whitespace. Enumerating all of them
+gives the expansions of expand_address except for those added by the
+roman_numerals post-processing step, and for phrases or numeric expressions
+that span a token with several variants and its neighbors.
+
+The lattice is a single allocation, free it with expansion_lattice_destroy.
+expansion_lattice_serialize writes it to a flat, pointer-free buffer (free
+with free) which expansion_lattice_deserialize reads back.
+*/
+
+typedef struct libpostal_expansion_lattice {
+    size_t num_sequences;
+    size_t *sequence_offsets;
+    size_t num_positions;
+    size_t *position_offsets;
+    size_t num_alternatives;
+    char **alternatives;
+    char *strings;
+    size_t strings_len;
+} libpostal_expansion_lattice_t;
+
+libpostal_expansion_lattice_t *expand_address_lattice(char *input, normalize_options_t options);
+void expansion_lattice_destroy(libpostal_expansion_lattice_t *self);
+
+char *expansion_lattice_serialize(libpostal_expansion_lattice_t *self, size_t *len);
+libpostal_expansion_lattice_t *expansion_lattice_deserialize(char *data, size_t len);
+
+/*
+Batch expansion
+
+Expands num_inputs addresses using a pool of num_threads worker threads
+(0 = number of CPUs). Results are in input order: the expansions of
+inputs[i] are expansions[offsets[i]] through expansions[offsets[i + 1] - 1].
+All results live in a single allocation, free with
+expand_address_batch_response_destroy.
+*/
+
+typedef struct expand_address_batch_response {
+    size_t num_inputs;
+    size_t num_expansions;
+    size_t *offsets;
+    char **expansions;
+    char *strings;
+} expand_address_batch_response_t;
+
+expand_address_batch_response_t *expand_address_batch(char **inputs, size_t num_inputs, normalize_options_t options, size_t num_threads);
+void expand_address_batch_response_destroy(expand_address_batch_response_t *self);
+
+/*
+Instrumentation
+
+Per-stage cumulative time and call counts, plus counters, summed over all
+threads. Only recorded in builds configured with --enable-stats (which
+defines LIBPOSTAL_STATS), otherwise enabled is false and everything is zero.
+Times of nested stages overlap, e.g. transliterate runs inside
+normalize_string_languages. Resetting while other threads are inside
+libpostal may miss some of their in-flight updates.
+*/
+
+typedef enum {
+    LIBPOSTAL_STAGE_TOKENIZE,
+    LIBPOSTAL_STAGE_NORMALIZE,
+    LIBPOSTAL_STAGE_TRANSLITERATE,
+    LIBPOSTAL_STAGE_DICTIONARY_SEARCH,
+    LIBPOSTAL_STAGE_NUMEX,
+    LIBPOSTAL_STAGE_LANGUAGE_CLASSIFIER,
+    LIBPOSTAL_STAGE_PARSER_CONTEXT_FILL,
+    LIBPOSTAL_STAGE_PARSER_PREDICT,
+    LIBPOSTAL_NUM_STAGES
+} libpostal_stage_t;
+
+typedef enum {
+    LIBPOSTAL_COUNTER_TOKENS,
+    LIBPOSTAL_COUNTER_PHRASES,
+    LIBPOSTAL_COUNTER_EXPANSIONS,
+    LIBPOSTAL_COUNTER_FEATURES,
+    LIBPOSTAL_COUNTER_ARENA_ALLOCATIONS,
+    // Arena blocks obtained from malloc
+    LIBPOSTAL_COUNTER_ARENA_BLOCKS,
+    LIBPOSTAL_NUM_COUNTERS
+} libpostal_counter_t;
+
+typedef struct libpostal_stage_stats {
+    uint64_t calls;
+    uint64_t nanoseconds;
+} libpostal_stage_stats_t;
+
+typedef struct libpostal_stats {
+    bool enabled;
+    libpostal_stage_stats_t stages[LIBPOSTAL_NUM_STAGES];
+    uint64_t counters[LIBPOSTAL_NUM_COUNTERS];
+} libpostal_stats_t;
+
+// Names are the function names of the stages, e.g. "transliterate"
+const char *libpostal_stage_name(libpostal_stage_t stage);
+const char *libpostal_counter_name(libpostal_counter_t counter);
+
+libpostal_stats_t libpostal_get_stats(void);
+void libpostal_reset_stats(void);
+
 /*
 Address parser
 */
@@ -85,21 +238,156 @@ typedef struct address_parser_options {
 
 void address_parser_response_destroy(address_parser_response_t *self);
 
+/*
+Compact parser responses
+
+Instead of one string per component and label, a compact response holds
+the normalized input once plus a (label, start, len) span per component,
+with start and len in bytes into normalized. The response is a single
+allocation, free it with address_parser_compact_response_destroy.
+*/
+
+typedef enum {
+    ADDRESS_LABEL_HOUSE,
+    ADDRESS_LABEL_HOUSE_NUMBER,
+    ADDRESS_LABEL_ROAD,
+    ADDRESS_LABEL_SUBURB,
+    ADDRESS_LABEL_CITY_DISTRICT,
+    ADDRESS_LABEL_CITY,
+    ADDRESS_LABEL_STATE_DISTRICT,
+    ADDRESS_LABEL_STATE,
+    ADDRESS_LABEL_POSTAL_CODE,
+    ADDRESS_LABEL_COUNTRY,
+    NUM_ADDRESS_LABELS,
+    ADDRESS_LABEL_UNKNOWN = NUM_ADDRESS_LABELS
+} address_parser_label_t;
+
+typedef struct address_parser_span {
+    uint32_t label;
+    uint32_t start;
+    uint32_t len;
+} address_parser_span_t;
+
+typedef struct address_parser_compact_response {
+    size_t num_components;
+    address_parser_span_t *components;
+    char *normalized;
+    size_t normalized_len;
+} address_parser_compact_response_t;
+
+// Label name as used in address_parser_response_t (e.g. "postcode"), NULL for ADDRESS_LABEL_UNKNOWN
+const char *address_parser_label_name(address_parser_label_t label);
+
+void address_parser_compact_response_destroy(address_parser_compact_response_t *self);
+
 address_parser_options_t get_libpostal_address_parser_default_options(void);
 
 address_parser_response_t *parse_address(char *address, address_parser_options_t options);
+address_parser_compact_response_t *parse_address_compact(char *address, address_parser_options_t options);
+
+/*
+Parser sessions hold all of the mutable per-call state used by the parser
+(feature buffers, phrase memberships, class scores), while
+the models loaded by libpostal_setup_parser are shared and read-only.
+
+A session may only be used by one thread at a time. Any number of threads
+can call parse_address_r concurrently provided each has its own session.
+*/
+typedef struct libpostal_parser_session libpostal_parser_session_t;
+
+libpostal_parser_session_t *libpostal_parser_session_new(void);
+void libpostal_parser_session_destroy(libpostal_parser_session_t *self);
+
+address_parser_response_t *parse_address_r(libpostal_parser_session_t *session, char *address, address_parser_options_t options);
+address_parser_compact_response_t *parse_address_compact_r(libpostal_parser_session_t *session, char *address, address_parser_options_t options);
+
+/*
+Batch parsing, same layout as expand_address_batch: the components of
+inputs[i] are components[offsets[i]] through components[offsets[i + 1] - 1]
+with the corresponding labels at the same indices.
+*/
+
+typedef struct address_parser_batch_response {
+    size_t num_inputs;
+    size_t num_components;
+    size_t *offsets;
+    char **components;
+    char **labels;
+    char *strings;
+} address_parser_batch_response_t;
+
+address_parser_batch_response_t *parse_address_batch(char **inputs, size_t num_inputs, address_parser_options_t options, size_t num_threads);
+void address_parser_batch_response_destroy(address_parser_batch_response_t *self);
+
+/*
+Result cache
+
+An optional in-process LRU cache in front of expand_address and
+parse_address (including parse_address_r and the batch calls), keyed by
+the input and every option that affects the result. Repeated inputs skip
+the whole pipeline.
+
+The cache is split into num_shards shards (0 = default of 16), each with its
+own lock and an equal share of max_memory bytes. Enabling it again replaces
+the current cache. Enabling and disabling should not race with in-flight
+calls, flushing can happen at any time. libpostal_teardown disables it.
+*/
+
+typedef struct libpostal_cache_stats {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+    size_t num_entries;
+    size_t memory_used;
+    size_t memory_limit;
+} libpostal_cache_stats_t;
+
+bool libpostal_cache_enable(size_t max_memory, size_t num_shards);
+void libpostal_cache_disable(void);
+void libpostal_cache_flush(void);
+libpostal_cache_stats_t libpostal_cache_get_stats(void);
 
 // Setup/teardown methods
 
 bool libpostal_setup(void);
 void libpostal_teardown(void);
 
+/*
+Same as libpostal_setup, but only the address dictionary entries for the
+given languages (and those shared by all languages) are loaded up front.
+Entries for other languages are loaded the first time they're needed.
+*/
+bool libpostal_setup_languages(char **languages, size_t num_languages);
+
 bool libpostal_setup_parser(void);
 void libpostal_teardown_parser(void);
 
+/*
+Same as libpostal_setup_parser, then indexes the parser model's features by
+hash so parsing doesn't build a string per feature. Opt-in because the
+index costs about 26 bytes per feature (~26MB per million features) and
+about a second per million features to build. Models saved with a feature
+index don't need it. Call before parsing starts, not concurrently with it.
+*/
+bool libpostal_setup_parser_feature_hashes(void);
+
 bool libpostal_setup_language_classifier(void);
 void libpostal_teardown_language_classifier(void);
 
+/*
+Data bundle setup
+
+Instead of the setup functions above, libpostal_setup_bundle opens a
+single data bundle (built with build_data_bundle) and loads each module
+from it the first time an API call needs it. path == NULL means the
+default bundle in the data directory. With verify_checksums, each
+section's checksum is checked when the section is first loaded.
+
+libpostal_teardown_bundle tears down any modules loaded and closes the bundle.
+*/
+bool libpostal_setup_bundle(char *path, bool verify_checksums);
+void libpostal_teardown_bundle(void);
+
 #ifdef __cplusplus
 }
 #endif
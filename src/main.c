@@ -6,12 +6,14 @@
 #include <unistd.h>
 
 #include "libpostal.h"
+#include "bulk_stream.h"
 #include "file_utils.h"
 #include "log/log.h"
 #include "json_encode.h"
 #include "string_utils.h"
 
-#define LIBPOSTAL_USAGE "Usage: ./libpostal address [...languages] [--json]\n"
+#define LIBPOSTAL_USAGE "Usage: ./libpostal address [...languages] [--json]\n" \
+                        "       ./libpostal --bulk [--input file] [--threads n] [...languages]\n"
 
 static inline void print_output(char *address, normalize_options_t options, bool use_json) {
     size_t num_expansions;
@@ -43,6 +45,33 @@ static inline void print_output(char *address, normalize_options_t options, bool
 
 }
 
+// Bulk mode: one NDJSON object per input line, {"address": ..., "expansions": [...]}
+static char *bulk_expand_line(void *arg, size_t worker_id, char *address) {
+    normalize_options_t *options = (normalize_options_t *)arg;
+
+    size_t num_expansions;
+    char **strings = expand_address(address, *options, &num_expansions);
+    if (strings == NULL) return NULL;
+
+    char_array *json = char_array_new_size(strlen(address) * 4);
+
+    char *json_string = json_encode_string(address);
+    char_array_cat_printf(json, "{\"address\": %s, \"expansions\": [", json_string);
+    free(json_string);
+
+    for (size_t i = 0; i < num_expansions; i++) {
+        json_string = json_encode_string(strings[i]);
+        char_array_cat_printf(json, "%s%s", json_string, i < num_expansions - 1 ? ", " : "");
+        free(json_string);
+        free(strings[i]);
+    }
+    char_array_cat(json, "]}");
+
+    free(strings);
+
+    return char_array_to_string(json);
+}
+
 int main(int argc, char **argv) {
     char *arg;
 
@@ -51,6 +80,10 @@ int main(int argc, char **argv) {
 
     bool use_json = false;
 
+    bool bulk = false;
+    char *input_file = NULL;
+    size_t num_threads = 0;
+
     string_array *languages = NULL;
 
     for (int i = 1; i < argc; i++) {
@@ -60,7 +93,14 @@ int main(int argc, char **argv) {
             exit(EXIT_SUCCESS);
         } else if (string_equals(arg, "--json")) {
             use_json = true;
-        } else if (address == NULL) {
+        } else if (string_equals(arg, "--bulk")) {
+            bulk = true;
+        } else if (string_equals(arg, "--input") && i < argc - 1) {
+            input_file = argv[++i];
+            bulk = true;
+        } else if (string_equals(arg, "--threads") && i < argc - 1) {
+            num_threads = (size_t)strtoul(argv[++i], NULL, 10);
+        } else if (address == NULL && !bulk) {
             address = arg;
         } else if (!string_starts_with(arg, "-")) {
             if (languages == NULL) {
@@ -70,7 +110,16 @@ int main(int argc, char **argv) {
         }
     }
 
-    if (address == NULL && (!use_json || isatty(fileno(stdin)))) {
+    // In bulk mode every positional argument is a language
+    if (bulk && address != NULL) {
+        if (languages == NULL) {
+            languages = string_array_new();
+        }
+        string_array_push(languages, address);
+        address = NULL;
+    }
+
+    if (address == NULL && !bulk && (!use_json || isatty(fileno(stdin)))) {
         log_error(LIBPOSTAL_USAGE);
         exit(EXIT_FAILURE);
     }
@@ -80,13 +129,31 @@ int main(int argc, char **argv) {
     }
 
     normalize_options_t options = get_libpostal_default_options();
+    bool success = true;
 
     if (languages != NULL) {
         options.languages = languages->a;
         options.num_languages = languages->n;
     }
 
-    if (address == NULL) {
+    if (bulk) {
+        FILE *input = stdin;
+        if (input_file != NULL && (input = fopen(input_file, "r")) == NULL) {
+            log_error("Could not open input file: %s\n", input_file);
+            exit(EXIT_FAILURE);
+        }
+
+        bulk_stream_stats_t stats;
+        success = bulk_stream_run(input, stdout, num_threads, 0, bulk_expand_line, &options, &stats);
+        if (!success) {
+            log_error("Error in bulk expansion\n");
+        }
+        bulk_stream_stats_print(stderr, stats);
+
+        if (input != stdin) {
+            fclose(input);
+        }
+    } else if (address == NULL) {
         char *line;
         while ((line = file_getline(stdin)) != NULL) {
             print_output(line, options, use_json);
@@ -102,4 +169,6 @@ int main(int argc, char **argv) {
 
     libpostal_teardown();
     libpostal_teardown_language_classifier();
+
+    return success ? EXIT_SUCCESS : EXIT_FAILURE;
 }
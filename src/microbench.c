@@ -0,0 +1,628 @@
+/*
+microbench
+----------
+
+Isolated benchmarks for the hot kernels, so kernel-level changes can be
+validated without end-to-end noise:
+
+    trie_get                               address dictionary lookups, one per token
+    trie_search_tokens_with_phrases        address dictionary phrase search
+    tokenize                               re2c scanner
+    transliterate                          latin-ascii transliterator
+    normalize_string_utf8                  utf8proc-based normalization
+    averaged_perceptron_predict            parser model, real features per token
+    logistic_regression_model_expectation  language classifier model
+
+Inputs are either sampled from a corpus (--input, reservoir sample of
+--samples lines with a fixed seed so runs are comparable) or generated
+synthetically. Everything a kernel needs (normalized strings, tokens, keys,
+feature vectors) is prepared up front, so only the kernel itself is timed.
+
+Each kernel is run over all inputs --warmup times untimed, then
+--repetitions times timed. Reports min and median nanoseconds and cycles
+per operation as JSON. Cycles come from rdtsc on x86 (reference cycles, not
+core cycles) and are reported as 0 elsewhere.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define MICROBENCH_CYCLE_COUNTER "rdtsc"
+static inline uint64_t microbench_cycles(void) {
+    return __rdtsc();
+}
+#else
+#define MICROBENCH_CYCLE_COUNTER "none"
+static inline uint64_t microbench_cycles(void) {
+    return 0;
+}
+#endif
+
+#include "libpostal.h"
+#include "address_dictionary.h"
+#include "address_parser.h"
+#include "averaged_perceptron.h"
+#include "averaged_perceptron_tagger.h"
+#include "collections.h"
+#include "file_utils.h"
+#include "json_encode.h"
+#include "language_classifier.h"
+#include "language_features.h"
+#include "log/log.h"
+#include "logistic_regression.h"
+#include "matrix.h"
+#include "minibatch.h"
+#include "normalize.h"
+#include "scanner.h"
+#include "sparse_matrix.h"
+#include "string_utils.h"
+#include "transliterate.h"
+#include "trie.h"
+#include "trie_search.h"
+
+#define MICROBENCH_USAGE "Usage: ./microbench [--input file] [--samples n] [--kernels name,...] [--warmup n] [--repetitions n] [--language code]\n"
+
+#define MICROBENCH_DEFAULT_SAMPLES 1000
+#define MICROBENCH_SEED 12345
+
+VECTOR_INIT(cstring_array_array, cstring_array *)
+VECTOR_INIT(token_array_array, token_array *)
+VECTOR_INIT(sparse_matrix_array, sparse_matrix_t *)
+
+typedef struct microbench_inputs {
+    cstring_array *strings;
+    // Lowercased strings and their tokens
+    cstring_array *normalized;
+    token_array_array *tokens;
+    // "lang|token" for every non-whitespace token
+    cstring_array *trie_keys;
+    // Parser features for every token
+    cstring_array_array *parser_features;
+    double_array *parser_scores;
+    // Language classifier feature vectors
+    sparse_matrix_array *language_features;
+    matrix_t *language_probs;
+    token_array *token_buffer;
+} microbench_inputs_t;
+
+// Runs a kernel once over all of the inputs, returns the number of operations
+typedef size_t (*microbench_kernel_function)(microbench_inputs_t *inputs);
+
+typedef struct microbench_kernel {
+    char *name;
+    microbench_kernel_function func;
+} microbench_kernel_t;
+
+// Results are accumulated here so the compiler can't drop the calls
+static volatile uint64_t microbench_sink = 0;
+
+static inline double microbench_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+static inline uint32_t microbench_random(uint64_t *state) {
+    *state = *state * 6364136223846793005ULL + 1442695040888963407ULL;
+    return (uint32_t)(*state >> 33);
+}
+
+/*
+Inputs
+*/
+
+static char *microbench_house_numbers[] = {"1", "12", "123", "4567", "22b", "7-9", "100A"};
+static char *microbench_streets[] = {"Main", "Broadway", "Hauptstraße", "Rue de l'Église", "Calle Mayor", "Via Roma", "Kings Road", "Şehit Mehmet", "Nørrebrogade", "Avenida Paulista"};
+static char *microbench_suffixes[] = {"St.", "Street", "Ave", "Avenue", "Rd", "Blvd", "", "Apt 2F", "Suite 100", "#3"};
+static char *microbench_cities[] = {"Brooklyn NY 11216", "Berlin", "Paris", "Madrid", "Roma", "London", "İstanbul", "København", "São Paulo", "Toronto ON"};
+
+#define MICROBENCH_CHOOSE(array, state) (array[microbench_random(state) % (sizeof(array) / sizeof(array[0]))])
+
+static cstring_array *microbench_synthetic_inputs(size_t n) {
+    cstring_array *strings = cstring_array_new();
+    char_array *str = char_array_new();
+    uint64_t state = MICROBENCH_SEED;
+
+    for (size_t i = 0; i < n; i++) {
+        char_array_clear(str);
+        char_array_cat_printf(str, "%s %s %s, %s",
+                              MICROBENCH_CHOOSE(microbench_house_numbers, &state),
+                              MICROBENCH_CHOOSE(microbench_streets, &state),
+                              MICROBENCH_CHOOSE(microbench_suffixes, &state),
+                              MICROBENCH_CHOOSE(microbench_cities, &state));
+        cstring_array_add_string(strings, char_array_get_string(str));
+    }
+
+    char_array_destroy(str);
+    return strings;
+}
+
+// Reservoir sample of up to n lines
+static cstring_array *microbench_corpus_inputs(char *filename, size_t n) {
+    FILE *f = fopen(filename, "r");
+    if (f == NULL) {
+        log_error("Could not open input file: %s\n", filename);
+        return NULL;
+    }
+
+    char **sample = calloc(n, sizeof(char *));
+    if (sample == NULL) {
+        fclose(f);
+        return NULL;
+    }
+
+    uint64_t state = MICROBENCH_SEED;
+    size_t num_lines = 0;
+    char *line;
+
+    while ((line = file_getline(f)) != NULL) {
+        if (line[0] == '\0') {
+            free(line);
+            continue;
+        }
+
+        size_t j = num_lines < n ? num_lines : (size_t)(microbench_random(&state) % (num_lines + 1));
+        num_lines++;
+
+        if (j < n) {
+            free(sample[j]);
+            sample[j] = line;
+        } else {
+            free(line);
+        }
+    }
+    fclose(f);
+
+    cstring_array *strings = cstring_array_new();
+    for (size_t i = 0; i < n; i++) {
+        if (sample[i] == NULL) continue;
+        cstring_array_add_string(strings, sample[i]);
+        free(sample[i]);
+    }
+    free(sample);
+
+    return strings;
+}
+
+static bool microbench_add_parser_features(microbench_inputs_t *inputs, address_parser_context_t *context, char *str) {
+    address_parser_t *parser = get_address_parser();
+
+    char *normalized = address_parser_normalize_string(str);
+    if (normalized == NULL) return true;
+
+    token_array *tokens = context->tokens;
+    token_array_clear(tokens);
+    tokenize_add_tokens(tokens, normalized, strlen(normalized), false);
+
+    tokenized_string_t *tokenized_str = context->tokenized_str;
+    tokenized_string_clear(tokenized_str);
+    tokenized_str->str = normalized;
+
+    uint32_array_clear(context->separators);
+
+    // Same token selection as address_parser_predict
+    for (size_t i = 0; i < tokens->n; i++) {
+        token_t token = tokens->a[i];
+        if (ADDRESS_PARSER_IS_SEPARATOR(token.type)) {
+            uint32_array_push(context->separators, ADDRESS_SEPARATOR_FIELD_INTERNAL);
+            continue;
+        } else if (ADDRESS_PARSER_IS_IGNORABLE(token.type)) {
+            continue;
+        }
+
+        tokenized_string_add_token(tokenized_str, normalized, token.len, token.type, token.offset);
+        uint32_array_push(context->separators, ADDRESS_SEPARATOR_NONE);
+    }
+
+    address_parser_context_fill(context, parser, tokenized_str, NULL, NULL);
+
+    bool ret = true;
+
+    for (uint32_t i = 0; i < tokenized_str->tokens->n; i++) {
+        cstring_array_clear(context->features);
+        // Tag history depends on predictions, START is as good as any for timing
+        if (!address_parser_features(parser, context, tokenized_str, i, START, START2)) {
+            ret = false;
+            break;
+        }
+
+        cstring_array *features = cstring_array_new_size(cstring_array_used(context->features));
+        for (uint32_t j = 0; j < cstring_array_num_strings(context->features); j++) {
+            cstring_array_add_string(features, cstring_array_get_string(context->features, j));
+        }
+        cstring_array_array_push(inputs->parser_features, features);
+    }
+
+    tokenized_string_clear(tokenized_str);
+    free(normalized);
+    return ret;
+}
+
+static bool microbench_add_language_features(microbench_inputs_t *inputs, char *str) {
+    language_classifier_t *classifier = get_language_classifier();
+
+    char *normalized = language_classifier_normalize_string(str);
+    if (normalized == NULL) return true;
+
+    token_array *tokens = token_array_new();
+    char_array *feature_array = char_array_new();
+
+    khash_t(str_double) *feature_counts = extract_language_features(normalized, NULL, tokens, feature_array);
+    if (feature_counts != NULL) {
+        if (kh_size(feature_counts) > 0) {
+            sparse_matrix_array_push(inputs->language_features, feature_vector(classifier->features, feature_counts));
+        }
+
+        const char *key;
+        kh_foreach_key(feature_counts, key, {
+            free((char *)key);
+        })
+        kh_destroy(str_double, feature_counts);
+    }
+
+    token_array_destroy(tokens);
+    char_array_destroy(feature_array);
+    free(normalized);
+    return true;
+}
+
+static void microbench_inputs_destroy(microbench_inputs_t *self) {
+    if (self == NULL) return;
+
+    if (self->strings != NULL) cstring_array_destroy(self->strings);
+    if (self->normalized != NULL) cstring_array_destroy(self->normalized);
+    if (self->trie_keys != NULL) cstring_array_destroy(self->trie_keys);
+
+    if (self->tokens != NULL) {
+        for (size_t i = 0; i < self->tokens->n; i++) {
+            token_array_destroy(self->tokens->a[i]);
+        }
+        token_array_array_destroy(self->tokens);
+    }
+
+    if (self->parser_features != NULL) {
+        for (size_t i = 0; i < self->parser_features->n; i++) {
+            cstring_array_destroy(self->parser_features->a[i]);
+        }
+        cstring_array_array_destroy(self->parser_features);
+    }
+
+    if (self->language_features != NULL) {
+        for (size_t i = 0; i < self->language_features->n; i++) {
+            sparse_matrix_destroy(self->language_features->a[i]);
+        }
+        sparse_matrix_array_destroy(self->language_features);
+    }
+
+    if (self->parser_scores != NULL) double_array_destroy(self->parser_scores);
+    if (self->language_probs != NULL) matrix_destroy(self->language_probs);
+    if (self->token_buffer != NULL) token_array_destroy(self->token_buffer);
+
+    free(self);
+}
+
+static microbench_inputs_t *microbench_inputs_new(cstring_array *strings, char *language) {
+    microbench_inputs_t *inputs = calloc(1, sizeof(microbench_inputs_t));
+    if (inputs == NULL) return NULL;
+
+    inputs->strings = strings;
+    inputs->normalized = cstring_array_new();
+    inputs->tokens = token_array_array_new();
+    inputs->trie_keys = cstring_array_new();
+    inputs->parser_features = cstring_array_array_new();
+    inputs->language_features = sparse_matrix_array_new();
+    inputs->token_buffer = token_array_new();
+    inputs->parser_scores = double_array_new_size(get_address_parser()->model->num_classes);
+    inputs->language_probs = matrix_new_zeros(1, get_language_classifier()->num_labels);
+
+    address_parser_context_t *context = address_parser_context_new();
+    char_array *key = char_array_new();
+
+    if (context == NULL || key == NULL) {
+        goto exit_microbench_inputs_error;
+    }
+
+    for (uint32_t i = 0; i < cstring_array_num_strings(strings); i++) {
+        char *str = cstring_array_get_string(strings, i);
+
+        char *normalized = normalize_string_utf8(str, NORMALIZE_STRING_LOWERCASE);
+        if (normalized == NULL) continue;
+
+        cstring_array_add_string(inputs->normalized, normalized);
+
+        token_array *tokens = token_array_new();
+        tokenize_add_tokens(tokens, normalized, strlen(normalized), true);
+        token_array_array_push(inputs->tokens, tokens);
+
+        for (size_t j = 0; j < tokens->n; j++) {
+            token_t token = tokens->a[j];
+            if (token.type == WHITESPACE) continue;
+
+            char_array_clear(key);
+            char_array_cat(key, language);
+            char_array_cat(key, NAMESPACE_SEPARATOR_CHAR);
+            char_array_cat_len(key, normalized + token.offset, token.len);
+            cstring_array_add_string(inputs->trie_keys, char_array_get_string(key));
+        }
+
+        free(normalized);
+
+        if (!microbench_add_parser_features(inputs, context, str) ||
+            !microbench_add_language_features(inputs, str)) {
+            goto exit_microbench_inputs_error;
+        }
+    }
+
+    address_parser_context_destroy(context);
+    char_array_destroy(key);
+    return inputs;
+
+exit_microbench_inputs_error:
+    if (context != NULL) address_parser_context_destroy(context);
+    if (key != NULL) char_array_destroy(key);
+    microbench_inputs_destroy(inputs);
+    return NULL;
+}
+
+/*
+Kernels
+*/
+
+static size_t microbench_trie_get(microbench_inputs_t *inputs) {
+    trie_t *trie = get_address_dictionary()->trie;
+    size_t n = cstring_array_num_strings(inputs->trie_keys);
+
+    for (uint32_t i = 0; i < n; i++) {
+        microbench_sink += trie_get(trie, cstring_array_get_string(inputs->trie_keys, i));
+    }
+
+    return n;
+}
+
+static size_t microbench_trie_search_tokens(microbench_inputs_t *inputs) {
+    trie_t *trie = get_address_dictionary()->trie;
+    size_t n = inputs->tokens->n;
+    phrase_array *phrases = NULL;
+
+    for (uint32_t i = 0; i < n; i++) {
+        char *str = cstring_array_get_string(inputs->normalized, i);
+        if (trie_search_tokens_with_phrases(trie, str, inputs->tokens->a[i], &phrases)) {
+            microbench_sink += phrases->n;
+            phrase_array_clear(phrases);
+        }
+    }
+
+    if (phrases != NULL) {
+        phrase_array_destroy(phrases);
+    }
+
+    return n;
+}
+
+static size_t microbench_tokenize(microbench_inputs_t *inputs) {
+    size_t n = cstring_array_num_strings(inputs->normalized);
+
+    for (uint32_t i = 0; i < n; i++) {
+        char *str = cstring_array_get_string(inputs->normalized, i);
+        token_array_clear(inputs->token_buffer);
+        tokenize_add_tokens(inputs->token_buffer, str, strlen(str), true);
+        microbench_sink += inputs->token_buffer->n;
+    }
+
+    return n;
+}
+
+static size_t microbench_transliterate(microbench_inputs_t *inputs) {
+    size_t n = cstring_array_num_strings(inputs->strings);
+
+    for (uint32_t i = 0; i < n; i++) {
+        char *str = cstring_array_get_string(inputs->strings, i);
+        char *transliterated = transliterate(LATIN_ASCII, str, strlen(str));
+        if (transliterated != NULL) {
+            microbench_sink += (uint64_t)transliterated[0];
+            free(transliterated);
+        }
+    }
+
+    return n;
+}
+
+static size_t microbench_normalize_string_utf8(microbench_inputs_t *inputs) {
+    size_t n = cstring_array_num_strings(inputs->strings);
+    uint64_t options = NORMALIZE_STRING_LOWERCASE | NORMALIZE_STRING_DECOMPOSE | NORMALIZE_STRING_STRIP_ACCENTS;
+
+    for (uint32_t i = 0; i < n; i++) {
+        char *normalized = normalize_string_utf8(cstring_array_get_string(inputs->strings, i), options);
+        if (normalized != NULL) {
+            microbench_sink += (uint64_t)normalized[0];
+            free(normalized);
+        }
+    }
+
+    return n;
+}
+
+static size_t microbench_averaged_perceptron_predict(microbench_inputs_t *inputs) {
+    averaged_perceptron_t *model = get_address_parser()->model;
+    size_t n = inputs->parser_features->n;
+
+    for (size_t i = 0; i < n; i++) {
+        microbench_sink += averaged_perceptron_predict_r(model, inputs->parser_features->a[i], inputs->parser_scores);
+    }
+
+    return n;
+}
+
+static size_t microbench_logistic_regression_model_expectation(microbench_inputs_t *inputs) {
+    matrix_t *weights = get_language_classifier()->weights;
+    size_t n = inputs->language_features->n;
+
+    for (size_t i = 0; i < n; i++) {
+        microbench_sink += logistic_regression_model_expectation(weights, inputs->language_features->a[i], inputs->language_probs);
+    }
+
+    return n;
+}
+
+static microbench_kernel_t microbench_kernels[] = {
+    {"trie_get", microbench_trie_get},
+    {"trie_search_tokens_with_phrases", microbench_trie_search_tokens},
+    {"tokenize", microbench_tokenize},
+    {"transliterate", microbench_transliterate},
+    {"normalize_string_utf8", microbench_normalize_string_utf8},
+    {"averaged_perceptron_predict", microbench_averaged_perceptron_predict},
+    {"logistic_regression_model_expectation", microbench_logistic_regression_model_expectation}
+};
+
+#define NUM_MICROBENCH_KERNELS (sizeof(microbench_kernels) / sizeof(microbench_kernels[0]))
+
+static int microbench_compare_double(const void *a, const void *b) {
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+static void microbench_run_kernel(microbench_kernel_t *kernel, microbench_inputs_t *inputs, size_t warmup, size_t repetitions, bool first) {
+    for (size_t i = 0; i < warmup; i++) {
+        kernel->func(inputs);
+    }
+
+    double *ns_per_op = malloc(sizeof(double) * repetitions);
+    double *cycles_per_op = malloc(sizeof(double) * repetitions);
+    size_t num_ops = 0;
+
+    for (size_t i = 0; i < repetitions; i++) {
+        double start = microbench_now();
+        uint64_t start_cycles = microbench_cycles();
+
+        num_ops = kernel->func(inputs);
+
+        uint64_t cycles = microbench_cycles() - start_cycles;
+        double elapsed = microbench_now() - start;
+
+        double ops = num_ops > 0 ? (double)num_ops : 1.0;
+        ns_per_op[i] = elapsed / ops;
+        cycles_per_op[i] = (double)cycles / ops;
+    }
+
+    qsort(ns_per_op, repetitions, sizeof(double), microbench_compare_double);
+    qsort(cycles_per_op, repetitions, sizeof(double), microbench_compare_double);
+
+    printf("%s\n    {\"kernel\": \"%s\", \"ops\": %zu, \"repetitions\": %zu, "
+           "\"ns_per_op\": {\"min\": %.3f, \"median\": %.3f}, "
+           "\"cycles_per_op\": {\"min\": %.1f, \"median\": %.1f}}",
+           first ? "" : ",", kernel->name, num_ops, repetitions,
+           ns_per_op[0], ns_per_op[repetitions / 2],
+           cycles_per_op[0], cycles_per_op[repetitions / 2]);
+    fflush(stdout);
+
+    free(ns_per_op);
+    free(cycles_per_op);
+}
+
+int main(int argc, char **argv) {
+    char *input_file = NULL;
+    char *kernels = NULL;
+    char *language = "en";
+    size_t num_samples = MICROBENCH_DEFAULT_SAMPLES;
+    size_t warmup = 2;
+    size_t repetitions = 10;
+
+    for (int i = 1; i < argc; i++) {
+        char *arg = argv[i];
+        if (string_equals(arg, "-h") || string_equals(arg, "--help")) {
+            printf(MICROBENCH_USAGE);
+            exit(EXIT_SUCCESS);
+        } else if (string_equals(arg, "--input") && i < argc - 1) {
+            input_file = argv[++i];
+        } else if (string_equals(arg, "--samples") && i < argc - 1) {
+            num_samples = (size_t)strtoul(argv[++i], NULL, 10);
+        } else if (string_equals(arg, "--kernels") && i < argc - 1) {
+            kernels = argv[++i];
+        } else if (string_equals(arg, "--warmup") && i < argc - 1) {
+            warmup = (size_t)strtoul(argv[++i], NULL, 10);
+        } else if (string_equals(arg, "--repetitions") && i < argc - 1) {
+            repetitions = (size_t)strtoul(argv[++i], NULL, 10);
+        } else if (string_equals(arg, "--language") && i < argc - 1) {
+            language = argv[++i];
+        } else {
+            log_error(MICROBENCH_USAGE);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (num_samples == 0 || repetitions == 0) {
+        log_error(MICROBENCH_USAGE);
+        exit(EXIT_FAILURE);
+    }
+
+    bool run_kernels[NUM_MICROBENCH_KERNELS];
+    for (size_t i = 0; i < NUM_MICROBENCH_KERNELS; i++) {
+        run_kernels[i] = kernels == NULL;
+    }
+
+    if (kernels != NULL) {
+        cstring_array *names = cstring_array_split(kernels, ",", 1, NULL);
+        for (uint32_t i = 0; names != NULL && i < cstring_array_num_strings(names); i++) {
+            char *name = cstring_array_get_string(names, i);
+            bool found = false;
+            for (size_t j = 0; j < NUM_MICROBENCH_KERNELS; j++) {
+                if (string_equals(name, microbench_kernels[j].name)) {
+                    run_kernels[j] = true;
+                    found = true;
+                }
+            }
+            if (!found) {
+                log_error("Unknown kernel: %s\n", name);
+                exit(EXIT_FAILURE);
+            }
+        }
+        if (names != NULL) {
+            cstring_array_destroy(names);
+        }
+    }
+
+    cstring_array *strings = input_file != NULL ? microbench_corpus_inputs(input_file, num_samples) : microbench_synthetic_inputs(num_samples);
+    if (strings == NULL || cstring_array_num_strings(strings) == 0) {
+        log_error("No inputs\n");
+        exit(EXIT_FAILURE);
+    }
+
+    if (!libpostal_setup() || !libpostal_setup_parser() || !libpostal_setup_language_classifier()) {
+        exit(EXIT_FAILURE);
+    }
+
+    microbench_inputs_t *inputs = microbench_inputs_new(strings, language);
+    if (inputs == NULL) {
+        log_error("Could not prepare inputs\n");
+        exit(EXIT_FAILURE);
+    }
+
+    char *source = json_encode_string(input_file != NULL ? input_file : "synthetic");
+    printf("{\"source\": %s, \"inputs\": %zu, \"cycle_counter\": \"%s\", \"kernels\": [",
+           source, (size_t)cstring_array_num_strings(inputs->strings), MICROBENCH_CYCLE_COUNTER);
+    free(source);
+
+    bool first = true;
+    for (size_t i = 0; i < NUM_MICROBENCH_KERNELS; i++) {
+        if (!run_kernels[i]) continue;
+        microbench_run_kernel(&microbench_kernels[i], inputs, warmup, repetitions, first);
+        first = false;
+    }
+
+    printf("\n]}\n");
+
+    microbench_inputs_destroy(inputs);
+
+    libpostal_teardown_language_classifier();
+    libpostal_teardown_parser();
+    libpostal_teardown();
+
+    return EXIT_SUCCESS;
+}
@@ -193,6 +193,31 @@ sparse_matrix_t *feature_vector(trie_t *feature_ids, khash_t(str_double) *featur
     return matrix;   
 }
 
+// Same as feature_vector with the feature ids looked up in a feature index
+sparse_matrix_t *feature_vector_index(feature_index_t *feature_ids, khash_t(str_double) *feature_counts) {
+    const char *feature;
+    uint32_t feature_id;
+    double count;
+
+    size_t m = 1;
+    // Add one feature for bias unit
+    size_t n = (size_t)feature_ids->num_keys + 1;
+
+    sparse_matrix_t *matrix = sparse_matrix_new_shape(m, n);
+
+    sparse_matrix_append(matrix, BIAS_FEATURE_ID, 1.0);
+    kh_foreach(feature_counts, feature, count, {
+        if (!feature_index_get(feature_ids, (char *)feature, &feature_id)) {
+            continue;
+        }
+        sparse_matrix_append(matrix, feature_id, count);
+    })
+
+    sparse_matrix_finalize_row(matrix);
+
+    return matrix;
+}
+
 uint32_array *label_vector(khash_t(str_uint32) *label_ids, cstring_array *labels) {
     uint32_t i;
     char *label;
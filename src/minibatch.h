@@ -5,6 +5,7 @@
 #include <stdlib.h>
 
 #include "collections.h"
+#include "feature_index.h"
 #include "features.h"
 #include "sparse_matrix.h"
 #include "trie.h"
@@ -20,6 +21,7 @@ khash_t(str_uint32) *select_labels_threshold(khash_t(str_uint32) *label_counts,
 
 sparse_matrix_t *feature_matrix(trie_t *feature_ids, feature_count_array *feature_counts);
 sparse_matrix_t *feature_vector(trie_t *feature_ids, khash_t(str_double) *feature_counts);
+sparse_matrix_t *feature_vector_index(feature_index_t *feature_ids, khash_t(str_double) *feature_counts);
 uint32_array *label_vector(khash_t(str_uint32) *label_ids, cstring_array *labels);
 
 
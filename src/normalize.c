@@ -1,4 +1,5 @@
 #include "normalize.h"
+#include "stats.h"
 
 #define FULL_STOP_CODEPOINT 0x002e
 #define APOSTROPHE_CODEPOINT 0x0027
@@ -109,6 +110,8 @@ void add_latin_alternatives(string_tree_t *tree, char *str, size_t len, uint64_t
 }
 
 string_tree_t *normalize_string_languages(char *str, uint64_t options, size_t num_languages, char **languages) {
+    STATS_TIME_SCOPE(LIBPOSTAL_STAGE_NORMALIZE);
+
     size_t len = strlen(str);
     string_tree_t *tree = string_tree_new_size(len);
 
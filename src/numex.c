@@ -1,7 +1,9 @@
 #include <math.h>
 #include <float.h>
 #include "numex.h"
+#include "data_bundle.h"
 #include "file_utils.h"
+#include "stats.h"
 
 #define NUMEX_TABLE_SIGNATURE 0xBBBBBBBB
 
@@ -484,7 +486,7 @@ exit_numex_table_load_error:
 
 bool numex_table_load(char *filename) {
     FILE *f;
-    if ((f = fopen(filename, "rb")) == NULL) {
+    if ((f = data_bundle_fopen(filename)) == NULL) {
         return NULL;
     }
     bool ret = numex_table_read(f);
@@ -987,6 +989,8 @@ char *get_ordinal_suffix(char *numeric_string, char *lang, numex_result_t result
 }
 
 char *replace_numeric_expressions(char *str, char *lang) {
+    STATS_TIME_SCOPE(LIBPOSTAL_STAGE_NUMEX);
+
     numex_result_array *results = convert_numeric_expressions(str, lang);
     if (results == NULL) return NULL;
 
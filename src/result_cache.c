@@ -0,0 +1,246 @@
+#include "result_cache.h"
+
+#include <string.h>
+
+#include "log/log.h"
+#include "murmur/murmur.h"
+
+#define RESULT_CACHE_INITIAL_BUCKETS 64
+#define RESULT_CACHE_HASH_SEED 0
+
+static inline uint64_t result_cache_hash(char *key, size_t key_len) {
+    uint64_t out[2];
+    MurmurHash3_x64_128(key, (int)key_len, RESULT_CACHE_HASH_SEED, out);
+    return out[0];
+}
+
+static inline size_t result_cache_entry_size(result_cache_entry_t *entry) {
+    return sizeof(result_cache_entry_t) + entry->key_len + entry->value_len;
+}
+
+static inline result_cache_shard_t *result_cache_get_shard(result_cache_t *self, uint64_t hash) {
+    // High bits pick the shard, low bits the bucket within it
+    return self->shards + ((hash >> 48) % self->num_shards);
+}
+
+static inline void result_cache_lru_remove(result_cache_entry_t *entry) {
+    entry->prev->next = entry->next;
+    entry->next->prev = entry->prev;
+}
+
+static inline void result_cache_lru_push_front(result_cache_shard_t *shard, result_cache_entry_t *entry) {
+    entry->next = shard->head.next;
+    entry->prev = &shard->head;
+    shard->head.next->prev = entry;
+    shard->head.next = entry;
+}
+
+static result_cache_entry_t **result_cache_find(result_cache_shard_t *shard, uint64_t hash, char *key, size_t key_len) {
+    result_cache_entry_t **ptr = shard->buckets + (hash & (shard->num_buckets - 1));
+    for (; *ptr != NULL; ptr = &(*ptr)->hash_next) {
+        result_cache_entry_t *entry = *ptr;
+        if (entry->hash == hash && entry->key_len == key_len && memcmp(entry->data, key, key_len) == 0) {
+            break;
+        }
+    }
+    return ptr;
+}
+
+static void result_cache_shard_remove(result_cache_shard_t *shard, result_cache_entry_t **ptr) {
+    result_cache_entry_t *entry = *ptr;
+    *ptr = entry->hash_next;
+    result_cache_lru_remove(entry);
+    shard->num_entries--;
+    shard->memory_used -= result_cache_entry_size(entry);
+    free(entry);
+}
+
+static void result_cache_shard_grow(result_cache_shard_t *shard) {
+    size_t num_buckets = shard->num_buckets * 2;
+    result_cache_entry_t **buckets = calloc(num_buckets, sizeof(result_cache_entry_t *));
+    // Not fatal, chains just get longer
+    if (buckets == NULL) return;
+
+    for (size_t i = 0; i < shard->num_buckets; i++) {
+        result_cache_entry_t *entry = shard->buckets[i];
+        while (entry != NULL) {
+            result_cache_entry_t *next = entry->hash_next;
+            size_t bucket = entry->hash & (num_buckets - 1);
+            entry->hash_next = buckets[bucket];
+            buckets[bucket] = entry;
+            entry = next;
+        }
+    }
+
+    free(shard->buckets);
+    shard->buckets = buckets;
+    shard->num_buckets = num_buckets;
+}
+
+static void result_cache_shard_clear(result_cache_shard_t *shard) {
+    result_cache_entry_t *entry = shard->head.next;
+    while (entry != &shard->head) {
+        result_cache_entry_t *next = entry->next;
+        free(entry);
+        entry = next;
+    }
+
+    shard->head.next = shard->head.prev = &shard->head;
+    memset(shard->buckets, 0, shard->num_buckets * sizeof(result_cache_entry_t *));
+    shard->num_entries = 0;
+    shard->memory_used = 0;
+}
+
+result_cache_t *result_cache_new(size_t num_shards, size_t max_memory) {
+    if (num_shards == 0) {
+        num_shards = RESULT_CACHE_DEFAULT_NUM_SHARDS;
+    }
+
+    result_cache_t *cache = malloc(sizeof(result_cache_t));
+    if (cache == NULL) return NULL;
+
+    cache->num_shards = 0;
+    cache->shards = calloc(num_shards, sizeof(result_cache_shard_t));
+    if (cache->shards == NULL) {
+        goto exit_cache_created;
+    }
+
+    for (size_t i = 0; i < num_shards; i++) {
+        result_cache_shard_t *shard = cache->shards + i;
+
+        shard->buckets = calloc(RESULT_CACHE_INITIAL_BUCKETS, sizeof(result_cache_entry_t *));
+        if (shard->buckets == NULL) {
+            goto exit_cache_created;
+        }
+        shard->num_buckets = RESULT_CACHE_INITIAL_BUCKETS;
+        shard->head.next = shard->head.prev = &shard->head;
+        shard->memory_limit = max_memory / num_shards;
+        pthread_mutex_init(&shard->lock, NULL);
+
+        cache->num_shards++;
+    }
+
+    return cache;
+
+exit_cache_created:
+    result_cache_destroy(cache);
+    return NULL;
+}
+
+bool result_cache_get(result_cache_t *self, char *key, size_t key_len, char_array *value) {
+    uint64_t hash = result_cache_hash(key, key_len);
+    result_cache_shard_t *shard = result_cache_get_shard(self, hash);
+
+    bool hit = false;
+
+    pthread_mutex_lock(&shard->lock);
+
+    result_cache_entry_t *entry = *result_cache_find(shard, hash, key, key_len);
+    if (entry != NULL) {
+        result_cache_lru_remove(entry);
+        result_cache_lru_push_front(shard, entry);
+
+        char_array_clear(value);
+        char_array_append_len(value, entry->data + entry->key_len, entry->value_len);
+        shard->hits++;
+        hit = true;
+    } else {
+        shard->misses++;
+    }
+
+    pthread_mutex_unlock(&shard->lock);
+
+    return hit;
+}
+
+void result_cache_put(result_cache_t *self, char *key, size_t key_len, char *value, size_t value_len) {
+    uint64_t hash = result_cache_hash(key, key_len);
+    result_cache_shard_t *shard = result_cache_get_shard(self, hash);
+
+    size_t entry_size = sizeof(result_cache_entry_t) + key_len + value_len;
+    if (entry_size > shard->memory_limit) return;
+
+    result_cache_entry_t *entry = malloc(entry_size);
+    if (entry == NULL) return;
+
+    entry->hash = hash;
+    entry->key_len = key_len;
+    entry->value_len = value_len;
+    memcpy(entry->data, key, key_len);
+    memcpy(entry->data + key_len, value, value_len);
+
+    pthread_mutex_lock(&shard->lock);
+
+    // Another thread may have computed the same result concurrently, keep the newest
+    result_cache_entry_t **ptr = result_cache_find(shard, hash, key, key_len);
+    if (*ptr != NULL) {
+        result_cache_shard_remove(shard, ptr);
+    }
+
+    while (shard->memory_used + entry_size > shard->memory_limit && shard->head.prev != &shard->head) {
+        result_cache_entry_t *lru = shard->head.prev;
+        result_cache_shard_remove(shard, result_cache_find(shard, lru->hash, lru->data, lru->key_len));
+        shard->evictions++;
+    }
+
+    if (shard->num_entries >= shard->num_buckets) {
+        result_cache_shard_grow(shard);
+    }
+
+    size_t bucket = hash & (shard->num_buckets - 1);
+    entry->hash_next = shard->buckets[bucket];
+    shard->buckets[bucket] = entry;
+    result_cache_lru_push_front(shard, entry);
+    shard->num_entries++;
+    shard->memory_used += entry_size;
+
+    pthread_mutex_unlock(&shard->lock);
+}
+
+void result_cache_clear(result_cache_t *self) {
+    if (self == NULL) return;
+
+    for (size_t i = 0; i < self->num_shards; i++) {
+        result_cache_shard_t *shard = self->shards + i;
+        pthread_mutex_lock(&shard->lock);
+        result_cache_shard_clear(shard);
+        pthread_mutex_unlock(&shard->lock);
+    }
+}
+
+result_cache_stats_t result_cache_get_stats(result_cache_t *self) {
+    result_cache_stats_t stats;
+    memset(&stats, 0, sizeof(stats));
+
+    if (self == NULL) return stats;
+
+    for (size_t i = 0; i < self->num_shards; i++) {
+        result_cache_shard_t *shard = self->shards + i;
+        pthread_mutex_lock(&shard->lock);
+        stats.hits += shard->hits;
+        stats.misses += shard->misses;
+        stats.evictions += shard->evictions;
+        stats.num_entries += shard->num_entries;
+        stats.memory_used += shard->memory_used;
+        stats.memory_limit += shard->memory_limit;
+        pthread_mutex_unlock(&shard->lock);
+    }
+
+    return stats;
+}
+
+void result_cache_destroy(result_cache_t *self) {
+    if (self == NULL) return;
+
+    if (self->shards != NULL) {
+        for (size_t i = 0; i < self->num_shards; i++) {
+            result_cache_shard_t *shard = self->shards + i;
+            result_cache_shard_clear(shard);
+            free(shard->buckets);
+            pthread_mutex_destroy(&shard->lock);
+        }
+        free(self->shards);
+    }
+
+    free(self);
+}
@@ -0,0 +1,85 @@
+/*
+result_cache.h
+--------------
+
+In-process LRU cache mapping byte-string keys to byte-string values, used
+to memoize expand_address and parse_address results (see libpostal.c for
+how results and options are serialized).
+
+The cache is split into shards by key hash, each with its own lock, hash
+table, LRU list and memory budget (max_memory / num_shards), so threads
+mostly contend only when they hit the same shard. Memory accounting covers
+entries (header + key + value), not the shard hash tables themselves.
+Once a shard is over budget, least recently used entries are evicted.
+
+Values are copied out under the shard lock, so entries can be evicted at
+any time without affecting callers.
+*/
+
+#ifndef RESULT_CACHE_H
+#define RESULT_CACHE_H
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+#include "collections.h"
+#include "string_utils.h"
+
+#define RESULT_CACHE_DEFAULT_NUM_SHARDS 16
+
+typedef struct result_cache_entry {
+    struct result_cache_entry *prev;
+    struct result_cache_entry *next;
+    struct result_cache_entry *hash_next;
+    uint64_t hash;
+    size_t key_len;
+    size_t value_len;
+    // key followed by value
+    char data[];
+} result_cache_entry_t;
+
+typedef struct result_cache_shard {
+    pthread_mutex_t lock;
+    result_cache_entry_t **buckets;
+    size_t num_buckets;
+    size_t num_entries;
+    // Sentinel of the LRU list, head.next is the most recently used
+    result_cache_entry_t head;
+    size_t memory_used;
+    size_t memory_limit;
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+} result_cache_shard_t;
+
+typedef struct result_cache {
+    size_t num_shards;
+    result_cache_shard_t *shards;
+} result_cache_t;
+
+typedef struct result_cache_stats {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+    size_t num_entries;
+    size_t memory_used;
+    size_t memory_limit;
+} result_cache_stats_t;
+
+// num_shards == 0 means RESULT_CACHE_DEFAULT_NUM_SHARDS
+result_cache_t *result_cache_new(size_t num_shards, size_t max_memory);
+
+// On a hit, copies the value into value (cleared first) and returns true
+bool result_cache_get(result_cache_t *self, char *key, size_t key_len, char_array *value);
+void result_cache_put(result_cache_t *self, char *key, size_t key_len, char *value, size_t value_len);
+
+// Removes all entries, counters are kept
+void result_cache_clear(result_cache_t *self);
+
+result_cache_stats_t result_cache_get_stats(result_cache_t *self);
+
+void result_cache_destroy(result_cache_t *self);
+
+#endif
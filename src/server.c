@@ -0,0 +1,473 @@
+/*
+libpostal_server
+----------------
+
+Loads the libpostal models once and serves expand/parse/classify requests
+to other processes over a Unix domain socket (default) or localhost TCP,
+see server_protocol.h for the wire format.
+
+The main thread polls the listening socket and all idle connections. When
+a connection becomes readable it's handed to a fixed pool of worker
+threads, each of which owns a parser session. The worker reads and answers
+one request, then hands the connection back to the main thread through a
+pipe, so an idle client never ties up a worker. Connections have a send
+and receive timeout (SERVER_IO_TIMEOUT_SECONDS), so a client that stalls
+in the middle of a frame holds a worker for at most that long before its
+connection is closed.
+*/
+
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "libpostal.h"
+#include "collections.h"
+#include "json_encode.h"
+#include "language_classifier.h"
+#include "log/log.h"
+#include "server_protocol.h"
+#include "string_utils.h"
+#include "thread_pool.h"
+
+#define SERVER_USAGE "Usage: ./libpostal_server [--socket path | --port n] [--threads n]\n"
+
+#define SERVER_LISTEN_BACKLOG 128
+
+static volatile sig_atomic_t server_shutdown = 0;
+
+/*
+Queue of connections with a pending request
+*/
+
+typedef struct server_queue {
+    int32_array *fds;
+    size_t head;
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+} server_queue_t;
+
+typedef struct server {
+    int listen_fd;
+    // Workers write connections back here when they're done with a request
+    int done_pipe[2];
+    server_queue_t queue;
+    size_t num_workers;
+    pthread_t *workers;
+} server_t;
+
+static void server_queue_push(server_queue_t *queue, int fd) {
+    pthread_mutex_lock(&queue->lock);
+    int32_array_push(queue->fds, fd);
+    pthread_cond_signal(&queue->not_empty);
+    pthread_mutex_unlock(&queue->lock);
+}
+
+static int server_queue_pop(server_queue_t *queue) {
+    pthread_mutex_lock(&queue->lock);
+    while (queue->head == queue->fds->n) {
+        pthread_cond_wait(&queue->not_empty, &queue->lock);
+    }
+
+    int fd = queue->fds->a[queue->head++];
+    if (queue->head == queue->fds->n) {
+        int32_array_clear(queue->fds);
+        queue->head = 0;
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return fd;
+}
+
+/*
+Request handling
+*/
+
+static server_status_t server_json_error(char_array *response, char *message) {
+    char_array_clear(response);
+    char *json_string = json_encode_string(message);
+    char_array_cat_printf(response, "{\"error\": %s}", json_string);
+    free(json_string);
+    return SERVER_STATUS_ERROR;
+}
+
+static bool server_expand(server_request_t request, char_array *response) {
+    normalize_options_t options = get_libpostal_default_options();
+
+    size_t num_languages = 0;
+    cstring_array *languages = NULL;
+    char **language_strings = NULL;
+
+    if (request.language != NULL) {
+        languages = cstring_array_split(request.language, ",", 1, &num_languages);
+        if (languages == NULL) return false;
+        language_strings = malloc(sizeof(char *) * num_languages);
+        for (size_t i = 0; i < num_languages; i++) {
+            language_strings[i] = cstring_array_get_string(languages, i);
+        }
+        options.languages = language_strings;
+        options.num_languages = num_languages;
+    }
+
+    size_t num_expansions;
+    char **expansions = expand_address(request.address, options, &num_expansions);
+
+    if (languages != NULL) {
+        free(language_strings);
+        cstring_array_destroy(languages);
+    }
+
+    if (expansions == NULL) return false;
+
+    char_array_cat(response, "{\"expansions\": [");
+    for (size_t i = 0; i < num_expansions; i++) {
+        char *json_string = json_encode_string(expansions[i]);
+        char_array_cat_printf(response, "%s%s", json_string, i < num_expansions - 1 ? ", " : "");
+        free(json_string);
+        free(expansions[i]);
+    }
+    char_array_cat(response, "]}");
+    free(expansions);
+
+    return true;
+}
+
+static bool server_parse(libpostal_parser_session_t *session, server_request_t request, char_array *response) {
+    address_parser_options_t options = get_libpostal_address_parser_default_options();
+    options.language = request.language;
+    options.country = request.country;
+
+    address_parser_response_t *parsed = parse_address_r(session, request.address, options);
+    if (parsed == NULL) return false;
+
+    char_array_cat(response, "{\"components\": {");
+    for (size_t i = 0; i < parsed->num_components; i++) {
+        char *json_string = json_encode_string(parsed->components[i]);
+        char_array_cat_printf(response, "\"%s\": %s%s", parsed->labels[i], json_string, i < parsed->num_components - 1 ? ", " : "");
+        free(json_string);
+    }
+    char_array_cat(response, "}}");
+
+    address_parser_response_destroy(parsed);
+    return true;
+}
+
+static bool server_classify(server_request_t request, char_array *response) {
+    language_classifier_response_t *classified = classify_languages(request.address);
+
+    char_array_cat(response, "{\"languages\": [");
+    if (classified != NULL) {
+        for (size_t i = 0; i < classified->num_languages; i++) {
+            char_array_cat_printf(response, "{\"language\": \"%s\", \"probability\": %f}%s", classified->languages[i], classified->probs[i], i < classified->num_languages - 1 ? ", " : "");
+        }
+        language_classifier_response_destroy(classified);
+    }
+    char_array_cat(response, "]}");
+
+    return true;
+}
+
+// Writes the JSON body of the response to response and returns its status
+static server_status_t server_handle_request(libpostal_parser_session_t *session, char_array *payload, char_array *response) {
+    server_request_t request;
+
+    if (!server_request_decode(payload, &request)) {
+        return server_json_error(response, "Malformed request");
+    }
+
+    char_array_clear(response);
+
+    bool ret;
+
+    switch (request.op) {
+        case SERVER_OP_EXPAND:
+            ret = server_expand(request, response);
+            break;
+        case SERVER_OP_PARSE:
+            ret = server_parse(session, request, response);
+            break;
+        case SERVER_OP_CLASSIFY:
+            ret = server_classify(request, response);
+            break;
+        default:
+            return server_json_error(response, "Unknown op");
+    }
+
+    if (!ret) {
+        return server_json_error(response, "Error processing request");
+    }
+
+    return SERVER_STATUS_OK;
+}
+
+static void *server_worker_main(void *arg) {
+    server_t *server = (server_t *)arg;
+
+    libpostal_parser_session_t *session = libpostal_parser_session_new();
+    char_array *payload = char_array_new_size(1024);
+    char_array *response = char_array_new_size(1024);
+
+    if (session == NULL || payload == NULL || response == NULL) {
+        log_error("Could not allocate worker state\n");
+        exit(EXIT_FAILURE);
+    }
+
+    int fd;
+    while ((fd = server_queue_pop(&server->queue)) >= 0) {
+        if (!server_read_frame(fd, payload)) {
+            close(fd);
+            continue;
+        }
+
+        server_status_t status = server_handle_request(session, payload, response);
+
+        if (!server_write_response(fd, status, response->a, char_array_len(response)) ||
+            !server_write_full(server->done_pipe[1], &fd, sizeof(fd))) {
+            close(fd);
+        }
+    }
+
+    libpostal_parser_session_destroy(session);
+    char_array_destroy(payload);
+    char_array_destroy(response);
+
+    return NULL;
+}
+
+/*
+Setup and main loop
+*/
+
+static int server_listen(char *socket_path, int port) {
+    int fd;
+
+    if (port > 0) {
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (fd < 0) return -1;
+
+        int reuse = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons((uint16_t)port);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+        if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+            close(fd);
+            return -1;
+        }
+    } else {
+        if (strlen(socket_path) >= sizeof(((struct sockaddr_un *)0)->sun_path)) return -1;
+
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0) return -1;
+
+        struct sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        strcpy(addr.sun_path, socket_path);
+
+        unlink(socket_path);
+        if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+            close(fd);
+            return -1;
+        }
+    }
+
+    if (listen(fd, SERVER_LISTEN_BACKLOG) < 0) {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+static void server_handle_signal(int sig) {
+    server_shutdown = 1;
+}
+
+static void server_loop(server_t *server) {
+    // Connections waiting for their next request
+    int32_array *idle = int32_array_new();
+    struct pollfd *pollfds = NULL;
+    size_t pollfds_size = 0;
+
+    while (!server_shutdown) {
+        size_t num_pollfds = idle->n + 2;
+        if (num_pollfds > pollfds_size) {
+            pollfds_size = num_pollfds * 2;
+            pollfds = realloc(pollfds, sizeof(struct pollfd) * pollfds_size);
+        }
+
+        pollfds[0] = (struct pollfd){server->listen_fd, POLLIN, 0};
+        pollfds[1] = (struct pollfd){server->done_pipe[0], POLLIN, 0};
+        for (size_t i = 0; i < idle->n; i++) {
+            pollfds[i + 2] = (struct pollfd){idle->a[i], POLLIN, 0};
+        }
+
+        if (poll(pollfds, num_pollfds, -1) < 0) {
+            if (errno == EINTR) continue;
+            log_error("poll failed: %s\n", strerror(errno));
+            break;
+        }
+
+        // Readable connections (or hung up, which the worker notices) go to the workers
+        size_t num_idle = 0;
+        for (size_t i = 0; i < idle->n; i++) {
+            if (pollfds[i + 2].revents != 0) {
+                server_queue_push(&server->queue, idle->a[i]);
+            } else {
+                idle->a[num_idle++] = idle->a[i];
+            }
+        }
+        idle->n = num_idle;
+
+        if (pollfds[1].revents & POLLIN) {
+            // Each write is a single fd and pipe writes that small are atomic
+            int fds[64];
+            ssize_t n = read(server->done_pipe[0], fds, sizeof(fds));
+            for (ssize_t i = 0; i < n / (ssize_t)sizeof(int); i++) {
+                int32_array_push(idle, fds[i]);
+            }
+        }
+
+        if (pollfds[0].revents & POLLIN) {
+            int fd = accept(server->listen_fd, NULL, NULL);
+            if (fd >= 0 && !server_set_timeout(fd, SERVER_IO_TIMEOUT_SECONDS)) {
+                log_error("Could not set timeout on connection: %s\n", strerror(errno));
+                close(fd);
+            } else if (fd >= 0) {
+                int32_array_push(idle, fd);
+            }
+        }
+    }
+
+    for (size_t i = 0; i < idle->n; i++) {
+        close(idle->a[i]);
+    }
+
+    int32_array_destroy(idle);
+    free(pollfds);
+}
+
+int main(int argc, char **argv) {
+    char *socket_path = SERVER_DEFAULT_SOCKET_PATH;
+    int port = 0;
+    size_t num_threads = 0;
+
+    for (int i = 1; i < argc; i++) {
+        char *arg = argv[i];
+        if (string_equals(arg, "-h") || string_equals(arg, "--help")) {
+            printf(SERVER_USAGE);
+            exit(EXIT_SUCCESS);
+        } else if (string_equals(arg, "--socket") && i < argc - 1) {
+            socket_path = argv[++i];
+        } else if (string_equals(arg, "--port") && i < argc - 1) {
+            port = atoi(argv[++i]);
+        } else if (string_equals(arg, "--threads") && i < argc - 1) {
+            num_threads = (size_t)strtoul(argv[++i], NULL, 10);
+        } else {
+            log_error(SERVER_USAGE);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (num_threads == 0) {
+        num_threads = thread_pool_default_num_threads();
+    }
+
+    if (!libpostal_setup() || !libpostal_setup_language_classifier() || !libpostal_setup_parser()) {
+        exit(EXIT_FAILURE);
+    }
+
+    server_t server;
+    memset(&server, 0, sizeof(server));
+
+    server.listen_fd = server_listen(socket_path, port);
+    if (server.listen_fd < 0) {
+        log_error("Could not listen on %s: %s\n", port > 0 ? "localhost" : socket_path, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+
+    if (pipe(server.done_pipe) < 0) {
+        log_error("Could not create pipe\n");
+        exit(EXIT_FAILURE);
+    }
+
+    server.queue.fds = int32_array_new();
+    pthread_mutex_init(&server.queue.lock, NULL);
+    pthread_cond_init(&server.queue.not_empty, NULL);
+
+    signal(SIGPIPE, SIG_IGN);
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = server_handle_signal;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    // Workers inherit a mask blocking the shutdown signals so poll in the main thread sees them
+    sigset_t signals, old_signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, &old_signals);
+
+    server.num_workers = num_threads;
+    server.workers = malloc(sizeof(pthread_t) * num_threads);
+    for (size_t i = 0; i < num_threads; i++) {
+        if (pthread_create(&server.workers[i], NULL, server_worker_main, &server) != 0) {
+            log_error("Could not create worker thread %zu\n", i);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    pthread_sigmask(SIG_SETMASK, &old_signals, NULL);
+
+    if (port > 0) {
+        log_info("Listening on 127.0.0.1:%d with %zu workers\n", port, num_threads);
+    } else {
+        log_info("Listening on %s with %zu workers\n", socket_path, num_threads);
+    }
+
+    server_loop(&server);
+
+    log_info("Shutting down\n");
+
+    // A negative fd tells a worker to exit
+    for (size_t i = 0; i < server.num_workers; i++) {
+        server_queue_push(&server.queue, -1);
+    }
+
+    for (size_t i = 0; i < server.num_workers; i++) {
+        pthread_join(server.workers[i], NULL);
+    }
+    free(server.workers);
+
+    close(server.listen_fd);
+    close(server.done_pipe[0]);
+    close(server.done_pipe[1]);
+
+    if (port == 0) {
+        unlink(socket_path);
+    }
+
+    int32_array_destroy(server.queue.fds);
+    pthread_mutex_destroy(&server.queue.lock);
+    pthread_cond_destroy(&server.queue.not_empty);
+
+    libpostal_teardown();
+    libpostal_teardown_language_classifier();
+    libpostal_teardown_parser();
+
+    return EXIT_SUCCESS;
+}
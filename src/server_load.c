@@ -0,0 +1,228 @@
+/*
+libpostal_server_load
+---------------------
+
+Load generator for libpostal_server. Reads addresses (one per line) from a
+file, then each of --connections client threads opens its own connection
+and sends requests back to back, cycling through the addresses, until
+--requests requests have been sent in total. Reports throughput and latency
+percentiles.
+*/
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+#include "collections.h"
+#include "file_utils.h"
+#include "log/log.h"
+#include "server_protocol.h"
+#include "string_utils.h"
+
+#define SERVER_LOAD_USAGE "Usage: ./libpostal_server_load --input file [--op expand|parse|classify] [--socket path | --port n] [--connections n] [--requests n] [--language code] [--country code]\n"
+
+typedef struct server_load_config {
+    char *socket_path;
+    int port;
+    uint8_t op;
+    char *language;
+    char *country;
+    cstring_array *addresses;
+    size_t num_requests;
+    volatile size_t next_request;
+} server_load_config_t;
+
+typedef struct server_load_client {
+    server_load_config_t *config;
+    double_array *latencies;
+    size_t num_errors;
+    bool connected;
+} server_load_client_t;
+
+static inline double server_load_now(void) {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (double)tv.tv_sec + (double)tv.tv_usec / 1e6;
+}
+
+static void *server_load_client_main(void *arg) {
+    server_load_client_t *client = (server_load_client_t *)arg;
+    server_load_config_t *config = client->config;
+
+    int fd = server_connect(config->socket_path, config->port);
+    if (fd < 0) {
+        log_error("Could not connect to server: %s\n", strerror(errno));
+        return NULL;
+    }
+    client->connected = true;
+
+    char_array *request = char_array_new();
+    char_array *response = char_array_new();
+
+    size_t num_addresses = cstring_array_num_strings(config->addresses);
+
+    while (true) {
+        size_t i = __sync_fetch_and_add(&config->next_request, 1);
+        if (i >= config->num_requests) break;
+
+        char *address = cstring_array_get_string(config->addresses, (uint32_t)(i % num_addresses));
+        server_request_encode(request, config->op, address, config->language, config->country);
+
+        double start = server_load_now();
+
+        uint8_t status;
+        char *json;
+        if (!server_write_frame(fd, request->a, request->n) ||
+            !server_read_response(fd, response, &status, &json)) {
+            log_error("Connection closed by server\n");
+            client->num_errors++;
+            break;
+        }
+
+        double_array_push(client->latencies, server_load_now() - start);
+
+        if (status != SERVER_STATUS_OK) {
+            client->num_errors++;
+        }
+    }
+
+    close(fd);
+    char_array_destroy(request);
+    char_array_destroy(response);
+
+    return NULL;
+}
+
+static int server_load_compare_double(const void *a, const void *b) {
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+static inline double server_load_percentile(double *sorted, size_t n, double p) {
+    size_t i = (size_t)(p * (double)(n - 1) + 0.5);
+    return sorted[i];
+}
+
+int main(int argc, char **argv) {
+    server_load_config_t config;
+    memset(&config, 0, sizeof(config));
+    config.socket_path = SERVER_DEFAULT_SOCKET_PATH;
+    config.op = SERVER_OP_EXPAND;
+    config.num_requests = 10000;
+
+    size_t num_connections = 1;
+    char *input_file = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        char *arg = argv[i];
+        if (string_equals(arg, "-h") || string_equals(arg, "--help")) {
+            printf(SERVER_LOAD_USAGE);
+            exit(EXIT_SUCCESS);
+        } else if (string_equals(arg, "--input") && i < argc - 1) {
+            input_file = argv[++i];
+        } else if (string_equals(arg, "--op") && i < argc - 1) {
+            config.op = (uint8_t)server_op_from_string(argv[++i]);
+        } else if (string_equals(arg, "--socket") && i < argc - 1) {
+            config.socket_path = argv[++i];
+        } else if (string_equals(arg, "--port") && i < argc - 1) {
+            config.port = atoi(argv[++i]);
+        } else if (string_equals(arg, "--connections") && i < argc - 1) {
+            num_connections = (size_t)strtoul(argv[++i], NULL, 10);
+        } else if (string_equals(arg, "--requests") && i < argc - 1) {
+            config.num_requests = (size_t)strtoul(argv[++i], NULL, 10);
+        } else if (string_equals(arg, "--language") && i < argc - 1) {
+            config.language = argv[++i];
+        } else if (string_equals(arg, "--country") && i < argc - 1) {
+            config.country = argv[++i];
+        } else {
+            log_error(SERVER_LOAD_USAGE);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (input_file == NULL || config.op == 0 || num_connections == 0) {
+        log_error(SERVER_LOAD_USAGE);
+        exit(EXIT_FAILURE);
+    }
+
+    FILE *f = fopen(input_file, "r");
+    if (f == NULL) {
+        log_error("Could not open input file: %s\n", input_file);
+        exit(EXIT_FAILURE);
+    }
+
+    config.addresses = cstring_array_new();
+    char *line;
+    while ((line = file_getline(f)) != NULL) {
+        if (line[0] != '\0') {
+            cstring_array_add_string(config.addresses, line);
+        }
+        free(line);
+    }
+    fclose(f);
+
+    if (cstring_array_num_strings(config.addresses) == 0) {
+        log_error("No addresses in %s\n", input_file);
+        exit(EXIT_FAILURE);
+    }
+
+    pthread_t *threads = malloc(sizeof(pthread_t) * num_connections);
+    server_load_client_t *clients = calloc(num_connections, sizeof(server_load_client_t));
+
+    double start = server_load_now();
+
+    for (size_t i = 0; i < num_connections; i++) {
+        clients[i].config = &config;
+        clients[i].latencies = double_array_new();
+        if (pthread_create(&threads[i], NULL, server_load_client_main, &clients[i]) != 0) {
+            log_error("Could not create client thread %zu\n", i);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    for (size_t i = 0; i < num_connections; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    double elapsed = server_load_now() - start;
+
+    double_array *latencies = double_array_new();
+    size_t num_errors = 0;
+    size_t num_connected = 0;
+
+    for (size_t i = 0; i < num_connections; i++) {
+        double_array_extend(latencies, clients[i].latencies);
+        num_errors += clients[i].num_errors;
+        num_connected += clients[i].connected;
+        double_array_destroy(clients[i].latencies);
+    }
+
+    size_t n = latencies->n;
+
+    printf("connections: %zu (%zu connected)\n", num_connections, num_connected);
+    printf("requests: %zu, errors: %zu\n", n, num_errors);
+
+    if (n > 0) {
+        qsort(latencies->a, n, sizeof(double), server_load_compare_double);
+
+        printf("elapsed: %.3f s, throughput: %.1f requests/s\n", elapsed, (double)n / elapsed);
+        printf("latency (ms): p50=%.3f p90=%.3f p99=%.3f p99.9=%.3f max=%.3f\n",
+               server_load_percentile(latencies->a, n, 0.5) * 1000.0,
+               server_load_percentile(latencies->a, n, 0.9) * 1000.0,
+               server_load_percentile(latencies->a, n, 0.99) * 1000.0,
+               server_load_percentile(latencies->a, n, 0.999) * 1000.0,
+               latencies->a[n - 1] * 1000.0);
+    }
+
+    double_array_destroy(latencies);
+    cstring_array_destroy(config.addresses);
+    free(threads);
+    free(clients);
+
+    return num_errors == 0 && num_connected == num_connections ? EXIT_SUCCESS : EXIT_FAILURE;
+}
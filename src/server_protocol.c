@@ -0,0 +1,189 @@
+#include "server_protocol.h"
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+
+#include "file_utils.h"
+#include "log/log.h"
+
+bool server_read_full(int fd, void *buf, size_t len) {
+    char *ptr = buf;
+    while (len > 0) {
+        ssize_t n = read(fd, ptr, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        ptr += n;
+        len -= (size_t)n;
+    }
+    return true;
+}
+
+bool server_write_full(int fd, const void *buf, size_t len) {
+    const char *ptr = buf;
+    while (len > 0) {
+        ssize_t n = write(fd, ptr, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        ptr += n;
+        len -= (size_t)n;
+    }
+    return true;
+}
+
+bool server_set_timeout(int fd, int seconds) {
+    struct timeval timeout = {seconds, 0};
+    return setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) == 0 &&
+           setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout)) == 0;
+}
+
+bool server_read_frame(int fd, char_array *payload) {
+    unsigned char header[4];
+    if (!server_read_full(fd, header, sizeof(header))) {
+        return false;
+    }
+
+    uint32_t len = file_deserialize_uint32(header);
+    if (len > SERVER_MAX_FRAME_SIZE) {
+        log_error("Frame of %u bytes exceeds the maximum size\n", len);
+        return false;
+    }
+
+    char_array_clear(payload);
+    char_array_resize(payload, len + 1);
+
+    if (!server_read_full(fd, payload->a, len)) {
+        return false;
+    }
+    payload->n = len;
+    payload->a[len] = '\0';
+
+    return true;
+}
+
+bool server_write_frame(int fd, const char *payload, size_t len) {
+    unsigned char header[4];
+    header[0] = (len >> 24) & 0xff;
+    header[1] = (len >> 16) & 0xff;
+    header[2] = (len >> 8) & 0xff;
+    header[3] = len & 0xff;
+
+    return server_write_full(fd, header, sizeof(header)) && server_write_full(fd, payload, len);
+}
+
+bool server_write_response(int fd, uint8_t status, const char *json, size_t len) {
+    // The client would reject the frame, send an error it can read instead
+    if (len + 1 > SERVER_MAX_FRAME_SIZE) {
+        log_error("Response of %zu bytes exceeds the maximum frame size\n", len + 1);
+        status = SERVER_STATUS_ERROR;
+        json = "{\"error\": \"response too large\"}";
+        len = strlen(json);
+    }
+
+    unsigned char header[5];
+    size_t frame_len = len + 1;
+    header[0] = (frame_len >> 24) & 0xff;
+    header[1] = (frame_len >> 16) & 0xff;
+    header[2] = (frame_len >> 8) & 0xff;
+    header[3] = frame_len & 0xff;
+    header[4] = status;
+
+    return server_write_full(fd, header, sizeof(header)) && server_write_full(fd, json, len);
+}
+
+bool server_read_response(int fd, char_array *payload, uint8_t *status, char **json) {
+    if (!server_read_frame(fd, payload) || payload->n < 1) {
+        return false;
+    }
+
+    *status = (uint8_t)payload->a[0];
+    *json = payload->a + 1;
+    return true;
+}
+
+bool server_request_decode(char_array *payload, server_request_t *request) {
+    if (payload->n < 1) return false;
+
+    char *fields[3];
+    size_t num_fields = 0;
+
+    char *ptr = payload->a + 1;
+    char *end = payload->a + payload->n;
+
+    while (num_fields < 3 && ptr < end) {
+        char *field_end = memchr(ptr, '\0', end - ptr);
+        if (field_end == NULL) return false;
+        fields[num_fields++] = ptr;
+        ptr = field_end + 1;
+    }
+
+    if (num_fields == 0) return false;
+
+    request->op = (uint8_t)payload->a[0];
+    request->address = fields[0];
+    request->language = num_fields > 1 && fields[1][0] != '\0' ? fields[1] : NULL;
+    request->country = num_fields > 2 && fields[2][0] != '\0' ? fields[2] : NULL;
+
+    return true;
+}
+
+void server_request_encode(char_array *payload, uint8_t op, char *address, char *language, char *country) {
+    char_array_clear(payload);
+    char_array_push(payload, (char)op);
+    char_array_add(payload, address);
+    char_array_add(payload, language != NULL ? language : "");
+    char_array_add(payload, country != NULL ? country : "");
+}
+
+int server_connect(char *socket_path, int port) {
+    int fd;
+
+    if (port > 0) {
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (fd < 0) return -1;
+
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons((uint16_t)port);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+        if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+            close(fd);
+            return -1;
+        }
+    } else {
+        if (socket_path == NULL || strlen(socket_path) >= sizeof(((struct sockaddr_un *)0)->sun_path)) return -1;
+
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0) return -1;
+
+        struct sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        strcpy(addr.sun_path, socket_path);
+
+        if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+            close(fd);
+            return -1;
+        }
+    }
+
+    return fd;
+}
+
+server_op_t server_op_from_string(char *op) {
+    if (string_equals(op, "expand")) {
+        return SERVER_OP_EXPAND;
+    } else if (string_equals(op, "parse")) {
+        return SERVER_OP_PARSE;
+    } else if (string_equals(op, "classify")) {
+        return SERVER_OP_CLASSIFY;
+    }
+    return 0;
+}
@@ -0,0 +1,89 @@
+/*
+server_protocol.h
+-----------------
+
+Wire protocol for libpostal_server (server.c), used over a Unix domain
+socket or localhost TCP.
+
+Every message is a frame: a big-endian uint32 payload length followed by
+the payload. A connection carries any number of request/response pairs,
+one at a time.
+
+Request payload:
+
+    uint8 op                        // SERVER_OP_*
+    char address[]  '\0'
+    char language[] '\0'            // optional, may be empty. For expand,
+                                    // a comma-separated list of languages
+    char country[]  '\0'            // optional, may be empty
+
+Response payload:
+
+    uint8 status                    // SERVER_STATUS_*
+    char json[]                     // rest of the payload, not NUL-terminated
+
+    expand   => {"expansions": [...]}
+    parse    => {"components": {"label": "value", ...}}
+    classify => {"languages": [{"language": "en", "probability": 0.99}, ...]}
+    error    => {"error": "message"}
+*/
+
+#ifndef SERVER_PROTOCOL_H
+#define SERVER_PROTOCOL_H
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "collections.h"
+#include "string_utils.h"
+
+#define SERVER_DEFAULT_SOCKET_PATH "/tmp/libpostal.sock"
+#define SERVER_MAX_FRAME_SIZE (1 << 20)
+// How long the server waits on a client that stops sending or reading mid-frame
+#define SERVER_IO_TIMEOUT_SECONDS 5
+
+typedef enum {
+    SERVER_OP_EXPAND = 1,
+    SERVER_OP_PARSE = 2,
+    SERVER_OP_CLASSIFY = 3
+} server_op_t;
+
+typedef enum {
+    SERVER_STATUS_OK = 0,
+    SERVER_STATUS_ERROR = 1
+} server_status_t;
+
+typedef struct server_request {
+    uint8_t op;
+    char *address;
+    char *language;
+    char *country;
+} server_request_t;
+
+// Blocking I/O on a socket, retrying on EINTR and short reads/writes
+bool server_read_full(int fd, void *buf, size_t len);
+bool server_write_full(int fd, const void *buf, size_t len);
+
+// Sets SO_RCVTIMEO/SO_SNDTIMEO, after which the calls above fail instead of blocking
+bool server_set_timeout(int fd, int seconds);
+
+// Reads one frame into payload (cleared first). Returns false on EOF, error or oversized frames.
+bool server_read_frame(int fd, char_array *payload);
+bool server_write_frame(int fd, const char *payload, size_t len);
+
+// Responses that would exceed SERVER_MAX_FRAME_SIZE are replaced by an error response
+bool server_write_response(int fd, uint8_t status, const char *json, size_t len);
+// Status is returned in status, json is NUL-terminated
+bool server_read_response(int fd, char_array *payload, uint8_t *status, char **json);
+
+// Request fields point into payload, which must outlive the request
+bool server_request_decode(char_array *payload, server_request_t *request);
+void server_request_encode(char_array *payload, uint8_t op, char *address, char *language, char *country);
+
+// Connects to a Unix socket path, or to 127.0.0.1:port if port > 0. Returns the fd or -1.
+int server_connect(char *socket_path, int port);
+
+server_op_t server_op_from_string(char *op);
+
+#endif
@@ -0,0 +1,200 @@
+#include "stats.h"
+
+#include <string.h>
+#include <pthread.h>
+
+#include "log/log.h"
+
+static const char *libpostal_stage_names[LIBPOSTAL_NUM_STAGES] = {
+    "tokenize",
+    "normalize_string_languages",
+    "transliterate",
+    "search_address_dictionaries_tokens",
+    "replace_numeric_expressions",
+    "classify_languages",
+    "address_parser_context_fill",
+    "averaged_perceptron_tagger_predict"
+};
+
+static const char *libpostal_counter_names[LIBPOSTAL_NUM_COUNTERS] = {
+    "tokens",
+    "phrases",
+    "expansions",
+    "features",
+    "arena_allocations",
+    "arena_blocks"
+};
+
+const char *libpostal_stage_name(libpostal_stage_t stage) {
+    if (stage >= LIBPOSTAL_NUM_STAGES) return NULL;
+    return libpostal_stage_names[stage];
+}
+
+const char *libpostal_counter_name(libpostal_counter_t counter) {
+    if (counter >= LIBPOSTAL_NUM_COUNTERS) return NULL;
+    return libpostal_counter_names[counter];
+}
+
+#ifdef LIBPOSTAL_STATS
+
+typedef struct stats_thread {
+    uint64_t calls[LIBPOSTAL_NUM_STAGES];
+    uint64_t nanoseconds[LIBPOSTAL_NUM_STAGES];
+    uint64_t counters[LIBPOSTAL_NUM_COUNTERS];
+    struct stats_thread *prev;
+    struct stats_thread *next;
+} stats_thread_t;
+
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+// Totals of threads which have exited
+static stats_thread_t stats_retired;
+static stats_thread_t *stats_threads = NULL;
+
+static pthread_key_t stats_key;
+static pthread_once_t stats_key_once = PTHREAD_ONCE_INIT;
+
+/*
+Only the owning thread writes its counters, but other threads read (and
+reset) them, so use relaxed atomic loads and stores. On the owning thread
+these compile to plain loads and stores, no locked instructions.
+*/
+static inline void stats_counter_add(uint64_t *counter, uint64_t n) {
+    __atomic_store_n(counter, __atomic_load_n(counter, __ATOMIC_RELAXED) + n, __ATOMIC_RELAXED);
+}
+
+static inline uint64_t stats_counter_get(uint64_t *counter) {
+    return __atomic_load_n(counter, __ATOMIC_RELAXED);
+}
+
+static void stats_thread_accumulate(stats_thread_t *total, stats_thread_t *thread) {
+    for (size_t i = 0; i < LIBPOSTAL_NUM_STAGES; i++) {
+        total->calls[i] += stats_counter_get(&thread->calls[i]);
+        total->nanoseconds[i] += stats_counter_get(&thread->nanoseconds[i]);
+    }
+
+    for (size_t i = 0; i < LIBPOSTAL_NUM_COUNTERS; i++) {
+        total->counters[i] += stats_counter_get(&thread->counters[i]);
+    }
+}
+
+static void stats_thread_clear(stats_thread_t *thread) {
+    for (size_t i = 0; i < LIBPOSTAL_NUM_STAGES; i++) {
+        __atomic_store_n(&thread->calls[i], 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&thread->nanoseconds[i], 0, __ATOMIC_RELAXED);
+    }
+
+    for (size_t i = 0; i < LIBPOSTAL_NUM_COUNTERS; i++) {
+        __atomic_store_n(&thread->counters[i], 0, __ATOMIC_RELAXED);
+    }
+}
+
+static void stats_key_destructor(void *arg) {
+    stats_thread_t *thread = (stats_thread_t *)arg;
+
+    pthread_mutex_lock(&stats_lock);
+    stats_thread_accumulate(&stats_retired, thread);
+
+    if (thread->prev != NULL) {
+        thread->prev->next = thread->next;
+    } else {
+        stats_threads = thread->next;
+    }
+
+    if (thread->next != NULL) {
+        thread->next->prev = thread->prev;
+    }
+    pthread_mutex_unlock(&stats_lock);
+
+    free(thread);
+}
+
+static void stats_key_init(void) {
+    pthread_key_create(&stats_key, stats_key_destructor);
+}
+
+static stats_thread_t *get_thread_stats(void) {
+    pthread_once(&stats_key_once, stats_key_init);
+
+    stats_thread_t *thread = pthread_getspecific(stats_key);
+    if (thread != NULL) return thread;
+
+    thread = calloc(1, sizeof(stats_thread_t));
+    if (thread == NULL) {
+        log_error("Could not allocate thread stats\n");
+        return NULL;
+    }
+
+    pthread_mutex_lock(&stats_lock);
+    thread->next = stats_threads;
+    if (stats_threads != NULL) {
+        stats_threads->prev = thread;
+    }
+    stats_threads = thread;
+    pthread_mutex_unlock(&stats_lock);
+
+    pthread_setspecific(stats_key, thread);
+
+    return thread;
+}
+
+void stats_add_time(libpostal_stage_t stage, uint64_t nanoseconds) {
+    stats_thread_t *thread = get_thread_stats();
+    if (thread == NULL) return;
+
+    stats_counter_add(&thread->calls[stage], 1);
+    stats_counter_add(&thread->nanoseconds[stage], nanoseconds);
+}
+
+void stats_add_count(libpostal_counter_t counter, uint64_t n) {
+    stats_thread_t *thread = get_thread_stats();
+    if (thread == NULL) return;
+
+    stats_counter_add(&thread->counters[counter], n);
+}
+
+libpostal_stats_t libpostal_get_stats(void) {
+    libpostal_stats_t stats;
+    memset(&stats, 0, sizeof(stats));
+    stats.enabled = true;
+
+    stats_thread_t total;
+    memset(&total, 0, sizeof(total));
+
+    pthread_mutex_lock(&stats_lock);
+    stats_thread_accumulate(&total, &stats_retired);
+    for (stats_thread_t *thread = stats_threads; thread != NULL; thread = thread->next) {
+        stats_thread_accumulate(&total, thread);
+    }
+    pthread_mutex_unlock(&stats_lock);
+
+    for (size_t i = 0; i < LIBPOSTAL_NUM_STAGES; i++) {
+        stats.stages[i].calls = total.calls[i];
+        stats.stages[i].nanoseconds = total.nanoseconds[i];
+    }
+
+    memcpy(stats.counters, total.counters, sizeof(stats.counters));
+
+    return stats;
+}
+
+void libpostal_reset_stats(void) {
+    pthread_mutex_lock(&stats_lock);
+    stats_thread_clear(&stats_retired);
+    for (stats_thread_t *thread = stats_threads; thread != NULL; thread = thread->next) {
+        stats_thread_clear(thread);
+    }
+    pthread_mutex_unlock(&stats_lock);
+}
+
+#else
+
+libpostal_stats_t libpostal_get_stats(void) {
+    libpostal_stats_t stats;
+    memset(&stats, 0, sizeof(stats));
+    return stats;
+}
+
+void libpostal_reset_stats(void) {
+}
+
+#endif
@@ -0,0 +1,61 @@
+/*
+stats.h
+-------
+
+Opt-in per-stage instrumentation, read through libpostal_get_stats.
+
+Only compiled in when LIBPOSTAL_STATS is defined (./configure --enable-stats).
+Otherwise STATS_TIME_SCOPE and STATS_COUNT expand to nothing, their
+arguments aren't evaluated, and libpostal_get_stats returns zeros with
+enabled == false.
+
+STATS_TIME_SCOPE(stage) at the top of a function times everything up to
+the function's return, on every return path, and counts one call. Stages
+can nest (normalize_string_languages calls transliterate), in which case
+both are charged for the inner call.
+
+Counters are per-thread, so recording never takes a lock. A thread's
+counters are linked into a global list when first used and folded into a
+process-wide total when the thread exits.
+*/
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "libpostal.h"
+
+#ifdef LIBPOSTAL_STATS
+
+void stats_add_time(libpostal_stage_t stage, uint64_t nanoseconds);
+void stats_add_count(libpostal_counter_t counter, uint64_t n);
+
+static inline uint64_t stats_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+typedef struct stats_timer {
+    libpostal_stage_t stage;
+    uint64_t start;
+} stats_timer_t;
+
+static inline void stats_timer_stop(stats_timer_t *timer) {
+    stats_add_time(timer->stage, stats_now_ns() - timer->start);
+}
+
+#define STATS_TIME_SCOPE(stage) stats_timer_t __stats_timer __attribute__((cleanup(stats_timer_stop))) = {(stage), stats_now_ns()}
+#define STATS_COUNT(counter, n) stats_add_count((counter), (uint64_t)(n))
+
+#else
+
+#define STATS_TIME_SCOPE(stage)
+#define STATS_COUNT(counter, n)
+
+#endif
+
+#endif
@@ -482,6 +482,7 @@ char_array *char_array_from_string(char *str) {
 
 char_array *char_array_from_string_no_copy(char *str, size_t n) {
     char_array *array = malloc(sizeof(char_array));
+    array->arena = NULL;
     array->a = str;
     array->m = n;
     array->n = n;
@@ -694,6 +695,8 @@ cstring_array *cstring_array_new(void) {
 
 void cstring_array_destroy(cstring_array *self) {
     if (self == NULL) return;
+    // Arena-backed arrays are released by arena_reset
+    if (self->indices != NULL && self->indices->arena != NULL) return;
     if (self->indices) {
         uint32_array_destroy(self->indices);
     }
@@ -709,6 +712,19 @@ cstring_array *cstring_array_new_size(size_t size) {
     return array;
 }
 
+cstring_array *cstring_array_new_size_arena(arena_t *arena, size_t size) {
+    cstring_array *array = arena_alloc(arena, sizeof(cstring_array));
+    if (array == NULL) return NULL;
+
+    array->indices = uint32_array_new_size_arena(arena, DEFAULT_VECTOR_SIZE);
+    array->str = char_array_new_size_arena(arena, size > 0 ? size : DEFAULT_VECTOR_SIZE);
+    if (array->indices == NULL || array->str == NULL) {
+        return NULL;
+    }
+
+    return array;
+}
+
 cstring_array *cstring_array_from_char_array(char_array *str) {
     cstring_array *array = malloc(sizeof(cstring_array));
     if (array == NULL) return NULL;
@@ -906,6 +922,27 @@ string_tree_t *string_tree_new_size(size_t size) {
     return self;
 }
 
+string_tree_t *string_tree_new_size_arena(arena_t *arena, size_t size) {
+    string_tree_t *self = arena_alloc(arena, sizeof(string_tree_t));
+    if (self == NULL) {
+        return NULL;
+    }
+
+    self->token_indices = uint32_array_new_size_arena(arena, size > 0 ? size : DEFAULT_VECTOR_SIZE);
+    if (self->token_indices == NULL) {
+        return NULL;
+    }
+
+    uint32_array_push(self->token_indices, 0);
+
+    self->strings = cstring_array_new_size_arena(arena, size);
+    if (self->strings == NULL) {
+        return NULL;
+    }
+
+    return self;
+}
+
 #define DEFAULT_STRING_TREE_SIZE 8
 
 string_tree_t *string_tree_new(void) {
@@ -957,6 +994,8 @@ inline uint32_t string_tree_num_alternatives(string_tree_t *self, uint32_t i) {
 
 void string_tree_destroy(string_tree_t *self) {
     if (self == NULL) return;
+    // Arena-backed trees are released by arena_reset
+    if (self->token_indices != NULL && self->token_indices->arena != NULL) return;
 
     if (self->token_indices != NULL) {
         uint32_array_destroy(self->token_indices);
@@ -973,17 +1012,17 @@ void string_tree_destroy(string_tree_t *self) {
 #define STRING_TREE_ITER_DIRECTION_RIGHT 1
 
 
-string_tree_iterator_t *string_tree_iterator_new(string_tree_t *tree) {
-    string_tree_iterator_t *self = malloc(sizeof(string_tree_iterator_t));
+// path and num_alternatives must be zeroed arrays of string_tree_num_tokens(tree) elements
+static void string_tree_iterator_init(string_tree_iterator_t *self, string_tree_t *tree, uint32_t *path, uint32_t *num_alternatives) {
     self->tree = tree;
 
     uint32_t num_tokens = string_tree_num_tokens(tree);
     self->num_tokens = num_tokens;
 
-    // calloc since the first path through the tree is all zeros
-    self->path = calloc(num_tokens, sizeof(uint32_t));
+    // zeroed since the first path through the tree is all zeros
+    self->path = path;
 
-    self->num_alternatives = calloc(num_tokens, sizeof(uint32_t));
+    self->num_alternatives = num_alternatives;
 
     uint32_t permutations = 1;
     uint32_t num_strings;
@@ -1009,6 +1048,32 @@ string_tree_iterator_t *string_tree_iterator_new(string_tree_t *tree) {
     // Start on the right going backward
     self->cursor = self->num_tokens - 1;
     self->direction = -1;
+}
+
+string_tree_iterator_t *string_tree_iterator_new(string_tree_t *tree) {
+    string_tree_iterator_t *self = malloc(sizeof(string_tree_iterator_t));
+    if (self == NULL) return NULL;
+
+    uint32_t num_tokens = string_tree_num_tokens(tree);
+
+    string_tree_iterator_init(self, tree, calloc(num_tokens, sizeof(uint32_t)), calloc(num_tokens, sizeof(uint32_t)));
+    self->arena = NULL;
+
+    return self;
+}
+
+string_tree_iterator_t *string_tree_iterator_new_arena(arena_t *arena, string_tree_t *tree) {
+    string_tree_iterator_t *self = arena_alloc(arena, sizeof(string_tree_iterator_t));
+    if (self == NULL) return NULL;
+
+    uint32_t num_tokens = string_tree_num_tokens(tree);
+
+    uint32_t *path = arena_calloc(arena, num_tokens, sizeof(uint32_t));
+    uint32_t *num_alternatives = arena_calloc(arena, num_tokens, sizeof(uint32_t));
+    if (path == NULL || num_alternatives == NULL) return NULL;
+
+    string_tree_iterator_init(self, tree, path, num_alternatives);
+    self->arena = arena;
 
     return self;
 }
@@ -1075,7 +1140,7 @@ bool string_tree_iterator_done(string_tree_iterator_t *self) {
 }
 
 void string_tree_iterator_destroy(string_tree_iterator_t *self) {
-    if (self == NULL) return;
+    if (self == NULL || self->arena != NULL) return;
 
     if (self->path) {
         free(self->path);
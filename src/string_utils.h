@@ -165,6 +165,8 @@ typedef struct {
 cstring_array *cstring_array_new(void);
 
 cstring_array *cstring_array_new_size(size_t size);
+// Allocated from arena, released by arena_reset, don't destroy
+cstring_array *cstring_array_new_size_arena(arena_t *arena, size_t size);
 
 size_t cstring_array_capacity(cstring_array *self);
 size_t cstring_array_used(cstring_array *self);
@@ -237,6 +239,8 @@ typedef struct string_tree {
 
 string_tree_t *string_tree_new(void);
 string_tree_t *string_tree_new_size(size_t size);
+// Allocated from arena, released by arena_reset, don't destroy
+string_tree_t *string_tree_new_size_arena(arena_t *arena, size_t size);
 
 // get
 char *string_tree_get_alternative(string_tree_t *self, size_t token_index, uint32_t alternative);
@@ -266,9 +270,12 @@ typedef struct string_tree_iterator {
     uint32_t cursor;
     int8_t direction;           // 1 or -1
     uint32_t remaining;
+    arena_t *arena;
 } string_tree_iterator_t;
 
 string_tree_iterator_t *string_tree_iterator_new(string_tree_t *tree);
+// Allocated from arena, released by arena_reset, don't destroy
+string_tree_iterator_t *string_tree_iterator_new_arena(arena_t *arena, string_tree_t *tree);
 void string_tree_iterator_next(string_tree_iterator_t *self);
 char *string_tree_iterator_get_string(string_tree_iterator_t *self, uint32_t i);
 bool string_tree_iterator_done(string_tree_iterator_t *self);
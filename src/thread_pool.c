@@ -0,0 +1,172 @@
+#include "thread_pool.h"
+
+#include <unistd.h>
+
+#include "log/log.h"
+
+// Tasks are claimed in chunks to keep contention on next_task low
+#define THREAD_POOL_CHUNKS_PER_WORKER 16
+
+struct thread_pool_worker {
+    thread_pool_t *pool;
+    size_t id;
+};
+
+size_t thread_pool_default_num_threads(void) {
+    long num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    return num_cpus > 0 ? (size_t)num_cpus : 1;
+}
+
+static void thread_pool_run_tasks(thread_pool_t *self, size_t worker_id) {
+    size_t num_tasks = self->num_tasks;
+    size_t chunk_size = self->chunk_size;
+    thread_pool_task_function func = self->func;
+    void *arg = self->arg;
+
+    while (true) {
+        size_t start = __sync_fetch_and_add(&self->next_task, chunk_size);
+        if (start >= num_tasks) break;
+
+        size_t end = start + chunk_size < num_tasks ? start + chunk_size : num_tasks;
+        for (size_t i = start; i < end; i++) {
+            func(arg, worker_id, i);
+        }
+    }
+}
+
+static void *thread_pool_worker_main(void *arg) {
+    thread_pool_worker_t *worker = (thread_pool_worker_t *)arg;
+    thread_pool_t *self = worker->pool;
+
+    uint64_t seen_generation = 0;
+
+    while (true) {
+        pthread_mutex_lock(&self->lock);
+        while (!self->shutdown && self->generation == seen_generation) {
+            pthread_cond_wait(&self->job_available, &self->lock);
+        }
+
+        if (self->shutdown) {
+            pthread_mutex_unlock(&self->lock);
+            break;
+        }
+
+        seen_generation = self->generation;
+        pthread_mutex_unlock(&self->lock);
+
+        thread_pool_run_tasks(self, worker->id);
+
+        pthread_mutex_lock(&self->lock);
+        self->num_active--;
+        if (self->num_active == 0) {
+            pthread_cond_signal(&self->job_done);
+        }
+        pthread_mutex_unlock(&self->lock);
+    }
+
+    return NULL;
+}
+
+thread_pool_t *thread_pool_new(size_t num_threads) {
+    if (num_threads == 0) {
+        num_threads = thread_pool_default_num_threads();
+    }
+
+    thread_pool_t *pool = calloc(1, sizeof(thread_pool_t));
+    if (pool == NULL) return NULL;
+
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->job_available, NULL);
+    pthread_cond_init(&pool->job_done, NULL);
+
+    if (num_threads <= 1) {
+        return pool;
+    }
+
+    pool->threads = malloc(sizeof(pthread_t) * num_threads);
+    pool->workers = malloc(sizeof(thread_pool_worker_t) * num_threads);
+    if (pool->threads == NULL || pool->workers == NULL) {
+        goto exit_thread_pool_created;
+    }
+
+    for (size_t i = 0; i < num_threads; i++) {
+        pool->workers[i] = (thread_pool_worker_t){pool, i};
+        if (pthread_create(&pool->threads[i], NULL, thread_pool_worker_main, &pool->workers[i]) != 0) {
+            log_error("Could not create worker thread %zu\n", i);
+            goto exit_thread_pool_created;
+        }
+        pool->num_threads++;
+    }
+
+    return pool;
+
+exit_thread_pool_created:
+    thread_pool_destroy(pool);
+    return NULL;
+}
+
+inline size_t thread_pool_num_workers(thread_pool_t *self) {
+    return self->num_threads > 0 ? self->num_threads : 1;
+}
+
+bool thread_pool_map(thread_pool_t *self, size_t num_tasks, thread_pool_task_function func, void *arg) {
+    if (self == NULL || func == NULL) return false;
+    if (num_tasks == 0) return true;
+
+    if (self->num_threads == 0) {
+        for (size_t i = 0; i < num_tasks; i++) {
+            func(arg, 0, i);
+        }
+        return true;
+    }
+
+    size_t chunk_size = num_tasks / (self->num_threads * THREAD_POOL_CHUNKS_PER_WORKER);
+    if (chunk_size == 0) chunk_size = 1;
+
+    pthread_mutex_lock(&self->lock);
+    self->func = func;
+    self->arg = arg;
+    self->num_tasks = num_tasks;
+    self->chunk_size = chunk_size;
+    self->next_task = 0;
+    self->num_active = self->num_threads;
+    self->generation++;
+    pthread_cond_broadcast(&self->job_available);
+
+    while (self->num_active > 0) {
+        pthread_cond_wait(&self->job_done, &self->lock);
+    }
+
+    self->func = NULL;
+    self->arg = NULL;
+    pthread_mutex_unlock(&self->lock);
+
+    return true;
+}
+
+void thread_pool_destroy(thread_pool_t *self) {
+    if (self == NULL) return;
+
+    if (self->threads != NULL) {
+        pthread_mutex_lock(&self->lock);
+        self->shutdown = true;
+        pthread_cond_broadcast(&self->job_available);
+        pthread_mutex_unlock(&self->lock);
+
+        for (size_t i = 0; i < self->num_threads; i++) {
+            pthread_join(self->threads[i], NULL);
+        }
+
+        free(self->threads);
+    }
+
+    if (self->workers != NULL) {
+        free(self->workers);
+    }
+
+    pthread_mutex_destroy(&self->lock);
+    pthread_cond_destroy(&self->job_available);
+    pthread_cond_destroy(&self->job_done);
+
+    free(self);
+}
@@ -0,0 +1,60 @@
+/*
+thread_pool.h
+-------------
+
+Fixed-size pool of worker threads for data-parallel work over an indexed
+set of tasks, e.g. a batch of addresses.
+
+thread_pool_map(pool, n, func, arg) calls func(arg, worker_id, i) for every
+i in [0, n) and blocks until all tasks are done. worker_id is in
+[0, num_workers) and is stable for the life of the pool, so callers can keep
+per-worker scratch state (parser contexts, buffers) in an array indexed by
+worker_id and write results into per-task slots to preserve input order.
+
+A pool created with num_threads <= 1 doesn't spawn any threads and runs
+every task in the calling thread as worker 0, in order.
+*/
+
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+typedef void (*thread_pool_task_function)(void *arg, size_t worker_id, size_t task_index);
+
+typedef struct thread_pool_worker thread_pool_worker_t;
+
+typedef struct thread_pool {
+    size_t num_threads;
+    pthread_t *threads;
+    thread_pool_worker_t *workers;
+    pthread_mutex_t lock;
+    pthread_cond_t job_available;
+    pthread_cond_t job_done;
+    // Current job
+    thread_pool_task_function func;
+    void *arg;
+    size_t num_tasks;
+    size_t chunk_size;
+    volatile size_t next_task;
+    size_t num_active;
+    uint64_t generation;
+    bool shutdown;
+} thread_pool_t;
+
+// Number of online CPUs, at least 1
+size_t thread_pool_default_num_threads(void);
+
+// num_threads == 0 means thread_pool_default_num_threads()
+thread_pool_t *thread_pool_new(size_t num_threads);
+
+size_t thread_pool_num_workers(thread_pool_t *self);
+
+bool thread_pool_map(thread_pool_t *self, size_t num_tasks, thread_pool_task_function func, void *arg);
+
+void thread_pool_destroy(thread_pool_t *self);
+
+#endif
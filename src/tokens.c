@@ -64,6 +64,14 @@ char *tokenized_string_get_token(tokenized_string_t *self, uint32_t index) {
     }
 }
 
+void tokenized_string_clear(tokenized_string_t *self) {
+    if (self == NULL) return;
+
+    self->str = NULL;
+    cstring_array_clear(self->strings);
+    token_array_clear(self->tokens);
+}
+
 void tokenized_string_destroy(tokenized_string_t *self) {
     if (self == NULL) return;
 
@@ -32,6 +32,8 @@ tokenized_string_t *tokenized_string_new_from_str_size(char *src, size_t len, si
 tokenized_string_t *tokenized_string_from_tokens(char *src, token_array *tokens, bool copy_tokens);
 void tokenized_string_add_token(tokenized_string_t *self, const char *src, size_t len, uint16_t token_type, size_t position);
 char *tokenized_string_get_token(tokenized_string_t *self, uint32_t index);
+// Clears tokens and strings in place for reuse, does not free str
+void tokenized_string_clear(tokenized_string_t *self);
 void tokenized_string_destroy(tokenized_string_t *self);
 
 
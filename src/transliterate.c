@@ -1,6 +1,8 @@
 #include <math.h>
 #include "transliterate.h"
+#include "data_bundle.h"
 #include "file_utils.h"
+#include "stats.h"
 
 #define TRANSLITERATION_TABLE_SIGNATURE 0xAAAAAAAA
 
@@ -664,6 +666,8 @@ static char *replace_groups(trie_t *trie, char *str, char *replacement, group_ca
 }
 
 char *transliterate(char *trans_name, char *str, size_t len) {
+    STATS_TIME_SCOPE(LIBPOSTAL_STAGE_TRANSLITERATE);
+
     if (trans_name == NULL || str == NULL || trans_table == NULL) return NULL;
 
     trie_t *trie = trans_table->trie;
@@ -1924,7 +1928,7 @@ bool transliteration_table_load(char *filename) {
 
     FILE *f;
 
-    if ((f = fopen(filename, "rb")) != NULL) {
+    if ((f = data_bundle_fopen(filename)) != NULL) {
         bool ret = transliteration_table_read(f);
         fclose(f);
         return ret;
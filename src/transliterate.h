@@ -165,6 +165,7 @@ transliterator_index_t get_transliterator_index_for_script_language(script_t scr
 
 bool transliteration_table_write(FILE *file);
 bool transliteration_table_save(char *filename);
+bool transliteration_table_load(char *filename);
 
 // Module setup/teardown
 bool transliteration_module_init(void);
@@ -1,6 +1,17 @@
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
 #include "trie.h"
+#include "data_bundle.h"
 #include <math.h>
 
+#ifdef HAVE_MMAP
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+#include <sys/stat.h>
+
 /* 
 * Maps the 256 characters (suitable for UTF-8 strings) to array indices
 * ordered by frequency of usage in Wikipedia titles.
@@ -32,7 +43,7 @@ Constructors
 */
 
 static trie_t *trie_new_empty(uint8_t *alphabet, uint32_t alphabet_size) {
-    trie_t *self = malloc(sizeof(trie_t));
+    trie_t *self = calloc(1, sizeof(trie_t));
     if (!self)
         goto exit_no_malloc;
 
@@ -100,6 +111,10 @@ trie_t *trie_new(void) {
     return trie_new_alphabet(DEFAULT_ALPHABET, sizeof(DEFAULT_ALPHABET));
 }
 
+inline bool trie_is_mapped(trie_t *self) {
+    return self->mapped != NULL;
+}
+
 inline bool trie_node_is_free(trie_node_t node) {
     return node.check < 0;
 }
@@ -616,6 +631,11 @@ void trie_print(trie_t *self) {
 }
 
 bool trie_add_at_index(trie_t *self, uint32_t node_id, char *key, size_t len, uint32_t data) {
+    if (trie_is_mapped(self)) {
+        log_error("Can't add keys to a memory-mapped trie\n");
+        return false;
+    }
+
     if (len == 2 && (key[0] == TRIE_SUFFIX_CHAR[0] || key[0] == TRIE_PREFIX_CHAR[0]) && key[1] == '\0') {
         return false;
     }
@@ -673,7 +693,7 @@ inline bool trie_add_len(trie_t *self, char *key, size_t len, uint32_t data) {
 
 bool trie_add_prefix_at_index(trie_t *self, char *key, uint32_t start_node_id, uint32_t data) {
     size_t len = strlen(key);
-    if (start_node_id == NULL_NODE_ID || len == 0) return false;
+    if (start_node_id == NULL_NODE_ID || len == 0 || trie_is_mapped(self)) return false;
 
     trie_node_t start_node = trie_get_node(self, start_node_id);
 
@@ -696,7 +716,7 @@ inline bool trie_add_prefix(trie_t *self, char *key, uint32_t data) {
 
 bool trie_add_suffix_at_index(trie_t *self, char *key, uint32_t start_node_id, uint32_t data) {
     size_t len = strlen(key);
-    if (start_node_id == NULL_NODE_ID || len == 0) return false;
+    if (start_node_id == NULL_NODE_ID || len == 0 || trie_is_mapped(self)) return false;
 
     trie_node_t start_node = trie_get_node(self, start_node_id);
 
@@ -896,13 +916,75 @@ inline uint32_t trie_num_keys(trie_t *self) {
     return self->num_keys;
 }
 
+static void trie_foreach_key_from_index(trie_t *self, uint32_t node_id, char_array *key, trie_key_function func, void *arg) {
+    trie_node_t node = trie_get_node(self, node_id);
+
+    if (node.base < 0) {
+        trie_data_node_t data_node = trie_get_data_node(self, node);
+        if (data_node.tail == 0 || data_node.tail >= self->tail->n) return;
+
+        size_t key_len = key->n;
+        char_array_append(key, (char *)self->tail->a + data_node.tail);
+        char_array_terminate(key);
+        func(key->a, data_node.data, arg);
+        key->n = key_len;
+        return;
+    }
+
+    for (uint32_t i = 0; i < self->alphabet_size; i++) {
+        unsigned char c = (unsigned char)self->alphabet[i];
+        uint32_t next_id = trie_get_transition_index(self, node, c);
+        trie_node_t next = trie_get_node(self, next_id);
+        if (next.check < 0 || (uint32_t)next.check != node_id) continue;
+
+        size_t key_len = key->n;
+        // The NUL transition terminates a key which is a prefix of a longer one
+        if (c != '\0') {
+            char_array_push(key, (char)c);
+        }
+        trie_foreach_key_from_index(self, next_id, key, func, arg);
+        key->n = key_len;
+    }
+}
+
+void trie_foreach_key(trie_t *self, trie_key_function func, void *arg) {
+    if (self == NULL || func == NULL) return;
+
+    char_array *key = char_array_new();
+    if (key == NULL) return;
+
+    trie_foreach_key_from_index(self, ROOT_NODE_ID, key, func, arg);
+
+    char_array_destroy(key);
+}
+
 /*
 Destructor
 */
+static void trie_unmap(trie_t *self) {
+    // The arrays point into the mapping, only the vector structs were allocated
+    free(self->nodes);
+    free(self->data);
+    free(self->tail);
+    self->nodes = NULL;
+    self->data = NULL;
+    self->tail = NULL;
+
+#ifdef HAVE_MMAP
+    munmap(self->mapped, self->mapped_size);
+#else
+    free(self->mapped);
+#endif
+    self->mapped = NULL;
+}
+
 void trie_destroy(trie_t *self) {
     if (!self)
         return;
 
+    if (self->mapped)
+        trie_unmap(self);
+
     if (self->alphabet)
         free(self->alphabet);
     if (self->nodes)
@@ -920,7 +1002,7 @@ void trie_destroy(trie_t *self) {
 I/O methods
 */
 
-bool trie_write(trie_t *self, FILE *file) {
+bool trie_write_legacy(trie_t *self, FILE *file) {
     if (!file_write_uint32(file, TRIE_SIGNATURE) ||
         !file_write_uint32(file, self->alphabet_size)|| 
         !file_write_chars(file, (char *)self->alphabet, (size_t)self->alphabet_size) ||
@@ -961,6 +1043,68 @@ bool trie_write(trie_t *self, FILE *file) {
     return true;
 }
 
+static inline uint64_t trie_mmap_align(uint64_t offset) {
+    return (offset + TRIE_MMAP_ALIGNMENT - 1) & ~((uint64_t)TRIE_MMAP_ALIGNMENT - 1);
+}
+
+static bool trie_write_padding(FILE *file, uint64_t from, uint64_t to) {
+    static const char zeros[TRIE_MMAP_ALIGNMENT] = {0};
+    size_t len = (size_t)(to - from);
+    return len == 0 || fwrite(zeros, 1, len, file) == len;
+}
+
+bool trie_write(trie_t *self, FILE *file) {
+    // Section alignment is relative to the start of the file since that's where mappings start
+    long pos = ftell(file);
+    if (pos < 0) {
+        log_error("trie_write requires a seekable file\n");
+        return false;
+    }
+    uint64_t start = (uint64_t)pos;
+
+    size_t nodes_size = self->nodes->n * sizeof(trie_node_t);
+    size_t data_size = self->data->n * sizeof(trie_data_node_t);
+    size_t tail_size = self->tail->n;
+
+    uint64_t nodes_start = trie_mmap_align(start + sizeof(trie_mmap_header_t));
+    uint64_t data_start = trie_mmap_align(nodes_start + nodes_size);
+    uint64_t tail_start = trie_mmap_align(data_start + data_size);
+    uint64_t end = tail_start + tail_size;
+
+    trie_mmap_header_t header;
+    memset(&header, 0, sizeof(header));
+    header.version = TRIE_MMAP_VERSION;
+    header.byte_order_mark = TRIE_MMAP_BYTE_ORDER_MARK;
+    header.alphabet_size = self->alphabet_size;
+    header.num_keys = self->num_keys;
+    header.num_nodes = (uint32_t)self->nodes->n;
+    header.num_data_nodes = (uint32_t)self->data->n;
+    header.tail_len = (uint32_t)self->tail->n;
+    header.nodes_offset = nodes_start - start;
+    header.data_offset = data_start - start;
+    header.tail_offset = tail_start - start;
+    header.size = end - start;
+    memcpy(header.alphabet, self->alphabet, self->alphabet_size);
+
+    size_t signature_size = sizeof(header.signature);
+
+    if (!file_write_uint32(file, TRIE_MMAP_SIGNATURE) ||
+        fwrite((char *)&header + signature_size, sizeof(header) - signature_size, 1, file) != 1) {
+        return false;
+    }
+
+    if (!trie_write_padding(file, start + sizeof(header), nodes_start) ||
+        (nodes_size > 0 && fwrite(self->nodes->a, nodes_size, 1, file) != 1) ||
+        !trie_write_padding(file, nodes_start + nodes_size, data_start) ||
+        (data_size > 0 && fwrite(self->data->a, data_size, 1, file) != 1) ||
+        !trie_write_padding(file, data_start + data_size, tail_start) ||
+        (tail_size > 0 && fwrite(self->tail->a, tail_size, 1, file) != 1)) {
+        return false;
+    }
+
+    return true;
+}
+
 
 bool trie_save(trie_t *self, char *path) {
     FILE *file;
@@ -976,6 +1120,125 @@ bool trie_save(trie_t *self, char *path) {
     return result;
 }
 
+/*
+Maps the byte range of a trie in the mmap layout, the header starting at
+header_pos, and points the trie's arrays into it. Only the pages holding the
+trie itself are mapped, so a trie embedded in a larger file doesn't map the
+rest of it. Without mmap, the range is read into memory instead, starting
+at an aligned offset so the sections stay aligned.
+*/
+static trie_t *trie_read_mapped(FILE *file, long header_pos) {
+    int fd = fileno(file);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        return NULL;
+    }
+
+    size_t file_size = (size_t)st.st_size;
+    if ((size_t)header_pos + sizeof(trie_mmap_header_t) > file_size) {
+        return NULL;
+    }
+
+    trie_mmap_header_t header;
+    size_t signature_size = sizeof(header.signature);
+    if (fread((char *)&header + signature_size, sizeof(header) - signature_size, 1, file) != 1) {
+        return NULL;
+    }
+
+    if (header.version != TRIE_MMAP_VERSION) {
+        log_error("Unsupported trie version: %u\n", header.version);
+        return NULL;
+    }
+
+    if (header.byte_order_mark != TRIE_MMAP_BYTE_ORDER_MARK) {
+        log_error("Trie was written on a machine with different endianness\n");
+        return NULL;
+    }
+
+    if (header.alphabet_size > NUM_CHARS ||
+        header.size < sizeof(header) ||
+        (size_t)header_pos + header.size > file_size ||
+        header.nodes_offset + (uint64_t)header.num_nodes * sizeof(trie_node_t) > header.size ||
+        header.data_offset + (uint64_t)header.num_data_nodes * sizeof(trie_data_node_t) > header.size ||
+        header.tail_offset + header.tail_len > header.size) {
+        log_error("Invalid trie header\n");
+        return NULL;
+    }
+
+    size_t map_end = (size_t)header_pos + (size_t)header.size;
+
+#ifdef HAVE_MMAP
+    // mmap offsets must be page-aligned, sections are aligned from the start of the file so they stay aligned
+    size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+    size_t map_start = (size_t)header_pos & ~(page_size - 1);
+    size_t map_size = map_end - map_start;
+    void *map = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, (off_t)map_start);
+    if (map == MAP_FAILED) {
+        log_error("Could not mmap trie\n");
+        return NULL;
+    }
+#else
+    size_t map_start = (size_t)header_pos & ~((size_t)TRIE_MMAP_ALIGNMENT - 1);
+    size_t map_size = map_end - map_start;
+    void *map = malloc(map_size);
+    if (map == NULL) {
+        return NULL;
+    }
+    if (fseek(file, (long)map_start, SEEK_SET) != 0 || fread(map, 1, map_size, file) != map_size) {
+        free(map);
+        return NULL;
+    }
+#endif
+
+    char *base = (char *)map + ((size_t)header_pos - map_start);
+
+    trie_t *trie = NULL;
+
+    trie = calloc(1, sizeof(trie_t));
+    if (trie == NULL) {
+        goto exit_trie_mapped;
+    }
+
+    trie->mapped = map;
+    trie->mapped_size = map_size;
+    trie->null_node = NULL_NODE;
+    trie->num_keys = header.num_keys;
+    trie->alphabet_size = header.alphabet_size;
+
+    trie->alphabet = malloc(header.alphabet_size);
+    trie->nodes = malloc(sizeof(trie_node_array));
+    trie->data = malloc(sizeof(trie_data_array));
+    trie->tail = malloc(sizeof(uchar_array));
+    if (trie->alphabet == NULL || trie->nodes == NULL || trie->data == NULL || trie->tail == NULL) {
+        trie_destroy(trie);
+        return NULL;
+    }
+
+    memcpy(trie->alphabet, header.alphabet, header.alphabet_size);
+    for (uint32_t i = 0; i < header.alphabet_size; i++) {
+        trie->alpha_map[header.alphabet[i]] = i;
+    }
+
+    *trie->nodes = (trie_node_array){header.num_nodes, header.num_nodes, (trie_node_t *)(base + header.nodes_offset), NULL};
+    *trie->data = (trie_data_array){header.num_data_nodes, header.num_data_nodes, (trie_data_node_t *)(base + header.data_offset), NULL};
+    *trie->tail = (uchar_array){header.tail_len, header.tail_len, (unsigned char *)(base + header.tail_offset), NULL};
+
+    if (fseek(file, header_pos + (long)header.size, SEEK_SET) != 0) {
+        trie_destroy(trie);
+        return NULL;
+    }
+
+    return trie;
+
+exit_trie_mapped:
+#ifdef HAVE_MMAP
+    munmap(map, map_size);
+#else
+    free(map);
+#endif
+    return NULL;
+}
+
 trie_t *trie_read(FILE *file) {
     uint32_t i;
 
@@ -989,7 +1252,13 @@ trie_t *trie_read(FILE *file) {
         goto exit_file_read;
     }
 
-    if (signature != TRIE_SIGNATURE) {
+    if (signature == TRIE_MMAP_SIGNATURE) {
+        trie_t *mapped_trie = trie_read_mapped(file, save_pos);
+        if (mapped_trie == NULL) {
+            goto exit_file_read;
+        }
+        return mapped_trie;
+    } else if (signature != TRIE_SIGNATURE) {
         goto exit_file_read;
     }
 
@@ -1110,7 +1379,7 @@ exit_file_read:
 trie_t *trie_load(char *path) {
     FILE *file;
 
-    file = fopen(path, "r");
+    file = data_bundle_fopen(path);
     if (!file)
         return NULL;
 
@@ -35,6 +35,7 @@
 #include "string_utils.h"
 
 #define TRIE_SIGNATURE 0xABABABAB
+#define TRIE_MMAP_SIGNATURE 0xABABABAC
 #define NULL_NODE_ID 0
 #define FREE_LIST_ID 1
 #define ROOT_NODE_ID 2
@@ -67,6 +68,45 @@ typedef struct trie_data_node {
 VECTOR_INIT(trie_node_array, trie_node_t)
 VECTOR_INIT(trie_data_array, trie_data_node_t)
 
+/*
+Memory-mappable layout
+
+trie_write stores the node, data and tail arrays as-is (native endian),
+each aligned to TRIE_MMAP_ALIGNMENT bytes from the start of the file, after
+a fixed-size header. trie_read/trie_load recognize this layout by its
+signature and map the file instead of deserializing it, so loading is
+O(1) and the pages are shared between processes through the page cache.
+Files written in the older big-endian layout (TRIE_SIGNATURE) are still
+read the old way, convert_data rewrites an existing data directory in the
+mapped layout. Only the trie's own byte range is mapped, so tries embedded
+in larger files don't map their host file.
+
+A mapped trie is read-only: keys can't be added, though data values can
+be changed with trie_set_data (copy-on-write, never written back).
+*/
+
+#define TRIE_MMAP_VERSION 1
+#define TRIE_MMAP_BYTE_ORDER_MARK 0x01020304
+#define TRIE_MMAP_ALIGNMENT 64
+
+typedef struct trie_mmap_header {
+    // Big-endian like TRIE_SIGNATURE so trie_read can tell the layouts apart
+    uint32_t signature;
+    uint32_t version;
+    uint32_t byte_order_mark;
+    uint32_t alphabet_size;
+    uint32_t num_keys;
+    uint32_t num_nodes;
+    uint32_t num_data_nodes;
+    uint32_t tail_len;
+    // Offsets are relative to the start of the header
+    uint64_t nodes_offset;
+    uint64_t data_offset;
+    uint64_t tail_offset;
+    uint64_t size;
+    uint8_t alphabet[NUM_CHARS];
+} trie_mmap_header_t;
+
 typedef struct trie {
     trie_node_t null_node;
     trie_node_array *nodes;
@@ -76,6 +116,9 @@ typedef struct trie {
     uint8_t alpha_map[NUM_CHARS];
     uint32_t alphabet_size;
     uint32_t num_keys;
+    // Set when nodes, data and tail point into a mapped file
+    void *mapped;
+    size_t mapped_size;
 } trie_t;
 
 trie_t *trie_new_alphabet(uint8_t *alphabet, uint32_t alphabet_size);
@@ -126,6 +169,10 @@ uint32_t trie_get(trie_t *self, char *word);
 
 uint32_t trie_num_keys(trie_t *self);
 
+// Calls func(key, data, arg) for every key in the trie, in no particular order
+typedef void (*trie_key_function)(char *key, uint32_t data, void *arg);
+void trie_foreach_key(trie_t *self, trie_key_function func, void *arg);
+
 typedef struct trie_prefix_result {
     uint32_t node_id;
     size_t tail_pos;
@@ -142,6 +189,10 @@ void trie_print(trie_t *self);
 
 bool trie_write(trie_t *self, FILE *file);
 bool trie_save(trie_t *self, char *path);
+// Older big-endian layout, deserialized node by node on read
+bool trie_write_legacy(trie_t *self, FILE *file);
+
+bool trie_is_mapped(trie_t *self);
 
 trie_t *trie_read(FILE *file);
 trie_t *trie_load(char *path);
@@ -1,12 +1,5 @@
 #include "trie_search.h"
 
-typedef enum {
-    SEARCH_STATE_BEGIN,
-    SEARCH_STATE_NO_MATCH,
-    SEARCH_STATE_PARTIAL_MATCH,
-    SEARCH_STATE_MATCH
-} trie_search_state_t;
-
 bool trie_search_from_index(trie_t *self, char *text, uint32_t start_node_id, phrase_array **phrases) {
     if (text == NULL) return false;
 
@@ -233,106 +226,219 @@ int trie_node_search_tail_tokens(trie_t *self, trie_node_t node, char *str, toke
 }
 
 
-bool trie_search_tokens_from_index(trie_t *self, char *str, token_array *tokens, uint32_t start_node_id, phrase_array **phrases) {
-    if (str == NULL || tokens == NULL || tokens->n == 0) return false;
+/*
+Token search state for one trie, advanced one token at a time by
+trie_token_search_step so several tries can be searched in lockstep.
+*/
+void trie_token_search_init(trie_token_search_t *search, trie_t *trie, uint32_t start_node_id, phrase_array **phrases) {
+    trie_node_t node = trie_get_node(trie, start_node_id);
+
+    *search = (trie_token_search_t){
+        .trie = trie,
+        .start_node_id = start_node_id,
+        .phrases = phrases,
+        .i = 0,
+        .node_id = start_node_id,
+        .last_node_id = start_node_id,
+        .node = node,
+        .last_node = node,
+        .data = 0,
+        .phrase_len = 0,
+        .phrase_start = 0,
+        .last_match_index = -1,
+        .state = SEARCH_STATE_BEGIN,
+        .last_state = SEARCH_STATE_BEGIN,
+        .done = false
+    };
+}
 
-    uint32_t node_id = start_node_id, last_node_id = start_node_id;
-    trie_node_t node = trie_get_node(self, node_id), last_node = node;
+/*
+Processes the token at search->i and moves on to the next token (or back to
+an earlier one after a partial match). Returns false once the search is
+done, after which trie_token_search_finish adds any pending match.
+*/
+static bool trie_token_search_step(trie_token_search_t *search, char *str, token_array *tokens) {
+    if (search->done || search->i >= (int)tokens->n) {
+        search->done = true;
+        return false;
+    }
 
-    uint32_t data;
+    trie_t *self = search->trie;
+    uint32_t start_node_id = search->start_node_id;
+    phrase_array **phrases = search->phrases;
 
-    int phrase_len = 0, phrase_start = 0, last_match_index = -1;
+    int i = search->i;
+    uint32_t node_id = search->node_id, last_node_id = search->last_node_id;
+    trie_node_t node = search->node, last_node = search->last_node;
+    uint32_t data = search->data;
+    int phrase_len = search->phrase_len, phrase_start = search->phrase_start, last_match_index = search->last_match_index;
+    trie_search_state_t state = search->state, last_state = search->last_state;
 
-    trie_search_state_t state = SEARCH_STATE_BEGIN, last_state = SEARCH_STATE_BEGIN;
+    bool finished = false;
 
     token_t token;
     size_t token_length;
 
-    log_debug("num_tokens: %zu\n", tokens->n);
-    for (int i = 0; i < tokens->n; i++, last_state = state) {
-        token = tokens->a[i];
-        token_length = token.len;
-        
-        char *ptr = str + token.offset;
-        log_debug("On %d, token=%.*s\n", i, (int)token_length, ptr);
+    token = tokens->a[i];
+    token_length = token.len;
+    
+    char *ptr = str + token.offset;
+    log_debug("On %d, token=%.*s\n", i, (int)token_length, ptr);
+
+    bool check_continuation = true;
+
+    if (token.type != WHITESPACE) {
+        for (int j = 0; j < token_length; j++, ptr++, last_node = node, last_node_id = node_id) {
+            log_debug("Getting transition index for %d, (%d, %d)\n", node_id, node.base, node.check);
+            size_t offset = j + 1;
+            if (j > 0 || last_node.base >= 0) {
+                node_id = trie_get_transition_index(self, node, *ptr);
+                node = trie_get_node(self, node_id);
+                log_debug("Doing %c, got node_id=%d\n", *ptr, node_id);
+            } else {
+                log_debug("Tail stored on space node, rolling back one character\n");
+                ptr--;
+                offset = j;
+                log_debug("ptr=%s\n", ptr);
+            }
 
-        bool check_continuation = true;
+            if (node.check != last_node_id && last_node.base >= 0) {
+                log_debug("Fell off trie. last_node_id=%d and node.check=%d\n", last_node_id, node.check);
+                node_id = start_node_id;
+                node = trie_get_node(self, node_id);
+                break;
+            } else if (node.base < 0) {
+                log_debug("Searching tail at index %d\n", i);
 
-        if (token.type != WHITESPACE) {
-            for (int j = 0; j < token_length; j++, ptr++, last_node = node, last_node_id = node_id) {
-                log_debug("Getting transition index for %d, (%d, %d)\n", node_id, node.base, node.check);
-                size_t offset = j + 1;
-                if (j > 0 || last_node.base >= 0) {
-                    node_id = trie_get_transition_index(self, node, *ptr);
-                    node = trie_get_node(self, node_id);
-                    log_debug("Doing %c, got node_id=%d\n", *ptr, node_id);
-                } else {
-                    log_debug("Tail stored on space node, rolling back one character\n");
-                    ptr--;
-                    offset = j;
-                    log_debug("ptr=%s\n", ptr);
+                uint32_t data_index = -1*node.base;
+                trie_data_node_t data_node = self->data->a[data_index];
+                uint32_t current_tail_pos = data_node.tail;
+                data = data_node.data;
+
+                unsigned char *current_tail = self->tail->a + current_tail_pos;
+
+                log_debug("token_length = %zu, j=%d\n", token_length, j);
+
+                size_t ptr_len = token_length - offset;
+                log_debug("next node tail: %s vs %.*s\n", current_tail, (int)ptr_len, ptr + 1);
+
+                if (last_state == SEARCH_STATE_NO_MATCH || last_state == SEARCH_STATE_BEGIN) {
+                    log_debug("phrase start at %d\n", i);
+                    phrase_start = i;
                 }
+                if (strncmp((char *)current_tail, ptr + 1, ptr_len) == 0) {
+                    log_debug("node tail matches first token\n");
+                    int tail_search_result = trie_node_search_tail_tokens(self, node, str, tokens, ptr_len, i + 1);
+                    log_debug("tail_search_result=%d\n", tail_search_result);
+                    node_id = start_node_id;
+                    node = trie_get_node(self, node_id);
+                    check_continuation = false;
+
+                    if (tail_search_result != -1) {
+                        phrase_len = tail_search_result - phrase_start + 1;
+                        last_match_index = i = tail_search_result;
+                        last_state = SEARCH_STATE_MATCH;
+                    }
+                    break;
 
-                if (node.check != last_node_id && last_node.base >= 0) {
-                    log_debug("Fell off trie. last_node_id=%d and node.check=%d\n", last_node_id, node.check);
+                } else {
                     node_id = start_node_id;
                     node = trie_get_node(self, node_id);
                     break;
-                } else if (node.base < 0) {
-                    log_debug("Searching tail at index %d\n", i);
+                }
+            }
+        }
+    } else {
+        check_continuation = false;
+        if (state == SEARCH_STATE_BEGIN || state == SEARCH_STATE_NO_MATCH) {
+            goto next_token;
+        }
+    }
 
-                    uint32_t data_index = -1*node.base;
-                    trie_data_node_t data_node = self->data->a[data_index];
-                    uint32_t current_tail_pos = data_node.tail;
-                    data = data_node.data;
 
-                    unsigned char *current_tail = self->tail->a + current_tail_pos;
+    if (node.check <= 0 || node_id == start_node_id) {
+        log_debug("state = SEARCH_STATE_NO_MATCH\n");
+        state = SEARCH_STATE_NO_MATCH;
+        // check
+        if (last_match_index != -1) {
+            log_debug("last_match not NULL and state==SEARCH_STATE_NO_MATCH, data=%d\n", data);
+            if (*phrases == NULL) {
+                *phrases = phrase_array_new_size(1);
+            }
+            phrase_array_push(*phrases, (phrase_t){phrase_start, last_match_index - phrase_start + 1, data});
+            i = last_match_index;
+            last_match_index = -1;
+            phrase_start = phrase_len = 0;
+            node_id = last_node_id = start_node_id;
+            node = last_node = trie_get_node(self, start_node_id);
+            goto next_token;
+        } else if (last_state == SEARCH_STATE_PARTIAL_MATCH) {
+            log_debug("last_state == SEARCH_STATE_PARTIAL_MATCH\n");
+            i = phrase_start;
+            goto next_token;
+        } else {
+            phrase_start = phrase_len = 0;
+            // this token was not a phrase
+            log_debug("Plain token=%.*s\n", (int)token.len, str + token.offset);
+        }
+        node_id = last_node_id = start_node_id;
+        node = last_node = trie_get_node(self, start_node_id);
+    } else {
+
+        state = SEARCH_STATE_PARTIAL_MATCH;
+        if (!(node.base < 0) && (last_state == SEARCH_STATE_NO_MATCH || last_state == SEARCH_STATE_BEGIN)) {
+            log_debug("phrase_start=%d, node.base = %d, last_state=%d\n", i, node.base, last_state);
+            phrase_start = i;
+        }
 
-                    log_debug("token_length = %zu, j=%d\n", token_length, j);
+        trie_node_t terminal_node = trie_get_transition(self, node, '\0');
+        if (terminal_node.check == node_id) {
+            log_debug("node match at %d\n", i);
+            state = SEARCH_STATE_MATCH;
+            int32_t data_index = -1*terminal_node.base;
+            trie_data_node_t data_node = self->data->a[data_index];
+            data = data_node.data;
+            log_debug("data = %d\n", data);
 
-                    size_t ptr_len = token_length - offset;
-                    log_debug("next node tail: %s vs %.*s\n", current_tail, (int)ptr_len, ptr + 1);
+            log_debug("phrase_start = %d\n", phrase_start);
 
-                    if (last_state == SEARCH_STATE_NO_MATCH || last_state == SEARCH_STATE_BEGIN) {
-                        log_debug("phrase start at %d\n", i);
-                        phrase_start = i;
-                    }
-                    if (strncmp((char *)current_tail, ptr + 1, ptr_len) == 0) {
-                        log_debug("node tail matches first token\n");
-                        int tail_search_result = trie_node_search_tail_tokens(self, node, str, tokens, ptr_len, i + 1);
-                        log_debug("tail_search_result=%d\n", tail_search_result);
-                        node_id = start_node_id;
-                        node = trie_get_node(self, node_id);
-                        check_continuation = false;
-
-                        if (tail_search_result != -1) {
-                            phrase_len = tail_search_result - phrase_start + 1;
-                            last_match_index = i = tail_search_result;
-                            last_state = SEARCH_STATE_MATCH;
-                        }
-                        break;
+            last_match_index = i;
+            log_debug("last_match_index = %d\n", i);
+        }
 
-                    } else {
-                        node_id = start_node_id;
-                        node = trie_get_node(self, node_id);
-                        break;
-                    }
+        if (i == tokens->n - 1) {
+            if (last_match_index == -1) {
+                log_debug("At last token\n");
+                finished = true;
+                goto save_state;
+            } else {
+                if (*phrases == NULL) {
+                    *phrases = phrase_array_new_size(1);
                 }
-            }
-        } else {
-            check_continuation = false;
-            if (state == SEARCH_STATE_BEGIN || state == SEARCH_STATE_NO_MATCH) {
-                continue;
+                phrase_array_push(*phrases, (phrase_t){phrase_start, last_match_index - phrase_start + 1, data});
+                i = last_match_index;
+                last_match_index = -1;
+                phrase_start = phrase_len = 0;
+                node_id = last_node_id = start_node_id;
+                node = last_node = trie_get_node(self, start_node_id);
+                state = SEARCH_STATE_NO_MATCH;
+                goto next_token;
             }
         }
 
+        if (check_continuation) {
 
-        if (node.check <= 0 || node_id == start_node_id) {
-            log_debug("state = SEARCH_STATE_NO_MATCH\n");
-            state = SEARCH_STATE_NO_MATCH;
-            // check
-            if (last_match_index != -1) {
-                log_debug("last_match not NULL and state==SEARCH_STATE_NO_MATCH, data=%d\n", data);
+            // Check continuation
+            uint32_t continuation_id = trie_get_transition_index(self, node, ' ');
+            log_debug("transition_id: %u\n", continuation_id);
+            trie_node_t continuation = trie_get_node(self, continuation_id);
+
+            if (token.type == IDEOGRAPHIC_CHAR && continuation.check != node_id) {
+                log_debug("Ideographic character\n");
+                last_node_id = node_id;
+                last_node = node;
+            } else if (continuation.check != node_id && last_match_index != -1) {
+                log_debug("node->match no continuation\n");
                 if (*phrases == NULL) {
                     *phrases = phrase_array_new_size(1);
                 }
@@ -342,105 +448,97 @@ bool trie_search_tokens_from_index(trie_t *self, char *str, token_array *tokens,
                 phrase_start = phrase_len = 0;
                 node_id = last_node_id = start_node_id;
                 node = last_node = trie_get_node(self, start_node_id);
-                continue;
-            } else if (last_state == SEARCH_STATE_PARTIAL_MATCH) {
-                log_debug("last_state == SEARCH_STATE_PARTIAL_MATCH\n");
-                i = phrase_start;
-                continue;
-            } else {
+                state = SEARCH_STATE_BEGIN;
+            } else if (continuation.check != node_id) {
+                log_debug("No continuation for phrase with start=%d, yielding tokens\n", phrase_start);
+                state = SEARCH_STATE_NO_MATCH;
                 phrase_start = phrase_len = 0;
-                // this token was not a phrase
-                log_debug("Plain token=%.*s\n", (int)token.len, str + token.offset);
-            }
-            node_id = last_node_id = start_node_id;
-            node = last_node = trie_get_node(self, start_node_id);
-        } else {
+                node_id = last_node_id = start_node_id;
+                node = last_node = trie_get_node(self, start_node_id);
+            } else {
+                log_debug("Has continuation, node_id=%d\n", continuation_id);
+                last_node = node = continuation;
+                last_node_id = node_id = continuation_id;
+            }            
+        }
+    }
 
-            state = SEARCH_STATE_PARTIAL_MATCH;
-            if (!(node.base < 0) && (last_state == SEARCH_STATE_NO_MATCH || last_state == SEARCH_STATE_BEGIN)) {
-                log_debug("phrase_start=%d, node.base = %d, last_state=%d\n", i, node.base, last_state);
-                phrase_start = i;
-            }
+next_token:
+    i++;
+    last_state = state;
+
+save_state:
+    search->i = i;
+    search->node_id = node_id;
+    search->last_node_id = last_node_id;
+    search->node = node;
+    search->last_node = last_node;
+    search->data = data;
+    search->phrase_len = phrase_len;
+    search->phrase_start = phrase_start;
+    search->last_match_index = last_match_index;
+    search->state = state;
+    search->last_state = last_state;
+    search->done = finished;
+
+    return !finished;
+}
 
-            trie_node_t terminal_node = trie_get_transition(self, node, '\0');
-            if (terminal_node.check == node_id) {
-                log_debug("node match at %d\n", i);
-                state = SEARCH_STATE_MATCH;
-                int32_t data_index = -1*terminal_node.base;
-                trie_data_node_t data_node = self->data->a[data_index];
-                data = data_node.data;
-                log_debug("data = %d\n", data);
+static void trie_token_search_finish(trie_token_search_t *search) {
+    if (search->last_match_index != -1) {
+        phrase_array **phrases = search->phrases;
+        if (*phrases == NULL) {
+            *phrases = phrase_array_new_size(1);
+        }
+        phrase_array_push(*phrases, (phrase_t){search->phrase_start, search->last_match_index - search->phrase_start + 1, search->data});
+        search->last_match_index = -1;
+    }
+}
 
-                log_debug("phrase_start = %d\n", phrase_start);
+bool trie_search_tokens_from_index(trie_t *self, char *str, token_array *tokens, uint32_t start_node_id, phrase_array **phrases) {
+    if (str == NULL || tokens == NULL || tokens->n == 0) return false;
 
-                last_match_index = i;
-                log_debug("last_match_index = %d\n", i);
-            }
+    log_debug("num_tokens: %zu\n", tokens->n);
 
-            if (i == tokens->n - 1) {
-                if (last_match_index == -1) {
-                    log_debug("At last token\n");
-                    break;
-                } else {
-                    if (*phrases == NULL) {
-                        *phrases = phrase_array_new_size(1);
-                    }
-                    phrase_array_push(*phrases, (phrase_t){phrase_start, last_match_index - phrase_start + 1, data});
-                    i = last_match_index;
-                    last_match_index = -1;
-                    phrase_start = phrase_len = 0;
-                    node_id = last_node_id = start_node_id;
-                    node = last_node = trie_get_node(self, start_node_id);
-                    state = SEARCH_STATE_NO_MATCH;
-                    continue;
-                }
-            }
+    trie_token_search_t search;
+    trie_token_search_init(&search, self, start_node_id, phrases);
 
-            if (check_continuation) {
+    while (trie_token_search_step(&search, str, tokens));
 
-                // Check continuation
-                uint32_t continuation_id = trie_get_transition_index(self, node, ' ');
-                log_debug("transition_id: %u\n", continuation_id);
-                trie_node_t continuation = trie_get_node(self, continuation_id);
+    trie_token_search_finish(&search);
 
-                if (token.type == IDEOGRAPHIC_CHAR && continuation.check != node_id) {
-                    log_debug("Ideographic character\n");
-                    last_node_id = node_id;
-                    last_node = node;
-                } else if (continuation.check != node_id && last_match_index != -1) {
-                    log_debug("node->match no continuation\n");
-                    if (*phrases == NULL) {
-                        *phrases = phrase_array_new_size(1);
-                    }
-                    phrase_array_push(*phrases, (phrase_t){phrase_start, last_match_index - phrase_start + 1, data});
-                    i = last_match_index;
-                    last_match_index = -1;
-                    phrase_start = phrase_len = 0;
-                    node_id = last_node_id = start_node_id;
-                    node = last_node = trie_get_node(self, start_node_id);
-                    state = SEARCH_STATE_BEGIN;
-                } else if (continuation.check != node_id) {
-                    log_debug("No continuation for phrase with start=%d, yielding tokens\n", phrase_start);
-                    state = SEARCH_STATE_NO_MATCH;
-                    phrase_start = phrase_len = 0;
-                    node_id = last_node_id = start_node_id;
-                    node = last_node = trie_get_node(self, start_node_id);
-                } else {
-                    log_debug("Has continuation, node_id=%d\n", continuation_id);
-                    last_node = node = continuation;
-                    last_node_id = node_id = continuation_id;
-                }            
+    return true;
+}
+
+/*
+Runs several token searches over the same tokens in a single pass. At each
+step, every search positioned on the earliest token any of them still needs
+processes it, so all the tries walk the tokens together and a search only
+falls behind while it backtracks after a partial match. Each search finds
+exactly the phrases trie_search_tokens_from_index would.
+*/
+bool trie_search_tokens_multi(trie_token_search_t *searches, size_t num_searches, char *str, token_array *tokens) {
+    if (str == NULL || tokens == NULL || tokens->n == 0) return false;
+
+    while (true) {
+        int min_index = -1;
+        for (size_t s = 0; s < num_searches; s++) {
+            if (!searches[s].done && (min_index == -1 || searches[s].i < min_index)) {
+                min_index = searches[s].i;
             }
         }
 
-    }
+        if (min_index == -1) break;
 
-    if (last_match_index != -1) {
-        if (*phrases == NULL) {
-            *phrases = phrase_array_new_size(1);
+        for (size_t s = 0; s < num_searches; s++) {
+            trie_token_search_t *search = searches + s;
+            if (search->done || search->i != min_index) continue;
+
+            if (!trie_token_search_step(search, str, tokens)) {
+                trie_token_search_finish(search);
+            }
         }
-        phrase_array_push(*phrases, (phrase_t){phrase_start, last_match_index - phrase_start + 1, data});
-   }
+    }
 
     return true;
 }
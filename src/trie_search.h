@@ -27,12 +27,40 @@ VECTOR_INIT(phrase_array, phrase_t)
 
 #define NULL_PHRASE (phrase_t){0, 0, 0};
 
+typedef enum {
+    SEARCH_STATE_BEGIN,
+    SEARCH_STATE_NO_MATCH,
+    SEARCH_STATE_PARTIAL_MATCH,
+    SEARCH_STATE_MATCH
+} trie_search_state_t;
+
+// State of a token search in one trie, see trie_search_tokens_multi
+typedef struct trie_token_search {
+    trie_t *trie;
+    uint32_t start_node_id;
+    phrase_array **phrases;
+    int i;
+    uint32_t node_id;
+    uint32_t last_node_id;
+    trie_node_t node;
+    trie_node_t last_node;
+    uint32_t data;
+    int phrase_len;
+    int phrase_start;
+    int last_match_index;
+    trie_search_state_t state;
+    trie_search_state_t last_state;
+    bool done;
+} trie_token_search_t;
+
 phrase_array *trie_search(trie_t *self, char *text);
 bool trie_search_from_index(trie_t *self, char *text, uint32_t start_node_id, phrase_array **phrases);
 bool trie_search_with_phrases(trie_t *self, char *text, phrase_array **phrases);
 phrase_array *trie_search_tokens(trie_t *self, char *str, token_array *tokens);
 bool trie_search_tokens_from_index(trie_t *self, char *str, token_array *tokens, uint32_t start_node_id, phrase_array **phrases);
 bool trie_search_tokens_with_phrases(trie_t *self, char *text, token_array *tokens, phrase_array **phrases);
+void trie_token_search_init(trie_token_search_t *search, trie_t *trie, uint32_t start_node_id, phrase_array **phrases);
+bool trie_search_tokens_multi(trie_token_search_t *searches, size_t num_searches, char *str, token_array *tokens);
 phrase_t trie_search_suffixes_from_index(trie_t *self, char *word, size_t len, uint32_t start_node_id);
 phrase_t trie_search_suffixes_from_index_get_suffix_char(trie_t *self, char *word, size_t len, uint32_t start_node_id);
 phrase_t trie_search_suffixes(trie_t *self, char *word, size_t len);
@@ -1,6 +1,8 @@
 #ifndef VECTOR_H
 #define VECTOR_H
 
+#include "arena.h"
+
 #define DEFAULT_VECTOR_SIZE 8
 
 #if defined(_MSC_VER) || defined(__MINGW32__) || defined(__MINGW64__)
@@ -28,12 +30,19 @@ static inline void _aligned_free(void *p)
 #define CONST_128D(var, val) \
     MIE_ALIGN(16) static const double var[2] = {(val), (val)}
 
+static inline void *_vector_realloc(arena_t *arena, void *ptr, size_t old_size, size_t new_size) {
+    if (arena == NULL) return realloc(ptr, new_size);
+    return arena_realloc(arena, ptr, old_size, new_size);
+}
+
 // Based kvec.h, dynamic vectors of any type
-#define __VECTOR_BASE(name, type) typedef struct { size_t n, m; type *a; } name;    \
+// Vectors created with name##_new_size_arena allocate from the arena (see arena.h)
+#define __VECTOR_BASE(name, type) typedef struct { size_t n, m; type *a; arena_t *arena; } name;    \
     static inline name *name##_new_size(size_t size) {                              \
         name *array = malloc(sizeof(name));                                         \
         if (array == NULL) return NULL;                                             \
         array->n = array->m = 0;                                                    \
+        array->arena = NULL;                                                        \
         array->a = malloc(size * sizeof(type));                                     \
         if (array->a == NULL) return NULL;                                          \
         array->m = size;                                                            \
@@ -42,10 +51,21 @@ static inline void _aligned_free(void *p)
     static inline name *name##_new(void) {                                          \
         return name##_new_size(DEFAULT_VECTOR_SIZE);                                \
     }                                                                               \
+    static inline name *name##_new_size_arena(arena_t *arena, size_t size) {        \
+        name *array = arena_alloc(arena, sizeof(name));                             \
+        if (array == NULL) return NULL;                                             \
+        array->n = array->m = 0;                                                    \
+        array->arena = arena;                                                       \
+        array->a = arena_alloc(arena, size * sizeof(type));                         \
+        if (array->a == NULL) return NULL;                                          \
+        array->m = size;                                                            \
+        return array;                                                               \
+    }                                                                               \
     static inline name *name##_new_aligned(size_t size, size_t alignment) {         \
         name *array = malloc(sizeof(name));                                         \
         if (array == NULL) return NULL;                                             \
         array->n = array->m = 0;                                                    \
+        array->arena = NULL;                                                        \
         array->a = _aligned_malloc(size * sizeof(type), alignment);                 \
         if (array->a == NULL) return NULL;                                          \
         array->m = size;                                                            \
@@ -53,7 +73,7 @@ static inline void _aligned_free(void *p)
     }                                                                               \
     static inline void name##_resize(name *array, size_t size) {                    \
         if (size <= array->m) return;                                               \
-        type *ptr = realloc(array->a, sizeof(type) * size);                         \
+        type *ptr = _vector_realloc(array->arena, array->a, sizeof(type) * array->m, sizeof(type) * size); \
         if (ptr == NULL) return;                                                    \
         array->a = ptr;                                                             \
         array->m = size;                                                            \
@@ -61,7 +81,7 @@ static inline void _aligned_free(void *p)
     static inline void name##_push(name *array, type value) {                       \
         if (array->n == array->m) {                                                 \
             size_t size = array->m ? array->m << 1 : 2;                             \
-            type *ptr = realloc(array->a, sizeof(type) * size);                     \
+            type *ptr = _vector_realloc(array->arena, array->a, sizeof(type) * array->m, sizeof(type) * size); \
             if (ptr == NULL) return;                                                \
             array->a = ptr;                                                         \
             array->m = size;                                                        \
@@ -93,7 +113,7 @@ static inline void _aligned_free(void *p)
 
 #define __VECTOR_DESTROY(name, type)                                    \
     static inline void name##_destroy(name *array) {                    \
-        if (array == NULL) return;                                      \
+        if (array == NULL || array->arena != NULL) return;              \
         if (array->a != NULL) free(array->a);                           \
         free(array);                                                    \
     }
@@ -101,7 +121,7 @@ static inline void _aligned_free(void *p)
 
 #define __VECTOR_DESTROY_FREE_DATA(name, type, free_func)               \
     static inline void name##_destroy(name *array) {                    \
-        if (array == NULL) return;                                      \
+        if (array == NULL || array->arena != NULL) return;              \
         if (array->a != NULL) {                                         \
             for (int i = 0; i < array->n; i++) {                        \
                 free_func(array->a[i]);                                 \
@@ -5,6 +5,13 @@ SUITE_EXTERN(libpostal_parser_tests);
 SUITE_EXTERN(libpostal_transliteration_tests);
 SUITE_EXTERN(libpostal_numex_tests);
 SUITE_EXTERN(libpostal_trie_tests);
+SUITE_EXTERN(libpostal_arena_tests);
+SUITE_EXTERN(libpostal_data_bundle_tests);
+SUITE_EXTERN(libpostal_address_dictionary_tests);
+SUITE_EXTERN(libpostal_server_tests);
+SUITE_EXTERN(libpostal_result_cache_tests);
+SUITE_EXTERN(libpostal_averaged_perceptron_tests);
+SUITE_EXTERN(libpostal_feature_index_tests);
 
 GREATEST_MAIN_DEFS();
 
@@ -17,5 +24,12 @@ int main(int argc, char **argv) {
     RUN_SUITE(libpostal_transliteration_tests);
     RUN_SUITE(libpostal_numex_tests);
     RUN_SUITE(libpostal_trie_tests);
+    RUN_SUITE(libpostal_arena_tests);
+    RUN_SUITE(libpostal_data_bundle_tests);
+    RUN_SUITE(libpostal_address_dictionary_tests);
+    RUN_SUITE(libpostal_server_tests);
+    RUN_SUITE(libpostal_result_cache_tests);
+    RUN_SUITE(libpostal_averaged_perceptron_tests);
+    RUN_SUITE(libpostal_feature_index_tests);
     GREATEST_MAIN_END();
 }
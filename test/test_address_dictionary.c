@@ -0,0 +1,115 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "greatest.h"
+#include "../src/address_dictionary.h"
+#include "../src/file_utils.h"
+
+SUITE(libpostal_address_dictionary_tests);
+
+#define ADDRESS_DICTIONARY_PARTITIONED_SIGNATURE 0xBABABABB
+
+static bool add_test_expansion(char *name, char *language, int32_t canonical_index) {
+    address_expansion_t expansion = (address_expansion_t){0};
+    expansion.canonical_index = canonical_index;
+    if (language != NULL) {
+        strcpy(expansion.language, language);
+    }
+    expansion.num_dictionaries = 1;
+    expansion.dictionary_ids[0] = DICTIONARY_STREET_TYPE;
+    expansion.address_components = ADDRESS_STREET;
+    expansion.separable = false;
+
+    return address_dictionary_add_expansion(name, language, expansion);
+}
+
+static greatest_test_res write_test_dictionary(char *path) {
+    ASSERT(address_dictionary_init());
+
+    ASSERT(address_dictionary_add_canonical("street"));
+    ASSERT(address_dictionary_add_canonical("strasse"));
+    ASSERT(address_dictionary_add_canonical("rue"));
+
+    ASSERT(add_test_expansion("st", "en", 0));
+    ASSERT(add_test_expansion("street", "en", NULL_CANONICAL_INDEX));
+    ASSERT(add_test_expansion("str", "de", 1));
+    ASSERT(add_test_expansion("r", "fr", 2));
+    ASSERT(add_test_expansion("and", ALL_LANGUAGES, NULL_CANONICAL_INDEX));
+    // Base namespace, added without a language
+    ASSERT(add_test_expansion("hunkins", NULL, NULL_CANONICAL_INDEX));
+
+    ASSERT(address_dictionary_save(path));
+    address_dictionary_module_teardown();
+
+    PASS();
+}
+
+TEST test_address_dictionary_partitioned(void) {
+    char path[] = "/tmp/libpostal_address_dictionary_XXXXXX";
+    int fd = mkstemp(path);
+    ASSERT(fd >= 0);
+    close(fd);
+
+    CHECK_CALL(write_test_dictionary(path));
+
+    FILE *f = fopen(path, "rb");
+    ASSERT(f != NULL);
+    uint32_t signature;
+    ASSERT(file_read_uint32(f, &signature));
+    fclose(f);
+    ASSERT_EQ(ADDRESS_DICTIONARY_PARTITIONED_SIGNATURE, signature);
+
+    char *languages[] = {"en"};
+    ASSERT(address_dictionary_load_languages(path, languages, 1));
+
+    // en, the base namespace and ALL_LANGUAGES, not de or fr
+    address_dictionary_t *address_dict = get_address_dictionary();
+    ASSERT(address_dict != NULL);
+    ASSERT(address_dict->slices != NULL);
+    ASSERT_EQ(5, address_dict->slices->n);
+    ASSERT_EQ(3, address_dictionary_num_loaded_languages());
+
+    address_expansion_array *expansions = address_dictionary_get_expansions("en|st");
+    ASSERT(expansions != NULL);
+    ASSERT_EQ(1, expansions->n);
+    ASSERT_STR_EQ("street", address_dictionary_get_canonical(expansions->a[0].canonical_index));
+    ASSERT(address_dictionary_get_expansions("en|street") != NULL);
+    ASSERT(address_dictionary_get_expansions("all|and") != NULL);
+    ASSERT(address_dictionary_get_expansions("hunkins") != NULL);
+    ASSERT(address_dictionary_get_expansions("en|missing") == NULL);
+    ASSERT(address_dictionary_get_expansions("xx|st") == NULL);
+    ASSERT_EQ(3, address_dictionary_num_loaded_languages());
+
+    // Other languages are read on first lookup, once
+    expansions = address_dictionary_get_expansions("de|str");
+    ASSERT(expansions != NULL);
+    ASSERT_STR_EQ("strasse", address_dictionary_get_canonical(expansions->a[0].canonical_index));
+    ASSERT_EQ(4, address_dictionary_num_loaded_languages());
+    ASSERT_EQ(expansions, address_dictionary_get_expansions("de|str"));
+    ASSERT_EQ(4, address_dictionary_num_loaded_languages());
+
+    // The trie is complete regardless of which slices are loaded
+    ASSERT(trie_get(address_dict->trie, "fr|r") != NULL_NODE_ID);
+
+    address_dictionary_module_teardown();
+
+    // A full load reads every slice into one table
+    ASSERT(address_dictionary_load(path));
+    ASSERT(get_address_dictionary()->slices == NULL);
+    ASSERT_EQ(0, address_dictionary_num_loaded_languages());
+    ASSERT(address_dictionary_get_expansions("fr|r") != NULL);
+    ASSERT(address_dictionary_get_expansions("hunkins") != NULL);
+    address_dictionary_module_teardown();
+
+    ASSERT_EQ(0, unlink(path));
+
+    PASS();
+}
+
+GREATEST_SUITE(libpostal_address_dictionary_tests) {
+    RUN_TEST(test_address_dictionary_partitioned);
+}
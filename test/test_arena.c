@@ -0,0 +1,142 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "greatest.h"
+#include "../src/arena.h"
+#include "../src/string_utils.h"
+
+SUITE(libpostal_arena_tests);
+
+TEST test_arena_alloc(void) {
+    arena_t *arena = arena_new(1024);
+    ASSERT(arena != NULL);
+
+    char *a = arena_alloc(arena, 3);
+    char *b = arena_alloc(arena, 5);
+    ASSERT(a != NULL);
+    ASSERT(b != NULL);
+    ASSERT_EQ(0, (uintptr_t)a % 16);
+    ASSERT_EQ(0, (uintptr_t)b % 16);
+    ASSERT(b >= a + 3);
+
+    char *s = arena_strdup(arena, "main street");
+    ASSERT_STR_EQ("main street", s);
+
+    // Growing the most recent allocation stays in place
+    char *grown = arena_realloc(arena, s, strlen(s) + 1, 64);
+    ASSERT_EQ(s, grown);
+    ASSERT_STR_EQ("main street", grown);
+
+    // Growing an older allocation copies it
+    memcpy(a, "ab", 3);
+    char *moved = arena_realloc(arena, a, 3, 32);
+    ASSERT(moved != a);
+    ASSERT_STR_EQ("ab", moved);
+
+    // Larger than a block gets a block of its own
+    size_t capacity = arena_capacity(arena);
+    char *large = arena_alloc(arena, 4096);
+    ASSERT(large != NULL);
+    memset(large, 'x', 4096);
+    ASSERT(arena_capacity(arena) >= capacity + 4096);
+
+    arena_destroy(arena);
+    PASS();
+}
+
+TEST test_arena_reset(void) {
+    arena_t *arena = arena_new(256);
+    ASSERT(arena != NULL);
+
+    char *first = arena_alloc(arena, 16);
+    // Spill into a few more blocks
+    for (size_t i = 0; i < 32; i++) {
+        ASSERT(arena_alloc(arena, 64) != NULL);
+    }
+    size_t capacity = arena_capacity(arena);
+    ASSERT(capacity > 256);
+
+    ASSERT(arena_alloc(arena, 1024) != NULL);
+    ASSERT(arena_capacity(arena) > capacity);
+
+    arena_reset(arena);
+
+    // Regular blocks are kept, the large block is released
+    ASSERT_EQ(capacity, arena_capacity(arena));
+    ASSERT_EQ(first, arena_alloc(arena, 16));
+
+    // Refilling the same amount reuses the kept blocks
+    for (size_t i = 0; i < 32; i++) {
+        ASSERT(arena_alloc(arena, 64) != NULL);
+    }
+    ASSERT_EQ(capacity, arena_capacity(arena));
+
+    arena_destroy(arena);
+    PASS();
+}
+
+static greatest_test_res test_arena_expand_call(arena_t *arena, char *expected) {
+    // Same shape of scratch usage as one expand_address call
+    string_tree_t *tree = string_tree_new_size_arena(arena, 4);
+    ASSERT(tree != NULL);
+    string_tree_add_string(tree, "main");
+    string_tree_finalize_token(tree);
+    string_tree_add_string(tree, "st");
+    string_tree_add_string(tree, "street");
+    string_tree_add_string(tree, "saint");
+    string_tree_finalize_token(tree);
+
+    string_tree_iterator_t *iter = string_tree_iterator_new_arena(arena, tree);
+    ASSERT(iter != NULL);
+
+    char_array *str = char_array_new_size_arena(arena, 16);
+    cstring_array *strings = cstring_array_new_size_arena(arena, 16);
+
+    for (; string_tree_iterator_done(iter); string_tree_iterator_next(iter)) {
+        char_array_clear(str);
+        char_array_append(str, string_tree_iterator_get_string(iter, 0));
+        char_array_append(str, " ");
+        char_array_append(str, string_tree_iterator_get_string(iter, 1));
+        char_array_terminate(str);
+        cstring_array_add_string(strings, char_array_get_string(str));
+    }
+
+    ASSERT_EQ(3, cstring_array_num_strings(strings));
+    ASSERT_STR_EQ(expected, cstring_array_get_string(strings, 0));
+
+    // Destroying arena-backed objects is a no-op, arena_reset releases them
+    string_tree_iterator_destroy(iter);
+    string_tree_destroy(tree);
+    cstring_array_destroy(strings);
+    char_array_destroy(str);
+
+    arena_reset(arena);
+    PASS();
+}
+
+TEST test_arena_reuse_across_calls(void) {
+    arena_t *arena = arena_new(512);
+    ASSERT(arena != NULL);
+
+    CHECK_CALL(test_arena_expand_call(arena, "main st"));
+    size_t capacity = arena_capacity(arena);
+
+    for (size_t i = 0; i < 100; i++) {
+        CHECK_CALL(test_arena_expand_call(arena, "main st"));
+    }
+
+    // Repeated calls settle into the same set of blocks
+    ASSERT_EQ(capacity, arena_capacity(arena));
+
+    arena_destroy(arena);
+    PASS();
+}
+
+GREATEST_SUITE(libpostal_arena_tests) {
+    RUN_TEST(test_arena_alloc);
+    RUN_TEST(test_arena_reset);
+    RUN_TEST(test_arena_reuse_across_calls);
+}
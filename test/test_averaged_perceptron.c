@@ -0,0 +1,885 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+
+#include "greatest.h"
+#include "test_averaged_perceptron.h"
+#include "../src/averaged_perceptron.h"
+#include "../src/averaged_perceptron_trainer.h"
+#include "../src/features.h"
+#include "../src/file_utils.h"
+
+SUITE(libpostal_averaged_perceptron_tests);
+
+// 10 classes pad to a row width of 12, which leaves a half-width block for the AVX2 kernels
+#define TEST_NUM_CLASSES 10
+// More than one batch of rows per prediction
+#define TEST_NUM_FEATURES 100
+
+double test_perceptron_weight(uint32_t feature_id, uint32_t class_id) {
+    uint32_t h = (feature_id * 31 + class_id * 17) % 11;
+    if (h == 0) return 0.0;
+    return ((double)h - 5.5) * (double)(1 + feature_id % 3) / 4.0;
+}
+
+averaged_perceptron_t *test_perceptron_new(uint32_t num_features, uint32_t num_classes, double (*weight)(uint32_t, uint32_t)) {
+    averaged_perceptron_t *model = calloc(1, sizeof(averaged_perceptron_t));
+    if (model == NULL) return NULL;
+
+    model->num_features = num_features;
+    model->num_classes = num_classes;
+    model->layout = AVERAGED_PERCEPTRON_LAYOUT_SPARSE;
+    model->features = trie_new();
+    model->classes = cstring_array_new();
+    model->weights = sparse_matrix_new();
+    model->scores = double_array_new_zeros(num_classes);
+
+    char name[32];
+    for (uint32_t class_id = 0; class_id < num_classes; class_id++) {
+        snprintf(name, sizeof(name), "class %u", class_id);
+        cstring_array_add_string(model->classes, name);
+    }
+
+    for (uint32_t feature_id = 0; feature_id < num_features; feature_id++) {
+        snprintf(name, sizeof(name), "feature %u", feature_id);
+        if (!trie_add(model->features, name, feature_id)) {
+            averaged_perceptron_destroy(model);
+            return NULL;
+        }
+
+        for (uint32_t class_id = 0; class_id < num_classes; class_id++) {
+            double value = weight(feature_id, class_id);
+            if (fabs(value) > 0.0) {
+                sparse_matrix_append(model->weights, class_id, value);
+            }
+        }
+        sparse_matrix_finalize_row(model->weights);
+    }
+
+    return model;
+}
+
+// A few feature sets: a single feature, every feature, every third feature plus one the model doesn't have
+static cstring_array **test_feature_sets_new(size_t *num_sets) {
+    size_t n = 3;
+    cstring_array **sets = malloc(sizeof(cstring_array *) * n);
+    char name[32];
+
+    sets[0] = cstring_array_new();
+    cstring_array_add_string(sets[0], "feature 7");
+
+    sets[1] = cstring_array_new();
+    for (uint32_t i = 0; i < TEST_NUM_FEATURES; i++) {
+        snprintf(name, sizeof(name), "feature %u", i);
+        cstring_array_add_string(sets[1], name);
+    }
+
+    sets[2] = cstring_array_new();
+    for (uint32_t i = 0; i < TEST_NUM_FEATURES; i += 3) {
+        snprintf(name, sizeof(name), "feature %u", i);
+        cstring_array_add_string(sets[2], name);
+    }
+    cstring_array_add_string(sets[2], "missing feature");
+
+    *num_sets = n;
+    return sets;
+}
+
+static void test_feature_sets_destroy(cstring_array **sets, size_t num_sets) {
+    for (size_t i = 0; i < num_sets; i++) {
+        cstring_array_destroy(sets[i]);
+    }
+    free(sets);
+}
+
+// Scores of each feature set, concatenated
+static double_array *test_perceptron_scores(averaged_perceptron_t *model, cstring_array **sets, size_t num_sets) {
+    double_array *all_scores = double_array_new();
+    double_array *scores = double_array_new();
+    for (size_t i = 0; i < num_sets; i++) {
+        averaged_perceptron_predict_scores_r(model, sets[i], scores);
+        double_array_extend(all_scores, scores);
+    }
+    double_array_destroy(scores);
+    return all_scores;
+}
+
+static greatest_test_res test_scores_within(double_array *expected, double_array *scores, double tolerance) {
+    ASSERT_EQ(expected->n, scores->n);
+    for (size_t i = 0; i < expected->n; i++) {
+        ASSERT_IN_RANGE(expected->a[i], scores->a[i], tolerance);
+    }
+    PASS();
+}
+
+static greatest_test_res test_file_signature(char *path, uint32_t expected) {
+    FILE *f = fopen(path, "rb");
+    ASSERT(f != NULL);
+    uint32_t signature;
+    ASSERT(file_read_uint32(f, &signature));
+    fclose(f);
+    ASSERT_EQ(expected, signature);
+    PASS();
+}
+
+TEST test_averaged_perceptron_dense(void) {
+    averaged_perceptron_t *model = test_perceptron_new(TEST_NUM_FEATURES, TEST_NUM_CLASSES, test_perceptron_weight);
+    ASSERT(model != NULL);
+
+    size_t num_sets;
+    cstring_array **sets = test_feature_sets_new(&num_sets);
+    double_array *sparse_scores = test_perceptron_scores(model, sets, num_sets);
+    size_t sparse_size = averaged_perceptron_weights_size(model);
+
+    ASSERT(averaged_perceptron_to_dense(model));
+    ASSERT_EQ(AVERAGED_PERCEPTRON_LAYOUT_DENSE, model->layout);
+    ASSERT_EQ(12, model->row_width);
+    ASSERT(model->weights == NULL);
+    ASSERT_EQ(TEST_NUM_FEATURES * 12 * sizeof(float), averaged_perceptron_weights_size(model));
+    ASSERT(averaged_perceptron_weights_size(model) != sparse_size);
+
+    // Padding stays zero
+    float zeros[2] = {0.0f, 0.0f};
+    for (uint32_t feature_id = 0; feature_id < TEST_NUM_FEATURES; feature_id++) {
+        float *row = model->dense_weights->a + feature_id * model->row_width;
+        ASSERT_EQ(0, memcmp(zeros, row + TEST_NUM_CLASSES, sizeof(zeros)));
+    }
+
+    // Weights are rounded to float, summed in float
+    double_array *dense_scores = test_perceptron_scores(model, sets, num_sets);
+    CHECK_CALL(test_scores_within(sparse_scores, dense_scores, 1e-4));
+
+    for (size_t i = 0; i < num_sets; i++) {
+        uint32_t expected = (uint32_t)double_array_argmax(sparse_scores->a + i * TEST_NUM_CLASSES, TEST_NUM_CLASSES);
+        ASSERT_EQ(expected, averaged_perceptron_predict(model, sets[i]));
+    }
+
+    // Converting again is a no-op
+    ASSERT(averaged_perceptron_to_dense(model));
+
+    double_array_destroy(sparse_scores);
+    double_array_destroy(dense_scores);
+    test_feature_sets_destroy(sets, num_sets);
+    averaged_perceptron_destroy(model);
+    PASS();
+}
+
+static greatest_test_res test_float_rows_sum_equals(float_rows_sum_function expected_function, float_rows_sum_function rows_sum, size_t row_width) {
+    size_t num_rows = 9;
+    float_array *weights = float_array_new_aligned(num_rows * row_width, AVERAGED_PERCEPTRON_KERNEL_ALIGNMENT);
+    ASSERT(weights != NULL);
+    for (size_t i = 0; i < num_rows * row_width; i++) {
+        weights->a[i] = (float)test_perceptron_weight((uint32_t)(i / row_width), (uint32_t)(i % row_width)) + 1e-3f * (float)i;
+    }
+
+    // Repeated rows and rows out of order
+    uint32_t rows[] = {3, 0, 8, 3, 5, 1, 7, 7, 2};
+    size_t num_ids = sizeof(rows) / sizeof(uint32_t);
+
+    float expected[row_width];
+    float sums[row_width];
+    for (size_t j = 0; j < row_width; j++) {
+        // Kernels add to the sums rather than overwrite them
+        expected[j] = sums[j] = (float)j;
+    }
+
+    expected_function(weights->a, row_width, rows, num_ids, expected);
+    rows_sum(weights->a, row_width, rows, num_ids, sums);
+
+    // Each column adds the same values in the same order, the results are identical
+    ASSERT_EQ(0, memcmp(expected, sums, sizeof(sums)));
+
+    float_array_destroy(weights);
+    PASS();
+}
+
+TEST test_averaged_perceptron_float_kernels(void) {
+    float_rows_sum_function scalar = float_rows_sum_function_get(AVERAGED_PERCEPTRON_KERNELS_SCALAR);
+    ASSERT(scalar != NULL);
+    ASSERT(float_rows_sum_function_select() != NULL);
+
+    averaged_perceptron_kernels_isa_t isas[] = {AVERAGED_PERCEPTRON_KERNELS_SCALAR, AVERAGED_PERCEPTRON_KERNELS_SSE2, AVERAGED_PERCEPTRON_KERNELS_AVX2};
+    // Full AVX2 blocks only, a half-width block only, both
+    size_t row_widths[] = {4, 8, 12, 16, 20};
+
+    for (size_t i = 0; i < sizeof(isas) / sizeof(isas[0]); i++) {
+        float_rows_sum_function rows_sum = float_rows_sum_function_get(isas[i]);
+        // Not supported on this machine
+        if (rows_sum == NULL) continue;
+
+        for (size_t j = 0; j < sizeof(row_widths) / sizeof(size_t); j++) {
+            CHECK_CALL(test_float_rows_sum_equals(scalar, rows_sum, row_widths[j]));
+        }
+    }
+
+    PASS();
+}
+
+TEST test_averaged_perceptron_dense_save_load(void) {
+    char path[] = "/tmp/libpostal_averaged_perceptron_XXXXXX";
+    int fd = mkstemp(path);
+    ASSERT(fd >= 0);
+    close(fd);
+
+    averaged_perceptron_t *model = test_perceptron_new(TEST_NUM_FEATURES, TEST_NUM_CLASSES, test_perceptron_weight);
+    ASSERT(model != NULL);
+    ASSERT(averaged_perceptron_to_dense(model));
+
+    size_t num_sets;
+    cstring_array **sets = test_feature_sets_new(&num_sets);
+    double_array *scores = test_perceptron_scores(model, sets, num_sets);
+
+    ASSERT(averaged_perceptron_save(model, path));
+    CHECK_CALL(test_file_signature(path, PERCEPTRON_DENSE_SIGNATURE));
+
+    averaged_perceptron_t *loaded = averaged_perceptron_load(path);
+    ASSERT(loaded != NULL);
+    ASSERT_EQ(AVERAGED_PERCEPTRON_LAYOUT_DENSE, loaded->layout);
+    ASSERT_EQ(model->num_features, loaded->num_features);
+    ASSERT_EQ(model->num_classes, loaded->num_classes);
+    ASSERT_EQ(model->row_width, loaded->row_width);
+    ASSERT(loaded->rows_sum != NULL);
+    ASSERT(loaded->weights == NULL);
+    ASSERT_EQ(model->dense_weights->n, loaded->dense_weights->n);
+    ASSERT_EQ(0, memcmp(model->dense_weights->a, loaded->dense_weights->a, model->dense_weights->n * sizeof(float)));
+    ASSERT_STR_EQ("class 3", cstring_array_get_string(loaded->classes, 3));
+
+    double_array *loaded_scores = test_perceptron_scores(loaded, sets, num_sets);
+    ASSERT_EQ(scores->n, loaded_scores->n);
+    ASSERT_EQ(0, memcmp(scores->a, loaded_scores->a, scores->n * sizeof(double)));
+
+    double_array_destroy(scores);
+    double_array_destroy(loaded_scores);
+    test_feature_sets_destroy(sets, num_sets);
+    averaged_perceptron_destroy(model);
+    averaged_perceptron_destroy(loaded);
+
+    ASSERT_EQ(0, unlink(path));
+    PASS();
+}
+
+static uint32_t test_num_known_features(averaged_perceptron_t *model, cstring_array *features) {
+    uint32_t num_known = 0;
+    uint32_t feature_id;
+    for (uint32_t i = 0; i < cstring_array_num_strings(features); i++) {
+        if (trie_get_data(model->features, cstring_array_get_string(features, i), &feature_id)) {
+            num_known++;
+        }
+    }
+    return num_known;
+}
+
+static int32_t test_quantized_weight(averaged_perceptron_t *model, size_t offset) {
+    return model->layout == AVERAGED_PERCEPTRON_LAYOUT_INT8 ? (int32_t)model->int8_weights->a[offset] : (int32_t)model->int16_weights->a[offset];
+}
+
+static greatest_test_res test_quantized_scores(uint32_t bits) {
+    averaged_perceptron_t *model = test_perceptron_new(TEST_NUM_FEATURES, TEST_NUM_CLASSES, test_perceptron_weight);
+    ASSERT(model != NULL);
+    ASSERT(averaged_perceptron_to_dense(model));
+
+    size_t num_sets;
+    cstring_array **sets = test_feature_sets_new(&num_sets);
+    double_array *dense_scores = test_perceptron_scores(model, sets, num_sets);
+
+    ASSERT(averaged_perceptron_quantize(model, bits));
+    ASSERT_EQ(bits == 8 ? AVERAGED_PERCEPTRON_LAYOUT_INT8 : AVERAGED_PERCEPTRON_LAYOUT_INT16, model->layout);
+    ASSERT_EQ(12, model->row_width);
+    ASSERT(model->dense_weights == NULL);
+    ASSERT_EQ(TEST_NUM_FEATURES * 12 * (bits / 8) + TEST_NUM_CLASSES * sizeof(float), averaged_perceptron_weights_size(model));
+
+    // The largest weight of each class maps to the largest integer
+    int32_t max_value = bits == 8 ? INT8_MAX : INT16_MAX;
+    for (uint32_t class_id = 0; class_id < TEST_NUM_CLASSES; class_id++) {
+        int32_t max_quantized = 0;
+        for (uint32_t feature_id = 0; feature_id < TEST_NUM_FEATURES; feature_id++) {
+            int32_t value = abs(test_quantized_weight(model, (size_t)feature_id * model->row_width + class_id));
+            if (value > max_quantized) {
+                max_quantized = value;
+            }
+        }
+        ASSERT_EQ(max_value, max_quantized);
+    }
+
+    /*
+    Each weight is rounded to the nearest multiple of its class scale, off
+    by at most half a scale, so a score summing n weights of class c is off
+    by at most n * class_scales[c] / 2, plus float rounding
+    */
+    double_array *quantized_scores = test_perceptron_scores(model, sets, num_sets);
+    ASSERT_EQ(dense_scores->n, quantized_scores->n);
+
+    for (size_t i = 0; i < num_sets; i++) {
+        uint32_t num_known = test_num_known_features(model, sets[i]);
+        for (uint32_t class_id = 0; class_id < TEST_NUM_CLASSES; class_id++) {
+            double tolerance = num_known * (double)model->class_scales->a[class_id] / 2.0 + 1e-4;
+            size_t index = i * TEST_NUM_CLASSES + class_id;
+            ASSERT_IN_RANGE(dense_scores->a[index], quantized_scores->a[index], tolerance);
+        }
+    }
+
+    double_array_destroy(dense_scores);
+    double_array_destroy(quantized_scores);
+    test_feature_sets_destroy(sets, num_sets);
+    averaged_perceptron_destroy(model);
+    PASS();
+}
+
+TEST test_averaged_perceptron_quantize(void) {
+    CHECK_CALL(test_quantized_scores(8));
+    CHECK_CALL(test_quantized_scores(16));
+
+    averaged_perceptron_t *model = test_perceptron_new(TEST_NUM_FEATURES, TEST_NUM_CLASSES, test_perceptron_weight);
+    ASSERT(model != NULL);
+    ASSERT_FALSE(averaged_perceptron_quantize(model, 4));
+    ASSERT_EQ(AVERAGED_PERCEPTRON_LAYOUT_SPARSE, model->layout);
+
+    // Quantizing straight from the sparse layout, then again to the other width
+    ASSERT(averaged_perceptron_quantize(model, 16));
+    ASSERT(averaged_perceptron_quantize(model, 8));
+    ASSERT_EQ(AVERAGED_PERCEPTRON_LAYOUT_INT8, model->layout);
+    ASSERT(model->int16_weights == NULL);
+    averaged_perceptron_destroy(model);
+
+    PASS();
+}
+
+#define TEST_INT_ROWS 9
+
+// Rows out of order and repeated
+static uint32_t test_int_rows[] = {3, 0, 8, 3, 5, 1, 7, 7, 2};
+
+// Sums start away from zero since the kernels add to them
+static void test_int_sums_init(int32_t *expected, int32_t *sums, size_t row_width) {
+    for (size_t j = 0; j < row_width; j++) {
+        expected[j] = sums[j] = -1000 * (int32_t)j;
+    }
+}
+
+static greatest_test_res test_int8_rows_sum_equals(int8_rows_sum_function rows_sum, size_t row_width) {
+    int8_array *weights = int8_array_new_aligned(TEST_INT_ROWS * row_width, AVERAGED_PERCEPTRON_KERNEL_ALIGNMENT);
+    ASSERT(weights != NULL);
+    // Covers the whole range, INT8_MIN and -1 included
+    for (size_t i = 0; i < TEST_INT_ROWS * row_width; i++) {
+        weights->a[i] = (int8_t)((int32_t)((i * 37) % 256) - 128);
+    }
+    weights->a[0] = INT8_MIN;
+    weights->a[1] = -1;
+
+    int32_t expected[row_width];
+    int32_t sums[row_width];
+
+    // A single row is sign-extended as is
+    test_int_sums_init(expected, sums, row_width);
+    uint32_t first_row = 0;
+    rows_sum(weights->a, row_width, &first_row, 1, sums);
+    for (size_t j = 0; j < row_width; j++) {
+        ASSERT_EQ(expected[j] + (int32_t)weights->a[j], sums[j]);
+    }
+    ASSERT_EQ(-128, sums[0]);
+    ASSERT_EQ(-1001, sums[1]);
+
+    size_t num_ids = sizeof(test_int_rows) / sizeof(uint32_t);
+    test_int_sums_init(expected, sums, row_width);
+    for (size_t i = 0; i < num_ids; i++) {
+        for (size_t j = 0; j < row_width; j++) {
+            expected[j] += weights->a[test_int_rows[i] * row_width + j];
+        }
+    }
+
+    rows_sum(weights->a, row_width, test_int_rows, num_ids, sums);
+    for (size_t j = 0; j < row_width; j++) {
+        ASSERT_EQ(expected[j], sums[j]);
+    }
+
+    int8_array_destroy(weights);
+    PASS();
+}
+
+static greatest_test_res test_int16_rows_sum_equals(int16_rows_sum_function rows_sum, size_t row_width) {
+    int16_array *weights = int16_array_new_aligned(TEST_INT_ROWS * row_width, AVERAGED_PERCEPTRON_KERNEL_ALIGNMENT);
+    ASSERT(weights != NULL);
+    for (size_t i = 0; i < TEST_INT_ROWS * row_width; i++) {
+        weights->a[i] = (int16_t)((int32_t)((i * 7919) % 65536) - 32768);
+    }
+    weights->a[0] = INT16_MIN;
+    weights->a[1] = -1;
+
+    int32_t expected[row_width];
+    int32_t sums[row_width];
+
+    test_int_sums_init(expected, sums, row_width);
+    uint32_t first_row = 0;
+    rows_sum(weights->a, row_width, &first_row, 1, sums);
+    for (size_t j = 0; j < row_width; j++) {
+        ASSERT_EQ(expected[j] + (int32_t)weights->a[j], sums[j]);
+    }
+    ASSERT_EQ(-32768, sums[0]);
+    ASSERT_EQ(-1001, sums[1]);
+
+    size_t num_ids = sizeof(test_int_rows) / sizeof(uint32_t);
+    test_int_sums_init(expected, sums, row_width);
+    for (size_t i = 0; i < num_ids; i++) {
+        for (size_t j = 0; j < row_width; j++) {
+            expected[j] += weights->a[test_int_rows[i] * row_width + j];
+        }
+    }
+
+    rows_sum(weights->a, row_width, test_int_rows, num_ids, sums);
+    for (size_t j = 0; j < row_width; j++) {
+        ASSERT_EQ(expected[j], sums[j]);
+    }
+
+    int16_array_destroy(weights);
+    PASS();
+}
+
+TEST test_averaged_perceptron_int_kernels(void) {
+    ASSERT(int8_rows_sum_function_get(AVERAGED_PERCEPTRON_KERNELS_SCALAR) != NULL);
+    ASSERT(int16_rows_sum_function_get(AVERAGED_PERCEPTRON_KERNELS_SCALAR) != NULL);
+
+    averaged_perceptron_kernels_isa_t isas[] = {AVERAGED_PERCEPTRON_KERNELS_SCALAR, AVERAGED_PERCEPTRON_KERNELS_SSE2, AVERAGED_PERCEPTRON_KERNELS_AVX2};
+    size_t row_widths[] = {4, 8, 12, 16, 20};
+
+    for (size_t i = 0; i < sizeof(isas) / sizeof(isas[0]); i++) {
+        int8_rows_sum_function int8_rows_sum = int8_rows_sum_function_get(isas[i]);
+        int16_rows_sum_function int16_rows_sum = int16_rows_sum_function_get(isas[i]);
+
+        for (size_t j = 0; j < sizeof(row_widths) / sizeof(size_t); j++) {
+            if (int8_rows_sum != NULL) {
+                CHECK_CALL(test_int8_rows_sum_equals(int8_rows_sum, row_widths[j]));
+            }
+            if (int16_rows_sum != NULL) {
+                CHECK_CALL(test_int16_rows_sum_equals(int16_rows_sum, row_widths[j]));
+            }
+        }
+    }
+
+    PASS();
+}
+
+static greatest_test_res test_quantized_save_load(uint32_t bits) {
+    char path[] = "/tmp/libpostal_averaged_perceptron_XXXXXX";
+    int fd = mkstemp(path);
+    ASSERT(fd >= 0);
+    close(fd);
+
+    averaged_perceptron_t *model = test_perceptron_new(TEST_NUM_FEATURES, TEST_NUM_CLASSES, test_perceptron_weight);
+    ASSERT(model != NULL);
+    ASSERT(averaged_perceptron_quantize(model, bits));
+
+    size_t num_sets;
+    cstring_array **sets = test_feature_sets_new(&num_sets);
+    double_array *scores = test_perceptron_scores(model, sets, num_sets);
+
+    ASSERT(averaged_perceptron_save(model, path));
+    CHECK_CALL(test_file_signature(path, PERCEPTRON_QUANTIZED_SIGNATURE));
+
+    averaged_perceptron_t *loaded = averaged_perceptron_load(path);
+    ASSERT(loaded != NULL);
+    ASSERT_EQ(model->layout, loaded->layout);
+    ASSERT_EQ(model->num_features, loaded->num_features);
+    ASSERT_EQ(model->num_classes, loaded->num_classes);
+    ASSERT_EQ(model->row_width, loaded->row_width);
+    ASSERT(loaded->weights == NULL);
+
+    ASSERT_EQ(model->class_scales->n, loaded->class_scales->n);
+    ASSERT_EQ(0, memcmp(model->class_scales->a, loaded->class_scales->a, model->class_scales->n * sizeof(float)));
+
+    if (bits == 8) {
+        ASSERT(loaded->int8_rows_sum != NULL);
+        ASSERT_EQ(model->int8_weights->n, loaded->int8_weights->n);
+        ASSERT_EQ(0, memcmp(model->int8_weights->a, loaded->int8_weights->a, model->int8_weights->n * sizeof(int8_t)));
+    } else {
+        ASSERT(loaded->int16_rows_sum != NULL);
+        ASSERT_EQ(model->int16_weights->n, loaded->int16_weights->n);
+        ASSERT_EQ(0, memcmp(model->int16_weights->a, loaded->int16_weights->a, model->int16_weights->n * sizeof(int16_t)));
+    }
+
+    double_array *loaded_scores = test_perceptron_scores(loaded, sets, num_sets);
+    ASSERT_EQ(scores->n, loaded_scores->n);
+    ASSERT_EQ(0, memcmp(scores->a, loaded_scores->a, scores->n * sizeof(double)));
+
+    double_array_destroy(scores);
+    double_array_destroy(loaded_scores);
+    test_feature_sets_destroy(sets, num_sets);
+    averaged_perceptron_destroy(model);
+    averaged_perceptron_destroy(loaded);
+
+    ASSERT_EQ(0, unlink(path));
+    PASS();
+}
+
+TEST test_averaged_perceptron_quantized_save_load(void) {
+    CHECK_CALL(test_quantized_save_load(8));
+    CHECK_CALL(test_quantized_save_load(16));
+    PASS();
+}
+
+#define TEST_PRUNE_NUM_FEATURES 8
+#define TEST_PRUNE_NUM_CLASSES 3
+
+static double test_prune_weights[TEST_PRUNE_NUM_FEATURES][TEST_PRUNE_NUM_CLASSES] = {
+    {0.0, 0.0, 0.0},        // no nonzero weights
+    {0.05, -0.05, 0.0},     // max 0.05, L1 0.1
+    {0.5, -0.5, 0.0},       // max 0.5, L1 1.0
+    {3.0, 0.0, 0.0},        // max 3.0, L1 3.0
+    {-0.1, 0.1, 0.1},       // max 0.1, L1 0.3
+    {0.0, 0.0, -2.0},       // max 2.0, L1 2.0
+    {0.5, 0.5, 0.5},        // max 0.5, L1 1.5
+    {0.0, -4.0, 1.0}        // max 4.0, L1 5.0
+};
+
+static double test_prune_weight(uint32_t feature_id, uint32_t class_id) {
+    return test_prune_weights[feature_id][class_id];
+}
+
+/*
+expected_ids[i] is the new id of "feature i" or -1 if it was pruned. Checks
+the trie and that row expected_ids[i] of the CSR matrix holds the original
+weights of feature i
+*/
+static greatest_test_res test_pruned_features(averaged_perceptron_t *model, int32_t *expected_ids) {
+    uint32_t num_kept = 0;
+    char name[32];
+
+    for (uint32_t i = 0; i < TEST_PRUNE_NUM_FEATURES; i++) {
+        snprintf(name, sizeof(name), "feature %u", i);
+        uint32_t feature_id;
+        bool found = trie_get_data(model->features, name, &feature_id);
+
+        if (expected_ids[i] < 0) {
+            ASSERT_FALSE(found);
+            continue;
+        }
+
+        num_kept++;
+        ASSERT(found);
+        ASSERT_EQ((uint32_t)expected_ids[i], feature_id);
+
+        double row[TEST_PRUNE_NUM_CLASSES] = {0.0, 0.0, 0.0};
+        uint32_t *indptr = model->weights->indptr->a;
+        for (uint32_t col = indptr[feature_id]; col < indptr[feature_id + 1]; col++) {
+            ASSERT(model->weights->indices->a[col] < TEST_PRUNE_NUM_CLASSES);
+            row[model->weights->indices->a[col]] = model->weights->data->a[col];
+        }
+        ASSERT_EQ(0, memcmp(test_prune_weights[i], row, sizeof(row)));
+    }
+
+    ASSERT_EQ(num_kept, model->num_features);
+    ASSERT_EQ(num_kept, trie_num_keys(model->features));
+    ASSERT_EQ(num_kept + 1, model->weights->indptr->n);
+
+    PASS();
+}
+
+TEST test_averaged_perceptron_prune(void) {
+    // Only features without nonzero weights are dropped
+    averaged_perceptron_t *model = test_perceptron_new(TEST_PRUNE_NUM_FEATURES, TEST_PRUNE_NUM_CLASSES, test_prune_weight);
+    ASSERT(model != NULL);
+    ASSERT(averaged_perceptron_prune(model, 0.0, 0));
+    int32_t nonzero_ids[TEST_PRUNE_NUM_FEATURES] = {-1, 0, 1, 2, 3, 4, 5, 6};
+    CHECK_CALL(test_pruned_features(model, nonzero_ids));
+    averaged_perceptron_destroy(model);
+
+    // min_weight applies to the largest absolute weight, and is inclusive
+    model = test_perceptron_new(TEST_PRUNE_NUM_FEATURES, TEST_PRUNE_NUM_CLASSES, test_prune_weight);
+    ASSERT(model != NULL);
+    ASSERT(averaged_perceptron_prune(model, 0.1, 0));
+    int32_t min_weight_ids[TEST_PRUNE_NUM_FEATURES] = {-1, -1, 0, 1, 2, 3, 4, 5};
+    CHECK_CALL(test_pruned_features(model, min_weight_ids));
+    averaged_perceptron_destroy(model);
+
+    // max_features keeps the largest L1 norms in their original order
+    model = test_perceptron_new(TEST_PRUNE_NUM_FEATURES, TEST_PRUNE_NUM_CLASSES, test_prune_weight);
+    ASSERT(model != NULL);
+    ASSERT(averaged_perceptron_build_feature_hashes(model));
+    ASSERT(averaged_perceptron_prune(model, 0.1, 3));
+    int32_t max_features_ids[TEST_PRUNE_NUM_FEATURES] = {-1, -1, -1, 0, -1, 1, -1, 2};
+    CHECK_CALL(test_pruned_features(model, max_features_ids));
+
+    // The hash table is rebuilt with the new ids
+    ASSERT(model->feature_hashes != NULL);
+    cstring_array *features = cstring_array_new();
+    uint64_array *feature_hashes = uint64_array_new();
+    cstring_array_add_string(features, "feature 5");
+    cstring_array_add_string(features, "feature 7");
+    cstring_array_add_string(features, "feature 6");
+    feature_hashes_add(feature_hashes, 1, "feature 5");
+    feature_hashes_add(feature_hashes, 1, "feature 7");
+    feature_hashes_add(feature_hashes, 1, "feature 6");
+
+    double_array *scores = double_array_new();
+    double_array *hash_scores = double_array_new();
+    averaged_perceptron_predict_scores_r(model, features, scores);
+    averaged_perceptron_predict_scores_hashes_r(model, feature_hashes, hash_scores);
+    double expected_scores[TEST_PRUNE_NUM_CLASSES] = {0.0, -4.0, -1.0};
+    ASSERT_EQ(TEST_PRUNE_NUM_CLASSES, scores->n);
+    ASSERT_EQ(0, memcmp(expected_scores, scores->a, sizeof(expected_scores)));
+    ASSERT_EQ(0, memcmp(expected_scores, hash_scores->a, sizeof(expected_scores)));
+
+    double_array_destroy(scores);
+    double_array_destroy(hash_scores);
+    cstring_array_destroy(features);
+    uint64_array_destroy(feature_hashes);
+    averaged_perceptron_destroy(model);
+
+    // Only sparse models can be pruned
+    model = test_perceptron_new(TEST_PRUNE_NUM_FEATURES, TEST_PRUNE_NUM_CLASSES, test_prune_weight);
+    ASSERT(model != NULL);
+    ASSERT(averaged_perceptron_to_dense(model));
+    ASSERT_FALSE(averaged_perceptron_prune(model, 0.1, 3));
+    ASSERT_EQ(AVERAGED_PERCEPTRON_LAYOUT_DENSE, model->layout);
+    ASSERT_EQ(TEST_PRUNE_NUM_FEATURES, model->num_features);
+    ASSERT_EQ(TEST_PRUNE_NUM_FEATURES, trie_num_keys(model->features));
+    averaged_perceptron_destroy(model);
+
+    PASS();
+}
+
+// Trainer feature function, context is the features array
+static bool test_trainer_features(void *tagger, void *context, tokenized_string_t *tokenized, uint32_t i, char *prev, char *prev2) {
+    cstring_array *features = context;
+    char *word = cstring_array_get_string(tokenized->strings, i);
+    feature_array_add(features, 1, "bias");
+    feature_array_add(features, 2, "word", word);
+    feature_array_add(features, 2, "prev", prev);
+    feature_array_add(features, 3, "prev word", prev, word);
+    return true;
+}
+
+// Words and labels are separated by spaces
+static greatest_test_res test_trainer_train(averaged_perceptron_trainer_t *trainer, char **examples, size_t num_examples) {
+    cstring_array *features = cstring_array_new();
+    for (size_t i = 0; i < num_examples; i += 2) {
+        char *words = examples[i];
+        size_t num_labels;
+        cstring_array *labels = cstring_array_split(examples[i + 1], " ", 1, &num_labels);
+        ASSERT(labels != NULL);
+
+        tokenized_string_t *tokenized = tokenized_string_new();
+        size_t start = 0;
+        size_t len = strlen(words);
+        for (size_t j = 0; j <= len; j++) {
+            if (j == len || words[j] == ' ') {
+                tokenized_string_add_token(tokenized, words, j - start, WORD, start);
+                start = j + 1;
+            }
+        }
+
+        ASSERT(averaged_perceptron_trainer_train_example(trainer, NULL, features, features, test_trainer_features, tokenized, labels));
+
+        tokenized_string_destroy(tokenized);
+        cstring_array_destroy(labels);
+    }
+    cstring_array_destroy(features);
+    PASS();
+}
+
+static char *test_trainer_examples[] = {
+    "781 franklin ave brooklyn", "house_number road road city",
+    "100 main st new york", "house_number road road city city",
+    "30 w 26th st manhattan", "house_number road road road city",
+    "franklin ave 781", "road road house_number",
+};
+
+static char *test_trainer_examples_a[] = {
+    "15 franklin st brooklyn", "house_number road road city",
+    "main st 100", "road road house_number",
+};
+
+static char *test_trainer_examples_b[] = {
+    "26 broadway manhattan", "house_number road city",
+    "york ave new york", "road road city city",
+};
+
+#define TEST_TRAINER_NUM_EXAMPLES(examples) (sizeof(examples) / sizeof(examples[0]))
+
+// Weight of a feature and class with its total brought up to updates, zero if the trainer doesn't have it
+static class_weight_t test_trainer_weight(averaged_perceptron_trainer_t *trainer, const char *feature, uint32_t class_id, uint64_t updates) {
+    uint32_t feature_id;
+    khiter_t k;
+    if (trainer->shared_features != NULL &&
+        (k = kh_get(str_uint32, trainer->shared_features, feature)) != kh_end(trainer->shared_features)) {
+        feature_id = kh_value(trainer->shared_features, k);
+    } else if ((k = kh_get(str_uint32, trainer->features, feature)) != kh_end(trainer->features)) {
+        feature_id = kh_value(trainer->features, k);
+    } else {
+        return NULL_WEIGHT;
+    }
+
+    k = kh_get(feature_class_weights, trainer->weights, feature_id);
+    if (k == kh_end(trainer->weights)) return NULL_WEIGHT;
+    khash_t(class_weights) *weights = kh_value(trainer->weights, k);
+
+    k = kh_get(class_weights, weights, class_id);
+    if (k == kh_end(weights)) return NULL_WEIGHT;
+    class_weight_t weight = kh_value(weights, k);
+    weight.total += (updates - weight.last_updated) * weight.value;
+    weight.last_updated = updates;
+    return weight;
+}
+
+TEST test_averaged_perceptron_trainer_mix_unchanged(void) {
+    // Mixing a single unchanged worker back in is a no-op
+    averaged_perceptron_trainer_t *trainer = averaged_perceptron_trainer_new();
+    averaged_perceptron_trainer_t *unmixed = averaged_perceptron_trainer_new();
+    ASSERT(trainer != NULL);
+    ASSERT(unmixed != NULL);
+    for (size_t i = 0; i < 2; i++) {
+        CHECK_CALL(test_trainer_train(trainer, test_trainer_examples, TEST_TRAINER_NUM_EXAMPLES(test_trainer_examples)));
+        CHECK_CALL(test_trainer_train(unmixed, test_trainer_examples, TEST_TRAINER_NUM_EXAMPLES(test_trainer_examples)));
+    }
+    ASSERT(trainer->num_updates > 1);
+
+    averaged_perceptron_trainer_t *worker = averaged_perceptron_trainer_new_worker(trainer);
+    ASSERT(worker != NULL);
+    ASSERT_EQ(trainer->num_features, worker->num_features);
+    ASSERT_EQ(trainer->num_classes, worker->num_classes);
+    ASSERT_EQ(0, worker->num_updates);
+    // The feature strings are shared, not copied
+    ASSERT(worker->shared_features == trainer->features);
+    ASSERT_EQ(0, kh_size(worker->features));
+
+    ASSERT(averaged_perceptron_trainer_mix(trainer, &worker, 1));
+    averaged_perceptron_trainer_destroy(worker);
+    ASSERT_EQ(unmixed->num_updates, trainer->num_updates);
+
+    averaged_perceptron_t *model = averaged_perceptron_trainer_finalize(trainer);
+    averaged_perceptron_t *unmixed_model = averaged_perceptron_trainer_finalize(unmixed);
+    ASSERT(model != NULL);
+    ASSERT(unmixed_model != NULL);
+    ASSERT_EQ(unmixed_model->num_features, model->num_features);
+    ASSERT_EQ(unmixed_model->num_classes, model->num_classes);
+
+    sparse_matrix_t *weights = model->weights;
+    sparse_matrix_t *unmixed_weights = unmixed_model->weights;
+    ASSERT_EQ(unmixed_weights->indptr->n, weights->indptr->n);
+    ASSERT_EQ(unmixed_weights->indices->n, weights->indices->n);
+    ASSERT_EQ(0, memcmp(unmixed_weights->indptr->a, weights->indptr->a, weights->indptr->n * sizeof(uint32_t)));
+    ASSERT_EQ(0, memcmp(unmixed_weights->indices->a, weights->indices->a, weights->indices->n * sizeof(uint32_t)));
+    for (size_t i = 0; i < weights->data->n; i++) {
+        ASSERT_IN_RANGE(unmixed_weights->data->a[i], weights->data->a[i], 1e-12);
+    }
+
+    averaged_perceptron_destroy(model);
+    averaged_perceptron_destroy(unmixed_model);
+
+    PASS();
+}
+
+TEST test_averaged_perceptron_trainer_mix(void) {
+    averaged_perceptron_trainer_t *trainer = averaged_perceptron_trainer_new();
+    ASSERT(trainer != NULL);
+    CHECK_CALL(test_trainer_train(trainer, test_trainer_examples, TEST_TRAINER_NUM_EXAMPLES(test_trainer_examples)));
+
+    averaged_perceptron_trainer_t *workers[2];
+    workers[0] = averaged_perceptron_trainer_new_worker(trainer);
+    workers[1] = averaged_perceptron_trainer_new_worker(trainer);
+    ASSERT(workers[0] != NULL);
+    ASSERT(workers[1] != NULL);
+    CHECK_CALL(test_trainer_train(workers[0], test_trainer_examples_a, TEST_TRAINER_NUM_EXAMPLES(test_trainer_examples_a)));
+    CHECK_CALL(test_trainer_train(workers[1], test_trainer_examples_b, TEST_TRAINER_NUM_EXAMPLES(test_trainer_examples_b)));
+    ASSERT(workers[0]->num_updates > 0);
+    ASSERT(workers[1]->num_updates > 0);
+    // Both add features the other hasn't seen, no new classes
+    ASSERT(workers[0]->num_features > trainer->num_features);
+    ASSERT(workers[1]->num_features > trainer->num_features);
+    ASSERT_EQ(trainer->num_classes, workers[0]->num_classes);
+    ASSERT_EQ(trainer->num_classes, workers[1]->num_classes);
+
+    // Every feature any of them has, the workers only hold the ones they added
+    cstring_array *feature_names = cstring_array_new();
+    const char *feature;
+    kh_foreach_key(trainer->features, feature, {
+        cstring_array_add_string(feature_names, (char *)feature);
+    })
+    for (size_t i = 0; i < 2; i++) {
+        kh_foreach_key(workers[i]->features, feature, {
+            if (i == 0 || kh_get(str_uint32, workers[0]->features, feature) == kh_end(workers[0]->features)) {
+                cstring_array_add_string(feature_names, (char *)feature);
+            }
+        })
+    }
+
+    size_t num_features = cstring_array_num_strings(feature_names);
+    size_t num_classes = (size_t)trainer->num_classes;
+    ASSERT_EQ(workers[0]->num_features + workers[1]->num_features - trainer->num_features, num_features);
+
+    // Averaged values, totals summed over self and the workers
+    double_array *expected_values = double_array_new_zeros(num_features * num_classes);
+    double_array *expected_totals = double_array_new_zeros(num_features * num_classes);
+    uint64_t expected_updates = trainer->num_updates + workers[0]->num_updates + workers[1]->num_updates;
+    uint64_t expected_errors = trainer->num_errors + workers[0]->num_errors + workers[1]->num_errors;
+
+    for (size_t i = 0; i < num_features; i++) {
+        char *name = cstring_array_get_string(feature_names, (uint32_t)i);
+        for (uint32_t class_id = 0; class_id < num_classes; class_id++) {
+            class_weight_t self_weight = test_trainer_weight(trainer, name, class_id, trainer->num_updates);
+            class_weight_t weight_a = test_trainer_weight(workers[0], name, class_id, workers[0]->num_updates);
+            class_weight_t weight_b = test_trainer_weight(workers[1], name, class_id, workers[1]->num_updates);
+            expected_values->a[i * num_classes + class_id] = (weight_a.value + weight_b.value) / 2.0;
+            expected_totals->a[i * num_classes + class_id] = self_weight.total + weight_a.total + weight_b.total;
+        }
+    }
+
+    ASSERT(averaged_perceptron_trainer_mix(trainer, workers, 2));
+    ASSERT_EQ(expected_updates, trainer->num_updates);
+    ASSERT_EQ(expected_errors, trainer->num_errors);
+    ASSERT_EQ(num_features, trainer->num_features);
+
+    for (size_t i = 0; i < num_features; i++) {
+        char *name = cstring_array_get_string(feature_names, (uint32_t)i);
+        ASSERT(kh_get(str_uint32, trainer->features, name) != kh_end(trainer->features));
+        for (uint32_t class_id = 0; class_id < num_classes; class_id++) {
+            class_weight_t weight = test_trainer_weight(trainer, name, class_id, trainer->num_updates);
+            ASSERT_IN_RANGE(expected_values->a[i * num_classes + class_id], weight.value, 1e-12);
+            ASSERT_IN_RANGE(expected_totals->a[i * num_classes + class_id], weight.total, 1e-9);
+        }
+    }
+
+    // Reset in place to the mixed weights for the next round
+    ASSERT(averaged_perceptron_trainer_reset_worker(workers[0], trainer));
+    ASSERT_EQ(0, workers[0]->num_updates);
+    ASSERT_EQ(0, workers[0]->num_errors);
+    ASSERT_EQ(0, kh_size(workers[0]->features));
+    ASSERT_EQ(trainer->num_features, workers[0]->num_features);
+    ASSERT_EQ(trainer->num_classes, workers[0]->num_classes);
+    ASSERT_EQ(kh_size(trainer->weights), kh_size(workers[0]->weights));
+
+    for (size_t i = 0; i < num_features; i++) {
+        char *name = cstring_array_get_string(feature_names, (uint32_t)i);
+        for (uint32_t class_id = 0; class_id < num_classes; class_id++) {
+            class_weight_t mixed_weight = test_trainer_weight(trainer, name, class_id, trainer->num_updates);
+            class_weight_t weight = test_trainer_weight(workers[0], name, class_id, 0);
+            ASSERT_EQ(0, memcmp(&mixed_weight.value, &weight.value, sizeof(double)));
+            ASSERT_EQ(0, weight.last_updated);
+            ASSERT_IN_RANGE(0.0, weight.total, 0.0);
+        }
+    }
+
+    double_array_destroy(expected_values);
+    double_array_destroy(expected_totals);
+    cstring_array_destroy(feature_names);
+    averaged_perceptron_trainer_destroy(workers[0]);
+    averaged_perceptron_trainer_destroy(workers[1]);
+    averaged_perceptron_trainer_destroy(trainer);
+
+    PASS();
+}
+
+GREATEST_SUITE(libpostal_averaged_perceptron_tests) {
+    RUN_TEST(test_averaged_perceptron_dense);
+    RUN_TEST(test_averaged_perceptron_float_kernels);
+    RUN_TEST(test_averaged_perceptron_dense_save_load);
+    RUN_TEST(test_averaged_perceptron_quantize);
+    RUN_TEST(test_averaged_perceptron_int_kernels);
+    RUN_TEST(test_averaged_perceptron_quantized_save_load);
+    RUN_TEST(test_averaged_perceptron_prune);
+    RUN_TEST(test_averaged_perceptron_trainer_mix_unchanged);
+    RUN_TEST(test_averaged_perceptron_trainer_mix);
+}
@@ -0,0 +1,14 @@
+#ifndef TEST_AVERAGED_PERCEPTRON_H
+#define TEST_AVERAGED_PERCEPTRON_H
+
+#include <stdint.h>
+
+#include "../src/averaged_perceptron.h"
+
+// Mix of positive, negative and zero weights of different magnitudes
+double test_perceptron_weight(uint32_t feature_id, uint32_t class_id);
+
+// Sparse model with features "feature %u" and classes "class %u", weight(feature_id, class_id) for each weight
+averaged_perceptron_t *test_perceptron_new(uint32_t num_features, uint32_t num_classes, double (*weight)(uint32_t, uint32_t));
+
+#endif
@@ -0,0 +1,217 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "greatest.h"
+#include "../src/libpostal.h"
+#include "../src/libpostal_config.h"
+#include "../src/address_dictionary.h"
+#include "../src/address_parser.h"
+#include "../src/data_bundle.h"
+#include "../src/geodb.h"
+#include "../src/numex.h"
+#include "../src/transliterate.h"
+
+SUITE(libpostal_data_bundle_tests);
+
+#define TEST_NUMEX_SECTION "numex" PATH_SEPARATOR "numex.dat"
+#define TEST_EXTRA_SECTION "extra.dat"
+
+static char *test_numex_contents = "numex section contents";
+static char *test_extra_contents = "extra";
+
+static bool write_test_file(char *dir, char *name, char *contents) {
+    char path[1024];
+    snprintf(path, sizeof(path), "%s%s%s", dir, PATH_SEPARATOR, name);
+    FILE *f = fopen(path, "wb");
+    if (f == NULL) return false;
+    size_t len = strlen(contents);
+    bool ret = fwrite(contents, 1, len, f) == len;
+    fclose(f);
+    return ret;
+}
+
+static greatest_test_res test_read_section(data_bundle_t *bundle, char *name, char *expected) {
+    FILE *f = data_bundle_open_section(bundle, name);
+    ASSERT(f != NULL);
+
+    char buf[64] = {0};
+    size_t len = strlen(expected);
+    ASSERT_EQ(len, fread(buf, 1, len, f));
+    ASSERT_STR_EQ(expected, buf);
+    fclose(f);
+
+    PASS();
+}
+
+TEST test_data_bundle_write_read(void) {
+    char dir[] = "/tmp/libpostal_bundle_XXXXXX";
+    ASSERT(mkdtemp(dir) != NULL);
+
+    char numex_dir[1024];
+    snprintf(numex_dir, sizeof(numex_dir), "%s%snumex", dir, PATH_SEPARATOR);
+    ASSERT_EQ(0, mkdir(numex_dir, 0700));
+
+    ASSERT(write_test_file(dir, TEST_NUMEX_SECTION, test_numex_contents));
+    ASSERT(write_test_file(dir, TEST_EXTRA_SECTION, test_extra_contents));
+
+    char bundle_path[1024];
+    snprintf(bundle_path, sizeof(bundle_path), "%s%s%s", dir, PATH_SEPARATOR, DEFAULT_DATA_BUNDLE_FILENAME);
+
+    char *names[] = {TEST_NUMEX_SECTION, TEST_EXTRA_SECTION};
+    ASSERT(data_bundle_write(bundle_path, dir, names, 2));
+
+    data_bundle_t *bundle = data_bundle_open(bundle_path, true);
+    ASSERT(bundle != NULL);
+    ASSERT_EQ(DATA_BUNDLE_VERSION, bundle->version);
+    ASSERT_EQ(2, bundle->sections->n);
+
+    data_bundle_section_t *numex_section = data_bundle_get_section(bundle, TEST_NUMEX_SECTION);
+    data_bundle_section_t *extra_section = data_bundle_get_section(bundle, TEST_EXTRA_SECTION);
+    ASSERT(numex_section != NULL);
+    ASSERT(extra_section != NULL);
+    ASSERT(data_bundle_get_section(bundle, "missing.dat") == NULL);
+
+    ASSERT_EQ(strlen(test_numex_contents), numex_section->size);
+    ASSERT_EQ(strlen(test_extra_contents), extra_section->size);
+    ASSERT_EQ(0, numex_section->offset % DATA_BUNDLE_ALIGNMENT);
+    ASSERT_EQ(0, extra_section->offset % DATA_BUNDLE_ALIGNMENT);
+    ASSERT(extra_section->offset > numex_section->offset);
+
+    // Nothing is read from a section until it's opened
+    ASSERT_FALSE(numex_section->verified);
+    ASSERT_FALSE(extra_section->verified);
+
+    CHECK_CALL(test_read_section(bundle, TEST_NUMEX_SECTION, test_numex_contents));
+    ASSERT(numex_section->verified);
+    ASSERT_FALSE(extra_section->verified);
+
+    CHECK_CALL(test_read_section(bundle, TEST_EXTRA_SECTION, test_extra_contents));
+    ASSERT(extra_section->verified);
+
+    ASSERT(data_bundle_open_section(bundle, "missing.dat") == NULL);
+
+    // Data files under the data directory are read from the default bundle
+    data_bundle_set_default(bundle);
+    FILE *f = data_bundle_fopen(LIBPOSTAL_DATA_DIR PATH_SEPARATOR TEST_NUMEX_SECTION);
+    ASSERT(f != NULL);
+    char buf[64] = {0};
+    ASSERT_EQ(strlen(test_numex_contents), fread(buf, 1, strlen(test_numex_contents), f));
+    ASSERT_STR_EQ(test_numex_contents, buf);
+    fclose(f);
+
+    // Anything else is opened on disk
+    char extra_path[1024];
+    snprintf(extra_path, sizeof(extra_path), "%s%s%s", dir, PATH_SEPARATOR, TEST_EXTRA_SECTION);
+    f = data_bundle_fopen(extra_path);
+    ASSERT(f != NULL);
+    fclose(f);
+    ASSERT(data_bundle_fopen(LIBPOSTAL_DATA_DIR PATH_SEPARATOR "missing.dat") == NULL);
+
+    data_bundle_set_default(NULL);
+    data_bundle_destroy(bundle);
+
+    // A corrupted section fails its checksum when opened
+    f = fopen(bundle_path, "r+b");
+    ASSERT(f != NULL);
+    bundle = data_bundle_open(bundle_path, true);
+    ASSERT(bundle != NULL);
+    numex_section = data_bundle_get_section(bundle, TEST_NUMEX_SECTION);
+    ASSERT(fseek(f, (long)numex_section->offset, SEEK_SET) == 0);
+    ASSERT(fputc('N', f) != EOF);
+    fclose(f);
+
+    ASSERT(data_bundle_open_section(bundle, TEST_NUMEX_SECTION) == NULL);
+    CHECK_CALL(test_read_section(bundle, TEST_EXTRA_SECTION, test_extra_contents));
+    data_bundle_destroy(bundle);
+
+    // Without verification the section is returned as-is
+    bundle = data_bundle_open(bundle_path, false);
+    ASSERT(bundle != NULL);
+    CHECK_CALL(test_read_section(bundle, TEST_NUMEX_SECTION, "Numex section contents"));
+    data_bundle_destroy(bundle);
+
+    ASSERT_EQ(0, unlink(bundle_path));
+    ASSERT_EQ(0, unlink(extra_path));
+    char numex_path[1024];
+    snprintf(numex_path, sizeof(numex_path), "%s%s%s", dir, PATH_SEPARATOR, TEST_NUMEX_SECTION);
+    ASSERT_EQ(0, unlink(numex_path));
+    ASSERT_EQ(0, rmdir(numex_dir));
+    ASSERT_EQ(0, rmdir(dir));
+
+    PASS();
+}
+
+TEST test_data_bundle_lazy_modules(void) {
+    char bundle_path[] = "/tmp/libpostal_bundle_XXXXXX";
+    int fd = mkstemp(bundle_path);
+    ASSERT(fd >= 0);
+    close(fd);
+
+    char *names[] = {
+        "transliteration" PATH_SEPARATOR "transliteration.dat",
+        "numex" PATH_SEPARATOR "numex.dat",
+        "address_expansions" PATH_SEPARATOR "address_dictionary.dat",
+        "address_parser" PATH_SEPARATOR ADDRESS_PARSER_MODEL_FILENAME
+    };
+    size_t num_names = sizeof(names) / sizeof(char *);
+    ASSERT(data_bundle_write(bundle_path, LIBPOSTAL_DATA_DIR, names, num_names));
+
+    ASSERT(libpostal_setup_bundle(bundle_path, true));
+    data_bundle_t *bundle = data_bundle_get_default();
+    ASSERT(bundle != NULL);
+
+    // Setting up the bundle doesn't load anything
+    ASSERT(get_transliteration_table() == NULL);
+    ASSERT(get_numex_table() == NULL);
+    ASSERT(get_address_dictionary() == NULL);
+    for (size_t i = 0; i < num_names; i++) {
+        ASSERT_FALSE(data_bundle_get_section(bundle, names[i])->verified);
+    }
+
+    normalize_options_t options = get_libpostal_default_options();
+    char *languages[] = {"en"};
+    options.languages = languages;
+    options.num_languages = 1;
+
+    size_t num_expansions;
+    char **expansions = expand_address("30 W 26th St", options, &num_expansions);
+    ASSERT(expansions != NULL);
+    ASSERT(num_expansions > 0);
+    expansion_array_destroy(expansions, num_expansions);
+
+    // The first expansion loaded the modules it needs from the bundle, and only those
+    ASSERT(get_transliteration_table() != NULL);
+    ASSERT(get_numex_table() != NULL);
+    ASSERT(get_address_dictionary() != NULL);
+    ASSERT(get_address_parser() == NULL);
+    ASSERT(get_geodb() == NULL);
+
+    for (size_t i = 0; i < num_names - 1; i++) {
+        ASSERT(data_bundle_get_section(bundle, names[i])->verified);
+    }
+    ASSERT_FALSE(data_bundle_get_section(bundle, names[num_names - 1])->verified);
+
+    // Later calls reuse the loaded modules
+    address_dictionary_t *address_dict = get_address_dictionary();
+    expansions = expand_address("Main St", options, &num_expansions);
+    ASSERT(expansions != NULL);
+    expansion_array_destroy(expansions, num_expansions);
+    ASSERT_EQ(address_dict, get_address_dictionary());
+
+    libpostal_teardown_bundle();
+    ASSERT(data_bundle_get_default() == NULL);
+    ASSERT(get_address_dictionary() == NULL);
+
+    ASSERT_EQ(0, unlink(bundle_path));
+
+    PASS();
+}
+
+GREATEST_SUITE(libpostal_data_bundle_tests) {
+    RUN_TEST(test_data_bundle_write_read);
+    RUN_TEST(test_data_bundle_lazy_modules);
+}
@@ -1,6 +1,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <string.h>
 #include <stdarg.h>
 
 #include "greatest.h"
@@ -84,6 +85,354 @@ TEST test_expansions_language_classifier(void) {
 }
 
 
+TEST test_expansions_batch(void) {
+    normalize_options_t options = get_libpostal_default_options();
+
+    char *inputs[] = {
+        "V XX Sett",
+        "C/ Ocho",
+        "123 Main St. #2f",
+        "Marktstrasse"
+    };
+    size_t num_inputs = sizeof(inputs) / sizeof(char *);
+
+    expand_address_batch_response_t *response = expand_address_batch(inputs, num_inputs, options, 2);
+    ASSERT(response != NULL);
+    ASSERT_EQ(num_inputs, response->num_inputs);
+
+    // Batch results should be in input order and match expand_address
+    for (size_t i = 0; i < num_inputs; i++) {
+        size_t num_expansions;
+        char **expansions = expand_address(inputs[i], options, &num_expansions);
+
+        ASSERT_EQ(num_expansions, response->offsets[i + 1] - response->offsets[i]);
+        for (size_t j = 0; j < num_expansions; j++) {
+            ASSERT_STR_EQ(expansions[j], response->expansions[response->offsets[i] + j]);
+        }
+
+        expansion_array_destroy(expansions, num_expansions);
+    }
+
+    expand_address_batch_response_destroy(response);
+    PASS();
+}
+
+TEST test_expansions_cache(void) {
+    normalize_options_t options = get_libpostal_default_options();
+    char *languages[] = {"en"};
+    options.languages = languages;
+    options.num_languages = 1;
+
+    char *input = "123 Main St. #2f";
+
+    size_t num_uncached;
+    char **uncached = expand_address(input, options, &num_uncached);
+    ASSERT(uncached != NULL);
+
+    ASSERT(libpostal_cache_enable(1 << 20, 4));
+
+    // First call misses and fills the cache, second call hits
+    for (int i = 0; i < 2; i++) {
+        size_t num_expansions;
+        char **expansions = expand_address(input, options, &num_expansions);
+        ASSERT_EQ(num_uncached, num_expansions);
+        for (size_t j = 0; j < num_expansions; j++) {
+            ASSERT_STR_EQ(uncached[j], expansions[j]);
+        }
+        expansion_array_destroy(expansions, num_expansions);
+    }
+
+    libpostal_cache_stats_t stats = libpostal_cache_get_stats();
+    ASSERT_EQ(1, stats.hits);
+    ASSERT_EQ(1, stats.misses);
+    ASSERT_EQ(1, stats.num_entries);
+
+    // The batch call shares the cache
+    char *inputs[] = {input};
+    expand_address_batch_response_t *response = expand_address_batch(inputs, 1, options, 1);
+    ASSERT(response != NULL);
+    ASSERT_EQ(num_uncached, response->offsets[1] - response->offsets[0]);
+    for (size_t j = 0; j < num_uncached; j++) {
+        ASSERT_STR_EQ(uncached[j], response->expansions[j]);
+    }
+    expand_address_batch_response_destroy(response);
+    ASSERT_EQ(2, libpostal_cache_get_stats().hits);
+
+    // Different options are a different key
+    options.lowercase = false;
+    size_t num_expansions;
+    char **expansions = expand_address(input, options, &num_expansions);
+    expansion_array_destroy(expansions, num_expansions);
+    ASSERT_EQ(2, libpostal_cache_get_stats().misses);
+
+    libpostal_cache_flush();
+    ASSERT_EQ(0, libpostal_cache_get_stats().num_entries);
+
+    libpostal_cache_disable();
+    expansion_array_destroy(uncached, num_uncached);
+    PASS();
+}
+
+TEST test_expansions_iterator(void) {
+    normalize_options_t options = get_libpostal_default_options();
+    char *languages[] = {"en"};
+    options.languages = languages;
+    options.num_languages = 1;
+
+    char *input = "123 Main St. #2f";
+
+    size_t num_expansions;
+    char **expansions = expand_address(input, options, &num_expansions);
+    ASSERT(expansions != NULL);
+    ASSERT(num_expansions > 1);
+
+    // Unlimited iterator yields the same expansions in the same order
+    libpostal_expansion_iterator_t *iter = expand_address_iterator_new(input, options, 0, 0);
+    ASSERT(iter != NULL);
+
+    size_t i = 0;
+    char *expansion;
+    while ((expansion = expand_address_iterator_next(iter)) != NULL) {
+        ASSERT(i < num_expansions);
+        ASSERT_STR_EQ(expansions[i], expansion);
+        i++;
+    }
+    ASSERT_EQ(num_expansions, i);
+    ASSERT_FALSE(expand_address_iterator_truncated(iter));
+    expand_address_iterator_destroy(iter);
+
+    // Capped iterator stops early and reports truncation
+    iter = expand_address_iterator_new(input, options, 1, 0);
+    ASSERT(iter != NULL);
+    expansion = expand_address_iterator_next(iter);
+    ASSERT(expansion != NULL);
+    ASSERT_STR_EQ(expansions[0], expansion);
+    ASSERT(expand_address_iterator_next(iter) == NULL);
+    ASSERT(expand_address_iterator_truncated(iter));
+    expand_address_iterator_destroy(iter);
+
+    // A cap equal to the number of expansions yields all of them without truncating
+    iter = expand_address_iterator_new(input, options, num_expansions, 0);
+    ASSERT(iter != NULL);
+    for (i = 0; i < num_expansions; i++) {
+        expansion = expand_address_iterator_next(iter);
+        ASSERT(expansion != NULL);
+        ASSERT_STR_EQ(expansions[i], expansion);
+        ASSERT_FALSE(expand_address_iterator_truncated(iter));
+    }
+    ASSERT(expand_address_iterator_next(iter) == NULL);
+    ASSERT_FALSE(expand_address_iterator_truncated(iter));
+    expand_address_iterator_destroy(iter);
+
+    // One below the cap still truncates
+    iter = expand_address_iterator_new(input, options, num_expansions - 1, 0);
+    ASSERT(iter != NULL);
+    for (i = 0; i < num_expansions - 1; i++) {
+        ASSERT(expand_address_iterator_next(iter) != NULL);
+    }
+    ASSERT(expand_address_iterator_next(iter) == NULL);
+    ASSERT(expand_address_iterator_truncated(iter));
+    expand_address_iterator_destroy(iter);
+
+    expansion_array_destroy(expansions, num_expansions);
+    PASS();
+}
+
+TEST test_expansions_lattice(void) {
+    normalize_options_t options = get_libpostal_default_options();
+    char *languages[] = {"en"};
+    options.languages = languages;
+    options.num_languages = 1;
+
+    char *input = "Main St";
+
+    libpostal_expansion_lattice_t *lattice = expand_address_lattice(input, options);
+    ASSERT(lattice != NULL);
+    ASSERT(lattice->num_sequences > 0);
+    ASSERT_EQ(lattice->num_positions, lattice->sequence_offsets[lattice->num_sequences]);
+    ASSERT_EQ(lattice->num_alternatives, lattice->position_offsets[lattice->num_positions]);
+
+    // "st" is ambiguous, so some position has more than one alternative
+    bool have_ambiguous = false;
+    for (size_t i = 0; i < lattice->num_positions; i++) {
+        if (lattice->position_offsets[i + 1] - lattice->position_offsets[i] > 1) {
+            have_ambiguous = true;
+        }
+    }
+    ASSERT(have_ambiguous);
+
+    // The first path through the first sequence is the first expansion
+    size_t num_expansions;
+    char **expansions = expand_address(input, options, &num_expansions);
+    ASSERT(num_expansions > 0);
+
+    char first[256] = "";
+    for (size_t i = lattice->sequence_offsets[0]; i < lattice->sequence_offsets[1]; i++) {
+        strncat(first, lattice->alternatives[lattice->position_offsets[i]], sizeof(first) - strlen(first) - 1);
+    }
+    ASSERT_STR_EQ(expansions[0], first);
+    expansion_array_destroy(expansions, num_expansions);
+
+    // Serialization round trip
+    size_t len;
+    char *data = expansion_lattice_serialize(lattice, &len);
+    ASSERT(data != NULL);
+
+    libpostal_expansion_lattice_t *copy = expansion_lattice_deserialize(data, len);
+    ASSERT(copy != NULL);
+    ASSERT_EQ(lattice->num_sequences, copy->num_sequences);
+    ASSERT_EQ(lattice->num_positions, copy->num_positions);
+    ASSERT_EQ(lattice->num_alternatives, copy->num_alternatives);
+    for (size_t i = 0; i <= lattice->num_positions; i++) {
+        ASSERT_EQ(lattice->position_offsets[i], copy->position_offsets[i]);
+    }
+    for (size_t i = 0; i < lattice->num_alternatives; i++) {
+        ASSERT_STR_EQ(lattice->alternatives[i], copy->alternatives[i]);
+    }
+
+    // Truncated input is rejected
+    ASSERT(expansion_lattice_deserialize(data, len - 1) == NULL);
+
+    free(data);
+    expansion_lattice_destroy(copy);
+    expansion_lattice_destroy(lattice);
+    PASS();
+}
+
+static bool lattice_position_has_alternative(libpostal_expansion_lattice_t *lattice, size_t position, char *alternative) {
+    for (size_t i = lattice->position_offsets[position]; i < lattice->position_offsets[position + 1]; i++) {
+        if (strcmp(lattice->alternatives[i], alternative) == 0) return true;
+    }
+    return false;
+}
+
+TEST test_expansions_lattice_linear(void) {
+    normalize_options_t options = get_libpostal_default_options();
+    char *languages[] = {"en"};
+    options.languages = languages;
+    options.num_languages = 1;
+
+    char *inputs[] = {
+        "Wilkes-Barre",
+        "Wilkes-Barre Winston-Salem",
+        "Wilkes-Barre Winston-Salem Hi-Lo",
+        "Wilkes-Barre Winston-Salem Hi-Lo Bel-Air"
+    };
+    size_t num_inputs = sizeof(inputs) / sizeof(char *);
+
+    size_t num_sequences = 0;
+    size_t last_num_alternatives = 0;
+
+    for (size_t i = 0; i < num_inputs; i++) {
+        libpostal_expansion_lattice_t *lattice = expand_address_lattice(inputs[i], options);
+        ASSERT(lattice != NULL);
+        ASSERT(lattice->num_sequences > 0);
+
+        // Hyphenated tokens add positions, not sequences
+        if (i == 0) {
+            num_sequences = lattice->num_sequences;
+        }
+        ASSERT_EQ(num_sequences, lattice->num_sequences);
+
+        // Each hyphenated token adds a bounded number of alternatives
+        ASSERT(lattice->num_alternatives > last_num_alternatives);
+        ASSERT(lattice->num_alternatives - last_num_alternatives <= 8 * num_sequences);
+        last_num_alternatives = lattice->num_alternatives;
+
+        // The variants of each hyphenated token share a position
+        size_t num_ambiguous = 0;
+        for (size_t j = lattice->sequence_offsets[0]; j < lattice->sequence_offsets[1]; j++) {
+            if (lattice_position_has_alternative(lattice, j, "wilkes barre") ||
+                lattice_position_has_alternative(lattice, j, "winston salem") ||
+                lattice_position_has_alternative(lattice, j, "hi lo") ||
+                lattice_position_has_alternative(lattice, j, "bel air")) {
+                ASSERT(lattice->position_offsets[j + 1] - lattice->position_offsets[j] > 1);
+                num_ambiguous++;
+            }
+        }
+        ASSERT_EQ(i + 1, num_ambiguous);
+
+        ASSERT(lattice_position_has_alternative(lattice, lattice->sequence_offsets[0], "wilkes barre"));
+        ASSERT(lattice_position_has_alternative(lattice, lattice->sequence_offsets[0], "wilkesbarre"));
+
+        expansion_lattice_destroy(lattice);
+    }
+
+    PASS();
+}
+
+TEST test_canonical_normalization(void) {
+    normalize_options_t options = get_libpostal_default_options();
+    char *languages[] = {"en"};
+    options.languages = languages;
+    options.num_languages = 1;
+
+    char *canonical = normalize_address_canonical("123 Main St.", options);
+    ASSERT(canonical != NULL);
+
+    // Every token is kept and "st" is replaced by its canonical form
+    ASSERT_STR_EQ("123 main street", canonical);
+
+    // Case, punctuation and whitespace differences map to the same key
+    char *other = normalize_address_canonical("123  MAIN ST", options);
+    ASSERT(other != NULL);
+    ASSERT_STR_EQ(canonical, other);
+    free(other);
+
+    // Leading and trailing whitespace is not part of the key
+    other = normalize_address_canonical(" 123 Main St ", options);
+    ASSERT(other != NULL);
+    ASSERT_STR_EQ(canonical, other);
+    free(other);
+
+    free(canonical);
+
+    // Unambiguous abbreviations map to their only canonical form
+    canonical = normalize_address_canonical("Franklin Blvd", options);
+    ASSERT(canonical != NULL);
+    ASSERT_STR_EQ("franklin boulevard", canonical);
+    free(canonical);
+
+    canonical = normalize_address_canonical("Main Ave.", options);
+    ASSERT(canonical != NULL);
+    ASSERT_STR_EQ("main avenue", canonical);
+    free(canonical);
+
+    // "st" before a name is a title, at the end of a component a street type
+    canonical = normalize_address_canonical("12 St Marks St, New York", options);
+    ASSERT(canonical != NULL);
+    ASSERT_STR_EQ("12 saint marks street new york", canonical);
+    free(canonical);
+
+    PASS();
+}
+
+TEST test_expansion_stats(void) {
+    normalize_options_t options = get_libpostal_default_options();
+    char *languages[] = {"en"};
+    options.languages = languages;
+    options.num_languages = 1;
+
+    libpostal_reset_stats();
+
+    size_t num_expansions;
+    char **expansions = expand_address("123 Main St.", options, &num_expansions);
+    ASSERT(expansions != NULL);
+
+    libpostal_stats_t stats = libpostal_get_stats();
+    if (stats.enabled) {
+        ASSERT_EQ(num_expansions, stats.counters[LIBPOSTAL_COUNTER_EXPANSIONS]);
+        ASSERT(stats.stages[LIBPOSTAL_STAGE_TOKENIZE].calls > 0);
+        ASSERT(stats.stages[LIBPOSTAL_STAGE_DICTIONARY_SEARCH].calls > 0);
+    } else {
+        ASSERT_EQ(0, stats.counters[LIBPOSTAL_COUNTER_EXPANSIONS]);
+    }
+    ASSERT_STR_EQ("tokenize", libpostal_stage_name(LIBPOSTAL_STAGE_TOKENIZE));
+
+    expansion_array_destroy(expansions, num_expansions);
+    PASS();
+}
+
 SUITE(libpostal_expansion_tests) {
 
     if (!libpostal_setup() || !libpostal_setup_language_classifier()) {
@@ -93,9 +442,27 @@ SUITE(libpostal_expansion_tests) {
 
     RUN_TEST(test_expansions);
     RUN_TEST(test_expansions_language_classifier);
+    RUN_TEST(test_expansions_batch);
+    RUN_TEST(test_expansions_cache);
+    RUN_TEST(test_expansions_iterator);
+    RUN_TEST(test_expansions_lattice);
+    RUN_TEST(test_expansions_lattice_linear);
+    RUN_TEST(test_canonical_normalization);
+    RUN_TEST(test_expansion_stats);
 
     libpostal_teardown();
     libpostal_teardown_language_classifier();
 
+    char *languages[] = {"en"};
+    if (!libpostal_setup_languages(languages, 1)) {
+        printf("Could not setup libpostal with languages\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // Other languages in test_expansions are loaded on first use
+    RUN_TEST(test_expansions);
+
+    libpostal_teardown();
+
 }
 
@@ -0,0 +1,248 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "greatest.h"
+#include "test_averaged_perceptron.h"
+#include "../src/averaged_perceptron.h"
+#include "../src/features.h"
+#include "../src/feature_index.h"
+#include "../src/language_classifier.h"
+#include "../src/minibatch.h"
+
+SUITE(libpostal_feature_index_tests);
+
+// Enough keys for many buckets, with ids out of insertion order
+#define TEST_NUM_KEYS 200
+#define TEST_NUM_CLASSES 3
+
+static uint32_t test_key_id(uint32_t i) {
+    return (i * 7) % TEST_NUM_KEYS;
+}
+
+static bool test_features_add(trie_t *features) {
+    char name[32];
+    for (uint32_t i = 0; i < TEST_NUM_KEYS; i++) {
+        snprintf(name, sizeof(name), "feature %u", i);
+        if (!trie_add(features, name, test_key_id(i))) return false;
+    }
+    return true;
+}
+
+// Every key gets the trie's id by string and by hash, keys not in the trie are rejected
+static greatest_test_res test_feature_index_matches_trie(feature_index_t *feature_index, trie_t *features) {
+    ASSERT(feature_index != NULL);
+    ASSERT_EQ(trie_num_keys(features), feature_index->num_keys);
+
+    char name[32];
+    uint32_t trie_id, index_id, hash_id;
+    for (uint32_t i = 0; i < TEST_NUM_KEYS; i++) {
+        snprintf(name, sizeof(name), "feature %u", i);
+        ASSERT(trie_get_data(features, name, &trie_id));
+        ASSERT(feature_index_get(feature_index, name, &index_id));
+        ASSERT(feature_index_get_hash(feature_index, feature_hash_string(name), &hash_id));
+        ASSERT_EQ(trie_id, index_id);
+        ASSERT_EQ(trie_id, hash_id);
+    }
+
+    for (uint32_t i = TEST_NUM_KEYS; i < TEST_NUM_KEYS * 2; i++) {
+        snprintf(name, sizeof(name), "feature %u", i);
+        ASSERT_FALSE(feature_index_get(feature_index, name, &index_id));
+    }
+    ASSERT_FALSE(feature_index_get(feature_index, "feature", &index_id));
+    ASSERT_FALSE(feature_index_get(feature_index, "", &index_id));
+
+    PASS();
+}
+
+TEST test_feature_index_write_read(void) {
+    trie_t *trie = trie_new();
+    ASSERT(trie != NULL);
+    ASSERT(trie_add(trie, "st", 1));
+    ASSERT(trie_add(trie, "street", 2));
+    ASSERT(trie_add(trie, "st rt", 3));
+    ASSERT(trie_add(trie, "st rd", 3));
+    ASSERT(trie_add(trie, "state route", 4));
+    ASSERT(trie_add(trie, "maine", 5));
+
+    feature_index_t *index = feature_index_new_from_trie(trie);
+    ASSERT(index != NULL);
+    ASSERT_EQ(trie_num_keys(trie), index->num_keys);
+
+    FILE *f = tmpfile();
+    ASSERT(f != NULL);
+    ASSERT(feature_index_write(index, f));
+    feature_index_destroy(index);
+
+    ASSERT(fseek(f, 0, SEEK_SET) == 0);
+    index = feature_index_read(f);
+    ASSERT(index != NULL);
+
+    // Not an index, read restores the position
+    ASSERT(fseek(f, 0, SEEK_SET) == 0);
+    ASSERT(fwrite("abcd", 1, 4, f) == 4);
+    ASSERT(fseek(f, 0, SEEK_SET) == 0);
+    ASSERT(feature_index_read(f) == NULL);
+    ASSERT_EQ(0, ftell(f));
+    fclose(f);
+
+    uint32_t data;
+    ASSERT(feature_index_get(index, "street", &data));
+    ASSERT_EQ(2, data);
+    ASSERT(feature_index_get(index, "st", &data));
+    ASSERT_EQ(1, data);
+    ASSERT(feature_index_get(index, "st rd", &data));
+    ASSERT_EQ(3, data);
+    ASSERT(feature_index_get(index, "maine", &data));
+    ASSERT_EQ(5, data);
+    ASSERT_FALSE(feature_index_get(index, "stre", &data));
+    ASSERT_FALSE(feature_index_get(index, "main", &data));
+
+    feature_index_destroy(index);
+    trie_destroy(trie);
+
+    PASS();
+}
+
+TEST test_feature_index_perceptron(void) {
+    char path[] = "/tmp/libpostal_feature_index_XXXXXX";
+    int fd = mkstemp(path);
+    ASSERT(fd >= 0);
+    close(fd);
+
+    averaged_perceptron_t *model = test_perceptron_new(TEST_NUM_KEYS, TEST_NUM_CLASSES, test_perceptron_weight);
+    ASSERT(model != NULL);
+    ASSERT(model->feature_index == NULL);
+    ASSERT(averaged_perceptron_save(model, path));
+
+    averaged_perceptron_t *loaded = averaged_perceptron_load(path);
+    ASSERT(loaded != NULL);
+    CHECK_CALL(test_feature_index_matches_trie(loaded->feature_index, loaded->features));
+
+    // The index stands in for the hash table
+    ASSERT(averaged_perceptron_build_feature_hashes(loaded));
+    ASSERT(loaded->feature_hashes == NULL);
+
+    cstring_array *features = cstring_array_new();
+    uint64_array *feature_hashes = uint64_array_new();
+    char *names[] = {"feature 3", "feature 150", "feature 199", "missing feature"};
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+        cstring_array_add_string(features, names[i]);
+        feature_hashes_add(feature_hashes, 1, names[i]);
+    }
+
+    double_array *scores = double_array_new();
+    double_array *loaded_scores = double_array_new();
+    double_array *hash_scores = double_array_new();
+    ASSERT(averaged_perceptron_predict_scores_r(model, features, scores) != NULL);
+    ASSERT(averaged_perceptron_predict_scores_r(loaded, features, loaded_scores) != NULL);
+    ASSERT(averaged_perceptron_predict_scores_hashes_r(loaded, feature_hashes, hash_scores) != NULL);
+    ASSERT_EQ(TEST_NUM_CLASSES, scores->n);
+    ASSERT_EQ(scores->n, loaded_scores->n);
+    ASSERT_EQ(scores->n, hash_scores->n);
+    ASSERT_EQ(0, memcmp(scores->a, loaded_scores->a, scores->n * sizeof(double)));
+    ASSERT_EQ(0, memcmp(scores->a, hash_scores->a, scores->n * sizeof(double)));
+
+    double_array_destroy(scores);
+    double_array_destroy(loaded_scores);
+    double_array_destroy(hash_scores);
+    cstring_array_destroy(features);
+    uint64_array_destroy(feature_hashes);
+    averaged_perceptron_destroy(model);
+    averaged_perceptron_destroy(loaded);
+
+    ASSERT_EQ(0, unlink(path));
+
+    PASS();
+}
+
+static language_classifier_t *test_language_classifier_new(void) {
+    language_classifier_t *classifier = language_classifier_new();
+    if (classifier == NULL) return NULL;
+
+    classifier->features = trie_new();
+    classifier->labels = cstring_array_new();
+    // One row per feature plus the bias
+    classifier->weights = matrix_new_zeros(TEST_NUM_KEYS + 1, TEST_NUM_CLASSES);
+
+    if (classifier->features == NULL || classifier->labels == NULL || classifier->weights == NULL ||
+        !test_features_add(classifier->features)) {
+        language_classifier_destroy(classifier);
+        return NULL;
+    }
+
+    cstring_array_add_string(classifier->labels, "en");
+    cstring_array_add_string(classifier->labels, "fr");
+    cstring_array_add_string(classifier->labels, "de");
+
+    classifier->num_features = TEST_NUM_KEYS;
+    classifier->num_labels = TEST_NUM_CLASSES;
+
+    return classifier;
+}
+
+static greatest_test_res test_sparse_matrix_equal(sparse_matrix_t *expected, sparse_matrix_t *matrix) {
+    ASSERT_EQ(expected->m, matrix->m);
+    ASSERT_EQ(expected->n, matrix->n);
+    ASSERT_EQ(expected->indptr->n, matrix->indptr->n);
+    ASSERT_EQ(expected->indices->n, matrix->indices->n);
+    ASSERT_EQ(0, memcmp(expected->indptr->a, matrix->indptr->a, expected->indptr->n * sizeof(uint32_t)));
+    ASSERT_EQ(0, memcmp(expected->indices->a, matrix->indices->a, expected->indices->n * sizeof(uint32_t)));
+    ASSERT_EQ(0, memcmp(expected->data->a, matrix->data->a, expected->data->n * sizeof(double)));
+    PASS();
+}
+
+TEST test_feature_index_language_classifier(void) {
+    char path[] = "/tmp/libpostal_feature_index_XXXXXX";
+    int fd = mkstemp(path);
+    ASSERT(fd >= 0);
+    close(fd);
+
+    language_classifier_t *classifier = test_language_classifier_new();
+    ASSERT(classifier != NULL);
+    ASSERT(classifier->feature_index == NULL);
+    ASSERT(language_classifier_save(classifier, path));
+
+    language_classifier_t *loaded = language_classifier_load(path);
+    ASSERT(loaded != NULL);
+    ASSERT_EQ(TEST_NUM_CLASSES, loaded->num_labels);
+    ASSERT_STR_EQ("fr", cstring_array_get_string(loaded->labels, 1));
+    CHECK_CALL(test_feature_index_matches_trie(loaded->feature_index, loaded->features));
+
+    // Feature vectors built through the index are the same as through the trie
+    khash_t(str_double) *feature_counts = kh_init(str_double);
+    char *names[] = {"feature 0", "feature 42", "feature 199", "missing feature"};
+    int ret;
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+        khiter_t k = kh_put(str_double, feature_counts, names[i], &ret);
+        ASSERT(ret >= 0);
+        kh_value(feature_counts, k) = (double)i + 1.0;
+    }
+
+    sparse_matrix_t *x = feature_vector(loaded->features, feature_counts);
+    sparse_matrix_t *x_index = feature_vector_index(loaded->feature_index, feature_counts);
+    ASSERT(x != NULL);
+    ASSERT(x_index != NULL);
+    // Bias plus the three known features
+    ASSERT_EQ(4, x->indices->n);
+    CHECK_CALL(test_sparse_matrix_equal(x, x_index));
+
+    sparse_matrix_destroy(x);
+    sparse_matrix_destroy(x_index);
+    kh_destroy(str_double, feature_counts);
+    language_classifier_destroy(classifier);
+    language_classifier_destroy(loaded);
+
+    ASSERT_EQ(0, unlink(path));
+
+    PASS();
+}
+
+GREATEST_SUITE(libpostal_feature_index_tests) {
+    RUN_TEST(test_feature_index_write_read);
+    RUN_TEST(test_feature_index_perceptron);
+    RUN_TEST(test_feature_index_language_classifier);
+}
@@ -2,9 +2,16 @@
 #include <stdlib.h>
 #include <stdbool.h>
 #include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
 
 #include "greatest.h"
 #include "../src/libpostal.h"
+#include "../src/address_parser.h"
+#include "../src/address_parser_trainer.h"
+#include "../src/averaged_perceptron_trainer.h"
+#include "../src/features.h"
+#include "../src/scanner.h"
 
 SUITE(libpostal_parser_tests);
 
@@ -227,6 +234,485 @@ TEST test_ru_parses(void) {
     PASS();
 }
 
+TEST test_parser_session(void) {
+    address_parser_options_t options = get_libpostal_address_parser_default_options();
+
+    libpostal_parser_session_t *session = libpostal_parser_session_new();
+    ASSERT(session != NULL);
+
+    char *inputs[] = {
+        "Barboncino 781 Franklin Ave Crown Heights Brooklyn NYC NY 11216 USA",
+        "Eschenbräu Bräurei Triftstraße 67 13353 Berlin Deutschland"
+    };
+
+    // Sessions are reused across calls and should give the same results as parse_address
+    for (size_t i = 0; i < sizeof(inputs) / sizeof(char *); i++) {
+        address_parser_response_t *expected = parse_address(inputs[i], options);
+        address_parser_response_t *response = parse_address_r(session, inputs[i], options);
+        ASSERT(expected != NULL);
+        ASSERT(response != NULL);
+        ASSERT_EQ(expected->num_components, response->num_components);
+
+        for (size_t j = 0; j < response->num_components; j++) {
+            ASSERT_STR_EQ(expected->labels[j], response->labels[j]);
+            ASSERT_STR_EQ(expected->components[j], response->components[j]);
+        }
+
+        address_parser_response_destroy(expected);
+        address_parser_response_destroy(response);
+    }
+
+    libpostal_parser_session_destroy(session);
+    PASS();
+}
+
+TEST test_parser_batch(void) {
+    address_parser_options_t options = get_libpostal_address_parser_default_options();
+
+    char *inputs[] = {
+        "Barboncino 781 Franklin Ave Crown Heights Brooklyn NYC NY 11216 USA",
+        "Szimpla Kert Kazinczy utca 14 Budapest 1075, Magyarország",
+        "Eschenbräu Bräurei Triftstraße 67 13353 Berlin Deutschland"
+    };
+    size_t num_inputs = sizeof(inputs) / sizeof(char *);
+
+    address_parser_batch_response_t *response = parse_address_batch(inputs, num_inputs, options, 2);
+    ASSERT(response != NULL);
+    ASSERT_EQ(num_inputs, response->num_inputs);
+
+    for (size_t i = 0; i < num_inputs; i++) {
+        address_parser_response_t *expected = parse_address(inputs[i], options);
+        ASSERT(expected != NULL);
+
+        size_t offset = response->offsets[i];
+        ASSERT_EQ(expected->num_components, response->offsets[i + 1] - offset);
+
+        for (size_t j = 0; j < expected->num_components; j++) {
+            ASSERT_STR_EQ(expected->labels[j], response->labels[offset + j]);
+            ASSERT_STR_EQ(expected->components[j], response->components[offset + j]);
+        }
+
+        address_parser_response_destroy(expected);
+    }
+
+    address_parser_batch_response_destroy(response);
+    PASS();
+}
+
+static greatest_test_res assert_same_parse(address_parser_response_t *expected, address_parser_response_t *response) {
+    ASSERT(expected != NULL);
+    ASSERT(response != NULL);
+    ASSERT_EQ(expected->num_components, response->num_components);
+
+    for (size_t j = 0; j < response->num_components; j++) {
+        ASSERT_STR_EQ(expected->labels[j], response->labels[j]);
+        ASSERT_STR_EQ(expected->components[j], response->components[j]);
+    }
+    PASS();
+}
+
+TEST test_parser_cache(void) {
+    address_parser_options_t options = get_libpostal_address_parser_default_options();
+
+    char *input = "Barboncino 781 Franklin Ave Crown Heights Brooklyn NYC NY 11216 USA";
+
+    address_parser_response_t *uncached = parse_address(input, options);
+    ASSERT(uncached != NULL);
+
+    ASSERT(libpostal_cache_enable(1 << 20, 4));
+
+    // First call misses and fills the cache, second call hits
+    for (int i = 0; i < 2; i++) {
+        address_parser_response_t *response = parse_address(input, options);
+        CHECK_CALL(assert_same_parse(uncached, response));
+        address_parser_response_destroy(response);
+    }
+
+    libpostal_cache_stats_t stats = libpostal_cache_get_stats();
+    ASSERT_EQ(1, stats.hits);
+    ASSERT_EQ(1, stats.misses);
+    ASSERT_EQ(1, stats.num_entries);
+
+    // Sessions and the batch call share the cache
+    libpostal_parser_session_t *session = libpostal_parser_session_new();
+    ASSERT(session != NULL);
+    address_parser_response_t *response = parse_address_r(session, input, options);
+    CHECK_CALL(assert_same_parse(uncached, response));
+    address_parser_response_destroy(response);
+    libpostal_parser_session_destroy(session);
+    ASSERT_EQ(2, libpostal_cache_get_stats().hits);
+
+    char *inputs[] = {input};
+    address_parser_batch_response_t *batch = parse_address_batch(inputs, 1, options, 1);
+    ASSERT(batch != NULL);
+    ASSERT_EQ(uncached->num_components, batch->offsets[1] - batch->offsets[0]);
+    for (size_t j = 0; j < uncached->num_components; j++) {
+        ASSERT_STR_EQ(uncached->labels[j], batch->labels[j]);
+        ASSERT_STR_EQ(uncached->components[j], batch->components[j]);
+    }
+    address_parser_batch_response_destroy(batch);
+    ASSERT_EQ(3, libpostal_cache_get_stats().hits);
+
+    // Parser options are part of the key
+    options.country = "us";
+    response = parse_address(input, options);
+    ASSERT(response != NULL);
+    address_parser_response_destroy(response);
+    stats = libpostal_cache_get_stats();
+    ASSERT_EQ(2, stats.misses);
+    ASSERT_EQ(2, stats.num_entries);
+
+    libpostal_cache_disable();
+    address_parser_response_destroy(uncached);
+    PASS();
+}
+
+TEST test_parser_compact(void) {
+    address_parser_options_t options = get_libpostal_address_parser_default_options();
+
+    char *inputs[] = {
+        "Barboncino 781 Franklin Ave Crown Heights Brooklyn NYC NY 11216 USA",
+        "Eschenbräu Bräurei Triftstraße 67 13353 Berlin Deutschland",
+        "Brooklyn",
+        "11216"
+    };
+
+    // With single spaces between tokens, spans should cover the same text as the full response's components
+    for (size_t i = 0; i < sizeof(inputs) / sizeof(char *); i++) {
+        address_parser_response_t *expected = parse_address(inputs[i], options);
+        address_parser_compact_response_t *response = parse_address_compact(inputs[i], options);
+        ASSERT(expected != NULL);
+        ASSERT(response != NULL);
+        ASSERT_EQ(expected->num_components, response->num_components);
+
+        for (size_t j = 0; j < response->num_components; j++) {
+            address_parser_span_t span = response->components[j];
+            ASSERT(span.start + span.len <= response->normalized_len);
+
+            const char *label = address_parser_label_name(span.label);
+            ASSERT(label != NULL);
+            ASSERT_STR_EQ(expected->labels[j], label);
+
+            ASSERT_EQ(strlen(expected->components[j]), span.len);
+            ASSERT(strncmp(expected->components[j], response->normalized + span.start, span.len) == 0);
+        }
+
+        address_parser_response_destroy(expected);
+        address_parser_compact_response_destroy(response);
+    }
+
+    PASS();
+}
+
+TEST test_feature_hashes(void) {
+    cstring_array *features = cstring_array_new();
+    uint64_array *feature_hashes = uint64_array_new();
+
+    feature_array_add(features, 1, "bias");
+    feature_hashes_add(feature_hashes, 1, "bias");
+    feature_array_add(features, 3, "i-1 tag+word", "road", "main");
+    feature_hashes_add(feature_hashes, 3, "i-1 tag+word", "road", "main");
+    // Trailing separators are stripped from all but the last part
+    feature_array_add(features, 3, "i-1 word+word", "a|", "b|");
+    feature_hashes_add(feature_hashes, 3, "i-1 word+word", "a|", "b|");
+
+    ASSERT_EQ(cstring_array_num_strings(features), feature_hashes->n);
+
+    for (uint32_t i = 0; i < feature_hashes->n; i++) {
+        char *feature = cstring_array_get_string(features, i);
+        ASSERT(feature_hash_string(feature) == feature_hashes->a[i]);
+    }
+
+    ASSERT(feature_hashes->a[0] != feature_hashes->a[1]);
+
+    cstring_array_destroy(features);
+    uint64_array_destroy(feature_hashes);
+
+    PASS();
+}
+
+/*
+Wraps the address parser feature functions to record the class scores of
+every step of the greedy pass. Each feature function call after the first
+sees the scores predicted for the previous token in the caller's buffer.
+*/
+typedef struct test_split_tagger {
+    address_parser_t *parser;
+    double_array *scores;
+    double_array *history;
+} test_split_tagger_t;
+
+static void test_split_tagger_record(test_split_tagger_t *tagger, uint32_t i) {
+    if (i > 0) {
+        double_array_extend(tagger->history, tagger->scores);
+    }
+}
+
+static bool test_split_features(void *self, void *ctx, tokenized_string_t *tokenized, uint32_t i, char *prev, char *prev2) {
+    test_split_tagger_t *tagger = (test_split_tagger_t *)self;
+    test_split_tagger_record(tagger, i);
+    return address_parser_features(tagger->parser, ctx, tokenized, i, prev, prev2);
+}
+
+static bool test_split_static_features(void *self, void *ctx, tokenized_string_t *tokenized, uint32_t i) {
+    test_split_tagger_t *tagger = (test_split_tagger_t *)self;
+    return address_parser_static_features(tagger->parser, ctx, tokenized, i);
+}
+
+static bool test_split_tag_features(void *self, void *ctx, tokenized_string_t *tokenized, uint32_t i, char *prev, char *prev2) {
+    test_split_tagger_t *tagger = (test_split_tagger_t *)self;
+    test_split_tagger_record(tagger, i);
+    return address_parser_tag_features(tagger->parser, ctx, tokenized, i, prev, prev2);
+}
+
+static tokenized_string_t *test_tokenized_string(char *str) {
+    char *copy = strdup(str);
+    return tokenized_string_from_tokens(copy, tokenize(copy), false);
+}
+
+static greatest_test_res test_predict_split_equals(averaged_perceptron_t *model, test_split_tagger_t *tagger, address_parser_context_t *context, tokenized_string_t *tokenized, cstring_array *expected_labels, double_array *expected_scores, bool hash_features) {
+    cstring_array *labels = cstring_array_new();
+    double_array_clear(tagger->history);
+
+    cstring_array *features = hash_features ? NULL : context->features;
+    uint64_array *feature_hashes = hash_features ? context->feature_hashes : NULL;
+    context->hash_features = hash_features;
+
+    bool ret = averaged_perceptron_tagger_predict_split(model, tagger, context, features, feature_hashes, context->scores, context->static_scores, labels, &test_split_static_features, &test_split_tag_features, tokenized);
+    context->hash_features = false;
+    ASSERT(ret);
+    double_array_extend(tagger->history, tagger->scores);
+
+    ASSERT_EQ(cstring_array_num_strings(expected_labels), cstring_array_num_strings(labels));
+    for (uint32_t i = 0; i < cstring_array_num_strings(labels); i++) {
+        ASSERT_STR_EQ(cstring_array_get_string(expected_labels, i), cstring_array_get_string(labels, i));
+    }
+
+    // Same features summed in a different order
+    ASSERT_EQ(expected_scores->n, tagger->history->n);
+    for (size_t i = 0; i < expected_scores->n; i++) {
+        ASSERT_IN_RANGE(expected_scores->a[i], tagger->history->a[i], 1e-9);
+    }
+
+    cstring_array_destroy(labels);
+    PASS();
+}
+
+TEST test_parser_predict_split(void) {
+    char *addresses[] = {
+        "781 franklin ave crown heights brooklyn ny 11216",
+        "100 main st new york ny",
+        "barboncino 781 franklin ave brooklyn"
+    };
+    char *address_labels[] = {
+        "house_number road road suburb suburb city_district state postcode",
+        "house_number road road city city state",
+        "house house_number road road city_district"
+    };
+    size_t num_addresses = sizeof(addresses) / sizeof(char *);
+
+    // A small parser with a few words in its vocab and one component phrase
+    address_parser_t *parser = address_parser_new();
+    ASSERT(parser != NULL);
+    parser->vocab = trie_new();
+    parser->phrase_types = trie_new();
+
+    address_parser_types_t types;
+    types.components = ADDRESS_COMPONENT_SUBURB | ADDRESS_COMPONENT_CITY_DISTRICT;
+    types.most_common = ADDRESS_PARSER_SUBURB;
+    ASSERT(trie_add(parser->phrase_types, "crown heights", types.value));
+
+    tokenized_string_t *tokenized[num_addresses];
+    cstring_array *labels[num_addresses];
+
+    for (size_t i = 0; i < num_addresses; i++) {
+        tokenized[i] = test_tokenized_string(addresses[i]);
+        size_t num_labels;
+        labels[i] = cstring_array_split(address_labels[i], " ", 1, &num_labels);
+        ASSERT_EQ(tokenized[i]->tokens->n, num_labels);
+
+        // Words of the last address stay out of the vocab and are featurized as unknown
+        if (i == num_addresses - 1) continue;
+        for (uint32_t j = 0; j < tokenized[i]->tokens->n; j++) {
+            char *word = tokenized_string_get_token(tokenized[i], j);
+            uint32_t count;
+            if (!trie_get_data(parser->vocab, word, &count)) {
+                ASSERT(trie_add(parser->vocab, word, 1));
+            }
+        }
+    }
+
+    address_parser_context_t *context = address_parser_context_new();
+    ASSERT(context != NULL);
+
+    averaged_perceptron_trainer_t *trainer = averaged_perceptron_trainer_new();
+    ASSERT(trainer != NULL);
+    for (size_t iter = 0; iter < 3; iter++) {
+        for (size_t i = 0; i < num_addresses; i++) {
+            address_parser_context_fill(context, parser, tokenized[i], "en", "us");
+            ASSERT(averaged_perceptron_trainer_train_example(trainer, parser, context, context->features, &address_parser_features, tokenized[i], labels[i]));
+        }
+    }
+
+    averaged_perceptron_t *model = averaged_perceptron_trainer_finalize(trainer);
+    ASSERT(model != NULL);
+    parser->model = model;
+
+    test_split_tagger_t tagger = {parser, context->scores, double_array_new()};
+    double_array *expected_scores = double_array_new();
+    cstring_array *expected_labels = cstring_array_new();
+
+    for (size_t i = 0; i < num_addresses; i++) {
+        address_parser_context_fill(context, parser, tokenized[i], "en", "us");
+
+        cstring_array_clear(expected_labels);
+        double_array_clear(tagger.history);
+        ASSERT(averaged_perceptron_tagger_predict(model, &tagger, context, context->features, context->scores, expected_labels, &test_split_features, tokenized[i]));
+        double_array_extend(tagger.history, tagger.scores);
+
+        double_array_clear(expected_scores);
+        double_array_extend(expected_scores, tagger.history);
+        ASSERT_EQ(tokenized[i]->tokens->n * model->num_classes, expected_scores->n);
+
+        CHECK_CALL(test_predict_split_equals(model, &tagger, context, tokenized[i], expected_labels, expected_scores, false));
+
+        // The hash path needs the model's feature hash table
+        ASSERT(averaged_perceptron_build_feature_hashes(model));
+        ASSERT(model->feature_hashes != NULL);
+        CHECK_CALL(test_predict_split_equals(model, &tagger, context, tokenized[i], expected_labels, expected_scores, true));
+    }
+
+    double_array_destroy(tagger.history);
+    double_array_destroy(expected_scores);
+    cstring_array_destroy(expected_labels);
+    for (size_t i = 0; i < num_addresses; i++) {
+        tokenized_string_destroy(tokenized[i]);
+        cstring_array_destroy(labels[i]);
+    }
+    address_parser_context_destroy(context);
+    address_parser_destroy(parser);
+
+    PASS();
+}
+
+// Same features, ids, classes and weights, with totals brought up to the number of updates
+static greatest_test_res test_trainers_equal(averaged_perceptron_trainer_t *expected, averaged_perceptron_trainer_t *trainer) {
+    ASSERT_EQ(expected->num_updates, trainer->num_updates);
+    ASSERT_EQ(expected->num_errors, trainer->num_errors);
+    ASSERT_EQ(expected->num_features, trainer->num_features);
+    ASSERT_EQ(expected->num_classes, trainer->num_classes);
+
+    for (uint32_t i = 0; i < expected->num_classes; i++) {
+        ASSERT_STR_EQ(cstring_array_get_string(expected->class_strings, i), cstring_array_get_string(trainer->class_strings, i));
+    }
+
+    const char *feature;
+    uint32_t feature_id;
+    kh_foreach(expected->features, feature, feature_id, {
+        khiter_t k = kh_get(str_uint32, trainer->features, feature);
+        ASSERT(k != kh_end(trainer->features));
+        ASSERT_EQ(feature_id, kh_value(trainer->features, k));
+    })
+
+    khash_t(class_weights) *expected_weights;
+    uint32_t class_id;
+    class_weight_t expected_weight;
+    kh_foreach(expected->weights, feature_id, expected_weights, {
+        khiter_t k = kh_get(feature_class_weights, trainer->weights, feature_id);
+        ASSERT(k != kh_end(trainer->weights));
+        khash_t(class_weights) *weights = kh_value(trainer->weights, k);
+        ASSERT_EQ(kh_size(expected_weights), kh_size(weights));
+
+        kh_foreach(expected_weights, class_id, expected_weight, {
+            k = kh_get(class_weights, weights, class_id);
+            ASSERT(k != kh_end(weights));
+            class_weight_t weight = kh_value(weights, k);
+            ASSERT_IN_RANGE(expected_weight.value, weight.value, 1e-9);
+            double expected_total = expected_weight.total + (expected->num_updates - expected_weight.last_updated) * expected_weight.value;
+            double total = weight.total + (trainer->num_updates - weight.last_updated) * weight.value;
+            ASSERT_IN_RANGE(expected_total, total, 1e-9);
+        })
+    })
+
+    PASS();
+}
+
+TEST test_parser_train_parallel(void) {
+    char *examples[] = {
+        "en\tus\t781/house_number franklin/road ave/road brooklyn/city ny/state",
+        "en\tus\t100/house_number main/road st/road new/city york/city",
+        "en\tus\tbarboncino/house 781/house_number franklin/road ave/road",
+        "en\tus\t30/house_number w/road 26th/road st/road new/city york/city",
+        "en\tus\tbrooklyn/city ny/state 11216/postcode",
+        "en\tus\tfranklin/road ave/road 781/house_number brooklyn/city"
+    };
+    size_t num_examples = sizeof(examples) / sizeof(char *);
+
+    char path[] = "/tmp/libpostal_parser_train_XXXXXX";
+    int fd = mkstemp(path);
+    ASSERT(fd >= 0);
+    FILE *f = fdopen(fd, "w");
+    ASSERT(f != NULL);
+    for (size_t i = 0; i < num_examples; i++) {
+        fprintf(f, "%s\n", examples[i]);
+    }
+    fclose(f);
+
+    address_parser_t *parser = address_parser_new();
+    ASSERT(parser != NULL);
+    parser->vocab = trie_new();
+    parser->phrase_types = trie_new();
+    char *vocab[] = {"781", "franklin", "ave", "brooklyn", "ny", "new", "york", "st"};
+    for (size_t i = 0; i < sizeof(vocab) / sizeof(char *); i++) {
+        ASSERT(trie_add(parser->vocab, vocab[i], 1));
+    }
+
+    // With one worker, parameter mixing trains the same model as a single pass in file order,
+    // with the epoch in one round, in rounds ending on the last example and in a shorter last round
+    size_t mix_examples[] = {0, 2, 4};
+    thread_pool_t *pool = thread_pool_new(1);
+    ASSERT(pool != NULL);
+    ASSERT_EQ(1, thread_pool_num_workers(pool));
+
+    for (size_t i = 0; i < sizeof(mix_examples) / sizeof(size_t); i++) {
+        averaged_perceptron_trainer_t *expected = averaged_perceptron_trainer_new();
+        averaged_perceptron_trainer_t *trainer = averaged_perceptron_trainer_new();
+        ASSERT(expected != NULL);
+        ASSERT(trainer != NULL);
+
+        for (uint32_t iter = 0; iter < 2; iter++) {
+            expected->iterations = iter;
+            trainer->iterations = iter;
+            ASSERT(address_parser_train_epoch(parser, expected, path));
+            ASSERT(address_parser_train_epoch_parallel(parser, trainer, path, pool, mix_examples[i]));
+        }
+
+        ASSERT(expected->num_updates > 0);
+        CHECK_CALL(test_trainers_equal(expected, trainer));
+
+        averaged_perceptron_trainer_destroy(expected);
+        averaged_perceptron_trainer_destroy(trainer);
+    }
+
+    thread_pool_destroy(pool);
+
+    // Several workers train on their shards and mix every round
+    pool = thread_pool_new(3);
+    ASSERT(pool != NULL);
+    averaged_perceptron_trainer_t *trainer = averaged_perceptron_trainer_new();
+    ASSERT(trainer != NULL);
+    ASSERT(address_parser_train_epoch_parallel(parser, trainer, path, pool, 2));
+    ASSERT(trainer->num_updates > 0);
+    ASSERT(trainer->num_classes > 0);
+    averaged_perceptron_trainer_destroy(trainer);
+    thread_pool_destroy(pool);
+
+    address_parser_destroy(parser);
+    ASSERT_EQ(0, unlink(path));
+
+    PASS();
+}
+
 SUITE(libpostal_parser_tests) {
     if (!libpostal_setup() || !libpostal_setup_parser()) {
         printf("Could not setup libpostal\n");
@@ -240,6 +726,13 @@ SUITE(libpostal_parser_tests) {
     RUN_TEST(test_de_parses);
     RUN_TEST(test_hu_parses);
     RUN_TEST(test_ru_parses);
+    RUN_TEST(test_parser_session);
+    RUN_TEST(test_parser_batch);
+    RUN_TEST(test_parser_cache);
+    RUN_TEST(test_parser_compact);
+    RUN_TEST(test_feature_hashes);
+    RUN_TEST(test_parser_predict_split);
+    RUN_TEST(test_parser_train_parallel);
 
     libpostal_teardown();
     libpostal_teardown_parser();
@@ -0,0 +1,129 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "greatest.h"
+#include "../src/result_cache.h"
+
+SUITE(libpostal_result_cache_tests);
+
+#define TEST_VALUE_LEN 32
+
+static size_t test_entry_size(char *key) {
+    return sizeof(result_cache_entry_t) + strlen(key) + TEST_VALUE_LEN;
+}
+
+static void test_cache_put(result_cache_t *cache, char *key, char fill) {
+    char value[TEST_VALUE_LEN];
+    memset(value, fill, TEST_VALUE_LEN);
+    result_cache_put(cache, key, strlen(key), value, TEST_VALUE_LEN);
+}
+
+static greatest_test_res test_cache_get(result_cache_t *cache, char *key, char fill) {
+    char_array *value = char_array_new();
+    ASSERT(result_cache_get(cache, key, strlen(key), value));
+    ASSERT_EQ(TEST_VALUE_LEN, value->n);
+    for (size_t i = 0; i < value->n; i++) {
+        ASSERT_EQ(fill, value->a[i]);
+    }
+    char_array_destroy(value);
+    PASS();
+}
+
+static bool test_cache_contains(result_cache_t *cache, char *key) {
+    char_array *value = char_array_new();
+    bool hit = result_cache_get(cache, key, strlen(key), value);
+    char_array_destroy(value);
+    return hit;
+}
+
+TEST test_result_cache_eviction(void) {
+    // One shard with room for exactly three entries
+    result_cache_t *cache = result_cache_new(1, test_entry_size("key a") * 3);
+    ASSERT(cache != NULL);
+
+    test_cache_put(cache, "key a", 'a');
+    test_cache_put(cache, "key b", 'b');
+    test_cache_put(cache, "key c", 'c');
+
+    result_cache_stats_t stats = result_cache_get_stats(cache);
+    ASSERT_EQ(3, stats.num_entries);
+    ASSERT_EQ(0, stats.evictions);
+    ASSERT_EQ(test_entry_size("key a") * 3, stats.memory_used);
+
+    // Touching a makes b the least recently used
+    CHECK_CALL(test_cache_get(cache, "key a", 'a'));
+
+    test_cache_put(cache, "key d", 'd');
+
+    stats = result_cache_get_stats(cache);
+    ASSERT_EQ(3, stats.num_entries);
+    ASSERT_EQ(1, stats.evictions);
+    ASSERT(stats.memory_used <= stats.memory_limit);
+
+    ASSERT_FALSE(test_cache_contains(cache, "key b"));
+    CHECK_CALL(test_cache_get(cache, "key a", 'a'));
+    CHECK_CALL(test_cache_get(cache, "key c", 'c'));
+    CHECK_CALL(test_cache_get(cache, "key d", 'd'));
+
+    // Putting an existing key replaces its value without evicting anything
+    test_cache_put(cache, "key c", 'C');
+    CHECK_CALL(test_cache_get(cache, "key c", 'C'));
+    stats = result_cache_get_stats(cache);
+    ASSERT_EQ(3, stats.num_entries);
+    ASSERT_EQ(1, stats.evictions);
+
+    // Entries bigger than the shard budget are never stored
+    char large[1024];
+    memset(large, 'x', sizeof(large));
+    result_cache_put(cache, "key large", strlen("key large"), large, sizeof(large));
+    ASSERT_FALSE(test_cache_contains(cache, "key large"));
+    ASSERT_EQ(3, result_cache_get_stats(cache).num_entries);
+
+    result_cache_clear(cache);
+    stats = result_cache_get_stats(cache);
+    ASSERT_EQ(0, stats.num_entries);
+    ASSERT_EQ(0, stats.memory_used);
+    ASSERT(stats.hits > 0);
+    ASSERT_FALSE(test_cache_contains(cache, "key a"));
+
+    result_cache_destroy(cache);
+    PASS();
+}
+
+TEST test_result_cache_shards(void) {
+    size_t num_shards = 4;
+    size_t max_memory = 64 * 1024;
+    result_cache_t *cache = result_cache_new(num_shards, max_memory);
+    ASSERT(cache != NULL);
+
+    // Enough keys to grow the shard tables and overflow every shard's budget
+    char key[32];
+    size_t num_keys = 5000;
+    for (size_t i = 0; i < num_keys; i++) {
+        snprintf(key, sizeof(key), "key %zu", i);
+        test_cache_put(cache, key, (char)('a' + i % 26));
+    }
+
+    result_cache_stats_t stats = result_cache_get_stats(cache);
+    ASSERT(stats.evictions > 0);
+    ASSERT_EQ(num_keys, stats.num_entries + stats.evictions);
+    ASSERT_EQ(max_memory / num_shards * num_shards, stats.memory_limit);
+    for (size_t i = 0; i < num_shards; i++) {
+        ASSERT(cache->shards[i].memory_used <= cache->shards[i].memory_limit);
+    }
+
+    // The most recent key is always kept
+    snprintf(key, sizeof(key), "key %zu", num_keys - 1);
+    CHECK_CALL(test_cache_get(cache, key, (char)('a' + (num_keys - 1) % 26)));
+
+    result_cache_destroy(cache);
+    PASS();
+}
+
+GREATEST_SUITE(libpostal_result_cache_tests) {
+    RUN_TEST(test_result_cache_eviction);
+    RUN_TEST(test_result_cache_shards);
+}
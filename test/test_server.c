@@ -0,0 +1,140 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include "greatest.h"
+#include "../src/server_protocol.h"
+
+SUITE(libpostal_server_tests);
+
+TEST test_server_request_round_trip(void) {
+    int fds[2];
+    ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+
+    char_array *sent = char_array_new();
+    char_array *received = char_array_new();
+
+    server_request_encode(sent, SERVER_OP_PARSE, "781 Franklin Ave Crown Heights Brooklyn NY", "en", "us");
+    ASSERT(server_write_frame(fds[0], sent->a, sent->n));
+
+    // Second request on the same connection, with the optional fields empty
+    char_array *sent_empty = char_array_new();
+    server_request_encode(sent_empty, SERVER_OP_EXPAND, "30 W 26th St", NULL, NULL);
+    ASSERT(server_write_frame(fds[0], sent_empty->a, sent_empty->n));
+
+    ASSERT(server_read_frame(fds[1], received));
+    ASSERT_EQ(sent->n, received->n);
+    ASSERT_EQ(0, memcmp(sent->a, received->a, sent->n));
+
+    server_request_t request;
+    ASSERT(server_request_decode(received, &request));
+    ASSERT_EQ(SERVER_OP_PARSE, request.op);
+    ASSERT_STR_EQ("781 Franklin Ave Crown Heights Brooklyn NY", request.address);
+    ASSERT_STR_EQ("en", request.language);
+    ASSERT_STR_EQ("us", request.country);
+
+    ASSERT(server_read_frame(fds[1], received));
+    ASSERT(server_request_decode(received, &request));
+    ASSERT_EQ(SERVER_OP_EXPAND, request.op);
+    ASSERT_STR_EQ("30 W 26th St", request.address);
+    ASSERT(request.language == NULL);
+    ASSERT(request.country == NULL);
+
+    // Payloads without the op/address are rejected
+    char_array_clear(received);
+    ASSERT_FALSE(server_request_decode(received, &request));
+    char_array_push(received, (char)SERVER_OP_EXPAND);
+    char_array_append(received, "no terminator");
+    ASSERT_FALSE(server_request_decode(received, &request));
+
+    char_array_destroy(sent);
+    char_array_destroy(sent_empty);
+    char_array_destroy(received);
+    close(fds[0]);
+    close(fds[1]);
+
+    PASS();
+}
+
+TEST test_server_response_round_trip(void) {
+    int fds[2];
+    ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+
+    char *json = "{\"expansions\": [\"30 west 26th street\"]}";
+    ASSERT(server_write_response(fds[0], SERVER_STATUS_OK, json, strlen(json)));
+    ASSERT(server_write_response(fds[0], SERVER_STATUS_ERROR, "", 0));
+
+    char_array *payload = char_array_new();
+    uint8_t status;
+    char *received_json;
+
+    ASSERT(server_read_response(fds[1], payload, &status, &received_json));
+    ASSERT_EQ(SERVER_STATUS_OK, status);
+    ASSERT_STR_EQ(json, received_json);
+
+    ASSERT(server_read_response(fds[1], payload, &status, &received_json));
+    ASSERT_EQ(SERVER_STATUS_ERROR, status);
+    ASSERT_STR_EQ("", received_json);
+
+    // EOF between frames
+    close(fds[0]);
+    ASSERT_FALSE(server_read_response(fds[1], payload, &status, &received_json));
+
+    char_array_destroy(payload);
+    close(fds[1]);
+
+    PASS();
+}
+
+TEST test_server_frame_limits(void) {
+    int fds[2];
+    ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+
+    char_array *payload = char_array_new();
+
+    // Header announcing more than SERVER_MAX_FRAME_SIZE
+    uint32_t len = SERVER_MAX_FRAME_SIZE + 1;
+    unsigned char header[4] = {(len >> 24) & 0xff, (len >> 16) & 0xff, (len >> 8) & 0xff, len & 0xff};
+    ASSERT(server_write_full(fds[0], header, sizeof(header)));
+    ASSERT_FALSE(server_read_frame(fds[1], payload));
+
+    // A response too large for one frame comes back as an error
+    size_t json_len = SERVER_MAX_FRAME_SIZE;
+    char *json = malloc(json_len);
+    ASSERT(json != NULL);
+    memset(json, 'a', json_len);
+    ASSERT(server_write_response(fds[0], SERVER_STATUS_OK, json, json_len));
+    free(json);
+
+    uint8_t status;
+    char *received_json;
+    ASSERT(server_read_response(fds[1], payload, &status, &received_json));
+    ASSERT_EQ(SERVER_STATUS_ERROR, status);
+    ASSERT_STR_EQ("{\"error\": \"response too large\"}", received_json);
+
+    // A client that stops mid-frame times out instead of blocking the reader
+    ASSERT(server_set_timeout(fds[1], 1));
+    unsigned char partial[6] = {0, 0, 0, 16, 'a', 'b'};
+    ASSERT(server_write_full(fds[0], partial, sizeof(partial)));
+
+    time_t start = time(NULL);
+    ASSERT_FALSE(server_read_frame(fds[1], payload));
+    ASSERT(time(NULL) - start <= 3);
+
+    char_array_destroy(payload);
+    close(fds[0]);
+    close(fds[1]);
+
+    PASS();
+}
+
+GREATEST_SUITE(libpostal_server_tests) {
+    RUN_TEST(test_server_request_round_trip);
+    RUN_TEST(test_server_response_round_trip);
+    RUN_TEST(test_server_frame_limits);
+}
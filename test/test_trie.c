@@ -54,6 +54,323 @@ TEST test_trie(void) {
     PASS();
 }
 
+TEST test_trie_write_read(void) {
+    trie_t *trie = trie_new();
+    ASSERT(trie != NULL);
+    CHECK_CALL(test_trie_setup(trie));
+
+    FILE *f = tmpfile();
+    ASSERT(f != NULL);
+    // Offset the trie so section alignment doesn't depend on it starting the file
+    ASSERT(fwrite("abc", 1, 3, f) == 3);
+    ASSERT(trie_write(trie, f));
+    ASSERT(fseek(f, 3, SEEK_SET) == 0);
+
+    trie_t *mapped = trie_read(f);
+    fclose(f);
+    ASSERT(mapped != NULL);
+    ASSERT(trie_is_mapped(mapped));
+    ASSERT_EQ(trie_num_keys(trie), trie_num_keys(mapped));
+
+    uint32_t data;
+    ASSERT(trie_get_data(mapped, "street", &data));
+    ASSERT_EQ(2, data);
+    ASSERT(trie_get_data(mapped, "state route", &data));
+    ASSERT_EQ(4, data);
+    ASSERT_EQ(0, trie_get(mapped, "stre"));
+
+    // Mapped tries are read-only
+    ASSERT_FALSE(trie_add(mapped, "avenue", 6));
+
+    trie_destroy(mapped);
+    trie_destroy(trie);
+
+    PASS();
+}
+
+TEST test_trie_write_read_embedded(void) {
+    trie_t *trie = trie_new();
+    ASSERT(trie != NULL);
+    CHECK_CALL(test_trie_setup(trie));
+
+    FILE *f = tmpfile();
+    ASSERT(f != NULL);
+
+    // A trie embedded in a larger file, with data on both sides of it
+    char padding[3 * 4096 + 5];
+    memset(padding, 'x', sizeof(padding));
+    ASSERT(fwrite(padding, 1, sizeof(padding), f) == sizeof(padding));
+    long trie_pos = ftell(f);
+    ASSERT(trie_write(trie, f));
+    long trie_end = ftell(f);
+    ASSERT(fwrite(padding, 1, sizeof(padding), f) == sizeof(padding));
+    ASSERT(fwrite("end", 1, 3, f) == 3);
+
+    ASSERT(fseek(f, trie_pos, SEEK_SET) == 0);
+    trie_t *mapped = trie_read(f);
+    ASSERT(mapped != NULL);
+    ASSERT(trie_is_mapped(mapped));
+
+    // The stream is left right after the trie
+    ASSERT_EQ(trie_end, ftell(f));
+
+    // Only the pages holding the trie are mapped, not the whole file
+    size_t trie_size = (size_t)(trie_end - trie_pos);
+    ASSERT(mapped->mapped_size >= trie_size);
+    ASSERT(mapped->mapped_size < trie_size + 4096);
+
+    uint32_t data;
+    ASSERT(trie_get_data(mapped, "st rd", &data));
+    ASSERT_EQ(3, data);
+    ASSERT(trie_get_data(mapped, "maine", &data));
+    ASSERT_EQ(5, data);
+
+    ASSERT(fseek(f, -3, SEEK_END) == 0);
+    char end[4] = {0};
+    ASSERT(fread(end, 1, 3, f) == 3);
+    ASSERT_STR_EQ("end", end);
+
+    fclose(f);
+    trie_destroy(mapped);
+    trie_destroy(trie);
+
+    PASS();
+}
+
+TEST test_trie_convert_legacy(void) {
+    trie_t *trie = trie_new();
+    ASSERT(trie != NULL);
+    CHECK_CALL(test_trie_setup(trie));
+
+    FILE *f = tmpfile();
+    ASSERT(f != NULL);
+    ASSERT(trie_write_legacy(trie, f));
+    ASSERT(fseek(f, 0, SEEK_SET) == 0);
+
+    // Legacy files are still deserialized into memory
+    trie_t *legacy = trie_read(f);
+    fclose(f);
+    ASSERT(legacy != NULL);
+    ASSERT_FALSE(trie_is_mapped(legacy));
+
+    // Writing it back out converts it to the mapped layout
+    f = tmpfile();
+    ASSERT(f != NULL);
+    ASSERT(trie_write(legacy, f));
+    ASSERT(fseek(f, 0, SEEK_SET) == 0);
+
+    trie_t *converted = trie_read(f);
+    fclose(f);
+    ASSERT(converted != NULL);
+    ASSERT(trie_is_mapped(converted));
+    ASSERT_EQ(trie_num_keys(trie), trie_num_keys(converted));
+
+    char *keys[] = {"st", "street", "st rt", "st rd", "state route", "maine"};
+    for (size_t i = 0; i < sizeof(keys) / sizeof(char *); i++) {
+        uint32_t expected, data;
+        ASSERT(trie_get_data(trie, keys[i], &expected));
+        ASSERT(trie_get_data(converted, keys[i], &data));
+        ASSERT_EQ(expected, data);
+    }
+
+    trie_destroy(converted);
+    trie_destroy(legacy);
+    trie_destroy(trie);
+
+    PASS();
+}
+
+typedef struct trie_key_counts {
+    trie_t *trie;
+    uint32_t num_keys;
+    uint32_t num_matched;
+} trie_key_counts_t;
+
+static void test_trie_count_key(char *key, uint32_t data, void *arg) {
+    trie_key_counts_t *counts = (trie_key_counts_t *)arg;
+    counts->num_keys++;
+
+    uint32_t trie_data;
+    if (trie_get_data(counts->trie, key, &trie_data) && trie_data == data) {
+        counts->num_matched++;
+    }
+}
+
+TEST test_trie_foreach_key(void) {
+    trie_t *trie = trie_new();
+    ASSERT(trie != NULL);
+    CHECK_CALL(test_trie_setup(trie));
+
+    trie_key_counts_t counts = {trie, 0, 0};
+    trie_foreach_key(trie, test_trie_count_key, &counts);
+
+    // "st" is a prefix of other keys, so it ends in a NUL transition rather than a tail
+    ASSERT_EQ(trie_num_keys(trie), counts.num_keys);
+    ASSERT_EQ(counts.num_keys, counts.num_matched);
+
+    trie_destroy(trie);
+
+    PASS();
+}
+
+// Searching all the tries in lockstep finds exactly the phrases a separate search of each would
+static greatest_test_res test_trie_search_tokens_multi_matches(trie_t **tries, size_t num_tries, char *input) {
+    token_array *tokens = tokenize_keep_whitespace(input);
+    ASSERT(tokens != NULL);
+
+    phrase_array *phrases[num_tries];
+    trie_token_search_t searches[num_tries];
+    for (size_t i = 0; i < num_tries; i++) {
+        phrases[i] = NULL;
+        trie_token_search_init(&searches[i], tries[i], ROOT_NODE_ID, &phrases[i]);
+    }
+    ASSERT(trie_search_tokens_multi(searches, num_tries, input, tokens));
+
+    for (size_t i = 0; i < num_tries; i++) {
+        phrase_array *expected = trie_search_tokens(tries[i], input, tokens);
+        size_t num_expected = expected != NULL ? expected->n : 0;
+        size_t num_phrases = phrases[i] != NULL ? phrases[i]->n : 0;
+        ASSERT_EQm(input, num_expected, num_phrases);
+        for (size_t j = 0; j < num_expected; j++) {
+            ASSERT_EQm(input, expected->a[j].start, phrases[i]->a[j].start);
+            ASSERT_EQm(input, expected->a[j].len, phrases[i]->a[j].len);
+            ASSERT_EQm(input, expected->a[j].data, phrases[i]->a[j].data);
+        }
+        if (expected != NULL) phrase_array_destroy(expected);
+        if (phrases[i] != NULL) phrase_array_destroy(phrases[i]);
+    }
+
+    token_array_destroy(tokens);
+
+    PASS();
+}
+
+TEST test_trie_search_tokens_multi(void) {
+    trie_t *tries[2];
+    tries[0] = trie_new();
+    ASSERT(tries[0] != NULL);
+    CHECK_CALL(test_trie_setup(tries[0]));
+
+    tries[1] = trie_new();
+    ASSERT(tries[1] != NULL);
+    CHECK_CALL(test_trie_add_get(tries[1], "main", 1));
+    CHECK_CALL(test_trie_add_get(tries[1], "main st", 2));
+    CHECK_CALL(test_trie_add_get(tries[1], "state", 3));
+
+    CHECK_CALL(test_trie_search_tokens_multi_matches(tries, 2, "main st state rt street st rd state route"));
+
+    for (size_t i = 0; i < 2; i++) {
+        trie_destroy(tries[i]);
+    }
+
+    PASS();
+}
+
+TEST test_trie_search_tokens_multi_backtrack(void) {
+    trie_t *tries[3];
+    for (size_t i = 0; i < 3; i++) {
+        tries[i] = trie_new();
+        ASSERT(tries[i] != NULL);
+    }
+
+    // Long phrases that fail late, so the search backtracks to the last match
+    // or to the token after the phrase start
+    CHECK_CALL(test_trie_add_get(tries[0], "a b c d", 1));
+    CHECK_CALL(test_trie_add_get(tries[0], "a", 2));
+    CHECK_CALL(test_trie_add_get(tries[0], "b c", 3));
+    CHECK_CALL(test_trie_add_get(tries[0], "c", 4));
+    // Short phrases that keep matching while the first trie is mid-phrase
+    CHECK_CALL(test_trie_add_get(tries[1], "b", 1));
+    CHECK_CALL(test_trie_add_get(tries[1], "c", 2));
+    CHECK_CALL(test_trie_add_get(tries[1], "d", 3));
+    CHECK_CALL(test_trie_add_get(tries[1], "x", 4));
+    // Partial match ending in the middle of the others' phrases
+    CHECK_CALL(test_trie_add_get(tries[2], "b c x y", 1));
+    CHECK_CALL(test_trie_add_get(tries[2], "c x", 2));
+
+    char *inputs[] = {
+        "a b c x",
+        "a b c x y",
+        "a b c a b c d",
+        "a b b c x y d",
+        "a b c d x a b c",
+        "x a b c",
+        "b c x b c x y a",
+        "a a b c c x"
+    };
+
+    for (size_t i = 0; i < sizeof(inputs) / sizeof(inputs[0]); i++) {
+        CHECK_CALL(test_trie_search_tokens_multi_matches(tries, 3, inputs[i]));
+    }
+
+    for (size_t i = 0; i < 3; i++) {
+        trie_destroy(tries[i]);
+    }
+
+    PASS();
+}
+
+#define TEST_SEARCH_NUM_TRIES 3
+#define TEST_SEARCH_NUM_WORDS 4
+#define TEST_SEARCH_MAX_PHRASE_TOKENS 4
+#define TEST_SEARCH_NUM_PHRASES 12
+#define TEST_SEARCH_NUM_INPUTS 200
+#define TEST_SEARCH_MAX_INPUT_TOKENS 16
+
+static uint32_t test_search_random(uint32_t *state) {
+    *state = *state * 1103515245 + 12345;
+    return (*state >> 16) & 0x7fff;
+}
+
+// Appends 1 to max_tokens words from a small vocabulary so phrases overlap a lot
+static void test_search_random_words(char_array *str, uint32_t *state, size_t max_tokens) {
+    char *words[TEST_SEARCH_NUM_WORDS] = {"a", "b", "c", "d"};
+
+    char_array_clear(str);
+    size_t num_tokens = 1 + test_search_random(state) % max_tokens;
+    for (size_t i = 0; i < num_tokens; i++) {
+        if (i > 0) char_array_cat(str, " ");
+        char_array_cat(str, words[test_search_random(state) % TEST_SEARCH_NUM_WORDS]);
+    }
+}
+
+TEST test_trie_search_tokens_multi_random(void) {
+    uint32_t state = 42;
+    char_array *str = char_array_new();
+    ASSERT(str != NULL);
+
+    trie_t *tries[TEST_SEARCH_NUM_TRIES];
+    for (size_t i = 0; i < TEST_SEARCH_NUM_TRIES; i++) {
+        tries[i] = trie_new();
+        ASSERT(tries[i] != NULL);
+        for (uint32_t j = 0; j < TEST_SEARCH_NUM_PHRASES; j++) {
+            test_search_random_words(str, &state, TEST_SEARCH_MAX_PHRASE_TOKENS);
+            char *phrase = char_array_get_string(str);
+            if (trie_get(tries[i], phrase) != NULL_NODE_ID) continue;
+            CHECK_CALL(test_trie_add_get(tries[i], phrase, j + 1));
+        }
+    }
+
+    for (size_t i = 0; i < TEST_SEARCH_NUM_INPUTS; i++) {
+        test_search_random_words(str, &state, TEST_SEARCH_MAX_INPUT_TOKENS);
+        CHECK_CALL(test_trie_search_tokens_multi_matches(tries, TEST_SEARCH_NUM_TRIES, char_array_get_string(str)));
+    }
+
+    for (size_t i = 0; i < TEST_SEARCH_NUM_TRIES; i++) {
+        trie_destroy(tries[i]);
+    }
+    char_array_destroy(str);
+
+    PASS();
+}
+
 GREATEST_SUITE(libpostal_trie_tests) {
     RUN_TEST(test_trie);
+    RUN_TEST(test_trie_write_read);
+    RUN_TEST(test_trie_write_read_embedded);
+    RUN_TEST(test_trie_convert_legacy);
+    RUN_TEST(test_trie_foreach_key);
+    RUN_TEST(test_trie_search_tokens_multi);
+    RUN_TEST(test_trie_search_tokens_multi_backtrack);
+    RUN_TEST(test_trie_search_tokens_multi_random);
 }